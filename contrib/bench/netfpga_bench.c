@@ -0,0 +1,1039 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * libnetfpga(3) benchmark: register access latency distribution and
+ * throughput for every module available (or those given with -m).
+ *
+ *	netfpga_bench [-w] [-n iters] [-b words] [-l label] [-f csv|json]
+ *	    [-o file] [-c baseline.csv] [-m module[:iface]] ...
+ *	netfpga_bench -P -w [-r reps] [-B cnet.bit] [-C cpci.bit] ...
+ *
+ * -P benchmarks nf_image_write() and nf_cpci_write() instead, with the
+ * time and register accesses of each programming phase reported
+ * separately ("image_write.push" etc.). Bytes and MB/s of all phases
+ * are counted against the bitstream size. Synthetic bit files of the
+ * right size are used unless real ones are given with -B/-C.
+ *
+ * Results are printed as CSV (default) or JSON. With -c, results are
+ * compared against a CSV file from an earlier run and differences are
+ * reported on stderr, so that two builds can be put side by side:
+ *
+ *	./netfpga_bench -l old -m sim > old.csv
+ *	./netfpga_bench -l new -m sim -c old.csv > new.csv
+ *
+ * Without a card use the "sim" module, for example with
+ * "-m sim:latency=500" to pretend a 500ns bus.
+ */
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <assert.h>
+#include <err.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <netfpga.h>
+#include "../../include/nf2.h"
+#include "../../include/nf2_common.h"
+#include "../../include/reg_defines.h"
+
+#define BENCH_MODULES_MAX	16
+#define BENCH_BASE_MAX		256
+
+struct bench_result {
+	char		 label[64];
+	char		 module[64];
+	char		 test[32];
+	long		 ops;
+	long		 bytes;
+	double		 mean_ns;
+	long		 p50_ns;
+	long		 p99_ns;
+	long		 p999_ns;
+	double		 mbps;
+	double		 acc_per_mb;	/* nf_read()/nf_write() calls per MB */
+};
+
+/*
+ * Test gets ``r'' with label, module and test name filled, and
+ * passes its results to bench_emit().
+ */
+typedef int bench_func_t(struct netfpga *nf, struct bench_result *r);
+
+struct bench_test {
+	const char	*name;
+	bench_func_t	*func;
+	int		 prog;		/* Programming test (-P) */
+	int		 destructive;	/* Writes something which matters */
+};
+
+static bench_func_t	bench_rd32;
+static bench_func_t	bench_wr32;
+static bench_func_t	bench_read_batch;
+static bench_func_t	bench_write_batch;
+static bench_func_t	bench_image_name;
+static bench_func_t	bench_route_commit;
+static bench_func_t	bench_route_full;
+static bench_func_t	bench_arp_single;
+static bench_func_t	bench_arp_batch;
+static bench_func_t	bench_lut_dump;
+static bench_func_t	bench_lut_single;
+static bench_func_t	bench_filter_reload;
+static bench_func_t	bench_filter_naive;
+static bench_func_t	bench_image_write;
+static bench_func_t	bench_cpci_write;
+
+static struct bench_test bench_tests[] = {
+	{ "rd32",		bench_rd32,		0, 0 },
+	{ "wr32",		bench_wr32,		0, 0 },
+	{ "read_batch",		bench_read_batch,	0, 0 },
+	{ "write_batch",	bench_write_batch,	0, 1 },
+	{ "image_name",		bench_image_name,	0, 0 },
+	{ "route_commit",	bench_route_commit,	0, 1 },
+	{ "route_full",		bench_route_full,	0, 1 },
+	{ "arp_single",		bench_arp_single,	0, 1 },
+	{ "arp_batch",		bench_arp_batch,	0, 1 },
+	{ "lut_dump",		bench_lut_dump,		0, 0 },
+	{ "lut_single",		bench_lut_single,	0, 0 },
+	{ "filter_reload",	bench_filter_reload,	0, 1 },
+	{ "filter_naive",	bench_filter_naive,	0, 1 },
+	{ "image_write",	bench_image_write,	1, 1 },
+	{ "cpci_write",		bench_cpci_write,	1, 1 },
+	{ NULL,			NULL,			0, 0 }
+};
+
+static const char *bench_phases[NF_PHASE_NUM] = {
+	[NF_PHASE_VALIDATE] =	"validate",
+	[NF_PHASE_RESET] =	"reset",
+	[NF_PHASE_PUSH] =	"push",
+	[NF_PHASE_DONE] =	"done",
+};
+
+static long	 bench_iters = 100000;
+static int	 bench_words = 64;
+static int	 bench_reps = 3;
+static long	*bench_samples;
+static const char *bench_label = "";
+static const char *bench_cnet_file;
+static const char *bench_cpci_file;
+static char	 bench_tmpdir[64];
+
+static void	bench_emit(struct bench_result *r);
+
+static long
+ts_diff(const struct timespec *ts0, const struct timespec *ts1)
+{
+
+	return ((ts1->tv_sec - ts0->tv_sec) * 1000000000L +
+	    (ts1->tv_nsec - ts0->tv_nsec));
+}
+
+static int
+long_cmp(const void *a, const void *b)
+{
+	long la, lb;
+
+	la = *(const long *)a;
+	lb = *(const long *)b;
+	return ((la > lb) - (la < lb));
+}
+
+static int
+bench_route_cmp(const void *a, const void *b)
+{
+	const struct nf_route *ra, *rb;
+
+	ra = a;
+	rb = b;
+	/* Longer mask is numerically bigger */
+	return ((ra->nrt_mask < rb->nrt_mask) - (ra->nrt_mask > rb->nrt_mask));
+}
+
+/*
+ * Fill ``r'' from ``n'' per-operation samples, each moving ``bytes''
+ * with ``acc'' register accesses in total.
+ */
+static void
+bench_stats(struct bench_result *r, long *samples, long n, long bytes,
+    unsigned long acc)
+{
+	double sum;
+	long i;
+
+	qsort(samples, n, sizeof(*samples), long_cmp);
+	sum = 0;
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+	r->ops = n;
+	r->bytes = n * bytes;
+	r->mean_ns = sum / n;
+	r->p50_ns = samples[(n - 1) * 500 / 1000];
+	r->p99_ns = samples[(n - 1) * 990 / 1000];
+	r->p999_ns = samples[(n - 1) * 999 / 1000];
+	r->mbps = (sum > 0) ? (double)r->bytes * 1000.0 / sum : 0;
+	r->acc_per_mb = (r->bytes > 0) ?
+	    (double)acc * (1024 * 1024) / r->bytes : 0;
+}
+
+/*
+ * Register accesses done since the last nf_stats_clear().
+ */
+static unsigned long
+bench_acc(struct netfpga *nf)
+{
+	struct nf_stats st;
+
+	nf_stats_get(nf, &st);
+	return (st.st_reads + st.st_writes);
+}
+
+/*
+ * Single register reads of an ID register.
+ */
+static int
+bench_rd32(struct netfpga *nf, struct bench_result *r)
+{
+	struct timespec ts0, ts1;
+	long i;
+
+	nf_stats_clear(nf);
+	for (i = 0; i < bench_iters; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &ts0);
+		(void)nf_rd32(nf, CPCI_REG_ID);
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		bench_samples[i] = ts_diff(&ts0, &ts1);
+	}
+	bench_stats(r, bench_samples, bench_iters, sizeof(uint32_t),
+	    bench_acc(nf));
+	bench_emit(r);
+	return (0);
+}
+
+/*
+ * Single register writes to the CPCI scratch register.
+ */
+static int
+bench_wr32(struct netfpga *nf, struct bench_result *r)
+{
+	struct timespec ts0, ts1;
+	long i;
+
+	nf_stats_clear(nf);
+	for (i = 0; i < bench_iters; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &ts0);
+		nf_wr32(nf, CPCI_REG_DUMMY, i);
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		bench_samples[i] = ts_diff(&ts0, &ts1);
+	}
+	bench_stats(r, bench_samples, bench_iters, sizeof(uint32_t),
+	    bench_acc(nf));
+	bench_emit(r);
+	return (0);
+}
+
+/*
+ * Batched transfers of ``bench_words'' words from/to the SRAM.
+ */
+static int
+bench_batch(struct netfpga *nf, struct bench_result *r, int write)
+{
+	struct timespec ts0, ts1;
+	uint32_t *buf;
+	size_t len;
+	long i, n;
+	int ret;
+
+	len = bench_words * sizeof(uint32_t);
+	buf = calloc(bench_words, sizeof(uint32_t));
+	if (buf == NULL)
+		err(EXIT_FAILURE, "calloc");
+	n = bench_iters / bench_words + 1;
+	ret = len;
+	nf_stats_clear(nf);
+	for (i = 0; i < n && ret == (int)len; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &ts0);
+		if (write)
+			ret = nf_write(nf, SRAM_BASE_ADDR, buf, len);
+		else
+			ret = nf_read(nf, SRAM_BASE_ADDR, buf, len);
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		bench_samples[i] = ts_diff(&ts0, &ts1);
+	}
+	free(buf);
+	if (ret != (int)len)
+		return (-1);
+	bench_stats(r, bench_samples, n, len, bench_acc(nf));
+	bench_emit(r);
+	return (0);
+}
+
+static int
+bench_read_batch(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_batch(nf, r, 0));
+}
+
+static int
+bench_write_batch(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_batch(nf, r, 1));
+}
+
+/*
+ * Reads of the design name string.
+ */
+static int
+bench_image_name(struct netfpga *nf, struct bench_result *r)
+{
+	struct timespec ts0, ts1;
+	char name[NF2_DEVICE_STR_LEN];
+	long i, n;
+	int ret;
+
+	n = bench_iters / (NF2_DEVICE_STR_LEN / 4) + 1;
+	ret = 0;
+	nf_stats_clear(nf);
+	for (i = 0; i < n && ret == 0; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &ts0);
+		ret = nf_image_name(nf, name, sizeof(name));
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		bench_samples[i] = ts_diff(&ts0, &ts1);
+	}
+	if (ret != 0)
+		return (-1);
+	bench_stats(r, bench_samples, n, NF2_DEVICE_STR_LEN, bench_acc(nf));
+	bench_emit(r);
+	return (0);
+}
+
+/*
+ * Route churn: random prefixes are added and removed from a table kept
+ * around BENCH_RT_FILL entries. Same sequence for every run.
+ */
+#define BENCH_RT_FILL	24
+
+static void
+bench_route_churn(struct nf_router *nr, unsigned *seed)
+{
+	struct nf_route rt;
+	int plen, i;
+
+	if (nr->nr_routes_num >= BENCH_RT_FILL ||
+	    (nr->nr_routes_num > 0 && rand_r(seed) % 3 == 0)) {
+		i = rand_r(seed) % nr->nr_routes_num;
+		(void)nf_router_del(nr, nr->nr_routes[i].nrt_ip,
+		    nr->nr_routes[i].nrt_mask);
+		return;
+	}
+	plen = 8 + rand_r(seed) % 25;
+	rt.nrt_mask = 0xffffffff << (32 - plen);
+	rt.nrt_ip = (10U << 24 | (rand_r(seed) & 0xffffff)) & rt.nrt_mask;
+	rt.nrt_next_hop = 0x0a000001 + rand_r(seed) % 4;
+	rt.nrt_port = NF_ROUTER_PORT_MAC(rand_r(seed) % 4);
+	(void)nf_router_add(nr, &rt);
+}
+
+/*
+ * Apply route churn with nf_router_commit(), or by rewriting the whole
+ * table with single register writes if ``full'' is set.
+ */
+static int
+bench_route(struct netfpga *nf, struct bench_result *r, int full)
+{
+	struct timespec ts0, ts1;
+	struct nf_router nr;
+	struct nf_route sorted[NF_ROUTER_RT_SIZE];
+	unsigned seed;
+	long i, n;
+	int s, ret;
+
+	if (nf_router_init(nf, &nr) != 0)
+		return (-1);
+	nf_router_flush(&nr);
+	if (nf_router_commit(&nr) < 0)
+		return (-1);
+	seed = 1;
+	n = bench_iters / 100 + 1;
+	ret = 0;
+	nf_stats_clear(nf);
+	for (i = 0; i < n && ret >= 0; i++) {
+		bench_route_churn(&nr, &seed);
+		clock_gettime(CLOCK_MONOTONIC, &ts0);
+		if (!full)
+			ret = nf_router_commit(&nr);
+		else {
+			/* What one would do without the shadow copy */
+			memcpy(sorted, nr.nr_routes, sizeof(sorted));
+			qsort(sorted, nr.nr_routes_num, sizeof(sorted[0]),
+			    bench_route_cmp);
+			for (s = 0; s < NF_ROUTER_RT_SIZE; s++) {
+				if (s >= nr.nr_routes_num) {
+					memset(&sorted[s], 0, sizeof(sorted[s]));
+					sorted[s].nrt_mask = 0xffffffff;
+				}
+				nf_wr32(nf, ROUTER_OP_LUT_RT_IP_REG,
+				    sorted[s].nrt_ip);
+				nf_wr32(nf, ROUTER_OP_LUT_RT_MASK_REG,
+				    sorted[s].nrt_mask);
+				nf_wr32(nf, ROUTER_OP_LUT_RT_NEXT_HOP_IP_REG,
+				    sorted[s].nrt_next_hop);
+				nf_wr32(nf, ROUTER_OP_LUT_RT_OUTPUT_PORT_REG,
+				    sorted[s].nrt_port);
+				nf_wr32(nf, ROUTER_OP_LUT_RT_LUT_WR_ADDR_REG, s);
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		bench_samples[i] = ts_diff(&ts0, &ts1);
+	}
+	if (ret < 0)
+		return (-1);
+	bench_stats(r, bench_samples, n, sizeof(struct nf_route),
+	    bench_acc(nf));
+	bench_emit(r);
+	return (0);
+}
+
+static int
+bench_route_commit(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_route(nf, r, 0));
+}
+
+static int
+bench_route_full(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_route(nf, r, 1));
+}
+
+/*
+ * ARP churn: next hops from a pool bigger than the table are set to
+ * new MACs, so some changes update entries and some evict. Changes are
+ * committed ``batch'' at a time; each gets an equal share of the time.
+ */
+#define BENCH_ARP_POOL	48
+#define BENCH_ARP_BATCH	16
+
+static int
+bench_arp(struct netfpga *nf, struct bench_result *r, int batch)
+{
+	struct timespec ts0, ts1;
+	struct nf_arp na;
+	uint8_t mac[6];
+	unsigned seed;
+	long *samples;
+	long i, j, n;
+	int k, ret;
+
+	if (nf_arp_init(nf, &na) != 0)
+		return (-1);
+	nf_arp_flush(&na);
+	if (nf_arp_commit(&na) < 0)
+		return (-1);
+	seed = 1;
+	n = (bench_iters / 100 + 1) * batch;
+	samples = calloc(n, sizeof(*samples));
+	if (samples == NULL)
+		err(EXIT_FAILURE, "calloc");
+	ret = 0;
+	nf_stats_clear(nf);
+	for (i = 0; i < n && ret >= 0; i += batch) {
+		clock_gettime(CLOCK_MONOTONIC, &ts0);
+		for (j = 0; j < batch && ret >= 0; j++) {
+			for (k = 0; k < 6; k++)
+				mac[k] = rand_r(&seed);
+			ret = nf_arp_set(&na, 0x0a000001 + rand_r(&seed) %
+			    BENCH_ARP_POOL, mac, 0);
+		}
+		if (ret >= 0)
+			ret = nf_arp_commit(&na);
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		for (j = 0; j < batch; j++)
+			samples[i + j] = ts_diff(&ts0, &ts1) / batch;
+	}
+	if (ret >= 0) {
+		bench_stats(r, samples, n, 3 * sizeof(uint32_t),
+		    bench_acc(nf));
+		bench_emit(r);
+	}
+	free(samples);
+	return (ret < 0 ? -1 : 0);
+}
+
+static int
+bench_arp_single(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_arp(nf, r, 1));
+}
+
+static int
+bench_arp_batch(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_arp(nf, r, BENCH_ARP_BATCH));
+}
+
+/*
+ * Switch MAC table dumps, batched by nf_switch_lut_dump() or done the
+ * old way: address write and two reads per entry.
+ */
+static int
+bench_lut(struct netfpga *nf, struct bench_result *r, int single)
+{
+	struct timespec ts0, ts1;
+	struct nf_switch_lut lut;
+	long i, n;
+	int e, ret;
+
+	n = bench_iters / 100 + 1;
+	ret = 0;
+	nf_stats_clear(nf);
+	for (i = 0; i < n && ret >= 0; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &ts0);
+		if (!single)
+			ret = nf_switch_lut_dump(nf, &lut);
+		else
+			for (e = 0; e < NF_SWITCH_LUT_SIZE; e++) {
+				nf_wr32(nf, SWITCH_OP_LUT_MAC_LUT_RD_ADDR_REG,
+				    e);
+				(void)nf_rd32(nf,
+				    SWITCH_OP_LUT_PORTS_MAC_HI_REG);
+				(void)nf_rd32(nf, SWITCH_OP_LUT_MAC_LO_REG);
+			}
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		bench_samples[i] = ts_diff(&ts0, &ts1);
+	}
+	if (ret < 0)
+		return (-1);
+	bench_stats(r, bench_samples, n,
+	    NF_SWITCH_LUT_SIZE * 2 * sizeof(uint32_t), bench_acc(nf));
+	bench_emit(r);
+	return (0);
+}
+
+static int
+bench_lut_dump(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_lut(nf, r, 0));
+}
+
+static int
+bench_lut_single(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_lut(nf, r, 1));
+}
+
+/*
+ * Filter reloads, alternating between two full sets which differ in
+ * BENCH_FILTER_DIFF addresses, as when a few local addresses come and
+ * go. Naive reload writes every slot, like a loop of "reg write" does.
+ */
+#define BENCH_FILTER_DIFF	4
+
+static int
+bench_filter(struct netfpga *nf, struct bench_result *r, int naive)
+{
+	struct timespec ts0, ts1;
+	struct nf_filter fl;
+	uint32_t ip;
+	long i, n;
+	int s, ret;
+
+	if (nf_filter_init(nf, &fl) != 0)
+		return (-1);
+	n = bench_iters / 100 + 1;
+	ret = 0;
+	nf_stats_clear(nf);
+	for (i = 0; i < n && ret >= 0; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &ts0);
+		nf_filter_flush(&fl);
+		for (s = 0; s < NF_FILTER_SIZE; s++) {
+			ip = 0xc0a80001 + s;
+			if ((i & 1) && s < BENCH_FILTER_DIFF)
+				ip += 0x100;
+			if (!naive)
+				(void)nf_filter_add(&fl, ip);
+			else {
+				nf_wr32(nf, ROUTER_OP_LUT_DST_IP_FILTER_IP_REG,
+				    ip);
+				nf_wr32(nf,
+				    ROUTER_OP_LUT_DST_IP_FILTER_WR_ADDR_REG, s);
+			}
+		}
+		if (!naive)
+			ret = nf_filter_commit(&fl);
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		bench_samples[i] = ts_diff(&ts0, &ts1);
+	}
+	if (ret < 0)
+		return (-1);
+	bench_stats(r, bench_samples, n, NF_FILTER_SIZE * sizeof(uint32_t),
+	    bench_acc(nf));
+	bench_emit(r);
+	return (0);
+}
+
+static int
+bench_filter_reload(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_filter(nf, r, 0));
+}
+
+static int
+bench_filter_naive(struct netfpga *nf, struct bench_result *r)
+{
+
+	return (bench_filter(nf, r, 1));
+}
+
+/*
+ * Write a Xilinx .bit file with ``len'' bytes of bitstream data.
+ */
+static void
+bench_bitgen(const char *fname, size_t len)
+{
+	static const unsigned char hdr[] = {
+		0x00, 0x09, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0,
+		0x00, 0x00, 0x01,
+	};
+	static const char *fields[] = {
+		"a" "bench.ncd",
+		"b" "2vp50ff1152",
+		"c" "2009/01/01",
+		"d" "00:00:00",
+	};
+	unsigned char u8[4];
+	uint32_t word;
+	FILE *fp;
+	size_t i, flen;
+
+	fp = fopen(fname, "w");
+	if (fp == NULL)
+		err(EXIT_FAILURE, "Couldn't create %s", fname);
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+		flen = strlen(fields[i]);	/* Key plus string with NUL */
+		u8[0] = fields[i][0];
+		u8[1] = flen >> 8;
+		u8[2] = flen & 0xff;
+		fwrite(u8, 3, 1, fp);
+		fwrite(fields[i] + 1, flen, 1, fp);
+	}
+	u8[0] = 'e';
+	fwrite(u8, 1, 1, fp);
+	u8[0] = len >> 24;
+	u8[1] = len >> 16;
+	u8[2] = len >> 8;
+	u8[3] = len;
+	fwrite(u8, 4, 1, fp);
+	word = 0xaa995566;	/* Virtex sync word, then garbage */
+	for (i = 0; i < len; i += 4, word = word * 1103515245 + 12345)
+		fwrite(&word, (len - i < 4) ? len - i : 4, 1, fp);
+	if (fclose(fp) != 0)
+		err(EXIT_FAILURE, "Couldn't write %s", fname);
+}
+
+static void
+bench_cleanup(void)
+{
+	char fname[128];
+
+	snprintf(fname, sizeof(fname), "%s/cnet.bit", bench_tmpdir);
+	(void)unlink(fname);
+	snprintf(fname, sizeof(fname), "%s/cpci.bit", bench_tmpdir);
+	(void)unlink(fname);
+	(void)rmdir(bench_tmpdir);
+}
+
+/*
+ * Return name of a synthetic bit file ``name'' of ``len'' bytes.
+ */
+static const char *
+bench_bitfile(const char *name, size_t len)
+{
+	static char fname[2][128];
+	static int n;
+
+	if (bench_tmpdir[0] == '\0') {
+		snprintf(bench_tmpdir, sizeof(bench_tmpdir),
+		    "/tmp/netfpga_bench.XXXXXX");
+		if (mkdtemp(bench_tmpdir) == NULL)
+			err(EXIT_FAILURE, "mkdtemp");
+		atexit(bench_cleanup);
+	}
+	n = (n + 1) % 2;
+	snprintf(fname[n], sizeof(fname[n]), "%s/%s", bench_tmpdir, name);
+	bench_bitgen(fname[n], len);
+	return (fname[n]);
+}
+
+/*
+ * Run programming function ``prog'' with ``fname'' bench_reps times
+ * and emit total and per phase results.
+ */
+static int
+bench_prog(struct netfpga *nf, struct bench_result *r,
+    int (*prog)(struct netfpga *, const char *), const char *fname)
+{
+	struct timespec ts0, ts1;
+	struct bench_result pr;
+	struct nf_stats st;
+	unsigned long acc[NF_PHASE_NUM + 1];
+	long *samples[NF_PHASE_NUM + 1];
+	long bytes;
+	int i, p, ret;
+
+	memset(acc, 0, sizeof(acc));
+	for (p = 0; p <= NF_PHASE_NUM; p++) {
+		samples[p] = calloc(bench_reps, sizeof(long));
+		if (samples[p] == NULL)
+			err(EXIT_FAILURE, "calloc");
+	}
+	bytes = 0;
+	ret = 0;
+	for (i = 0; i < bench_reps && ret == 0; i++) {
+		nf_stats_clear(nf);
+		clock_gettime(CLOCK_MONOTONIC, &ts0);
+		ret = prog(nf, fname);
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		nf_stats_get(nf, &st);
+		for (p = 0; p < NF_PHASE_NUM; p++) {
+			samples[p][i] = st.st_phase_ns[p];
+			acc[p] += st.st_phase_acc[p];
+		}
+		samples[NF_PHASE_NUM][i] = ts_diff(&ts0, &ts1);
+		acc[NF_PHASE_NUM] += st.st_reads + st.st_writes;
+		bytes = st.st_prog_bytes;
+	}
+	if (ret == 0) {
+		bench_stats(r, samples[NF_PHASE_NUM], bench_reps, bytes,
+		    acc[NF_PHASE_NUM]);
+		bench_emit(r);
+		for (p = 0; p < NF_PHASE_NUM; p++) {
+			if (acc[p] == 0 && samples[p][0] == 0)
+				continue;
+			memcpy(&pr, r, sizeof(pr));
+			if ((size_t)snprintf(pr.test, sizeof(pr.test), "%s.%s",
+			    r->test, bench_phases[p]) >= sizeof(pr.test)) {
+				warnx("Test name %s.%s is too long", r->test,
+				    bench_phases[p]);
+				continue;
+			}
+			bench_stats(&pr, samples[p], bench_reps, bytes, acc[p]);
+			bench_emit(&pr);
+		}
+	} else
+		warnx("%s", nf_strerror(nf));
+	for (p = 0; p <= NF_PHASE_NUM; p++)
+		free(samples[p]);
+	return (ret);
+}
+
+static int
+bench_image_write(struct netfpga *nf, struct bench_result *r)
+{
+	const char *fname;
+	size_t len;
+
+	fname = bench_cnet_file;
+	if (fname == NULL) {
+		len = VIRTEX_BIN_SIZE_V2_1;
+		if (NF2_GET_VERSION(nf_rd32(nf, CPCI_REG_ID)) == 1)
+			len = VIRTEX_BIN_SIZE_V2_0;
+		fname = bench_bitfile("cnet.bit", len);
+	}
+	return (bench_prog(nf, r, nf_image_write, fname));
+}
+
+static int
+bench_cpci_write(struct netfpga *nf, struct bench_result *r)
+{
+	const char *fname;
+
+	fname = bench_cpci_file;
+	if (fname == NULL)
+		fname = bench_bitfile("cpci.bit", CPCI_BIN_SIZE);
+	return (bench_prog(nf, r, nf_cpci_write, fname));
+}
+
+/*
+ * Output.
+ */
+#define BENCH_CSV_HDR							\
+	"label,module,test,ops,bytes,mean_ns,p50_ns,p99_ns,p999_ns,mbps,"	\
+	"acc_per_mb"
+
+static FILE		*bench_fp;
+static const char	*bench_fmt = "csv";
+static int		 bench_first = 1;
+static struct bench_result bench_base[BENCH_BASE_MAX];
+static int		 bench_base_num = -1;
+
+static void
+bench_print(FILE *fp, const char *fmt, struct bench_result *r, int first)
+{
+
+	if (strcmp(fmt, "json") == 0) {
+		fprintf(fp, "%s  {\"label\": \"%s\", \"module\": \"%s\", "
+		    "\"test\": \"%s\", \"ops\": %ld, \"bytes\": %ld, "
+		    "\"mean_ns\": %.1f, \"p50_ns\": %ld, \"p99_ns\": %ld, "
+		    "\"p999_ns\": %ld, \"mbps\": %.3f, \"acc_per_mb\": %.1f}",
+		    first ? "" : ",\n", r->label, r->module, r->test, r->ops,
+		    r->bytes, r->mean_ns, r->p50_ns, r->p99_ns, r->p999_ns,
+		    r->mbps, r->acc_per_mb);
+		return;
+	}
+	fprintf(fp, "%s,%s,%s,%ld,%ld,%.1f,%ld,%ld,%ld,%.3f,%.1f\n",
+	    r->label, r->module, r->test, r->ops, r->bytes, r->mean_ns,
+	    r->p50_ns, r->p99_ns, r->p999_ns, r->mbps, r->acc_per_mb);
+}
+
+/*
+ * Load results of an earlier run written as CSV.
+ */
+static int
+bench_load(const char *fname, struct bench_result *res, int res_max)
+{
+	struct bench_result *r;
+	char line[512];
+	FILE *fp;
+	int n;
+
+	fp = fopen(fname, "r");
+	if (fp == NULL)
+		err(EXIT_FAILURE, "Couldn't open %s", fname);
+	n = 0;
+	while (n < res_max && fgets(line, sizeof(line), fp) != NULL) {
+		r = &res[n];
+		if (sscanf(line, "%63[^,],%63[^,],%31[^,],%ld,%ld,%lf,%ld,"
+		    "%ld,%ld,%lf,%lf", r->label, r->module, r->test, &r->ops,
+		    &r->bytes, &r->mean_ns, &r->p50_ns, &r->p99_ns,
+		    &r->p999_ns, &r->mbps, &r->acc_per_mb) == 11)
+			n++;
+		else if (sscanf(line, ",%63[^,],%31[^,],%ld,%ld,%lf,%ld,"
+		    "%ld,%ld,%lf,%lf", r->module, r->test, &r->ops, &r->bytes,
+		    &r->mean_ns, &r->p50_ns, &r->p99_ns, &r->p999_ns,
+		    &r->mbps, &r->acc_per_mb) == 10) {
+			r->label[0] = '\0';
+			n++;
+		}
+	}
+	fclose(fp);
+	return (n);
+}
+
+static double
+pct(double base, double now)
+{
+
+	return (base != 0 ? (now - base) * 100.0 / base : 0);
+}
+
+/*
+ * Report how ``r'' compares to the matching baseline result.
+ */
+static void
+bench_compare(struct bench_result *base, int base_num, struct bench_result *r)
+{
+	struct bench_result *b;
+	int i;
+
+	for (i = 0; i < base_num; i++) {
+		b = &base[i];
+		if (strcmp(b->module, r->module) != 0 ||
+		    strcmp(b->test, r->test) != 0)
+			continue;
+		fprintf(stderr, "%-12s %-12s p50 %8ld -> %8ld ns (%+6.1f%%)  "
+		    "p99 %8ld -> %8ld ns (%+6.1f%%)  MB/s %8.2f -> %8.2f "
+		    "(%+6.1f%%)\n", r->module, r->test, b->p50_ns, r->p50_ns,
+		    pct(b->p50_ns, r->p50_ns), b->p99_ns, r->p99_ns,
+		    pct(b->p99_ns, r->p99_ns), b->mbps, r->mbps,
+		    pct(b->mbps, r->mbps));
+		return;
+	}
+	fprintf(stderr, "%-12s %-12s not in the baseline\n", r->module,
+	    r->test);
+}
+
+/*
+ * Output a result and compare it against the baseline, if there's one.
+ */
+static void
+bench_emit(struct bench_result *r)
+{
+
+	bench_print(bench_fp, bench_fmt, r, bench_first);
+	bench_first = 0;
+	if (bench_base_num >= 0)
+		bench_compare(bench_base, bench_base_num, r);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: netfpga_bench [-w] [-n iters] [-b words] "
+	    "[-l label] [-f csv|json]\n"
+	    "\t[-o file] [-c baseline.csv] [-m module[:iface]] ...\n"
+	    "       netfpga_bench -P -w [-r reps] [-B cnet.bit] [-C cpci.bit] "
+	    "...\n"
+	    "\t-w\talso run tests which overwrite card's SRAM or "
+	    "program it\n"
+	    "\t-P\tbenchmark programming instead of register access\n");
+	exit(EX_USAGE);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *mods[BENCH_MODULES_MAX];
+	struct bench_test *t;
+	struct bench_result r;
+	struct netfpga nf;
+	const char *ofile, *cfile;
+	char modname[64], *iface;
+	int mods_num, flag_p, flag_w, o, i;
+
+	ofile = cfile = NULL;
+	flag_p = flag_w = mods_num = 0;
+	while ((o = getopt(argc, argv, "B:C:b:c:f:l:m:n:o:Pr:wh")) != -1)
+		switch (o) {
+		case 'B':
+			bench_cnet_file = optarg;
+			break;
+		case 'C':
+			bench_cpci_file = optarg;
+			break;
+		case 'b':
+			bench_words = atoi(optarg);
+			break;
+		case 'c':
+			cfile = optarg;
+			break;
+		case 'f':
+			bench_fmt = optarg;
+			break;
+		case 'l':
+			bench_label = optarg;
+			break;
+		case 'm':
+			if (mods_num == BENCH_MODULES_MAX)
+				errx(EXIT_FAILURE, "Too many modules");
+			mods[mods_num++] = optarg;
+			break;
+		case 'n':
+			bench_iters = atol(optarg);
+			break;
+		case 'o':
+			ofile = optarg;
+			break;
+		case 'P':
+			flag_p = 1;
+			break;
+		case 'r':
+			bench_reps = atoi(optarg);
+			break;
+		case 'w':
+			flag_w = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	if (bench_iters <= 0 || bench_words <= 0 || bench_reps <= 0 ||
+	    (strcmp(bench_fmt, "csv") != 0 && strcmp(bench_fmt, "json") != 0))
+		usage();
+	if (flag_p && !flag_w)
+		errx(EX_USAGE, "Programming benchmark overwrites the card's "
+		    "design, confirm with -w");
+	if (mods_num == 0)
+		mods_num = nf_module_names(mods, BENCH_MODULES_MAX);
+	if (cfile != NULL)
+		bench_base_num = bench_load(cfile, bench_base, BENCH_BASE_MAX);
+
+	bench_samples = calloc(bench_iters + 1, sizeof(*bench_samples));
+	if (bench_samples == NULL)
+		err(EXIT_FAILURE, "calloc");
+	bench_fp = stdout;
+	if (ofile != NULL && (bench_fp = fopen(ofile, "w")) == NULL)
+		err(EXIT_FAILURE, "Couldn't open %s", ofile);
+	if (strcmp(bench_fmt, "json") == 0)
+		fprintf(bench_fp, "[\n");
+	else
+		fprintf(bench_fp, "%s\n", BENCH_CSV_HDR);
+
+	for (i = 0; i < mods_num; i++) {
+		snprintf(modname, sizeof(modname), "%s", mods[i]);
+		iface = strchr(modname, ':');
+		if (iface != NULL)
+			*iface++ = '\0';
+		nf_init(&nf);
+		nf.nf_module = modname;
+		nf.nf_iface = iface;
+		nf.nf_quiet = 1;
+		if (nf_start(&nf) != 0) {
+			warnx("Skipping module '%s': %s", modname,
+			    nf_strerror(&nf));
+			continue;
+		}
+		for (t = bench_tests; t->name != NULL; t++) {
+			if (t->prog != flag_p || (t->destructive && !flag_w))
+				continue;
+			memset(&r, 0, sizeof(r));
+			snprintf(r.label, sizeof(r.label), "%s", bench_label);
+			snprintf(r.module, sizeof(r.module), "%s", modname);
+			snprintf(r.test, sizeof(r.test), "%s", t->name);
+			if (t->func(&nf, &r) != 0)
+				warnx("Test '%s' failed on module '%s'",
+				    t->name, modname);
+		}
+		(void)nf_stop(&nf);
+	}
+	if (strcmp(bench_fmt, "json") == 0)
+		fprintf(bench_fp, "\n]\n");
+	if (bench_fp != stdout)
+		fclose(bench_fp);
+	free(bench_samples);
+	exit(EXIT_SUCCESS);
+}
@@ -3,7 +3,12 @@
 
 enum {
 	NF_REG_READ = 0x10,
-	NF_REG_WRITE
+	NF_REG_WRITE,
+	NF_MEM_SIZE,
+	NF_EVENTS,
+	NF_REG_RWV,
+	NF_MEM_RW,
+	NF_LINK
 };
 
 struct nf_req {
@@ -12,7 +17,62 @@ struct nf_req {
 };
 #define	netfpga_req nf_req
 
+/*
+ * Batch of register reads and writes done in order, with the lock held
+ * across the whole batch. Programming registers aren't allowed here.
+ */
+struct nf_reqv_ent {
+	uint32_t op;
+#define NF_REQV_READ	0
+#define NF_REQV_WRITE	1
+	uint32_t offset;
+	uint32_t value;
+};
+
+struct nf_reqv {
+	uint64_t ents;		/* struct nf_reqv_ent * */
+	uint32_t num;
+	uint32_t _pad;
+};
+#define NF_REQV_MAX	1024
+
+/*
+ * Copy ``len'' bytes between card's memory at ``offset'' and userland
+ * buffer ``buf'' in the driver, in chunks of NF_REQM_CHUNK bytes.
+ * Programming registers aren't allowed here.
+ */
+struct nf_reqm {
+	uint64_t buf;		/* void * */
+	uint32_t offset;
+	uint32_t len;
+	uint32_t op;		/* NF_REQV_READ or NF_REQV_WRITE */
+	uint32_t _pad;
+};
+#define NF_REQM_CHUNK	(64 * 1024)
+
+/*
+ * Link state kept by the driver's link monitor: bit per port with link,
+ * changes seen per port since attach and the current poll interval. A
+ * change also latches INT_PHY_INTERRUPT for SIOCEVENTS.
+ */
+struct nf_reqlink {
+	uint32_t up;
+	uint32_t changes[4];
+	uint32_t ival;		/* us */
+};
+
 #define SIOCREGREAD	_IOWR('f', NF_REG_READ, struct nf_req)
 #define SIOCREGWRITE	_IOWR('f', NF_REG_WRITE, struct nf_req)
+#define SIOCMEMSIZE	_IOWR('f', NF_MEM_SIZE, struct nf_req)
+/*
+ * Fetch and clear interrupt status bits (INT_* from nf2.h) which were
+ * latched by the driver since the last call. Only bits set in
+ * ``offset'' are returned in ``value'' and cleared. The descriptor
+ * polls readable (and fires EVFILT_READ) while any bit is pending.
+ */
+#define SIOCEVENTS	_IOWR('f', NF_EVENTS, struct nf_req)
+#define SIOCREGRWV	_IOW('f', NF_REG_RWV, struct nf_reqv)
+#define SIOCMEMRW	_IOW('f', NF_MEM_RW, struct nf_reqm)
+#define SIOCLINK	_IOR('f', NF_LINK, struct nf_reqlink)
 
 #endif /* _NETFPGA_FREEBSD_H_ */
@@ -0,0 +1,75 @@
+#ifndef _NETFPGA_NET_H_
+#define _NETFPGA_NET_H_
+
+/*
+ * Wire protocol of "nfutil server" and the "net" module of libnetfpga.
+ *
+ * Every message is a header followed by ``nnh_len'' bytes of payload,
+ * all in network byte order. Replies carry the request's sequence
+ * number and type with NF_NET_REPLY set, and come in request order, so
+ * a client can have many requests in flight. A negative ``nnh_status''
+ * means the request failed; the payload is then the error message.
+ */
+struct nf_net_hdr {
+	uint16_t	nnh_magic;
+	uint8_t		nnh_version;
+	uint8_t		nnh_type;
+	uint32_t	nnh_seq;
+	int32_t		nnh_status;	/* Replies only */
+	uint32_t	nnh_len;
+};
+#define NF_NET_MAGIC		0x6e66	/* "nf" */
+#define NF_NET_VERSION		1
+#define NF_NET_PORT		7440
+#define NF_NET_PAYLOAD_MAX	(64 * 1024)
+#define NF_NET_FRAME_MAX	(sizeof(struct nf_net_hdr) + NF_NET_PAYLOAD_MAX)
+
+/*
+ * Requests, with their payload and reply's payload and status:
+ *
+ * HELLO	-> module name; status is NF_NET_VERSION
+ * REGV		ops -> values read, in order; status is ops done
+ *		Op is a word with the register offset, NF_NET_OP_WRITE
+ *		set in bit 0 for writes, which are followed by the value.
+ * READ		offset, length -> words read
+ * WRITE	offset, words ->
+ * MEM		NF_NET_OP_*, address, length[, words] -> [words]; status
+ *		is length
+ * LINK		-> up, NF_LINK_PORTS change counters; status is 1 if the
+ *		driver keeps them
+ */
+#define NF_NET_HELLO		1
+#define NF_NET_REGV		2
+#define NF_NET_READ		3
+#define NF_NET_WRITE		4
+#define NF_NET_MEM		5
+#define NF_NET_LINK		6
+#define NF_NET_REPLY		0x80
+
+#define NF_NET_OP_READ		0
+#define NF_NET_OP_WRITE		1
+
+/*
+ * nfbrokerd(8) speaks the same protocol on a UNIX socket, and publishes
+ * its hot registers, sampled with one nf_regv() every tick, in shared
+ * memory: file "<socket>.hot" holds one ``struct nf_broker_hot'' in
+ * host byte order. ``nbh_gen'' is odd while the broker writes; readers
+ * copy what they need and retry unless they saw the same even value
+ * before and after.
+ */
+#define NF_BROKER_SOCK		"/var/run/nfbrokerd.sock"
+#define NF_BROKER_MAGIC		0x6e666268	/* "nfbh" */
+#define NF_BROKER_HOT_MAX	256
+
+struct nf_broker_hot {
+	uint32_t	nbh_magic;
+	uint32_t	nbh_num;
+	uint32_t	nbh_tick_us;
+	_Atomic uint32_t nbh_gen;
+	uint64_t	nbh_time;	/* ns, CLOCK_MONOTONIC sample began */
+	uint64_t	nbh_ticks;
+	uint32_t	nbh_reg[NF_BROKER_HOT_MAX];	/* Sorted */
+	uint32_t	nbh_value[NF_BROKER_HOT_MAX];
+};
+
+#endif /* _NETFPGA_NET_H_ */
@@ -32,10 +32,11 @@
 #include <sys/param.h>
 #include <sys/ioctl.h>
 #include <sys/utsname.h>
-#include <sys/sysctl.h>
 
 #ifdef __linux__
 #include <linux/sysctl.h>
+#else
+#include <sys/sysctl.h>
 #endif
 
 #include <netinet/in.h>
@@ -52,6 +53,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../../include/nf2.h"
@@ -70,18 +72,56 @@ int nf_tbd = 0;
 
 extern struct nf_module nf2_dummy;
 extern struct nf_module nf2_freebsd;
+extern struct nf_module nf2_freebsd_mmap;
 extern struct nf_module nf2_linux;
+extern struct nf_module nf2_sim;
+extern struct nf_module nf2_net;
+extern struct nf_module nf2_broker;
 
+/*
+ * Modules linked into the library. Everything else is looked up in
+ * NETFPGA_PATH_LIB when asked for.
+ */
 static struct nf_module *nf_modules[] = {
 #ifdef __FreeBSD__
 	&nf2_freebsd,
+	&nf2_freebsd_mmap,
 #endif
 #ifdef __linux__
 	&nf2_linux,
 #endif
-	&nf2_dummy
+	&nf2_sim,
+	&nf2_net,
+	&nf2_broker,
+	&nf2_dummy,
+	NULL
 };
 
+/* Number of register reads used to rank hardware modules */
+#define NF_PROBE_ROUNDS		256
+
+/*
+ * Adaptive polling: spin for NF_POLL_SPIN reads, then sleep between
+ * reads, doubling the sleep from NF_POLL_SLEEP_MIN up to
+ * NF_POLL_SLEEP_MAX nanoseconds.
+ */
+#define NF_POLL_SPIN		64
+#define NF_POLL_SLEEP_MIN	1000
+#define NF_POLL_SLEEP_MAX	1000000
+
+/* How long (ms) to wait for DONE after pushing a bitstream */
+#define NF_PROG_DONE_TIMEOUT	5000
+
+/*
+ * Bulk memory transfers: words per nf_regv() batch when the module
+ * can't do better, and bytes per file read or write.
+ */
+#define NF_MEM_BATCH		1024
+#define NF_MEM_CHUNK		(64 * 1024)
+
+/* Link status bit of MDIO_*_STATUS_REG, which mirrors the PHY's BMSR */
+#define NF_MII_BMSR_LINK	0x0004
+
 /*
  * Returns true if there was an error in a NetFPGA library, and error
  * message has been filled.
@@ -170,6 +210,187 @@ _nf_erri(struct netfpga *nf, const char *func, int lineno, const char *fmt, ...)
 	return (-lineno);
 }
 
+/*
+ * Forget about the error reported so far.
+ */
+void
+nf_err_clear(struct netfpga *nf)
+{
+
+	nf_assert(nf);
+	memset(nf->__nf_errmsg_src, 0, sizeof(nf->__nf_errmsg_src));
+	memset(nf->__nf_errmsg, 0, sizeof(nf->__nf_errmsg));
+}
+
+/*
+ * Check if module ``mod'' can be used with this version of the library.
+ */
+static int
+nf_module_check(struct netfpga *nf, struct nf_module *mod)
+{
+
+	nf_assert(nf);
+	ASSERT(mod != NULL);
+	if (mod->nf_version != NETFPGA_MODULE_VERSION)
+		return (nf_erri(nf, "Module '%s' has interface version %u, "
+		    "but the library requires %u", mod->nf_name,
+		    mod->nf_version, NETFPGA_MODULE_VERSION));
+	if (mod->nf_open == NULL || mod->nf_close == NULL ||
+	    mod->nf_read == NULL || mod->nf_write == NULL)
+		return (nf_erri(nf, "Module '%s' lacks mandatory methods",
+		    mod->nf_name));
+	return (0);
+}
+
+/*
+ * Load module ``name'' from the shared object found first in the
+ * search path. Handle for dlclose() is returned through ``dlp''.
+ */
+static struct nf_module *
+nf_module_load(struct netfpga *nf, const char *name, void **dlp)
+{
+	struct nf_module *mod;
+	char dirs[MAXPATHLEN * 4];
+	char path[MAXPATHLEN];
+	char sym[128];
+	const char *env;
+	char *dir, *last;
+	void *dl;
+
+	nf_assert(nf);
+	ASSERT(name != NULL);
+	ASSERT(dlp != NULL);
+
+	*dlp = NULL;
+	if (strchr(name, '/') != NULL || strlen(name) > sizeof(sym) - 5)
+		return (NULL);
+	env = getenv(NETFPGA_PATH_ENV);
+	if (env != NULL)
+		snprintf(dirs, sizeof(dirs), "%s:%s", env, NETFPGA_PATH_LIB);
+	else
+		snprintf(dirs, sizeof(dirs), "%s", NETFPGA_PATH_LIB);
+	snprintf(sym, sizeof(sym), "nf2_%s", name);
+
+	mod = NULL;
+	for (dir = strtok_r(dirs, ":", &last); dir != NULL;
+	    dir = strtok_r(NULL, ":", &last)) {
+		snprintf(path, sizeof(path), "%s/netfpga_%s.so", dir, name);
+		if (access(path, R_OK) != 0)
+			continue;
+		dl = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+		if (dl == NULL) {
+			DEBUG("dlopen(%s): %s\n", path, dlerror());
+			continue;
+		}
+		mod = dlsym(dl, sym);
+		if (mod == NULL) {
+			DEBUG("%s: no symbol '%s'\n", path, sym);
+			dlclose(dl);
+			continue;
+		}
+		DEBUG("Module '%s' loaded from %s\n", name, path);
+		*dlp = dl;
+		break;
+	}
+	return (mod);
+}
+
+/*
+ * Find module by its name. Modules linked in win over plugins.
+ */
+static struct nf_module *
+nf_module_find(struct netfpga *nf, const char *name, void **dlp)
+{
+	struct nf_module **modp;
+
+	nf_assert(nf);
+	*dlp = NULL;
+	for (modp = nf_modules; *modp != NULL; modp++)
+		if (strcmp((*modp)->nf_name, name) == 0)
+			return (*modp);
+	return (nf_module_load(nf, name, dlp));
+}
+
+/*
+ * Open module ``mod'', time a burst of register reads and close it.
+ * Returns nanoseconds per read or -1 if module can't be used here.
+ */
+static long
+nf_module_probe(struct netfpga *nf, struct nf_module *mod)
+{
+	struct timespec ts0, ts1;
+	uint32_t u32;
+	void *ctx;
+	long ns;
+	int i, ret;
+
+	nf_assert(nf);
+	ctx = mod->nf_open(nf);
+	if (ctx == NULL)
+		return (-1);
+	ret = sizeof(u32);
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	for (i = 0; i < NF_PROBE_ROUNDS && ret == sizeof(u32); i++)
+		ret = mod->nf_read(nf, ctx, CPCI_REG_ID, &u32, sizeof(u32));
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	(void)mod->nf_close(nf, ctx);
+	if (ret != sizeof(u32))
+		return (-1);
+	ns = (ts1.tv_sec - ts0.tv_sec) * 1000000000L +
+	    (ts1.tv_nsec - ts0.tv_nsec);
+	return (ns / NF_PROBE_ROUNDS);
+}
+
+/*
+ * Benchmark all hardware modules whose name starts with ``prefix''
+ * (all of them if ``prefix'' is NULL) and return the fastest one.
+ */
+static struct nf_module *
+nf_module_fastest(struct netfpga *nf, const char *prefix)
+{
+	struct nf_module **modp, *best;
+	long ns, best_ns;
+
+	nf_assert(nf);
+	best = NULL;
+	best_ns = -1;
+	for (modp = nf_modules; *modp != NULL; modp++) {
+		if (((*modp)->nf_flags & NF_MODULE_FLAG_HW) == 0)
+			continue;
+		if (prefix != NULL &&
+		    strncmp((*modp)->nf_name, prefix, strlen(prefix)) != 0)
+			continue;
+		if (nf_module_check(nf, *modp) != 0)
+			continue;
+		ns = nf_module_probe(nf, *modp);
+		DEBUG("Module '%s': %ld ns per register read\n",
+		    (*modp)->nf_name, ns);
+		if (ns >= 0 && (best == NULL || ns < best_ns)) {
+			best = *modp;
+			best_ns = ns;
+		}
+	}
+	/* Failed candidates aren't errors once we've got a winner */
+	if (best != NULL)
+		nf_err_clear(nf);
+	return (best);
+}
+
+/*
+ * Put names of up to ``names_num'' modules linked into the library to
+ * ``names''. Returns the number of such modules.
+ */
+int
+nf_module_names(const char **names, int names_num)
+{
+	int i;
+
+	for (i = 0; nf_modules[i] != NULL; i++)
+		if (i < names_num)
+			names[i] = nf_modules[i]->nf_name;
+	return (i);
+}
+
 /*
  * Main function for NetFPGA startup. Passed pointer must be initialized
  * with nf_init() prior to the nf_start().
@@ -177,49 +398,75 @@ _nf_erri(struct netfpga *nf, const char *func, int lineno, const char *fmt, ...)
 int
 nf_start(struct netfpga *nf)
 {
-	nf_open_t *nfopen;
+	struct nf_module *mod;
 	struct utsname ut;
 	void *ctx;
+	void *dl;
 	char *tmp;
 	unsigned i;
 	int error;
 
 	nf_assert(nf);
 	tmp = NULL;
+	dl = NULL;
 	error = 0;
 
 	if (!nf_initialized(nf))
 		return (nf_erri(nf, "Library hasn't been initialized"));
-	/*
-	 * If user passed specific module name, use it.
-	 */
-	if (nf->nf_module != NULL) {
-		tmp = strdup(nf->nf_module);
+	if (nf->nf_module != NULL &&
+	    strcmp(nf->nf_module, NETFPGA_MODULE_AUTO) != 0) {
+		/*
+		 * If user passed specific module name, use it.
+		 */
+		mod = nf_module_find(nf, nf->nf_module, &dl);
+		if (mod == NULL)
+			return (nf_erri(nf, "Module '%s' not found",
+			    nf->nf_module));
 	} else {
 		/*
 		 * Otherwise, get the system's name and convert it to lower
-		 * case letters,
+		 * case letters. All modules for this system are candidates
+		 * then, and the fastest one wins. For "auto" we don't care
+		 * about the system's name.
 		 */
-		memset(&ut, 0, sizeof(ut));
-		error = uname(&ut);
-		if (error != 0)
-			return (nf_erri(nf, "Couldn't get system type "
-			    "(uname(2) failed)!"));
-		tmp = calloc(1, strlen(ut.sysname) + 1);
-		ASSERT(tmp != NULL);
-		for (i = 0; i < strlen(ut.sysname); i++)
-			tmp[i] = tolower(ut.sysname[i]);
-	}
-	ASSERT(tmp != NULL);
-	nf->__nf_mod = nf_modules[0];
-	nfopen = nf_modules[0]->nf_open;
-	if (nfopen == NULL)
-		return (nf_erri(nf, "There is no 'open' method in a module"));
-	ctx = nfopen(nf);
-	if (ctx == NULL)
-		return (nf_erri(nf, "Method 'open' failed"));
+		if (nf->nf_module == NULL) {
+			memset(&ut, 0, sizeof(ut));
+			error = uname(&ut);
+			if (error != 0)
+				return (nf_erri(nf, "Couldn't get system type "
+				    "(uname(2) failed)!"));
+			tmp = calloc(1, strlen(ut.sysname) + 1);
+			ASSERT(tmp != NULL);
+			for (i = 0; i < strlen(ut.sysname); i++)
+				tmp[i] = tolower(ut.sysname[i]);
+		}
+		mod = nf_module_fastest(nf, tmp);
+		if (mod == NULL) {
+			error = nf_erri(nf, "No usable module for '%s' found",
+			    tmp != NULL ? tmp : NETFPGA_MODULE_AUTO);
+			free(tmp);
+			return (error);
+		}
+		free(tmp);
+	}
+	error = nf_module_check(nf, mod);
+	if (error != 0)
+		goto errout;
+	ctx = mod->nf_open(nf);
+	if (ctx == NULL) {
+		error = nf_erri(nf, "Method 'open' of module '%s' failed",
+		    mod->nf_name);
+		goto errout;
+	}
+	nf->__nf_mod = mod;
 	nf->__nf_mod_ctx = ctx;
+	nf->__nf_mod_dl = dl;
 	nf->__nf_regs = NULL;
+	nf->__nf_regs_hash = NULL;
+	return (0);
+errout:
+	if (dl != NULL)
+		dlclose(dl);
 	return (error);
 }
 
@@ -244,8 +491,15 @@ nf_stop(struct netfpga *nf)
 	if (nfclose == NULL)
 		return (nf_erri(nf, "There is no 'close' method' in a module"));
 	error = nfclose(nf, nf->__nf_mod_ctx);
-	if (error != 0)
+	if (nf->__nf_mod_dl != NULL)
+		dlclose(nf->__nf_mod_dl);
+	if (error != 0) {
+		/* Module is gone either way, but keep its error message */
+		nf->__nf_mod = NULL;
+		nf->__nf_mod_ctx = NULL;
+		nf->__nf_mod_dl = NULL;
 		return (-1);
+	}
 	/* Clear the library state */
 	nf_init(nf);
 	nf->__nf_flags = 0;
@@ -297,6 +551,8 @@ nf_read(struct netfpga *nf, uint32_t reg, void *buf, size_t buf_len)
 	    " handler");
 	ASSERT(reg % 4 == 0 && "must be 4 aligned");
 	ASSERT(buf_len % 4 == 0 && "must be 4 aligned");
+	nf->__nf_stats.st_reads++;
+	nf->__nf_stats.st_bytes += buf_len;
 	return (nf->__nf_mod->nf_read(nf, nf->__nf_mod_ctx, reg, buf, buf_len));
 }
 
@@ -314,6 +570,8 @@ nf_write(struct netfpga *nf, uint32_t reg, void *buf, size_t buf_len)
 	ASSERT(nf->__nf_mod->nf_read != NULL);
 	ASSERT(reg % 4 == 0 && "must be 4 aligned");
 	ASSERT(buf_len % 4 == 0 && "must be 4 aligned");
+	nf->__nf_stats.st_writes++;
+	nf->__nf_stats.st_bytes += buf_len;
 	return (nf->__nf_mod->nf_write(nf, nf->__nf_mod_ctx, reg, buf, buf_len));
 }
 
@@ -347,6 +605,486 @@ nf_wr32(struct netfpga *nf, uint32_t reg, uint32_t value)
 	ASSERT(ret == sizeof(value));
 }
 
+/*
+ * Perform a batch of register operations, in order. Modules which can
+ * do it cheaper than one access at a time (e.g. in one system call)
+ * get the whole batch. Returns ``ops_num'' or -1 on error.
+ */
+int
+nf_regv(struct netfpga *nf, struct nf_regop *ops, int ops_num)
+{
+	struct nf_module *mod;
+	int i, ret;
+
+	nf_assert(nf);
+	ASSERT(ops != NULL || ops_num == 0);
+	mod = nf->__nf_mod;
+	ASSERT(mod != NULL && "i/o module must exist");
+	if (mod->nf_regv != NULL) {
+		for (i = 0; i < ops_num; i++)
+			if (ops[i].nro_op == NF_REGOP_READ)
+				nf->__nf_stats.st_reads++;
+			else
+				nf->__nf_stats.st_writes++;
+		nf->__nf_stats.st_bytes += ops_num * sizeof(uint32_t);
+		ret = mod->nf_regv(nf, nf->__nf_mod_ctx, ops, ops_num);
+		if (ret != ops_num)
+			return (nf_erri(nf, "Only %d of %d register operations "
+			    "done", ret, ops_num));
+		return (ops_num);
+	}
+	for (i = 0; i < ops_num; i++) {
+		ASSERT(ops[i].nro_reg % 4 == 0 && "must be 4 aligned");
+		if (ops[i].nro_op == NF_REGOP_READ)
+			ret = nf_read(nf, ops[i].nro_reg, &ops[i].nro_value,
+			    sizeof(uint32_t));
+		else
+			ret = nf_write(nf, ops[i].nro_reg, &ops[i].nro_value,
+			    sizeof(uint32_t));
+		if (ret != sizeof(uint32_t))
+			return (nf_erri(nf, "Register operation %d of %d "
+			    "(register %#x) failed", i, ops_num,
+			    ops[i].nro_reg));
+	}
+	return (ops_num);
+}
+
+/*
+ * Copy ``len'' bytes between card's memory at ``addr'' and ``buf'' the
+ * fastest way the module knows: its nf_mem method, a single access if
+ * registers are mmap()ed, and nf_regv() batches for whatever is left.
+ */
+static int
+nf_mem_xfer(struct netfpga *nf, int write, uint32_t addr, void *buf,
+    size_t len)
+{
+	struct nf_regop ops[NF_MEM_BATCH];
+	struct nf_module *mod;
+	uint8_t *p;
+	size_t done;
+	int i, n, ret;
+
+	nf_assert(nf);
+	ASSERT(buf != NULL || len == 0);
+	mod = nf->__nf_mod;
+	ASSERT(mod != NULL && "i/o module must exist");
+	if (addr % 4 != 0 || len % 4 != 0)
+		return (nf_erri(nf, "Memory address and length must be "
+		    "multiples of 4 bytes"));
+	if ((uint64_t)addr + len > UINT32_MAX)
+		return (nf_erri(nf, "Memory at %#x is out of range", addr));
+
+	done = 0;
+	if (mod->nf_mem != NULL) {
+		ret = mod->nf_mem(nf, nf->__nf_mod_ctx, write, addr, buf, len);
+		if (ret < 0)
+			return (-1);
+		done = ret;
+	} else if ((mod->nf_flags & NF_MODULE_FLAG_MMAP) && len > 0) {
+		ret = write ?
+		    mod->nf_write(nf, nf->__nf_mod_ctx, addr, buf, len) :
+		    mod->nf_read(nf, nf->__nf_mod_ctx, addr, buf, len);
+		if (ret != (int)len)
+			return (nf_erri(nf, "Couldn't %s %zu bytes at %#x",
+			    write ? "write" : "read", len, addr));
+		done = len;
+	}
+	if (done > 0) {
+		if (write)
+			nf->__nf_stats.st_writes++;
+		else
+			nf->__nf_stats.st_reads++;
+		nf->__nf_stats.st_bytes += done;
+	}
+
+	p = buf;
+	for (; done < len; done += n * 4) {
+		n = (len - done) / 4;
+		if (n > NF_MEM_BATCH)
+			n = NF_MEM_BATCH;
+		for (i = 0; i < n; i++) {
+			ops[i].nro_op = write ? NF_REGOP_WRITE : NF_REGOP_READ;
+			ops[i].nro_reg = addr + done + i * 4;
+			if (write)
+				memcpy(&ops[i].nro_value, p + done + i * 4, 4);
+		}
+		if (nf_regv(nf, ops, n) != n)
+			return (-1);
+		if (!write)
+			for (i = 0; i < n; i++)
+				memcpy(p + done + i * 4, &ops[i].nro_value, 4);
+	}
+	return (0);
+}
+
+/*
+ * Read ``len'' bytes of card's memory (like SRAM_1_BASE) at ``addr''
+ * to ``buf''. Returns 0 or -1 on error.
+ */
+int
+nf_mem_read(struct netfpga *nf, uint32_t addr, void *buf, size_t len)
+{
+
+	return (nf_mem_xfer(nf, 0, addr, buf, len));
+}
+
+/*
+ * Write ``len'' bytes from ``buf'' to card's memory at ``addr''.
+ */
+int
+nf_mem_write(struct netfpga *nf, uint32_t addr, const void *buf, size_t len)
+{
+
+	return (nf_mem_xfer(nf, 1, addr, (void *)(uintptr_t)buf, len));
+}
+
+/*
+ * Save ``len'' bytes of card's memory at ``addr'' to file ``fname''.
+ */
+int
+nf_mem_save(struct netfpga *nf, uint32_t addr, size_t len, const char *fname)
+{
+	uint8_t *buf;
+	size_t off, n;
+	FILE *fp;
+	int error;
+
+	nf_assert(nf);
+	ASSERT(fname != NULL);
+	fp = fopen(fname, "w");
+	if (fp == NULL)
+		return (nf_erri(nf, "Couldn't create '%s': %s", fname,
+		    strerror(errno)));
+	buf = malloc(NF_MEM_CHUNK);
+	ASSERT(buf != NULL);
+	error = 0;
+	for (off = 0; off < len && error == 0; off += n) {
+		n = len - off;
+		if (n > NF_MEM_CHUNK)
+			n = NF_MEM_CHUNK;
+		if (nf_mem_read(nf, addr + off, buf, n) != 0)
+			error = -1;
+		else if (fwrite(buf, 1, n, fp) != n)
+			error = nf_erri(nf, "Couldn't write '%s': %s", fname,
+			    strerror(errno));
+	}
+	free(buf);
+	if (fclose(fp) != 0 && error == 0)
+		error = nf_erri(nf, "Couldn't write '%s': %s", fname,
+		    strerror(errno));
+	return (error);
+}
+
+/*
+ * Load file ``fname'' to card's memory at ``addr'', up to ``len''
+ * bytes. A last partial word is padded with zeros. Returns the number
+ * of bytes loaded, padding included, or -1 on error, also if the file
+ * doesn't fit.
+ */
+int
+nf_mem_load(struct netfpga *nf, uint32_t addr, size_t len, const char *fname)
+{
+	uint8_t *buf;
+	size_t off, n;
+	FILE *fp;
+	int error;
+
+	nf_assert(nf);
+	ASSERT(fname != NULL);
+	fp = fopen(fname, "r");
+	if (fp == NULL)
+		return (nf_erri(nf, "Couldn't open '%s': %s", fname,
+		    strerror(errno)));
+	buf = malloc(NF_MEM_CHUNK);
+	ASSERT(buf != NULL);
+	error = 0;
+	for (off = 0; error == 0; off += n) {
+		n = fread(buf, 1, NF_MEM_CHUNK, fp);
+		/* Only the last chunk may be short, and only that one padded */
+		if (ferror(fp) || (n < NF_MEM_CHUNK && !feof(fp))) {
+			error = nf_erri(nf, "Couldn't read '%s': %s", fname,
+			    ferror(fp) ? strerror(errno) : "short read");
+			break;
+		}
+		if (n == 0)
+			break;
+		for (; n % 4 != 0; n++)
+			buf[n] = 0;
+		if (off + n > len) {
+			error = nf_erri(nf, "'%s' doesn't fit in %zu bytes",
+			    fname, len);
+			break;
+		}
+		error = nf_mem_write(nf, addr + off, buf, n);
+	}
+	free(buf);
+	fclose(fp);
+	return (error != 0 ? -1 : (int)off);
+}
+
+/*
+ * Copy access statistics gathered so far to ``st''.
+ */
+void
+nf_stats_get(struct netfpga *nf, struct nf_stats *st)
+{
+
+	nf_assert(nf);
+	ASSERT(st != NULL);
+	memcpy(st, &nf->__nf_stats, sizeof(*st));
+}
+
+void
+nf_stats_clear(struct netfpga *nf)
+{
+
+	nf_assert(nf);
+	memset(&nf->__nf_stats, 0, sizeof(nf->__nf_stats));
+}
+
+static long
+nf_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000000L + ts.tv_nsec);
+}
+
+/*
+ * Account time and accesses spent since the last call to the phase
+ * which was being timed, and start timing ``phase''.
+ */
+static void
+nf_phase(struct netfpga *nf, int phase)
+{
+	struct nf_stats *st;
+	unsigned long acc;
+	long now;
+
+	st = &nf->__nf_stats;
+	now = nf_now_ns();
+	acc = st->st_reads + st->st_writes;
+	if (nf->__nf_phase != NF_PHASE_NONE) {
+		st->st_phase_ns[nf->__nf_phase] += now - nf->__nf_phase_t0;
+		st->st_phase_acc[nf->__nf_phase] += acc - nf->__nf_phase_acc0;
+	}
+	nf->__nf_phase = phase;
+	nf->__nf_phase_t0 = now;
+	nf->__nf_phase_acc0 = acc;
+}
+
+/*
+ * Forget phases timed by the previous programming run.
+ */
+static void
+nf_phase_clear(struct netfpga *nf)
+{
+	struct nf_stats *st;
+
+	st = &nf->__nf_stats;
+	nf->__nf_phase = NF_PHASE_NONE;
+	st->st_prog_bytes = 0;
+	memset(st->st_phase_ns, 0, sizeof(st->st_phase_ns));
+	memset(st->st_phase_acc, 0, sizeof(st->st_phase_acc));
+}
+
+/*
+ * Milliseconds left till ``timeout'' (-1 means forever) counted from
+ * ``ts0'' expires.
+ */
+static int
+nf_timeout_left(const struct timespec *ts0, int timeout)
+{
+	struct timespec ts1;
+	long ms;
+
+	if (timeout < 0)
+		return (-1);
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	ms = (ts1.tv_sec - ts0->tv_sec) * 1000 +
+	    (ts1.tv_nsec - ts0->tv_nsec) / 1000000;
+	return (ms >= timeout ? 0 : timeout - ms);
+}
+
+/*
+ * Poll register ``reg'' until ``cond'' holds for (value & mask), or
+ * ``timeout'' milliseconds pass. Returns 1 and the last value read in
+ * ``last'', or 0 on timeout.
+ */
+#define NF_POLL_EQ	0	/* (value & mask) == want */
+#define NF_POLL_ANY	1	/* (value & mask) != 0 */
+static int
+nf_poll_reg(struct netfpga *nf, uint32_t reg, uint32_t mask, uint32_t want,
+    int cond, int timeout, uint32_t *last)
+{
+	struct timespec ts0, nap;
+	uint32_t value;
+	long sleep_ns;
+	int i, left;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	sleep_ns = NF_POLL_SLEEP_MIN;
+	for (i = 0; ; i++) {
+		value = NF_RD32(nf, reg);
+		if (cond == NF_POLL_EQ ? (value & mask) == want :
+		    (value & mask) != 0) {
+			*last = value;
+			return (1);
+		}
+		left = nf_timeout_left(&ts0, timeout);
+		if (left == 0)
+			break;
+		if (i < NF_POLL_SPIN)
+			continue;
+		if (left > 0 && sleep_ns > left * 1000000L)
+			sleep_ns = left * 1000000L;
+		nap.tv_sec = 0;
+		nap.tv_nsec = sleep_ns;
+		nanosleep(&nap, NULL);
+		if (sleep_ns < NF_POLL_SLEEP_MAX)
+			sleep_ns *= 2;
+	}
+	*last = value;
+	return (0);
+}
+
+/*
+ * Wait up to ``timeout'' milliseconds (-1 for forever) for register
+ * ``reg'' to satisfy (reg & mask) == value. Returns 1 if it did and 0
+ * on timeout.
+ */
+int
+nf_wait_reg(struct netfpga *nf, uint32_t reg, uint32_t mask, uint32_t value,
+    int timeout)
+{
+	uint32_t last;
+
+	nf_assert(nf);
+	return (nf_poll_reg(nf, reg, mask, value, NF_POLL_EQ, timeout, &last));
+}
+
+/*
+ * Wait up to ``timeout'' milliseconds (-1 for forever) for any of the
+ * interrupts from ``mask'' (INT_* bits from nf2.h). Interrupts which
+ * happened are returned in ``events'' and forgotten; others stay
+ * latched for the next call. Returns 1 if there were some events and
+ * 0 on timeout.
+ *
+ * The module's interrupt method is used if it has one and the driver
+ * supports it; otherwise the interrupt status register is polled.
+ */
+int
+nf_wait_event(struct netfpga *nf, uint32_t mask, uint32_t *events,
+    int timeout)
+{
+	struct nf_module *mod;
+	struct timespec ts0;
+	uint32_t status;
+	int left, ret;
+
+	nf_assert(nf);
+	ASSERT(events != NULL);
+	ASSERT(mask != 0);
+	mod = nf->__nf_mod;
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	for (;;) {
+		if ((nf->__nf_events & mask) != 0) {
+			*events = nf->__nf_events & mask;
+			nf->__nf_events &= ~mask;
+			return (1);
+		}
+		if (mod->nf_intr == NULL || nf->nf_nointr)
+			break;
+		status = 0;
+		ret = mod->nf_intr(nf, nf->__nf_mod_ctx, &status,
+		    nf_timeout_left(&ts0, timeout));
+		if (ret < 0)
+			break;
+		if (ret == 0)
+			return (0);
+		nf->__nf_events |= status;
+	}
+	DEBUG("No interrupts from module '%s', polling\n", mod->nf_name);
+	left = nf_timeout_left(&ts0, timeout);
+	ret = nf_poll_reg(nf, CPCI_REG_INTERRUPT_STATUS, mask, 0, NF_POLL_ANY,
+	    left, &status);
+	*events = status & mask;
+	return (ret);
+}
+
+/*
+ * Read link state of all ports. Drivers with a link monitor know it,
+ * and how many times it changed, without touching the card; otherwise
+ * MDIO status registers are read in one batch. Wait for changes with
+ * nf_wait_event() on INT_PHY_INTERRUPT, which such drivers latch when
+ * a link changes.
+ */
+int
+nf_link_read(struct netfpga *nf, struct nf_link *lk)
+{
+	struct nf_regop ops[NF_LINK_PORTS];
+	struct nf_module *mod;
+	int i, ret;
+
+	nf_assert(nf);
+	ASSERT(lk != NULL);
+	memset(lk, 0, sizeof(*lk));
+	mod = nf->__nf_mod;
+	if (mod->nf_link != NULL) {
+		ret = mod->nf_link(nf, nf->__nf_mod_ctx, &lk->nl_up,
+		    lk->nl_changes);
+		if (ret < 0)
+			return (-1);
+		if (ret > 0) {
+			lk->nl_driver = 1;
+			return (0);
+		}
+	}
+	for (i = 0; i < NF_LINK_PORTS; i++) {
+		ops[i].nro_op = NF_REGOP_READ;
+		ops[i].nro_reg = MDIO_0_STATUS_REG +
+		    i * (MDIO_1_STATUS_REG - MDIO_0_STATUS_REG);
+		ops[i].nro_value = 0;
+	}
+	if (nf_regv(nf, ops, NF_LINK_PORTS) != NF_LINK_PORTS)
+		return (nf_erri(nf, "Couldn't read MDIO status"));
+	for (i = 0; i < NF_LINK_PORTS; i++)
+		if (ops[i].nro_value & NF_MII_BMSR_LINK)
+			lk->nl_up |= 1 << i;
+	return (0);
+}
+
+/*
+ * Registers the library was built with, for drivers which don't export
+ * their list and for modules which aren't drivers.
+ */
+static const struct {
+	const char	*name;
+	uint32_t	 offset;
+} _nf_regs_builtin[] = {
+#define NF_REGDEF(r)	{ #r, r },
+#include "netfpga_regs.h"
+#undef NF_REGDEF
+};
+
+static struct nf_regs *
+_nf_get_regs_builtin(struct nf_regs *list)
+{
+	struct nf_reg *reg;
+	size_t i;
+
+	for (i = 0; i < sizeof(_nf_regs_builtin) /
+	    sizeof(_nf_regs_builtin[0]); i++) {
+		reg = calloc(1, sizeof(*reg));
+		ASSERT(reg != NULL);
+		reg->nfr_name = strdup(_nf_regs_builtin[i].name);
+		reg->nfr_offset = _nf_regs_builtin[i].offset;
+		TAILQ_INSERT_TAIL(list, reg, next);
+	}
+	return (list);
+}
+
 /*
  * Get registers offset from the kernel.
  */
@@ -367,12 +1105,13 @@ _nf_get_regs(void)
 	ASSERT(list != NULL);
 	TAILQ_INIT(list);
 
-	error = 0;
+	/* Only our FreeBSD driver has it */
+	error = -1;
 #ifndef __linux__
 	error = sysctlbyname("dev.nfc.0.dev_uiface", NULL, NULL, NULL, 0);
 #endif
 	if (error != 0)
-		return (NULL);
+		return (_nf_get_regs_builtin(list));
 
 	/*
 	 * sysctlbyname() should be used, but since we execute gunzip
@@ -430,10 +1169,45 @@ _nf_get_regs(void)
 		reg->nfr_offset = offset;
 		TAILQ_INSERT_TAIL(list, reg, next);
 	}
-	fclose(fp);
+	pclose(fp);
 	return (list);
 }
 
+/*
+ * Register names are looked up by scripts and batches over and over, so
+ * chain them in a hash table instead of walking the whole list.
+ */
+#define NF_REGS_HASH	512
+
+static unsigned
+_nf_reg_hash(const char *name)
+{
+	unsigned h;
+
+	/* FNV-1a */
+	for (h = 2166136261u; *name != '\0'; name++)
+		h = (h ^ (unsigned char)*name) * 16777619u;
+	return (h % NF_REGS_HASH);
+}
+
+static struct nf_reg **
+_nf_hash_regs(struct nf_regs *list)
+{
+	struct nf_reg **hash;
+	struct nf_reg *nfr;
+	unsigned h;
+
+	hash = calloc(NF_REGS_HASH, sizeof(*hash));
+	ASSERT(hash != NULL);
+	/* Keep the first of duplicate names, as the list walk did */
+	TAILQ_FOREACH_REVERSE(nfr, list, nf_regs, next) {
+		h = _nf_reg_hash(nfr->nfr_name);
+		nfr->nfr_hnext = hash[h];
+		hash[h] = nfr;
+	}
+	return (hash);
+}
+
 /*
  * Try to get register by name. It will generate a list of registers
  * once it's used for the first time. Otherwise, it'll use list that was
@@ -447,15 +1221,18 @@ nf_reg_byname(struct netfpga *nf, const char *name, uint32_t *reg)
 	nf_assert(nf);
 	ASSERT(name != NULL);
 
-	if (nf->__nf_regs == NULL)
+	if (nf->__nf_regs == NULL) {
 		nf->__nf_regs = _nf_get_regs();
-	ASSERT(nf->__nf_regs != NULL && "couldn't read register list");
+		ASSERT(nf->__nf_regs != NULL && "couldn't read register list");
+		nf->__nf_regs_hash = _nf_hash_regs(nf->__nf_regs);
+	}
 
 	/* This call is for register list re-reading */
 	if (reg == NULL)
 		return (0);
 
-	TAILQ_FOREACH(nfr, nf->__nf_regs, next) {
+	for (nfr = nf->__nf_regs_hash[_nf_reg_hash(name)]; nfr != NULL;
+	    nfr = nfr->nfr_hnext) {
 		if (strcmp(nfr->nfr_name, name) == 0) {
 			*reg = nfr->nfr_offset;
 			return (1);
@@ -494,7 +1271,7 @@ int
 nf_image_name(struct netfpga *nf, void *dev_name, size_t dev_name_len)
 {
 	uint32_t *u32;
-	int i;
+	int i, ret;
 
 	nf_assert(nf);
 	ASSERT(dev_name != NULL);
@@ -502,8 +1279,11 @@ nf_image_name(struct netfpga *nf, void *dev_name, size_t dev_name_len)
 		return (nf_erri(nf, "Buffer lenght for image name must "
 		    "have at least %d bytes", NF2_DEVICE_STR_LEN));
 	u32 = dev_name;
-	for (i = 0; i < NF2_DEVICE_STR_LEN / 4; i += 4, u32++)
-		*u32 = htonl(nf_rd32(nf, DEVICE_STR_REG + i));
+	ret = nf_read(nf, DEVICE_STR_REG, u32, NF2_DEVICE_STR_LEN);
+	if (ret != NF2_DEVICE_STR_LEN)
+		return (nf_erri(nf, "Couldn't read image name"));
+	for (i = 0; i < NF2_DEVICE_STR_LEN / 4; i++)
+		u32[i] = htonl(u32[i]);
 	return (0);
 }
 
@@ -605,10 +1385,13 @@ nf_prog_reset(struct netfpga *nf)
 	 * consistency.
 	 */
 	errreg = NF_RD32(nf, CPCI_REG_ERROR);
-	fprintf(stderr, "Error Registers: %x\n", errreg);
+	if (!nf->nf_quiet) {
+		fprintf(stderr, "Error Registers: %x\n", errreg);
 
-	/* XXWKOSZEK: This doesn't make much sense */
-	fprintf(stderr, "Good, after resetting programming interface the FIFO is empty\n");
+		/* XXWKOSZEK: This doesn't make much sense */
+		fprintf(stderr, "Good, after resetting programming interface "
+		    "the FIFO is empty\n");
+	}
 
 	/* Sleep a bit */
 	usleep(1000);
@@ -625,41 +1408,35 @@ static int
 nf_image_write_done(struct netfpga *nf)
 {
 	uint32_t status;
-	int tries;
+	int done;
 
 	nf_assert(nf);
 	/* 
 	 * Check, if everything is fine once we reach this stage and
 	 * wait for some time if we aren't done yet.
 	 */
-	tries = 5;
-	do {
-		status = NF_RD32(nf, CPCI_REG_PROG_STATUS);
-		if (status & PROG_DONE) {
+	done = nf_wait_reg(nf, CPCI_REG_PROG_STATUS, PROG_DONE, PROG_DONE,
+	    NF_PROG_DONE_TIMEOUT);
+	if (done) {
+		if (!nf->nf_quiet)
 			fprintf(stderr, "DONE went high - chip has been "
 			    "successfully programmed.\n");
-			break;
-		}
-		sleep(1);
-		tries--;
-	} while (tries > 0);
+		return (1);
+	}
 
 	/*
-	 * Something could go wrong, because all the ``tries''
-	 * iterations were necessary.
+	 * Something went wrong, because DONE hasn't gone high in time.
 	 */
-	if (tries == 0) {
-		printf("status = %#x\n", status);
-		if (status & PROG_INIT)
-			fprintf(stderr, "INIT went high - appears to be a "
-			    "programming error.\n");
-		if (!(status & PROG_DONE))
-			fprintf(stderr, "DONE has not gone high - looks like "
-			    "an error\n");
-		return (nf_erri(nf, "Error while programming NetFPGA "
-		    "Virtex chip"));
-	}
-	return (1);
+	status = NF_RD32(nf, CPCI_REG_PROG_STATUS);
+	printf("status = %#x\n", status);
+	if (status & PROG_INIT)
+		fprintf(stderr, "INIT went high - appears to be a "
+		    "programming error.\n");
+	if (!(status & PROG_DONE))
+		fprintf(stderr, "DONE has not gone high - looks like "
+		    "an error\n");
+	return (nf_erri(nf, "Error while programming NetFPGA "
+	    "Virtex chip"));
 }
 
 /*
@@ -683,7 +1460,8 @@ nf_image_write_start(struct netfpga *nf, struct xbf *xbf)
 
 	bytes_written = 0;
 	prog_word = xbf_get_data(xbf);
-	printf("Expected to write = %d\n", (int)xbf_get_len(xbf));
+	if (!nf->nf_quiet)
+		printf("Expected to write = %d\n", (int)xbf_get_len(xbf));
 
 	nwrites = xbf_get_len(xbf) / 4;
 
@@ -708,11 +1486,14 @@ nf_image_write_start(struct netfpga *nf, struct xbf *xbf)
 			ASSERT(tries != 0);
 #endif
 		}
-		if ((bytes_written % (1024 * 128)) == 0)
+		if (!nf->nf_quiet && (bytes_written % (1024 * 128)) == 0)
 			printf(".");
 	}
-	printf("\n");
-	printf("Bytes_written = %d\n", (int)bytes_written);
+	nf->__nf_stats.st_prog_bytes += bytes_written;
+	if (!nf->nf_quiet) {
+		printf("\n");
+		printf("Bytes_written = %d\n", (int)bytes_written);
+	}
 	return (bytes_written);
 }
 
@@ -728,6 +1509,8 @@ nf_image_write(struct netfpga *nf, const char *fname)
 
 	nf_assert(nf);
 
+	nf_phase_clear(nf);
+	nf_phase(nf, NF_PHASE_VALIDATE);
 	xbf_init(&xbf);
 	ret = xbf_open(&xbf, fname);
 	if (ret != 0)
@@ -738,10 +1521,12 @@ nf_image_write(struct netfpga *nf, const char *fname)
 	if (ret != 0)
 		return (nf_erri(nf, "Invalid image for this NetFPGA"
 		    " card"));
+	nf_phase(nf, NF_PHASE_RESET);
 	ret = nf_prog_reset(nf);
 	if (ret != 0)
 		return (nf_erri(nf, "Couldn't get CPCI programmer to "
 		    "reset"));
+	nf_phase(nf, NF_PHASE_PUSH);
 	ret = nf_image_write_start(nf, &xbf);
 	if (ret != exblen)
 		return (nf_erri(nf, "Couldn't program a device: "
@@ -749,12 +1534,14 @@ nf_image_write(struct netfpga *nf, const char *fname)
 	ret = xbf_close(&xbf);
 	if (ret != 0)
 		return (nf_erri(nf, "Couldn't close bit stream file"));
+	nf_phase(nf, NF_PHASE_DONE);
 	ret = nf_image_write_done(nf);
 	if (ret != 1)
 		return (nf_erri(nf, "Error occured while card"
 		    "programming"));
 	nf_reset(nf);
 	nf_reset_allphy(nf);
+	nf_phase(nf, NF_PHASE_NONE);
 	return (0);
 }
 
@@ -784,12 +1571,15 @@ nf_cpci_write_start(struct netfpga *nf, struct xbf *xbf)
 		prog_wordp++;
 		bytes_written += 4;
 		nwrites--;
-		if ((bytes_written % (1024 * 128)) == 0)
+		if (!nf->nf_quiet && (bytes_written % (1024 * 128)) == 0)
 			printf(".");
 	}
-	printf("\n");
-	printf("CPCI reprogramming finished (expected %d, written "
-	    "%d)\n", (int)xbf_get_len(xbf), (int)bytes_written);
+	nf->__nf_stats.st_prog_bytes += bytes_written;
+	if (!nf->nf_quiet) {
+		printf("\n");
+		printf("CPCI reprogramming finished (expected %d, written "
+		    "%d)\n", (int)xbf_get_len(xbf), (int)bytes_written);
+	}
 	return (0);
 }
 
@@ -828,6 +1618,9 @@ nf_cpci_write(struct netfpga *nf, const char *fname)
 	struct xbf xbf;
 	int ret;
 
+	nf_assert(nf);
+	nf_phase_clear(nf);
+	nf_phase(nf, NF_PHASE_VALIDATE);
 	xbf_init(&xbf);
 	ret = xbf_open(&xbf, fname);
 	if (ret != 0)
@@ -837,14 +1630,17 @@ nf_cpci_write(struct netfpga *nf, const char *fname)
 	if (ret != 0)
 		return (nf_erri(nf, "Invalid image for this NetFPGA"
 		    " card"));
+	nf_phase(nf, NF_PHASE_PUSH);
 	ret = nf_cpci_write_start(nf, &xbf);
 	if (ret != 0)
 		return (nf_erri(nf, "Couldn't write CPCI image"));
 	ret = xbf_close(&xbf);
 	if (ret != 0)
 		return (nf_erri(nf, "Couldn't close CPCI image"));
+	nf_phase(nf, NF_PHASE_DONE);
 	nf_cpci_write_done(nf);
 	nf_reset_allphy(nf);
+	nf_phase(nf, NF_PHASE_NONE);
 	return (0);
 }
 
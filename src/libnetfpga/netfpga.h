@@ -44,6 +44,18 @@ extern int	nf_tbd;
 	printf("%s = '%s'\n", #x, (x))
 #define ASSERT assert
 
+/*
+ * One register operation of a batch passed to nf_regv(). Layout must
+ * match ``struct nf_reqv_ent'' of the FreeBSD driver.
+ */
+struct nf_regop {
+	uint32_t		 nro_op;
+#define NF_REGOP_READ		0
+#define NF_REGOP_WRITE		1
+	uint32_t		 nro_reg;
+	uint32_t		 nro_value;	/* Filled in for reads */
+};
+
 /*
  * Helper typedefs for NetFPGA accessory methods.
  */
@@ -54,10 +66,42 @@ typedef int nf_read_t(struct netfpga *nf, void *ctx, uint32_t reg,
     void *buf, size_t buf_len);
 typedef int nf_write_t(struct netfpga *nf, void *ctx, uint32_t reg,
     void *buf, size_t buf_len);
+typedef int nf_intr_t(struct netfpga *nf, void *ctx, uint32_t *status,
+    int timeout);
+typedef int nf_regv_t(struct netfpga *nf, void *ctx, struct nf_regop *ops,
+    int ops_num);
+typedef int nf_mem_t(struct netfpga *nf, void *ctx, int write, uint32_t addr,
+    void *buf, size_t len);
+typedef int nf_link_t(struct netfpga *nf, void *ctx, uint32_t *up,
+    uint32_t *changes);
+
+/*
+ * Version of the interface between the library and its modules. Bump
+ * it every time ``struct nf_module'' changes, so that stale plugins get
+ * rejected by nf_start() instead of crashing it.
+ */
+#define NETFPGA_MODULE_VERSION	5
 
 /*
- * OS-specific handlers for NetFPGA manipulation. No function can be
- * left uninitialized.
+ * OS-specific handlers for NetFPGA manipulation. No function up to
+ * nf_write can be left uninitialized; the rest is optional.
+ *
+ * nf_intr waits up to ``timeout'' milliseconds (-1 means forever) for
+ * card's interrupt and returns 1 with the interrupt status register
+ * in ``status'', 0 on timeout and -1 if interrupts aren't available.
+ *
+ * nf_regv performs ``ops_num'' register operations in order, in one go
+ * if it's cheaper than separate reads and writes. Returns the number
+ * of operations done.
+ *
+ * nf_mem copies ``len'' bytes of card's memory from (or, if ``write''
+ * is set, to) ``addr'' in bulk. It returns the number of bytes copied,
+ * and fewer than ``len'' (even 0) make the library do the rest with
+ * nf_regv batches.
+ *
+ * nf_link returns 1 with link state kept by the driver: bit per port
+ * with link in ``up'' and changes per port (NF_LINK_PORTS of them) in
+ * ``changes''. 0 means the driver doesn't keep it, -1 an error.
  */
 struct nf_module {
 	unsigned int		 nf_version;
@@ -69,12 +113,53 @@ struct nf_module {
 	nf_close_t		*nf_close;
 	nf_read_t		*nf_read;
 	nf_write_t		*nf_write;
+	nf_intr_t		*nf_intr;
+	nf_regv_t		*nf_regv;
+	nf_mem_t		*nf_mem;
+	nf_link_t		*nf_link;
+};
+#define NF_MODULE_FLAG_HW	(1 << 0)	/* Talks to a real card */
+#define NF_MODULE_FLAG_MMAP	(1 << 1)	/* Registers are mmap()ed */
+
+/*
+ * Programming phases timed by nf_image_write() and nf_cpci_write().
+ */
+#define NF_PHASE_NONE		-1
+#define NF_PHASE_VALIDATE	0	/* Opening and checking bit file */
+#define NF_PHASE_RESET		1	/* Resetting programming interface */
+#define NF_PHASE_PUSH		2	/* Pushing bitstream words */
+#define NF_PHASE_DONE		3	/* Waiting for DONE, card reset */
+#define NF_PHASE_NUM		4
+
+/*
+ * Link state of the card's ports.
+ */
+#define NF_LINK_PORTS		4
+
+struct nf_link {
+	uint32_t		 nl_up;		/* Bit per port */
+	uint32_t		 nl_changes[NF_LINK_PORTS];	/* 0: unknown */
+	int			 nl_driver;	/* From driver's monitor */
+};
+
+/*
+ * Access statistics. nf_read()/nf_write() calls are counted as
+ * accesses; phases are filled by the last programming run.
+ */
+struct nf_stats {
+	unsigned long		 st_reads;
+	unsigned long		 st_writes;
+	unsigned long		 st_bytes;
+	unsigned long		 st_prog_bytes;	/* Bitstream bytes pushed */
+	long			 st_phase_ns[NF_PHASE_NUM];
+	unsigned long		 st_phase_acc[NF_PHASE_NUM];
 };
 
 struct nf_reg {
 	char		*nfr_name;
 	uint32_t	 nfr_offset;
 	TAILQ_ENTRY(nf_reg)	next;
+	struct nf_reg	*nfr_hnext;	/* Name hash chain */
 };
 TAILQ_HEAD(nf_regs, nf_reg);
 
@@ -97,12 +182,21 @@ struct netfpga {
 	unsigned		 __nf_flags;
 	struct nf_module	*__nf_mod;
 	void			*__nf_mod_ctx;
+	void			*__nf_mod_dl;
 	struct nf_regs		*__nf_regs;
+	struct nf_reg		**__nf_regs_hash;
+	uint32_t		 __nf_events;	/* Latched, not returned yet */
+	struct nf_stats		 __nf_stats;
+	int			 __nf_phase;	/* Phase being timed */
+	long			 __nf_phase_t0;
+	unsigned long		 __nf_phase_acc0;
 
 	/* Public: stuff */
 	const char		*nf_iface;
 	const char		*nf_module;
 	int			 nf_verbose;
+	int			 nf_nointr;	/* Poll even if intr works */
+	int			 nf_quiet;	/* No progress output */
 };
 #define	NETFPGA_FLAG_INITIALIZED	(1 << 0)
 
@@ -122,11 +216,20 @@ nf_init(struct netfpga *nf)
 	nf->__nf_flags |= NETFPGA_FLAG_INITIALIZED;
 	nf->__nf_mod = NULL;
 	nf->__nf_mod_ctx = NULL;
+	nf->__nf_mod_dl = NULL;
 	nf->__nf_regs = NULL;
+	nf->__nf_regs_hash = NULL;
+	nf->__nf_events = 0;
+	memset(&nf->__nf_stats, 0, sizeof(nf->__nf_stats));
+	nf->__nf_phase = NF_PHASE_NONE;
+	nf->__nf_phase_t0 = 0;
+	nf->__nf_phase_acc0 = 0;
 
 	nf->nf_iface = NULL;
 	nf->nf_module = NULL;
 	nf->nf_verbose = 0;
+	nf->nf_nointr = 0;
+	nf->nf_quiet = 0;
 }
 
 /*
@@ -152,6 +255,7 @@ nf_initialized(struct netfpga *nf)
  */
 int nf_start(struct netfpga *nf);
 int nf_stop(struct netfpga *nf);
+int nf_module_names(const char **names, int names_num);
 void nf_reset(struct netfpga *nf);
 #define MDIO_RESET_MAGIC	(0x8000)
 void nf_reset_allphy(struct netfpga *nf);
@@ -159,6 +263,19 @@ int nf_read(struct netfpga *nf, uint32_t reg, void *buf, size_t buf_len);
 int nf_write(struct netfpga *nf, uint32_t reg, void *buf, size_t buf_len);
 uint32_t nf_rd32(struct netfpga *nf, uint32_t reg);
 void nf_wr32(struct netfpga *nf, uint32_t reg, uint32_t value);
+int nf_regv(struct netfpga *nf, struct nf_regop *ops, int ops_num);
+int nf_mem_read(struct netfpga *nf, uint32_t addr, void *buf, size_t len);
+int nf_mem_write(struct netfpga *nf, uint32_t addr, const void *buf,
+    size_t len);
+int nf_mem_save(struct netfpga *nf, uint32_t addr, size_t len,
+    const char *fname);
+int nf_mem_load(struct netfpga *nf, uint32_t addr, size_t len,
+    const char *fname);
+int nf_wait_event(struct netfpga *nf, uint32_t mask, uint32_t *events,
+    int timeout);
+int nf_wait_reg(struct netfpga *nf, uint32_t reg, uint32_t mask,
+    uint32_t value, int timeout);
+int nf_link_read(struct netfpga *nf, struct nf_link *lk);
 int nf_image_name(struct netfpga *nf, void *dev_name, size_t dev_name_len);
 void nf_image_name_print_fp(struct netfpga *nf, FILE *fp);
 void nf_image_name_print(struct netfpga *nf);
@@ -166,8 +283,630 @@ int nf_prog_reset(struct netfpga *nf);
 int nf_image_write(struct netfpga *nf, const char *fname);
 int nf_cpci_write(struct netfpga *nf, const char *fname);
 int nf_reg_byname(struct netfpga *nf, const char *name, uint32_t *reg);
+void nf_stats_get(struct netfpga *nf, struct nf_stats *st);
+void nf_stats_clear(struct netfpga *nf);
 void nf_reg_print_all(struct netfpga *nf, int verbose);
 
+/*
+ * Route table of the reference router design. Hardware matches
+ * entries in slot order, so longer prefixes must come first. The
+ * manager keeps a shadow copy of the hardware table; routes are added
+ * and removed in memory and nf_router_commit() writes only slots which
+ * have to change, in one batch.
+ */
+struct nf_route {
+	uint32_t		 nrt_ip;	/* Host byte order */
+	uint32_t		 nrt_mask;
+	uint32_t		 nrt_next_hop;
+	uint32_t		 nrt_port;	/* NF_ROUTER_PORT_* bits */
+};
+#define NF_ROUTER_PORT_MAC(n)	(1 << ((n) * 2))
+#define NF_ROUTER_PORT_CPU(n)	(1 << ((n) * 2 + 1))
+#define NF_ROUTER_RT_SIZE	32	/* ROUTER_RT_SIZE */
+/* Unused slots hold 0.0.0.0/32, which never matches real traffic */
+#define NF_RT_EMPTY_MASK	0xffffffff
+
+struct nf_router {
+	struct netfpga		*nr_nf;
+	struct nf_route		 nr_hw[NF_ROUTER_RT_SIZE];	/* Shadow */
+	struct nf_route		 nr_routes[NF_ROUTER_RT_SIZE];	/* Wanted */
+	int			 nr_routes_num;
+	unsigned		 nr_slots_written;	/* By last commit */
+};
+
+int nf_router_init(struct netfpga *nf, struct nf_router *nr);
+int nf_router_add(struct nf_router *nr, const struct nf_route *rt);
+int nf_router_del(struct nf_router *nr, uint32_t ip, uint32_t mask);
+void nf_router_flush(struct nf_router *nr);
+int nf_router_commit(struct nf_router *nr);
+int nf_route_plen(uint32_t mask);
+
+/*
+ * ARP cache of the reference router design. Slots are found by next hop
+ * through a hash kept on the host, changed in memory and written by
+ * nf_arp_commit() in one batch. Hardware only counts misses, so entries
+ * are ranked by use reported with nf_arp_touch(), aged whenever
+ * nf_arp_sample() sees the miss counter go up.
+ */
+struct nf_arp_ent {
+	uint32_t		 nae_ip;	/* Host byte order */
+	uint8_t			 nae_mac[6];
+	uint16_t		 nae_flags;	/* NF_ARP_* */
+	uint32_t		 nae_refs;	/* Aged use count */
+	uint32_t		 nae_seq;	/* Last set or touched */
+};
+#define NF_ARP_VALID		0x0001
+#define NF_ARP_STATIC		0x0002	/* Never evicted */
+#define NF_ARP_SIZE		32	/* ROUTER_ARP_SIZE */
+#define NF_ARP_HASH_BITS	6
+#define NF_ARP_HASH_SIZE	(1 << NF_ARP_HASH_BITS)
+
+struct nf_arp {
+	struct netfpga		*na_nf;
+	struct nf_arp_ent	 na_ent[NF_ARP_SIZE];
+	uint8_t			 na_hash[NF_ARP_HASH_SIZE];	/* Slot + 1 */
+	uint32_t		 na_dirty;	/* Slots to write */
+	uint32_t		 na_seq;
+	uint32_t		 na_misses;	/* Counter at last sample */
+	int			 na_num;
+	unsigned		 na_evictions;
+	unsigned		 na_slots_written;	/* By last commit */
+};
+
+int nf_arp_init(struct netfpga *nf, struct nf_arp *na);
+int nf_arp_lookup(struct nf_arp *na, uint32_t ip);
+int nf_arp_set(struct nf_arp *na, uint32_t ip, const uint8_t *mac,
+    int flags);
+int nf_arp_del(struct nf_arp *na, uint32_t ip);
+void nf_arp_flush(struct nf_arp *na);
+void nf_arp_touch(struct nf_arp *na, uint32_t ip);
+int nf_arp_sample(struct nf_arp *na, uint32_t *misses);
+int nf_arp_commit(struct nf_arp *na);
+
+/*
+ * Destination IP filter of the reference router design: packets to
+ * these addresses go to the CPU. Order doesn't matter, so on commit
+ * addresses stay in slots they're in and only the rest is written.
+ */
+#define NF_FILTER_SIZE		32	/* ROUTER_DST_IP_FILTER_TABLE_DEPTH */
+
+struct nf_filter {
+	struct netfpga		*nfl_nf;
+	uint32_t		 nfl_hw[NF_FILTER_SIZE];	/* 0 is unused */
+	uint32_t		 nfl_ips[NF_FILTER_SIZE];	/* Wanted */
+	int			 nfl_ips_num;
+	unsigned		 nfl_slots_written;	/* By last commit */
+};
+
+int nf_filter_init(struct netfpga *nf, struct nf_filter *fl);
+int nf_filter_add(struct nf_filter *fl, uint32_t ip);
+int nf_filter_del(struct nf_filter *fl, uint32_t ip);
+void nf_filter_flush(struct nf_filter *fl);
+int nf_filter_load(struct nf_filter *fl, const char *fname);
+int nf_filter_commit(struct nf_filter *fl);
+
+/*
+ * MAC table of the reference switch design. nf_switch_lut_dump() reads
+ * the whole table and the hit/miss counters in one nf_regv() batch and
+ * keeps used entries only, sorted by MAC, which is what
+ * nf_switch_lut_diff() needs to compare two dumps in one pass.
+ */
+struct nf_lut_ent {
+	uint8_t			 nle_mac[6];
+	uint16_t		 nle_ports;	/* NF_ROUTER_PORT_* bits */
+};
+#define NF_SWITCH_LUT_SIZE	32	/* Not in reg_defines.h */
+
+struct nf_switch_lut {
+	uint32_t		 nsl_hits;
+	uint32_t		 nsl_misses;
+	int			 nsl_num;
+	struct nf_lut_ent	 nsl_ents[NF_SWITCH_LUT_SIZE];
+};
+
+/* One difference: ports 0 on either side means added or removed */
+struct nf_lut_diff {
+	uint8_t			 nld_mac[6];
+	uint16_t		 nld_old_ports;
+	uint16_t		 nld_new_ports;
+};
+
+int nf_switch_lut_dump(struct netfpga *nf, struct nf_switch_lut *lut);
+int nf_switch_lut_diff(const struct nf_switch_lut *old,
+    const struct nf_switch_lut *new, struct nf_lut_diff *diffs,
+    int diffs_num);
+
+/*
+ * Reading pcap files. The callback gets every frame with its timestamp
+ * in nanoseconds and may return non-zero to stop.
+ */
+typedef int nf_pcap_cb_t(void *arg, uint8_t *pkt, size_t len,
+    uint64_t ts_ns);
+int nf_pcap_foreach(struct netfpga *nf, const char *fname, nf_pcap_cb_t *cb,
+    void *arg, uint64_t *pkts);
+
+/*
+ * Event capture: configuration, counters and a decoder which turns
+ * event packets into per-queue occupancy over time. See
+ * netfpga_evcap.c for the packet format.
+ */
+#define NF_EVCAP_QUEUES		8
+#define NF_EVCAP_RES_MAX	15	/* Tick is 8 ns << resolution */
+#define NF_EVCAP_MON_STORE	0x1	/* EVT_CAP_MONITOR_MASK_REG bits */
+#define NF_EVCAP_MON_REMOVE	0x2
+#define NF_EVCAP_MON_DROP	0x4
+
+struct nf_evcap_cfg {
+	uint8_t			 nec_dst_mac[6];
+	uint8_t			 nec_src_mac[6];
+	uint32_t		 nec_ip_dst;	/* Host byte order */
+	uint32_t		 nec_ip_src;
+	uint16_t		 nec_udp_src;
+	uint16_t		 nec_udp_dst;
+	uint32_t		 nec_output_ports;	/* NF_ROUTER_PORT_* */
+	uint32_t		 nec_monitor_mask;	/* NF_EVCAP_MON_* */
+	uint32_t		 nec_queue_mask;	/* Bit per queue */
+	uint32_t		 nec_resolution;
+};
+
+struct nf_evcap_stats {
+	uint32_t		 nes_pkts_sent;
+	uint32_t		 nes_evts_sent;
+	uint32_t		 nes_evts_dropped;
+};
+
+/* One decoded event, 16 bytes, also the record of timeline files */
+struct nf_evt {
+	uint64_t		 ne_time;	/* ns since timers were reset */
+	uint32_t		 ne_occ;	/* Queue bytes after the event */
+	uint8_t			 ne_queue;
+	uint8_t			 ne_type;	/* NF_EVT_* */
+	uint16_t		 ne_len;	/* Packet bytes */
+};
+#define NF_EVT_TIMESTAMP	0	/* Never returned */
+#define NF_EVT_STORE		1
+#define NF_EVT_REMOVE		2
+#define NF_EVT_DROP		3
+
+struct nf_evcap_dec {
+	uint64_t		 ned_tick_ns;
+	uint64_t		 ned_ticks;	/* Last timestamp event */
+	uint32_t		 ned_occ[NF_EVCAP_QUEUES];	/* Bytes */
+	uint32_t		 ned_seq;	/* Expected next */
+	uint64_t		 ned_pkts;
+	uint64_t		 ned_events;
+	uint64_t		 ned_lost;	/* Packets, by sequence gaps */
+	uint64_t		 ned_bad;
+	uint64_t		 ned_overflows;	/* Events cut off by out_num */
+};
+
+int nf_evcap_config(struct netfpga *nf, const struct nf_evcap_cfg *cfg);
+int nf_evcap_stop(struct netfpga *nf, int flush);
+int nf_evcap_stats(struct netfpga *nf, struct nf_evcap_stats *st);
+const uint8_t *nf_evcap_udp(const uint8_t *frame, size_t len, uint16_t port,
+    size_t *plen);
+void nf_evcap_dec_init(struct nf_evcap_dec *dec, unsigned resolution);
+int nf_evcap_decode(struct nf_evcap_dec *dec, const uint8_t *payload,
+    size_t len, struct nf_evt *out, int out_num);
+
+/*
+ * Correlation of the card's stamp counter (125 MHz ticks) with a host
+ * clock: bracketed samples, a weighted least squares fit of drift and
+ * offset, and conversion of tick values with an error bound.
+ */
+#define NF_HWTIME_SAMPLES	64
+#define NF_HWTIME_TICK_NS	8
+
+struct nf_hwtime_sample {
+	uint64_t		 nhs_ticks;
+	uint64_t		 nhs_host;	/* ns, middle of bracket */
+	uint32_t		 nhs_width;	/* ns, bracket */
+};
+
+struct nf_hwtime {
+	struct netfpga		*nht_nf;
+	int			 nht_clock;	/* clockid_t */
+	struct nf_hwtime_sample	 nht_samples[NF_HWTIME_SAMPLES];	/* Ring */
+	int			 nht_num;
+	int			 nht_next;
+	/* Fit: host = nht_y0 + nht_offset + nht_slope * (ticks - nht_x0) */
+	int			 nht_fitted;
+	uint64_t		 nht_x0;
+	uint64_t		 nht_y0;
+	double			 nht_offset;
+	double			 nht_slope;	/* ns per tick */
+	double			 nht_slope_err;	/* Standard error */
+	double			 nht_xmean;
+	uint32_t		 nht_err;	/* ns, within samples */
+};
+
+void nf_hwtime_init(struct netfpga *nf, struct nf_hwtime *ht, int clock);
+int nf_hwtime_read(struct netfpga *nf, uint64_t *ticks);
+int nf_hwtime_sample(struct nf_hwtime *ht);
+int nf_hwtime_fit(struct nf_hwtime *ht);
+uint64_t nf_hwtime_to_host(const struct nf_hwtime *ht, uint64_t ticks,
+    uint64_t *err_ns);
+
+/*
+ * Sampler: a thread reading a set of registers every period into a
+ * ring which any number of readers can consume without stopping it,
+ * and a burst detector for the samples.
+ */
+#define NF_SAMPLER_REGS_MAX	32
+
+struct nf_sample {
+	uint64_t		 nsm_seq;
+	uint64_t		 nsm_time;	/* CLOCK_MONOTONIC ns */
+	uint32_t		 nsm_values[NF_SAMPLER_REGS_MAX];
+};
+
+struct nf_sampler;
+
+struct nf_sampler_reader {
+	uint64_t		 nsr_next;	/* Sample to read next */
+	uint64_t		 nsr_lost;	/* Overwritten before read */
+};
+
+struct nf_burst {
+	int			 nb_reg;	/* Index in sampled registers */
+	uint32_t		 nb_peak;
+	uint64_t		 nb_start;	/* ns */
+	uint64_t		 nb_end;
+	uint64_t		 nb_samples;
+};
+
+struct nf_burst_det {
+	int			 nbd_regs_num;
+	int			 nbd_primed;
+	uint32_t		 nbd_delta;	/* Bit per register */
+	uint32_t		 nbd_active;	/* Bit per register */
+	uint32_t		 nbd_hi[NF_SAMPLER_REGS_MAX];
+	uint32_t		 nbd_lo[NF_SAMPLER_REGS_MAX];
+	uint32_t		 nbd_prev[NF_SAMPLER_REGS_MAX];
+	struct nf_burst		 nbd_cur[NF_SAMPLER_REGS_MAX];
+	uint64_t		 nbd_bursts;
+	uint64_t		 nbd_dropped;	/* Didn't fit in out_num */
+};
+
+struct nf_sampler *nf_sampler_new(struct netfpga *nf, const uint32_t *regs,
+    int regs_num, unsigned period_us, unsigned ring_size);
+int nf_sampler_start(struct nf_sampler *sp);
+int nf_sampler_stop(struct nf_sampler *sp);
+void nf_sampler_free(struct nf_sampler *sp);
+int nf_sampler_stats(struct nf_sampler *sp, uint64_t *samples,
+    uint64_t *overruns);
+void nf_sampler_reader_init(struct nf_sampler *sp,
+    struct nf_sampler_reader *rd);
+int nf_sampler_read(struct nf_sampler *sp, struct nf_sampler_reader *rd,
+    struct nf_sample *out, int out_num);
+void nf_burst_init(struct nf_burst_det *bd, int regs_num, const uint32_t *hi,
+    const uint32_t *lo, uint32_t delta);
+int nf_burst_feed(struct nf_burst_det *bd, const struct nf_sample *s,
+    struct nf_burst *out, int out_num);
+
+/*
+ * Watch: changes of sampled registers and triggers on their values,
+ * from samples fed to it or taken by nf_watch_poll() itself.
+ */
+#define NF_WATCH_TRIGS_MAX	16
+
+struct nf_trig {
+	char			 ntg_expr[96];	/* As given */
+	char			 ntg_name[64];	/* Register, as given */
+	uint32_t		 ntg_reg;
+	uint32_t		 ntg_mask;
+	uint32_t		 ntg_value;
+	int			 ntg_op;
+#define NF_TRIG_EQ		0
+#define NF_TRIG_NE		1
+#define NF_TRIG_LT		2
+#define NF_TRIG_LE		3
+#define NF_TRIG_GT		4
+#define NF_TRIG_GE		5
+	int			 ntg_delta;	/* Increase since last sample */
+	int			 ntg_snap;	/* Poll reads nw_snap */
+	/* Kept by the watch */
+	int			 ntg_idx;	/* Index in watched registers */
+	int			 ntg_active;
+	uint64_t		 ntg_fired;
+};
+
+/* A change, or with ``nwe_trig'' >= 0, a trigger which fired */
+struct nf_watch_ev {
+	int			 nwe_reg;	/* Index in watched registers */
+	int			 nwe_trig;
+	uint32_t		 nwe_old;
+	uint32_t		 nwe_new;
+	uint64_t		 nwe_time;	/* CLOCK_MONOTONIC ns */
+	int			 nwe_snap;	/* nw_snap was read for it */
+};
+
+struct nf_watch {
+	struct netfpga		*nw_nf;
+	int			 nw_regs_num;
+	int			 nw_primed;
+	uint32_t		 nw_changes;	/* Bit per register */
+	struct nf_regop		 nw_ops[NF_SAMPLER_REGS_MAX];
+	uint32_t		 nw_prev[NF_SAMPLER_REGS_MAX];
+	struct nf_trig		 nw_trigs[NF_WATCH_TRIGS_MAX];
+	int			 nw_trigs_num;
+	struct nf_snap		*nw_snap;
+	int			 nw_snap_due;
+	uint64_t		 nw_polls;
+	uint64_t		 nw_events;
+	uint64_t		 nw_dropped;	/* Didn't fit in out_num */
+};
+
+int nf_trig_parse(struct netfpga *nf, const char *expr, struct nf_trig *tg);
+void nf_watch_init(struct netfpga *nf, struct nf_watch *w, const uint32_t *regs,
+    int regs_num, uint32_t changes);
+int nf_watch_trig(struct nf_watch *w, const struct nf_trig *tg);
+int nf_watch_feed(struct nf_watch *w, const struct nf_sample *s,
+    struct nf_watch_ev *out, int out_num);
+int nf_watch_poll(struct nf_watch *w, struct nf_watch_ev *out, int out_num);
+
+/*
+ * Log-linear (HDR-style) histogram of 32-bit values: exact below 16,
+ * within 1/16 above, in constant memory.
+ */
+#define NF_HIST_SUB_BITS	4
+#define NF_HIST_BUCKETS		((33 - NF_HIST_SUB_BITS) << NF_HIST_SUB_BITS)
+
+struct nf_hist {
+	uint64_t		 nh_counts[NF_HIST_BUCKETS];
+	uint64_t		 nh_total;
+	uint32_t		 nh_min;
+	uint32_t		 nh_max;
+};
+
+void nf_hist_init(struct nf_hist *h);
+void nf_hist_add(struct nf_hist *h, uint32_t v);
+uint32_t nf_hist_quantile(const struct nf_hist *h, double q);
+double nf_hist_above(const struct nf_hist *h, uint32_t v);
+
+/*
+ * Output queues of the reference designs: occupancy histograms and
+ * drops per time window, from samples taken by nf_sampler.
+ */
+#define NF_OQ_QUEUES		8
+#define NF_OQ_WORD_BYTES	8	/* SRAM word, without parity */
+#define NF_OQ_PKT_MAX		1514	/* Largest packet queued */
+#define NF_OQ_REG(reg0, q)	((reg0) + (q) * 0x100)	/* _REG_0 + q */
+#define NF_OQ_STATS_REGS	(NF_OQ_QUEUES * 4)
+#define NF_OQ_WORST		4
+
+struct nf_oq_queue_win {
+	uint64_t		 nqw_start;	/* ns */
+	uint64_t		 nqw_drops;
+	uint32_t		 nqw_occ_max;	/* Bytes */
+};
+
+struct nf_oq_stats {
+	uint64_t		 nos_window_ns;
+	uint64_t		 nos_t0;
+	uint64_t		 nos_t1;
+	uint64_t		 nos_samples;
+	uint32_t		 nos_capacity[NF_OQ_QUEUES];	/* Bytes */
+	uint32_t		 nos_thresh[NF_OQ_QUEUES];
+	struct nf_hist		 nos_occ[NF_OQ_QUEUES];	/* Bytes */
+	uint64_t		 nos_drops[NF_OQ_QUEUES];
+	uint64_t		 nos_pkts[NF_OQ_QUEUES];	/* Stored */
+	uint64_t		 nos_bytes[NF_OQ_QUEUES];
+	struct nf_oq_queue_win	 nos_cur[NF_OQ_QUEUES];
+	struct nf_oq_queue_win	 nos_worst[NF_OQ_QUEUES][NF_OQ_WORST];
+	uint32_t		 nos_prev[NF_OQ_STATS_REGS];
+};
+
+int nf_oq_layout(struct netfpga *nf, uint32_t *lo, uint32_t *hi,
+    uint32_t *thresh);
+void nf_oq_stats_regs(uint32_t *regs);
+int nf_oq_stats_init(struct netfpga *nf, struct nf_oq_stats *st,
+    unsigned window_ms);
+void nf_oq_stats_feed(struct nf_oq_stats *st, const struct nf_sample *s);
+void nf_oq_stats_finish(struct nf_oq_stats *st);
+uint64_t nf_oq_stats_need(const struct nf_oq_stats *st, int q);
+
+/*
+ * SRAM partition planning for the output queues. Windows are in SRAM
+ * words, ``hi'' included.
+ */
+#define NF_OQ_PROFILE_SCALE	1000000	/* Samples of a declared profile */
+/* Words left below which a queue is full: the largest packet and header */
+#define NF_OQ_FULL_THRESH	((NF_OQ_PKT_MAX + NF_OQ_WORD_BYTES - 1) / \
+				NF_OQ_WORD_BYTES + 1)
+
+struct nf_oq_profile {
+	struct nf_hist		 nop_occ[NF_OQ_QUEUES];	/* Bytes wanted */
+	double			 nop_rate[NF_OQ_QUEUES];	/* Packets/s */
+};
+
+struct nf_oq_plan {
+	uint32_t		 nqp_lo[NF_OQ_QUEUES];
+	uint32_t		 nqp_hi[NF_OQ_QUEUES];
+	uint32_t		 nqp_thresh[NF_OQ_QUEUES];	/* Words */
+	double			 nqp_drops[NF_OQ_QUEUES];	/* Expected/s */
+	double			 nqp_drops_total;
+};
+
+void nf_oq_profile_from_stats(const struct nf_oq_stats *st,
+    struct nf_oq_profile *pr);
+int nf_oq_profile_load(struct netfpga *nf, const char *fname,
+    struct nf_oq_profile *pr);
+double nf_oq_expected_drops(const struct nf_oq_profile *pr, int q,
+    uint64_t bytes);
+int nf_oq_plan(const struct nf_oq_profile *pr, uint32_t base, uint32_t words,
+    uint32_t quantum, uint32_t min_words, struct nf_oq_plan *plan);
+int nf_oq_plan_apply(struct netfpga *nf, const struct nf_oq_plan *plan);
+
+/*
+ * Self-test engines of the selftest bitfile.
+ */
+#define NF_TEST_SRAM		0
+#define NF_TEST_DRAM		1
+#define NF_TEST_SERIAL0		2	/* Two serial links */
+#define NF_TEST_PHY0		4	/* Four PHYs */
+#define NF_TEST_NUM		8
+#define NF_TEST_ALL		((1U << NF_TEST_NUM) - 1)
+#define NF_TEST_LOG_MAX		16	/* Log entries of memory testers */
+
+struct nf_test_res {
+	uint64_t		 ntr_runs;	/* Iterations, frames, pkts */
+	uint64_t		 ntr_good;
+	uint64_t		 ntr_bad;
+	uint64_t		 ntr_errors;	/* Bad words, lost/bad pkts */
+};
+
+struct nf_test_log {
+	uint32_t		 ntl_addr;	/* Status for PHYs */
+	uint64_t		 ntl_exp;
+	uint64_t		 ntl_got;
+};
+
+const char *nf_test_name(int t);
+int nf_test_byname(const char *name);
+int nf_test_start(struct netfpga *nf, unsigned mask, uint32_t seed);
+int nf_test_stop(struct netfpga *nf, unsigned mask);
+int nf_test_poll(struct netfpga *nf, unsigned mask, struct nf_test_res *res);
+int nf_test_log(struct netfpga *nf, int t, unsigned first,
+    struct nf_test_log *log, int log_num);
+
+/*
+ * Rate limiter and delay modules in front of a MAC port, set up by
+ * measuring what the port sends.
+ */
+#define NF_SHAPE_SHIFT_MAX	15
+#define NF_SHAPE_ITER_MAX	12	/* Measurements per calibration */
+
+struct nf_shape_meas {
+	double			 nsh_rate;	/* Bytes/s sent */
+	double			 nsh_held;	/* Bytes, queue's - MAC's */
+	uint64_t		 nsh_bytes;
+	uint64_t		 nsh_ticks;	/* Stamp counter */
+	int			 nsh_samples;
+};
+
+struct nf_shape_cal {
+	int			 nsc_port;
+	unsigned		 nsc_ms;	/* Each measurement */
+	double			 nsc_tol;	/* Relative */
+	/* Results */
+	int			 nsc_enabled;
+	uint32_t		 nsc_value;	/* Shift or length set */
+	double			 nsc_got;	/* Bytes/s or ns measured */
+	int			 nsc_iters;	/* Measurements taken */
+	int			 nsc_ok;	/* Within tolerance */
+};
+
+int nf_shape_measure(struct netfpga *nf, int port, unsigned ms,
+    struct nf_shape_meas *m);
+int nf_shape_rate(struct netfpga *nf, double rate, struct nf_shape_cal *cal);
+int nf_shape_delay(struct netfpga *nf, double ns, struct nf_shape_cal *cal);
+int nf_shape_off(struct netfpga *nf);
+
+/*
+ * Serving the card to "net" module clients, see include/netfpga_net.h.
+ * nf_net_frame() tells if a whole request is in a buffer and
+ * nf_net_exec() does it, building the reply in NF_NET_FRAME_MAX bytes.
+ */
+int nf_net_frame(const void *buf, size_t len);
+int nf_net_exec(struct netfpga *nf, const void *req, void *rep);
+
+/*
+ * Snapshots of register space: the register catalog and/or address
+ * ranges, read in one nf_regv() pass, saved to and loaded from compact
+ * files, and compared.
+ */
+#define NF_SNAP_RANGE_MAX	(1 << 20)	/* Registers per range */
+#define NF_SNAP_DESIGN_LEN	120		/* NF2_DEVICE_STR_LEN */
+
+struct nf_snap_reg {
+	uint32_t		 nsr_reg;
+	uint32_t		 nsr_value;
+	char			*nsr_name;	/* NULL if added by offset */
+};
+
+struct nf_snap {
+	struct netfpga		*ns_nf;		/* For errors */
+	uint64_t		 ns_time;	/* ns since the Epoch */
+	uint32_t		 ns_read_ns;	/* Reading took */
+	char			 ns_design[NF_SNAP_DESIGN_LEN];
+	char			 ns_module[16];
+	int			 ns_num;
+	int			 ns_size;
+	int			 ns_sorted;
+	struct nf_snap_reg	*ns_regs;	/* By offset once read */
+	struct nf_regop		*ns_ops;
+};
+
+/* One difference; ONLY_* on either side means added or removed */
+struct nf_snap_diff {
+	uint32_t		 nsd_reg;
+	const char		*nsd_name;
+	uint32_t		 nsd_old;
+	uint32_t		 nsd_new;
+	int			 nsd_flags;
+#define NF_SNAP_ONLY_OLD	0x01
+#define NF_SNAP_ONLY_NEW	0x02
+#define NF_SNAP_COUNTER		0x04	/* By name, see nf_snap_counter() */
+#define NF_SNAP_WRAPPED		0x08	/* Counter went down: wrap or reset */
+	uint32_t		 nsd_delta;	/* Counters, modulo 2^32 */
+	double			 nsd_rate;	/* Counters, per second */
+};
+
+struct nf_snap *nf_snap_new(struct netfpga *nf);
+void nf_snap_free(struct nf_snap *s);
+void nf_snap_add(struct nf_snap *s, const char *name, uint32_t reg);
+int nf_snap_add_range(struct nf_snap *s, uint32_t lo, uint32_t hi);
+int nf_snap_add_catalog(struct nf_snap *s);
+int nf_snap_read(struct nf_snap *s);
+int nf_snap_save(struct nf_snap *s, const char *fname);
+struct nf_snap *nf_snap_load(struct netfpga *nf, const char *fname);
+int nf_snap_counter(const char *name);
+int nf_snap_diff(const struct nf_snap *old, const struct nf_snap *new,
+    struct nf_snap_diff *diffs, int diffs_num);
+
+/*
+ * Host model of the reference router's datapath. It's built from the
+ * same tables the managers above keep, or read from a card, and counts
+ * what the router's counters would count for a given traffic.
+ */
+#define NF_RM_ARP_MISSES	0	/* ROUTER_OP_LUT_ARP_NUM_MISSES_REG */
+#define NF_RM_LPM_MISSES	1
+#define NF_RM_CPU_PKTS_SENT	2
+#define NF_RM_BAD_OPTS_VER	3
+#define NF_RM_BAD_CHKSUMS	4
+#define NF_RM_BAD_TTLS		5
+#define NF_RM_NON_IP_RCVD	6
+#define NF_RM_PKTS_FORWARDED	7
+#define NF_RM_WRONG_DEST	8
+#define NF_RM_FILTERED_PKTS	9	/* ROUTER_OP_LUT_NUM_FILTERED_PKTS_REG */
+#define NF_RM_CTR_NUM		10
+#define NF_ROUTER_PORTS		4
+
+struct nf_rmodel {
+	struct netfpga		*rm_nf;		/* For errors */
+	struct nf_route		 rm_rt[NF_ROUTER_RT_SIZE];	/* Slot order */
+	int			 rm_rt_num;
+	struct nf_arp		 rm_arp;
+	uint32_t		 rm_filter[NF_FILTER_SIZE];
+	int			 rm_filter_num;
+	uint8_t			 rm_mac[NF_ROUTER_PORTS][6];
+	uint64_t		 rm_ctr[NF_RM_CTR_NUM];
+	uint64_t		 rm_out[NF_ROUTER_PORTS * 2];	/* Per port bit */
+	uint64_t		 rm_dropped;
+};
+
+void nf_rmodel_init(struct nf_rmodel *rm, const struct nf_router *nr,
+    const struct nf_arp *na, const struct nf_filter *fl,
+    uint8_t mac[][6]);
+int nf_rmodel_load(struct netfpga *nf, struct nf_rmodel *rm);
+int nf_rmodel_packet(struct nf_rmodel *rm, uint32_t in_port, uint8_t *pkt,
+    size_t len);
+int nf_rmodel_pcap(struct nf_rmodel *rm, const char *fname, uint32_t in_port,
+    uint64_t *pkts);
+int nf_rmodel_counters(struct netfpga *nf, uint32_t *ctr);
+const char *nf_rmodel_ctr_name(int ctr);
+
 /*
  * Error handling
  */
@@ -183,11 +922,21 @@ int _nf_erri(struct netfpga *nf, const char *func, int lineno,
 	(_nf_erri(nf, __func__, __LINE__, fmt, ## __VA_ARGS__))
 int nf_has_error(struct netfpga *nf);
 const char *nf_strerror(struct netfpga *nf);
+void nf_err_clear(struct netfpga *nf);
 #define NETFPGA_SECTION	"netfpga"
 
 /*
- * Path for module lookup.
+ * Path for module lookup. Directories listed in NETFPGA_PATH_ENV
+ * (colon separated) are searched before the default one. A module
+ * called ``foo'' lives in ``netfpga_foo.so'' and exports ``nf2_foo''.
  */
 #define NETFPGA_PATH_LIB	"."
+#define NETFPGA_PATH_ENV	"NETFPGA_PATH"
+
+/*
+ * Module name which makes nf_start() benchmark all hardware modules
+ * available on this system and pick the fastest one.
+ */
+#define NETFPGA_MODULE_AUTO	"auto"
 
 #endif
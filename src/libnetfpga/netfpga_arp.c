@@ -0,0 +1,395 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * ARP cache manager for the reference router design.
+ *
+ * Hardware looks next hops up in a 32 entry table and sends packets it
+ * can't resolve to the CPU, counting them in ROUTER_OP_LUT_ARP_NUM_MISSES.
+ * We keep a copy of the table with an open addressing hash from next
+ * hop to slot, so lookups and updates don't touch the card. Changes
+ * mark slots dirty and nf_arp_commit() writes all of them in one
+ * nf_regv() batch; several changes to one slot cost one write.
+ *
+ * There's no per-entry hit information in hardware. Users report use
+ * of an entry with nf_arp_touch(), e.g. when a route starts pointing
+ * at it or the slow path sees traffic for it. When the table is full,
+ * the entry with the smallest use count goes, oldest first. Counts are
+ * halved each time nf_arp_sample() finds the miss counter went up, so
+ * when the table is under pressure recent use outweighs old one, and
+ * when it isn't nothing gets aged out for no reason.
+ */
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+/* MAC high, MAC low, next hop: in order they're laid out in */
+#define NF_ARP_REGS_NUM		3
+
+static u_int
+nf_arp_hash(uint32_t ip)
+{
+
+	/* Fibonacci hashing */
+	return ((ip * 2654435761U) >> (32 - NF_ARP_HASH_BITS));
+}
+
+/*
+ * Find hash bucket of ``ip'', or the free one where it would go.
+ */
+static u_int
+nf_arp_bucket(struct nf_arp *na, uint32_t ip)
+{
+	u_int h;
+
+	for (h = nf_arp_hash(ip); na->na_hash[h] != 0;
+	    h = (h + 1) % NF_ARP_HASH_SIZE)
+		if (na->na_ent[na->na_hash[h] - 1].nae_ip == ip)
+			break;
+	return (h);
+}
+
+static void
+nf_arp_hash_del(struct nf_arp *na, uint32_t ip)
+{
+	u_int h, i, want;
+
+	h = nf_arp_bucket(na, ip);
+	ASSERT(na->na_hash[h] != 0);
+	/* Move back entries that probed past the hole */
+	for (i = (h + 1) % NF_ARP_HASH_SIZE; na->na_hash[i] != 0;
+	    i = (i + 1) % NF_ARP_HASH_SIZE) {
+		want = nf_arp_hash(na->na_ent[na->na_hash[i] - 1].nae_ip);
+		if (((i - want) % NF_ARP_HASH_SIZE) <
+		    ((i - h) % NF_ARP_HASH_SIZE))
+			continue;
+		na->na_hash[h] = na->na_hash[i];
+		h = i;
+	}
+	na->na_hash[h] = 0;
+}
+
+static void
+nf_arp_clear_slot(struct nf_arp *na, int s)
+{
+
+	memset(&na->na_ent[s], 0, sizeof(na->na_ent[s]));
+	na->na_dirty |= 1U << s;
+}
+
+/*
+ * Read the hardware table into ``na''.
+ */
+int
+nf_arp_init(struct netfpga *nf, struct nf_arp *na)
+{
+	struct nf_regop ops[NF_ARP_SIZE * (NF_ARP_REGS_NUM + 1) + 1];
+	struct nf_regop *op;
+	struct nf_arp_ent *ae;
+	uint32_t hi, lo;
+	u_int h;
+	int i, j;
+
+	nf_assert(nf);
+	ASSERT(na != NULL);
+	memset(na, 0, sizeof(*na));
+	na->na_nf = nf;
+	op = ops;
+	for (i = 0; i < NF_ARP_SIZE; i++) {
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = ROUTER_OP_LUT_ARP_LUT_RD_ADDR_REG;
+		op->nro_value = i;
+		op++;
+		for (j = 0; j < NF_ARP_REGS_NUM; j++, op++) {
+			op->nro_op = NF_REGOP_READ;
+			op->nro_reg = ROUTER_OP_LUT_ARP_MAC_HI_REG + j * 4;
+			op->nro_value = 0;
+		}
+	}
+	op->nro_op = NF_REGOP_READ;
+	op->nro_reg = ROUTER_OP_LUT_ARP_NUM_MISSES_REG;
+	op++;
+	if (nf_regv(nf, ops, op - ops) != op - ops)
+		return (nf_erri(nf, "Couldn't read the ARP table"));
+	na->na_misses = op[-1].nro_value;
+
+	op = ops;
+	for (i = 0; i < NF_ARP_SIZE; i++, op += NF_ARP_REGS_NUM + 1) {
+		hi = op[1].nro_value;
+		lo = op[2].nro_value;
+		ae = &na->na_ent[i];
+		ae->nae_ip = op[3].nro_value;
+		ae->nae_mac[0] = hi >> 8;
+		ae->nae_mac[1] = hi;
+		for (j = 0; j < 4; j++)
+			ae->nae_mac[2 + j] = lo >> (24 - j * 8);
+		if (ae->nae_ip == 0) {
+			/* Keep junk next to unused entries from confusing us */
+			if (hi != 0 || lo != 0)
+				nf_arp_clear_slot(na, i);
+			continue;
+		}
+		h = nf_arp_bucket(na, ae->nae_ip);
+		if (na->na_hash[h] != 0) {
+			nf_arp_clear_slot(na, i);	/* Duplicate */
+			continue;
+		}
+		ae->nae_flags = NF_ARP_VALID;
+		ae->nae_seq = ++na->na_seq;
+		na->na_hash[h] = i + 1;
+		na->na_num++;
+	}
+	return (0);
+}
+
+/*
+ * Slot holding next hop ``ip'' or -1.
+ */
+int
+nf_arp_lookup(struct nf_arp *na, uint32_t ip)
+{
+	u_int h;
+
+	ASSERT(na != NULL);
+	h = nf_arp_bucket(na, ip);
+	return (na->na_hash[h] - 1);
+}
+
+/*
+ * Slot for a new entry: a free one, preferably already dirty so that
+ * its pending write is reused, or the least used evictable one.
+ */
+static int
+nf_arp_victim(struct nf_arp *na)
+{
+	struct nf_arp_ent *ae, *v;
+	int s, free_s;
+
+	free_s = -1;
+	for (s = 0; s < NF_ARP_SIZE; s++)
+		if (!(na->na_ent[s].nae_flags & NF_ARP_VALID)) {
+			if (na->na_dirty & (1U << s))
+				return (s);
+			if (free_s < 0)
+				free_s = s;
+		}
+	if (free_s >= 0)
+		return (free_s);
+
+	v = NULL;
+	for (s = 0; s < NF_ARP_SIZE; s++) {
+		ae = &na->na_ent[s];
+		if (ae->nae_flags & NF_ARP_STATIC)
+			continue;
+		if (v == NULL || ae->nae_refs < v->nae_refs ||
+		    (ae->nae_refs == v->nae_refs &&
+		    (int32_t)(ae->nae_seq - v->nae_seq) < 0))
+			v = ae;
+	}
+	if (v == NULL)
+		return (-1);
+	DEBUG("Evicting %#x (refs %u)\n", v->nae_ip, v->nae_refs);
+	nf_arp_hash_del(na, v->nae_ip);
+	na->na_num--;
+	na->na_evictions++;
+	return (v - na->na_ent);
+}
+
+/*
+ * Point next hop ``ip'' at ``mac'', adding an entry if there's none.
+ * ``flags'' may have NF_ARP_STATIC. Returns the slot used or -1.
+ */
+int
+nf_arp_set(struct nf_arp *na, uint32_t ip, const uint8_t *mac, int flags)
+{
+	struct nf_arp_ent *ae;
+	u_int h;
+	int s;
+
+	ASSERT(na != NULL);
+	ASSERT(mac != NULL);
+	if (ip == 0)
+		return (nf_erri(na->na_nf, "Next hop 0.0.0.0 marks unused "
+		    "entries"));
+	flags = (flags & NF_ARP_STATIC) | NF_ARP_VALID;
+	h = nf_arp_bucket(na, ip);
+	if (na->na_hash[h] != 0) {
+		s = na->na_hash[h] - 1;
+		ae = &na->na_ent[s];
+		if (memcmp(ae->nae_mac, mac, sizeof(ae->nae_mac)) != 0)
+			na->na_dirty |= 1U << s;
+	} else {
+		s = nf_arp_victim(na);
+		if (s < 0)
+			return (nf_erri(na->na_nf, "ARP table is full of "
+			    "static entries"));
+		/* Eviction may have moved things around */
+		h = nf_arp_bucket(na, ip);
+		na->na_hash[h] = s + 1;
+		na->na_num++;
+		ae = &na->na_ent[s];
+		ae->nae_ip = ip;
+		ae->nae_refs = 1;
+		na->na_dirty |= 1U << s;
+	}
+	memcpy(ae->nae_mac, mac, sizeof(ae->nae_mac));
+	ae->nae_flags = flags;
+	ae->nae_seq = ++na->na_seq;
+	return (s);
+}
+
+/*
+ * Remove entry for next hop ``ip''.
+ */
+int
+nf_arp_del(struct nf_arp *na, uint32_t ip)
+{
+	int s;
+
+	ASSERT(na != NULL);
+	s = nf_arp_lookup(na, ip);
+	if (s < 0)
+		return (nf_erri(na->na_nf, "No ARP entry for %#x", ip));
+	nf_arp_hash_del(na, ip);
+	nf_arp_clear_slot(na, s);
+	na->na_num--;
+	return (0);
+}
+
+/*
+ * Remove all entries, static ones too.
+ */
+void
+nf_arp_flush(struct nf_arp *na)
+{
+	int s;
+
+	ASSERT(na != NULL);
+	for (s = 0; s < NF_ARP_SIZE; s++)
+		if (na->na_ent[s].nae_flags & NF_ARP_VALID)
+			nf_arp_clear_slot(na, s);
+	memset(na->na_hash, 0, sizeof(na->na_hash));
+	na->na_num = 0;
+}
+
+/*
+ * Note that next hop ``ip'' is in use. Unknown ones are ignored.
+ */
+void
+nf_arp_touch(struct nf_arp *na, uint32_t ip)
+{
+	struct nf_arp_ent *ae;
+	int s;
+
+	ASSERT(na != NULL);
+	s = nf_arp_lookup(na, ip);
+	if (s < 0)
+		return;
+	ae = &na->na_ent[s];
+	if (ae->nae_refs < UINT32_MAX)
+		ae->nae_refs++;
+	ae->nae_seq = ++na->na_seq;
+}
+
+/*
+ * Read the miss counter and age use counts if it moved. Number of
+ * misses since the last call is stored in ``misses'' if it's not NULL.
+ */
+int
+nf_arp_sample(struct nf_arp *na, uint32_t *misses)
+{
+	uint32_t cnt, delta;
+	int s;
+
+	ASSERT(na != NULL);
+	if (nf_read(na->na_nf, ROUTER_OP_LUT_ARP_NUM_MISSES_REG, &cnt,
+	    sizeof(cnt)) != sizeof(cnt))
+		return (nf_erri(na->na_nf, "Couldn't read ARP miss counter"));
+	delta = cnt - na->na_misses;
+	na->na_misses = cnt;
+	if (delta != 0)
+		for (s = 0; s < NF_ARP_SIZE; s++)
+			na->na_ent[s].nae_refs >>= 1;
+	if (misses != NULL)
+		*misses = delta;
+	return (0);
+}
+
+/*
+ * Write changed slots to the card. Returns the number of slots written
+ * or -1 on error.
+ */
+int
+nf_arp_commit(struct nf_arp *na)
+{
+	struct nf_regop ops[NF_ARP_SIZE * (NF_ARP_REGS_NUM + 1)];
+	struct nf_regop *op;
+	struct nf_arp_ent *ae;
+	uint32_t val[NF_ARP_REGS_NUM];
+	int s, j;
+
+	ASSERT(na != NULL);
+	nf_assert(na->na_nf);
+	op = ops;
+	for (s = 0; s < NF_ARP_SIZE; s++) {
+		if (!(na->na_dirty & (1U << s)))
+			continue;
+		ae = &na->na_ent[s];
+		val[0] = ae->nae_mac[0] << 8 | ae->nae_mac[1];
+		val[1] = (uint32_t)ae->nae_mac[2] << 24 |
+		    ae->nae_mac[3] << 16 | ae->nae_mac[4] << 8 |
+		    ae->nae_mac[5];
+		val[2] = ae->nae_ip;
+		for (j = 0; j < NF_ARP_REGS_NUM; j++, op++) {
+			op->nro_op = NF_REGOP_WRITE;
+			op->nro_reg = ROUTER_OP_LUT_ARP_MAC_HI_REG + j * 4;
+			op->nro_value = val[j];
+		}
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = ROUTER_OP_LUT_ARP_LUT_WR_ADDR_REG;
+		op->nro_value = s;
+		op++;
+	}
+	na->na_slots_written = (op - ops) / (NF_ARP_REGS_NUM + 1);
+	if (nf_regv(na->na_nf, ops, op - ops) != op - ops)
+		return (nf_erri(na->na_nf, "Couldn't write the ARP table"));
+	na->na_dirty = 0;
+	return (na->na_slots_written);
+}
@@ -111,7 +111,9 @@ nf2_dummy_write(struct netfpga *nf, void *ctx, uint32_t reg, void *buf, size_t b
  * Dummy NetFPGA handler.
  */
 struct nf_module nf2_dummy = {
-	.nf_version =	0,
+	.nf_version =	NETFPGA_MODULE_VERSION,
+	.nf_flags =	0,
+	.nf_name =	"dummy",
 	.nf_open =	nf2_dummy_open,
 	.nf_close = 	nf2_dummy_close,
 	.nf_read =	nf2_dummy_read,
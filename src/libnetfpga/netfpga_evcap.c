@@ -0,0 +1,310 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Event capture of the reference designs.
+ *
+ * The output queues report every packet stored, removed and dropped to
+ * an event capture block, which packs events into UDP packets and sends
+ * them out of the ports in EVT_CAP_OUTPUT_PORTS_REG. Payload of such a
+ * packet is a sequence of 32-bit big-endian words:
+ *
+ *	word 0		version (31:28), number of event words (7:0)
+ *	word 1		sequence number
+ *	words 2-9	occupancy of queues 0-7 in 64-bit words
+ *	words 10-17	occupancy of queues 0-7 in packets
+ *	words 18-	events
+ *
+ * Occupancies are those before the first event of the packet. An event
+ * is one word: type (31:30), queue (29:27), packet length in 64-bit
+ * words (26:19) and time in clock ticks since the last timestamp event
+ * (18:0). A timestamp event (type 0) takes two words and carries the
+ * 62-bit tick counter instead. A tick is 8 ns shifted left by
+ * EVT_CAP_TIMER_RESOLUTION_REG.
+ *
+ * The decoder only ever touches its own state and the caller's output
+ * array, and starts each packet from the occupancies in its header, so
+ * a lost packet costs the events in it and nothing more.
+ */
+#include <sys/types.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+#define NF_EVCAP_VERSION	1
+#define NF_EVCAP_HDR_WORDS	18
+#define NF_EVCAP_TICK_NS	8	/* 125 MHz core clock */
+#define NF_EVCAP_ETHERTYPE_IP	0x0800
+
+#define NF_EVCAP_ETH_HDR_LEN	14
+#define NF_EVCAP_UDP_HDR_LEN	8
+
+static inline uint32_t
+nf_evcap_word(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (ntohl(v));
+}
+
+/*
+ * Program event capture with ``cfg'' and start it. Capture is stopped
+ * while registers change, and timers are reset, so the first timestamp
+ * event starts from zero.
+ */
+int
+nf_evcap_config(struct netfpga *nf, const struct nf_evcap_cfg *cfg)
+{
+	struct nf_regop ops[16], *op;
+	const uint8_t *m;
+
+	nf_assert(nf);
+	ASSERT(cfg != NULL);
+	if (cfg->nec_resolution > NF_EVCAP_RES_MAX)
+		return (nf_erri(nf, "Timer resolution %u is above %d",
+		    cfg->nec_resolution, NF_EVCAP_RES_MAX));
+	op = ops;
+#define NF_EVCAP_WR(r, v)	do {					\
+	op->nro_op = NF_REGOP_WRITE;					\
+	op->nro_reg = (r);						\
+	op->nro_value = (v);						\
+	op++;								\
+} while (0)
+	NF_EVCAP_WR(EVT_CAP_ENABLE_CAPTURE_REG, 0);
+	m = cfg->nec_dst_mac;
+	NF_EVCAP_WR(EVT_CAP_DST_MAC_HI_REG, m[0] << 8 | m[1]);
+	NF_EVCAP_WR(EVT_CAP_DST_MAC_LO_REG,
+	    (uint32_t)m[2] << 24 | m[3] << 16 | m[4] << 8 | m[5]);
+	m = cfg->nec_src_mac;
+	NF_EVCAP_WR(EVT_CAP_SRC_MAC_HI_REG, m[0] << 8 | m[1]);
+	NF_EVCAP_WR(EVT_CAP_SRC_MAC_LO_REG,
+	    (uint32_t)m[2] << 24 | m[3] << 16 | m[4] << 8 | m[5]);
+	NF_EVCAP_WR(EVT_CAP_ETHERTYPE_REG, NF_EVCAP_ETHERTYPE_IP);
+	NF_EVCAP_WR(EVT_CAP_IP_DST_REG, cfg->nec_ip_dst);
+	NF_EVCAP_WR(EVT_CAP_IP_SRC_REG, cfg->nec_ip_src);
+	NF_EVCAP_WR(EVT_CAP_UDP_SRC_PORT_REG, cfg->nec_udp_src);
+	NF_EVCAP_WR(EVT_CAP_UDP_DST_PORT_REG, cfg->nec_udp_dst);
+	NF_EVCAP_WR(EVT_CAP_OUTPUT_PORTS_REG, cfg->nec_output_ports);
+	NF_EVCAP_WR(EVT_CAP_MONITOR_MASK_REG, cfg->nec_monitor_mask);
+	NF_EVCAP_WR(EVT_CAP_SIGNAL_ID_MASK_REG, cfg->nec_queue_mask);
+	NF_EVCAP_WR(EVT_CAP_TIMER_RESOLUTION_REG, cfg->nec_resolution);
+	NF_EVCAP_WR(EVT_CAP_RESET_TIMERS_REG, 1);
+	NF_EVCAP_WR(EVT_CAP_ENABLE_CAPTURE_REG, 1);
+#undef NF_EVCAP_WR
+	ASSERT(op - ops <= (int)(sizeof(ops) / sizeof(ops[0])));
+	if (nf_regv(nf, ops, op - ops) != op - ops)
+		return (nf_erri(nf, "Couldn't configure event capture"));
+	return (0);
+}
+
+/*
+ * Stop event capture. If ``flush'' is set, events collected so far are
+ * sent out in a last, possibly short, packet.
+ */
+int
+nf_evcap_stop(struct netfpga *nf, int flush)
+{
+	struct nf_regop ops[2];
+	int n;
+
+	nf_assert(nf);
+	n = 0;
+	ops[n].nro_op = NF_REGOP_WRITE;
+	ops[n].nro_reg = EVT_CAP_ENABLE_CAPTURE_REG;
+	ops[n++].nro_value = 0;
+	if (flush) {
+		ops[n].nro_op = NF_REGOP_WRITE;
+		ops[n].nro_reg = EVT_CAP_SEND_PKT_REG;
+		ops[n++].nro_value = 1;
+	}
+	if (nf_regv(nf, ops, n) != n)
+		return (nf_erri(nf, "Couldn't stop event capture"));
+	return (0);
+}
+
+/*
+ * Read event capture counters in one batch.
+ */
+int
+nf_evcap_stats(struct netfpga *nf, struct nf_evcap_stats *st)
+{
+	struct nf_regop ops[3];
+	int i;
+
+	nf_assert(nf);
+	ASSERT(st != NULL);
+	ops[0].nro_reg = EVT_CAP_NUM_EVT_PKTS_SENT_REG;
+	ops[1].nro_reg = EVT_CAP_NUM_EVTS_SENT_REG;
+	ops[2].nro_reg = EVT_CAP_NUM_EVTS_DROPPED_REG;
+	for (i = 0; i < 3; i++) {
+		ops[i].nro_op = NF_REGOP_READ;
+		ops[i].nro_value = 0;
+	}
+	if (nf_regv(nf, ops, 3) != 3)
+		return (nf_erri(nf, "Couldn't read event capture counters"));
+	st->nes_pkts_sent = ops[0].nro_value;
+	st->nes_evts_sent = ops[1].nro_value;
+	st->nes_evts_dropped = ops[2].nro_value;
+	return (0);
+}
+
+/*
+ * Return UDP payload of Ethernet frame ``frame'' if it's an IPv4 UDP
+ * datagram to ``port'' (any port if 0), NULL otherwise.
+ */
+const uint8_t *
+nf_evcap_udp(const uint8_t *frame, size_t len, uint16_t port,
+    size_t *plen)
+{
+	const uint8_t *ip, *udp;
+	size_t ihl, ulen;
+
+	ASSERT(frame != NULL);
+	ASSERT(plen != NULL);
+	if (len < NF_EVCAP_ETH_HDR_LEN + 20 + NF_EVCAP_UDP_HDR_LEN ||
+	    (frame[12] << 8 | frame[13]) != NF_EVCAP_ETHERTYPE_IP)
+		return (NULL);
+	ip = frame + NF_EVCAP_ETH_HDR_LEN;
+	ihl = (ip[0] & 0x0f) * 4;
+	if ((ip[0] >> 4) != 4 || ihl < 20 || ip[9] != IPPROTO_UDP ||
+	    len < NF_EVCAP_ETH_HDR_LEN + ihl + NF_EVCAP_UDP_HDR_LEN)
+		return (NULL);
+	udp = ip + ihl;
+	if (port != 0 && (udp[2] << 8 | udp[3]) != port)
+		return (NULL);
+	ulen = udp[4] << 8 | udp[5];
+	len -= NF_EVCAP_ETH_HDR_LEN + ihl;
+	if (ulen < NF_EVCAP_UDP_HDR_LEN || ulen > len)
+		return (NULL);
+	*plen = ulen - NF_EVCAP_UDP_HDR_LEN;
+	return (udp + NF_EVCAP_UDP_HDR_LEN);
+}
+
+void
+nf_evcap_dec_init(struct nf_evcap_dec *dec, unsigned resolution)
+{
+
+	ASSERT(dec != NULL);
+	ASSERT(resolution <= NF_EVCAP_RES_MAX);
+	memset(dec, 0, sizeof(*dec));
+	dec->ned_tick_ns = NF_EVCAP_TICK_NS << resolution;
+}
+
+/*
+ * Decode one event packet payload into at most ``out_num'' events in
+ * ``out''. Timestamp events only move the clock and aren't stored.
+ * Returns number of events stored, or -1 if the payload isn't an event
+ * packet or doesn't fit, which is counted in ned_bad.
+ */
+int
+nf_evcap_decode(struct nf_evcap_dec *dec, const uint8_t *payload,
+    size_t len, struct nf_evt *out, int out_num)
+{
+	const uint8_t *p, *end;
+	uint64_t ts, tick_ns;
+	uint32_t w, seq, occ[NF_EVCAP_QUEUES], blen;
+	unsigned q, type;
+	int i, n, words;
+
+	ASSERT(dec != NULL);
+	ASSERT(payload != NULL);
+	ASSERT(out != NULL || out_num == 0);
+	if (len < NF_EVCAP_HDR_WORDS * 4) {
+		dec->ned_bad++;
+		return (-1);
+	}
+	w = nf_evcap_word(payload);
+	words = w & 0xff;
+	if ((w >> 28) != NF_EVCAP_VERSION ||
+	    len < (size_t)(NF_EVCAP_HDR_WORDS + words) * 4) {
+		dec->ned_bad++;
+		return (-1);
+	}
+	seq = nf_evcap_word(payload + 4);
+	if (dec->ned_pkts != 0 && seq != dec->ned_seq)
+		dec->ned_lost += seq - dec->ned_seq;
+	dec->ned_seq = seq + 1;
+	dec->ned_pkts++;
+	for (q = 0; q < NF_EVCAP_QUEUES; q++)
+		occ[q] = nf_evcap_word(payload + 8 + q * 4) * 8;
+
+	ts = dec->ned_ticks;
+	tick_ns = dec->ned_tick_ns;
+	p = payload + NF_EVCAP_HDR_WORDS * 4;
+	end = p + words * 4;
+	n = 0;
+	while (p < end) {
+		w = nf_evcap_word(p);
+		p += 4;
+		type = w >> 30;
+		if (type == NF_EVT_TIMESTAMP) {
+			if (p == end)
+				break;
+			ts = (uint64_t)(w & 0x3fffffff) << 32 |
+			    nf_evcap_word(p);
+			p += 4;
+			continue;
+		}
+		if (n == out_num) {
+			dec->ned_overflows++;
+			break;
+		}
+		q = (w >> 27) & 0x7;
+		blen = ((w >> 19) & 0xff) * 8;
+		if (type == NF_EVT_STORE)
+			occ[q] += blen;
+		else if (type == NF_EVT_REMOVE)
+			occ[q] = occ[q] > blen ? occ[q] - blen : 0;
+		out[n].ne_time = (ts + (w & 0x7ffff)) * tick_ns;
+		out[n].ne_occ = occ[q];
+		out[n].ne_queue = q;
+		out[n].ne_type = type;
+		out[n].ne_len = blen;
+		n++;
+	}
+	dec->ned_ticks = ts;
+	for (i = 0; i < NF_EVCAP_QUEUES; i++)
+		dec->ned_occ[i] = occ[i];
+	dec->ned_events += n;
+	return (n);
+}
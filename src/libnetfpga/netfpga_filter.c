@@ -0,0 +1,267 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Destination IP filter manager for the reference router design.
+ *
+ * The filter is a plain set of addresses, so a reload doesn't need to
+ * move anything: addresses already in hardware keep their slots, new
+ * ones take the slots of addresses which went away, and only those
+ * slots are written (IP, then WR_ADDR), all in one nf_regv() batch.
+ */
+#include <sys/types.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+static int
+nf_filter_find(struct nf_filter *fl, uint32_t ip)
+{
+	int i;
+
+	for (i = 0; i < fl->nfl_ips_num; i++)
+		if (fl->nfl_ips[i] == ip)
+			return (i);
+	return (-1);
+}
+
+/*
+ * Read the hardware filter into ``fl'' and start with addresses found
+ * there.
+ */
+int
+nf_filter_init(struct netfpga *nf, struct nf_filter *fl)
+{
+	struct nf_regop ops[NF_FILTER_SIZE * 2];
+	struct nf_regop *op;
+	int i;
+
+	nf_assert(nf);
+	ASSERT(fl != NULL);
+	memset(fl, 0, sizeof(*fl));
+	fl->nfl_nf = nf;
+	op = ops;
+	for (i = 0; i < NF_FILTER_SIZE; i++) {
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = ROUTER_OP_LUT_DST_IP_FILTER_RD_ADDR_REG;
+		op->nro_value = i;
+		op++;
+		op->nro_op = NF_REGOP_READ;
+		op->nro_reg = ROUTER_OP_LUT_DST_IP_FILTER_IP_REG;
+		op->nro_value = 0;
+		op++;
+	}
+	if (nf_regv(nf, ops, op - ops) != op - ops)
+		return (nf_erri(nf, "Couldn't read the filter table"));
+	for (i = 0; i < NF_FILTER_SIZE; i++) {
+		fl->nfl_hw[i] = ops[i * 2 + 1].nro_value;
+		if (fl->nfl_hw[i] != 0 &&
+		    nf_filter_find(fl, fl->nfl_hw[i]) < 0)
+			fl->nfl_ips[fl->nfl_ips_num++] = fl->nfl_hw[i];
+	}
+	return (0);
+}
+
+/*
+ * Add address ``ip'' (host byte order) to the filter. Adding one that's
+ * there already is fine.
+ */
+int
+nf_filter_add(struct nf_filter *fl, uint32_t ip)
+{
+
+	ASSERT(fl != NULL);
+	if (ip == 0)
+		return (nf_erri(fl->nfl_nf, "0.0.0.0 marks unused slots"));
+	if (nf_filter_find(fl, ip) >= 0)
+		return (0);
+	if (fl->nfl_ips_num == NF_FILTER_SIZE)
+		return (nf_erri(fl->nfl_nf, "Filter is full (%d addresses)",
+		    NF_FILTER_SIZE));
+	fl->nfl_ips[fl->nfl_ips_num++] = ip;
+	return (0);
+}
+
+int
+nf_filter_del(struct nf_filter *fl, uint32_t ip)
+{
+	int i;
+
+	ASSERT(fl != NULL);
+	i = nf_filter_find(fl, ip);
+	if (i < 0)
+		return (nf_erri(fl->nfl_nf, "Address %#x isn't filtered",
+		    ip));
+	fl->nfl_ips[i] = fl->nfl_ips[--fl->nfl_ips_num];
+	return (0);
+}
+
+void
+nf_filter_flush(struct nf_filter *fl)
+{
+
+	ASSERT(fl != NULL);
+	fl->nfl_ips_num = 0;
+}
+
+/*
+ * Replace wanted addresses with ones from file ``fname'': one address
+ * per line, '#' starts a comment. Nothing changes on error.
+ */
+int
+nf_filter_load(struct nf_filter *fl, const char *fname)
+{
+	struct nf_filter tmp;
+	struct in_addr in;
+	char line[128], *s, *e;
+	FILE *fp;
+	int lineno, ret;
+
+	ASSERT(fl != NULL);
+	ASSERT(fname != NULL);
+	fp = fopen(fname, "r");
+	if (fp == NULL)
+		return (nf_erri(fl->nfl_nf, "Couldn't open '%s': %s", fname,
+		    strerror(errno)));
+	tmp = *fl;
+	nf_filter_flush(&tmp);
+	ret = 0;
+	for (lineno = 1; ret == 0 && fgets(line, sizeof(line), fp) != NULL;
+	    lineno++) {
+		if ((s = strchr(line, '#')) != NULL)
+			*s = '\0';
+		for (s = line; isspace((unsigned char)*s); s++)
+			;
+		for (e = s; *e != '\0' && !isspace((unsigned char)*e); e++)
+			;
+		*e = '\0';
+		if (*s == '\0')
+			continue;
+		if (inet_pton(AF_INET, s, &in) != 1)
+			ret = nf_erri(fl->nfl_nf, "%s:%d: Bad address '%s'",
+			    fname, lineno, s);
+		else if (in.s_addr == INADDR_ANY)
+			ret = nf_erri(fl->nfl_nf, "%s:%d: 0.0.0.0 can't be "
+			    "filtered", fname, lineno);
+		else if (tmp.nfl_ips_num == NF_FILTER_SIZE &&
+		    nf_filter_find(&tmp, ntohl(in.s_addr)) < 0)
+			ret = nf_erri(fl->nfl_nf, "%s:%d: More than %d "
+			    "addresses", fname, lineno, NF_FILTER_SIZE);
+		else
+			ret = nf_filter_add(&tmp, ntohl(in.s_addr));
+	}
+	fclose(fp);
+	if (ret == 0)
+		*fl = tmp;
+	return (ret);
+}
+
+/*
+ * Make the hardware filter hold wanted addresses. Returns the number
+ * of slots written or -1 on error.
+ */
+int
+nf_filter_commit(struct nf_filter *fl)
+{
+	struct nf_regop ops[NF_FILTER_SIZE * 2];
+	struct nf_regop *op;
+	uint32_t layout[NF_FILTER_SIZE];
+	int placed[NF_FILTER_SIZE];
+	int i, s;
+
+	ASSERT(fl != NULL);
+	nf_assert(fl->nfl_nf);
+	memset(placed, 0, sizeof(placed));
+	memset(layout, 0, sizeof(layout));
+	for (s = 0; s < NF_FILTER_SIZE; s++) {
+		if (fl->nfl_hw[s] == 0)
+			continue;
+		i = nf_filter_find(fl, fl->nfl_hw[s]);
+		if (i >= 0 && !placed[i]) {
+			layout[s] = fl->nfl_hw[s];
+			placed[i] = 1;
+		}
+	}
+	/* Prefer slots which are empty already; they needn't be cleared */
+	i = 0;
+	for (s = 0; s < NF_FILTER_SIZE && i < fl->nfl_ips_num; s++) {
+		if (layout[s] != 0 || fl->nfl_hw[s] != 0)
+			continue;
+		for (; i < fl->nfl_ips_num && placed[i]; i++)
+			;
+		if (i < fl->nfl_ips_num) {
+			layout[s] = fl->nfl_ips[i];
+			placed[i] = 1;
+		}
+	}
+	for (s = 0; s < NF_FILTER_SIZE && i < fl->nfl_ips_num; s++) {
+		if (layout[s] != 0)
+			continue;
+		for (; i < fl->nfl_ips_num && placed[i]; i++)
+			;
+		if (i < fl->nfl_ips_num) {
+			layout[s] = fl->nfl_ips[i];
+			placed[i] = 1;
+		}
+	}
+
+	op = ops;
+	for (s = 0; s < NF_FILTER_SIZE; s++) {
+		if (layout[s] == fl->nfl_hw[s])
+			continue;
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = ROUTER_OP_LUT_DST_IP_FILTER_IP_REG;
+		op->nro_value = layout[s];
+		op++;
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = ROUTER_OP_LUT_DST_IP_FILTER_WR_ADDR_REG;
+		op->nro_value = s;
+		op++;
+	}
+	fl->nfl_slots_written = (op - ops) / 2;
+	if (nf_regv(fl->nfl_nf, ops, op - ops) != op - ops)
+		return (nf_erri(fl->nfl_nf, "Couldn't write the filter table"));
+	memcpy(fl->nfl_hw, layout, sizeof(fl->nfl_hw));
+	return (fl->nfl_slots_written);
+}
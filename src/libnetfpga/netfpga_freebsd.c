@@ -31,8 +31,11 @@
 #ifdef __FreeBSD__
 #include <sys/types.h>
 #include <sys/ioccom.h>
+#include <sys/mman.h>
 
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -42,6 +45,7 @@
 #include "../../include/nf2_common.h"
 #include "../../include/nf2.h"
 #include "../../include/netfpga_freebsd.h"
+#include "../../include/reg_defines.h"
 
 #include "netfpga.h"
 
@@ -51,11 +55,56 @@ nf_open_t nf2_freebsd_open;
 nf_close_t nf2_freebsd_close;
 nf_read_t nf2_freebsd_read;
 nf_write_t nf2_freebsd_write;
+nf_intr_t nf2_freebsd_intr;
+nf_regv_t nf2_freebsd_regv;
+nf_mem_t nf2_freebsd_mem;
+nf_link_t nf2_freebsd_link;
+
+nf_open_t nf2_freebsd_mmap_open;
+nf_close_t nf2_freebsd_mmap_close;
+nf_read_t nf2_freebsd_mmap_read;
+nf_write_t nf2_freebsd_mmap_write;
 
 struct nf_softc {
 	int fd;
+	int no_regv;			/* Driver lacks SIOCREGRWV */
+	int no_mem;			/* Driver lacks SIOCMEMRW */
+	int no_link;			/* Driver lacks SIOCLINK */
+	volatile uint32_t *regs;	/* mmap()ed BAR, if any */
+	size_t regs_len;
 };
 
+/*
+ * Find out if the driver has SIOCREGRWV, SIOCMEMRW and SIOCLINK, newer
+ * than SIOCREGREAD and SIOCREGWRITE. Older drivers fail them with
+ * EINVAL, from their offset check or switch default, and newer ones
+ * fail what they lack with ENOTTY. The probes are empty, so a driver
+ * which has them does no I/O.
+ */
+static void
+nf2_freebsd_probe(struct nf_softc *sc)
+{
+	struct nf_reqv reqv;
+	struct nf_reqm reqm;
+	struct nf_reqlink reql;
+
+	memset(&reqv, 0, sizeof(reqv));
+	if (ioctl(sc->fd, SIOCREGRWV, &reqv) != 0 &&
+	    (errno == EINVAL || errno == ENOTTY))
+		sc->no_regv = 1;
+	memset(&reqm, 0, sizeof(reqm));
+	if (ioctl(sc->fd, SIOCMEMRW, &reqm) != 0 &&
+	    (errno == EINVAL || errno == ENOTTY))
+		sc->no_mem = 1;
+	memset(&reql, 0, sizeof(reql));
+	if (ioctl(sc->fd, SIOCLINK, &reql) != 0 &&
+	    (errno == EINVAL || errno == ENOTTY))
+		sc->no_link = 1;
+	DEBUG("Driver has%s SIOCREGRWV,%s SIOCMEMRW,%s SIOCLINK\n",
+	    sc->no_regv ? " no" : "", sc->no_mem ? " no" : "",
+	    sc->no_link ? " no" : "");
+}
+
 /*
  * Open one of "/dev/netfpga[0-9]+" devices
  */
@@ -76,6 +125,7 @@ nf2_freebsd_open(struct netfpga *nf)
 		free(sc);
 		return (NULL);
 	}
+	nf2_freebsd_probe(sc);
 	return (sc);
 }
 
@@ -137,7 +187,7 @@ nf2_freebsd_read(struct netfpga *nf, void *ctx, uint32_t reg, void *buf,
 	 * Read data
 	 */
 	bytes_read = 0;
-	for (u32 = buf, i = 0; i < buf_len / 4; i += 4) {
+	for (u32 = buf, i = 0; i < buf_len; i += 4, u32++) {
 		req.offset = reg + i;
 		error = ioctl(sc->fd, SIOCREGREAD, &req);
 		ASSERT(error == 0);
@@ -172,7 +222,7 @@ nf2_freebsd_write(struct netfpga *nf, void *ctx, uint32_t reg, void *buf, size_t
 		return (nf_erri(nf, "Buffer length must be a multiple of 4 bytes"));
 	
 	written = 0;
-	for (u32 = buf, i = 0; i < buf_len / 4; i += 4) {
+	for (u32 = buf, i = 0; i < buf_len; i += 4) {
 		req.offset = reg + i;
 		req.value = *u32++;
 		error = ioctl(sc->fd, SIOCREGWRITE, &req);
@@ -185,14 +235,286 @@ nf2_freebsd_write(struct netfpga *nf, void *ctx, uint32_t reg, void *buf, size_t
 	return (written);
 }
 
+/*
+ * Open the device and map card's registers to our address space. It
+ * requires the driver with d_mmap() support.
+ */
+void *
+nf2_freebsd_mmap_open(struct netfpga *nf)
+{
+	struct nf_softc *sc;
+	struct nf_req req;
+	void *regs;
+	int error;
+
+	sc = nf2_freebsd_open(nf);
+	if (sc == NULL)
+		return (NULL);
+	memset(&req, 0, sizeof(req));
+	error = ioctl(sc->fd, SIOCMEMSIZE, &req);
+	if (error != 0 || req.value == 0) {
+		(void)nf_erri(nf, "Driver doesn't report its memory size");
+		goto errout;
+	}
+	regs = mmap(NULL, req.value, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    sc->fd, 0);
+	if (regs == MAP_FAILED) {
+		(void)nf_erri(nf, "Couldn't mmap() card's registers");
+		goto errout;
+	}
+	sc->regs = regs;
+	sc->regs_len = req.value;
+	return (sc);
+errout:
+	(void)nf2_freebsd_close(nf, sc);
+	return (NULL);
+}
+
+/*
+ * Unmap registers and close the device.
+ */
+int
+nf2_freebsd_mmap_close(struct netfpga *nf, void *ctx)
+{
+	struct nf_softc *sc;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	if (sc->regs != NULL)
+		(void)munmap((void *)(uintptr_t)sc->regs, sc->regs_len);
+	return (nf2_freebsd_close(nf, sc));
+}
+
+/*
+ * Programming writes must go through the driver, which saves PCI
+ * configuration and resets the card once we're done. A block write is
+ * sent there if any word of it lands in the programming registers.
+ */
+static int
+nf2_freebsd_mmap_viadrv(uint32_t reg, size_t len)
+{
+	uint64_t end;
+
+	end = (uint64_t)reg + len;
+	return ((reg <= CPCI_REG_PROG_DATA && end > CPCI_REG_PROG_DATA) ||
+	    (reg <= VIRTEX_PROGRAM_RAM_BASE_ADDR + CPCI_BIN_SIZE &&
+	    end > VIRTEX_PROGRAM_RAM_BASE_ADDR));
+}
+
+/*
+ * Read registers straight from the mapping.
+ */
+int
+nf2_freebsd_mmap_read(struct netfpga *nf, void *ctx, uint32_t reg, void *buf,
+    size_t buf_len)
+{
+	struct nf_softc *sc;
+	uint32_t *u32;
+	unsigned int i;
+
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	if (buf_len % 4 != 0)
+		return (nf_erri(nf, "Buffer length must be a multiple of"
+		    " 4 bytes"));
+	if ((size_t)reg + buf_len > sc->regs_len)
+		return (nf_erri(nf, "Register %#x out of range", reg));
+	u32 = buf;
+	for (i = 0; i < buf_len / 4; i++)
+		u32[i] = sc->regs[reg / 4 + i];
+	return (buf_len);
+}
+
+/*
+ * Write registers straight to the mapping.
+ */
+int
+nf2_freebsd_mmap_write(struct netfpga *nf, void *ctx, uint32_t reg, void *buf,
+    size_t buf_len)
+{
+	struct nf_softc *sc;
+	uint32_t *u32;
+	unsigned int i;
+
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	if (nf2_freebsd_mmap_viadrv(reg, buf_len))
+		return (nf2_freebsd_write(nf, ctx, reg, buf, buf_len));
+	if (buf_len % 4 != 0)
+		return (nf_erri(nf, "Buffer length must be a multiple of"
+		    " 4 bytes"));
+	if ((size_t)reg + buf_len > sc->regs_len)
+		return (nf_erri(nf, "Register %#x out of range", reg));
+	u32 = buf;
+	for (i = 0; i < buf_len / 4; i++)
+		sc->regs[reg / 4 + i] = u32[i];
+	return (buf_len);
+}
+
+/*
+ * Wait for the driver to latch interrupt status bits and fetch them.
+ * Drivers without SIOCEVENTS make us report that interrupts aren't
+ * available, so that the caller falls back to polling.
+ */
+int
+nf2_freebsd_intr(struct netfpga *nf, void *ctx, uint32_t *status, int timeout)
+{
+	struct nf_softc *sc;
+	struct pollfd pfd;
+	struct nf_req req;
+	int ret;
+
+	ASSERT(ctx != NULL);
+	ASSERT(status != NULL);
+	sc = ctx;
+	pfd.fd = sc->fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	ret = poll(&pfd, 1, timeout);
+	if (ret < 0)
+		return (nf_erri(nf, "poll() on NetFPGA device failed"));
+	if (ret == 0)
+		return (0);
+	req.offset = ~0U;
+	req.value = 0;
+	if (ioctl(sc->fd, SIOCEVENTS, &req) == -1)
+		return (-1);
+	*status = req.value;
+	return (1);
+}
+
+/*
+ * Pass batches of register operations to the driver in as few ioctl()
+ * calls as possible. Drivers without SIOCREGRWV, or batches touching
+ * programming registers, are handled one operation at a time. Other
+ * errors, like a bad register, are reported.
+ */
+int
+nf2_freebsd_regv(struct netfpga *nf, void *ctx, struct nf_regop *ops,
+    int ops_num)
+{
+	struct nf_softc *sc;
+	struct nf_reqv reqv;
+	struct nf_req req;
+	int i, n, prog, error;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	/* The driver refuses programming registers in batches */
+	prog = 0;
+	for (i = 0; i < ops_num; i++)
+		if (nf2_freebsd_mmap_viadrv(ops[i].nro_reg, 4))
+			prog = 1;
+	for (i = 0; i < ops_num && !sc->no_regv && !prog; i += n) {
+		n = ops_num - i;
+		if (n > NF_REQV_MAX)
+			n = NF_REQV_MAX;
+		memset(&reqv, 0, sizeof(reqv));
+		reqv.ents = (uintptr_t)&ops[i];
+		reqv.num = n;
+		error = ioctl(sc->fd, SIOCREGRWV, &reqv);
+		if (error != 0)
+			return (nf_erri(nf, "Couldn't access %d registers at "
+			    "%#x: %s", n, ops[i].nro_reg, strerror(errno)));
+	}
+	for (; i < ops_num; i++) {
+		memset(&req, 0, sizeof(req));
+		req.offset = ops[i].nro_reg;
+		req.value = ops[i].nro_value;
+		error = ioctl(sc->fd, ops[i].nro_op == NF_REGOP_READ ?
+		    SIOCREGREAD : SIOCREGWRITE, &req);
+		if (error != 0)
+			return (nf_erri(nf, "Couldn't access register %#x",
+			    ops[i].nro_reg));
+		ops[i].nro_value = req.value;
+	}
+	return (ops_num);
+}
+
+/*
+ * Let the driver copy card's memory in one ioctl(). Drivers without
+ * SIOCMEMRW leave it to nf_regv batches.
+ */
+int
+nf2_freebsd_mem(struct netfpga *nf, void *ctx, int write, uint32_t addr,
+    void *buf, size_t len)
+{
+	struct nf_softc *sc;
+	struct nf_reqm reqm;
+	int error;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	if (sc->no_mem || len == 0)
+		return (0);
+	memset(&reqm, 0, sizeof(reqm));
+	reqm.buf = (uintptr_t)buf;
+	reqm.offset = addr;
+	reqm.len = len;
+	reqm.op = write ? NF_REQV_WRITE : NF_REQV_READ;
+	error = ioctl(sc->fd, SIOCMEMRW, &reqm);
+	if (error != 0)
+		return (nf_erri(nf, "Couldn't %s %zu bytes at %#x: %s",
+		    write ? "write" : "read", len, addr, strerror(errno)));
+	return (len);
+}
+
+/*
+ * Ask the driver's link monitor about ports' links.
+ */
+int
+nf2_freebsd_link(struct netfpga *nf, void *ctx, uint32_t *up,
+    uint32_t *changes)
+{
+	struct nf_softc *sc;
+	struct nf_reqlink reql;
+	int i;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	if (sc->no_link)
+		return (0);
+	memset(&reql, 0, sizeof(reql));
+	if (ioctl(sc->fd, SIOCLINK, &reql) != 0)
+		return (nf_erri(nf, "Couldn't get link state: %s",
+		    strerror(errno)));
+	*up = reql.up;
+	for (i = 0; i < NF_LINK_PORTS; i++)
+		changes[i] = reql.changes[i];
+	return (1);
+}
+
 /*
  * FreeBSD NetFPGA handler
  */
 struct nf_module nf2_freebsd = {
-	.nf_version =	0,
+	.nf_version =	NETFPGA_MODULE_VERSION,
+	.nf_flags =	NF_MODULE_FLAG_HW,
+	.nf_name =	"freebsd",
 	.nf_open =	nf2_freebsd_open,
 	.nf_close = 	nf2_freebsd_close,
 	.nf_read =	nf2_freebsd_read,
 	.nf_write =	nf2_freebsd_write,
+	.nf_intr =	nf2_freebsd_intr,
+	.nf_regv =	nf2_freebsd_regv,
+	.nf_mem =	nf2_freebsd_mem,
+	.nf_link =	nf2_freebsd_link,
+};
+
+/*
+ * FreeBSD NetFPGA handler with memory mapped registers.
+ */
+struct nf_module nf2_freebsd_mmap = {
+	.nf_version =	NETFPGA_MODULE_VERSION,
+	.nf_flags =	NF_MODULE_FLAG_HW | NF_MODULE_FLAG_MMAP,
+	.nf_name =	"freebsd_mmap",
+	.nf_open =	nf2_freebsd_mmap_open,
+	.nf_close = 	nf2_freebsd_mmap_close,
+	.nf_read =	nf2_freebsd_mmap_read,
+	.nf_write =	nf2_freebsd_mmap_write,
+	.nf_intr =	nf2_freebsd_intr,
+	.nf_link =	nf2_freebsd_link,
 };
 #endif /* __FreeBSD__ */
@@ -0,0 +1,235 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Correlation of the card's stamp counter with a host clock.
+ *
+ * The stamp counter is a free-running 96-bit count of 125 MHz core
+ * clock ticks. Writing STAMP_COUNTER_READ_ENABLE latches it into the
+ * STAMP_COUNTER_BIT_* registers, so one nf_regv() batch of a write and
+ * three reads gives a consistent value, latched somewhere between two
+ * host clock reads taken around the batch. The middle of that bracket
+ * is the sample's host time and half its width the sample's error.
+ *
+ * Each sample is the narrowest bracket of NF_HWTIME_TRIES attempts,
+ * which throws away the ones an interrupt or a busy bus stretched. The
+ * fit is least squares of host time over ticks, weighted by inverse
+ * square of bracket width, done relative to the first sample so that
+ * doubles don't lose nanoseconds to 64-bit clock values. Error of a
+ * converted time is the worst residual plus half the widest bracket,
+ * growing with three standard errors of the slope away from the
+ * middle of the samples.
+ */
+#include <sys/types.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+#define NF_HWTIME_TRIES		4
+
+static uint64_t
+nf_hwtime_host(struct nf_hwtime *ht)
+{
+	struct timespec ts;
+
+	clock_gettime((clockid_t)ht->nht_clock, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * Start correlating stamp counter of ``nf'' with host clock ``clock''
+ * (CLOCK_MONOTONIC, CLOCK_REALTIME, ...).
+ */
+void
+nf_hwtime_init(struct netfpga *nf, struct nf_hwtime *ht, int clock)
+{
+
+	nf_assert(nf);
+	ASSERT(ht != NULL);
+	memset(ht, 0, sizeof(*ht));
+	ht->nht_nf = nf;
+	ht->nht_clock = clock;
+}
+
+/*
+ * Latch and read the stamp counter. Bits above 63 are dropped: at 8 ns
+ * a tick, 64 bits last for thousands of years.
+ */
+int
+nf_hwtime_read(struct netfpga *nf, uint64_t *ticks)
+{
+	struct nf_regop ops[4];
+	int i;
+
+	nf_assert(nf);
+	ASSERT(ticks != NULL);
+	ops[0].nro_op = NF_REGOP_WRITE;
+	ops[0].nro_reg = STAMP_COUNTER_READ_ENABLE;
+	ops[0].nro_value = 1;
+	ops[1].nro_reg = STAMP_COUNTER_BIT_95_64;
+	ops[2].nro_reg = STAMP_COUNTER_BIT_63_32;
+	ops[3].nro_reg = STAMP_COUNTER_BIT_31_0;
+	for (i = 1; i < 4; i++) {
+		ops[i].nro_op = NF_REGOP_READ;
+		ops[i].nro_value = 0;
+	}
+	if (nf_regv(nf, ops, 4) != 4)
+		return (nf_erri(nf, "Couldn't read stamp counter"));
+	*ticks = (uint64_t)ops[2].nro_value << 32 | ops[3].nro_value;
+	return (0);
+}
+
+/*
+ * Take one sample and add it to the ring, replacing the oldest one if
+ * it's full.
+ */
+int
+nf_hwtime_sample(struct nf_hwtime *ht)
+{
+	struct nf_hwtime_sample best, *s;
+	uint64_t t0, t1, ticks;
+	int i;
+
+	ASSERT(ht != NULL);
+	best.nhs_width = UINT32_MAX;
+	for (i = 0; i < NF_HWTIME_TRIES; i++) {
+		t0 = nf_hwtime_host(ht);
+		if (nf_hwtime_read(ht->nht_nf, &ticks) != 0)
+			return (-1);
+		t1 = nf_hwtime_host(ht);
+		if (t1 - t0 < best.nhs_width) {
+			best.nhs_ticks = ticks;
+			best.nhs_host = t0 + (t1 - t0) / 2;
+			best.nhs_width = t1 - t0 > 0 ? t1 - t0 : 1;
+		}
+	}
+	s = &ht->nht_samples[ht->nht_next];
+	*s = best;
+	ht->nht_next = (ht->nht_next + 1) % NF_HWTIME_SAMPLES;
+	if (ht->nht_num < NF_HWTIME_SAMPLES)
+		ht->nht_num++;
+	return (0);
+}
+
+/*
+ * Fit host time over ticks to the samples taken so far.
+ */
+int
+nf_hwtime_fit(struct nf_hwtime *ht)
+{
+	struct nf_hwtime_sample *s;
+	double w, x, y, sw, sx, sy, sxx, sxy, d, r, res, var;
+	uint32_t width;
+	int i;
+
+	ASSERT(ht != NULL);
+	if (ht->nht_num < 2)
+		return (nf_erri(ht->nht_nf, "Need two samples to fit, have %d",
+		    ht->nht_num));
+	s = &ht->nht_samples[(ht->nht_next - ht->nht_num +
+	    NF_HWTIME_SAMPLES) % NF_HWTIME_SAMPLES];
+	ht->nht_x0 = s->nhs_ticks;
+	ht->nht_y0 = s->nhs_host;
+
+	sw = sx = sy = sxx = sxy = 0;
+	for (i = 0; i < ht->nht_num; i++) {
+		s = &ht->nht_samples[i];
+		x = (double)(int64_t)(s->nhs_ticks - ht->nht_x0);
+		y = (double)(int64_t)(s->nhs_host - ht->nht_y0);
+		w = 1.0 / ((double)s->nhs_width * s->nhs_width);
+		sw += w;
+		sx += w * x;
+		sy += w * y;
+		sxx += w * x * x;
+		sxy += w * x * y;
+	}
+	d = sw * sxx - sx * sx;
+	if (d <= 0)
+		return (nf_erri(ht->nht_nf,
+		    "Stamp counter didn't move between samples"));
+	ht->nht_slope = (sw * sxy - sx * sy) / d;
+	ht->nht_offset = (sy - ht->nht_slope * sx) / sw;
+	ht->nht_xmean = sx / sw;
+
+	res = var = 0;
+	width = 0;
+	for (i = 0; i < ht->nht_num; i++) {
+		s = &ht->nht_samples[i];
+		x = (double)(int64_t)(s->nhs_ticks - ht->nht_x0);
+		y = (double)(int64_t)(s->nhs_host - ht->nht_y0);
+		r = fabs(y - (ht->nht_offset + ht->nht_slope * x));
+		if (r > res)
+			res = r;
+		var += r * r / ((double)s->nhs_width * s->nhs_width);
+		if (s->nhs_width > width)
+			width = s->nhs_width;
+	}
+	/* Two samples fit exactly; their brackets are all we know */
+	if (ht->nht_num > 2)
+		ht->nht_slope_err = sqrt(var / (ht->nht_num - 2) * sw / d);
+	else
+		ht->nht_slope_err = width / fabs((double)(int64_t)
+		    (ht->nht_samples[1].nhs_ticks -
+		    ht->nht_samples[0].nhs_ticks));
+	ht->nht_err = (uint32_t)ceil(res) + (width + 1) / 2;
+	ht->nht_fitted = 1;
+	return (0);
+}
+
+/*
+ * Convert stamp counter value ``ticks'' to host clock nanoseconds. If
+ * ``err_ns'' isn't NULL, error bound of the result is stored there.
+ */
+uint64_t
+nf_hwtime_to_host(const struct nf_hwtime *ht, uint64_t ticks,
+    uint64_t *err_ns)
+{
+	double x;
+
+	ASSERT(ht != NULL);
+	ASSERT(ht->nht_fitted && "nf_hwtime_fit() hasn't succeeded");
+	x = (double)(int64_t)(ticks - ht->nht_x0);
+	if (err_ns != NULL)
+		*err_ns = ht->nht_err + (uint64_t)ceil(3 * ht->nht_slope_err *
+		    fabs(x - ht->nht_xmean));
+	return (ht->nht_y0 + (int64_t)llround(ht->nht_offset +
+	    ht->nht_slope * x));
+}
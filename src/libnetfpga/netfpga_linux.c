@@ -30,9 +30,14 @@
 
 #ifdef __linux__
 #include <sys/types.h>
+#include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <assert.h>
+#include <dirent.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,63 +50,313 @@
 
 #include "netfpga.h"
 
+/*
+ * Where PCI devices live. Both can be overridden from the environment,
+ * so that a fake tree made of plain files can stand in for the card.
+ */
+#define NETFPGA_LINUX_SYSFS	"/sys/bus/pci/devices"
+#define NETFPGA_LINUX_SYSFS_ENV	"NETFPGA_SYSFS"
+#define NETFPGA_LINUX_DEVDIR	"/dev"
+#define NETFPGA_LINUX_DEVDIR_ENV "NETFPGA_DEVDIR"
+
+#define NF2_PCI_VENDOR		0xfeed
+#define NF2_PCI_DEVICE		0x0001
+
 nf_open_t nf2_linux_open;
 nf_close_t nf2_linux_close;
 nf_read_t nf2_linux_read;
 nf_write_t nf2_linux_write;
+nf_intr_t nf2_linux_intr;
+
+struct nf_softc {
+	int			 fd;		/* resource0 */
+	volatile uint32_t	*regs;
+	size_t			 regs_len;
+	int			 uio_fd;	/* -1 if no UIO driver */
+	char			 path[MAXPATHLEN];
+};
+
+static const char *
+nf2_linux_env(const char *env, const char *def)
+{
+	const char *v;
+
+	v = getenv(env);
+	return (v != NULL ? v : def);
+}
 
 /*
- * Placeholders for NetFPGA Linux handling code
+ * Read a number from sysfs attribute ``file'' of device ``dir''.
+ */
+static int
+nf2_linux_attr(const char *dir, const char *file, unsigned *val)
+{
+	char path[MAXPATHLEN];
+	FILE *fp;
+	int ret;
+
+	if ((size_t)snprintf(path, sizeof(path), "%s/%s", dir, file) >=
+	    sizeof(path))
+		return (-1);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return (-1);
+	ret = fscanf(fp, "%x", val);
+	fclose(fp);
+	return (ret == 1 ? 0 : -1);
+}
+
+/*
+ * Is the device in ``dir'' a NetFPGA card?
+ */
+static int
+nf2_linux_match(const char *dir)
+{
+	unsigned vendor, device;
+
+	if (nf2_linux_attr(dir, "vendor", &vendor) != 0 ||
+	    nf2_linux_attr(dir, "device", &device) != 0)
+		return (0);
+	return (vendor == NF2_PCI_VENDOR && device == NF2_PCI_DEVICE);
+}
+
+/*
+ * Find card's sysfs directory. ``nf_iface'' may name a PCI slot (like
+ * "0000:05:00.0") or a full path; without it first card found is used.
+ */
+static int
+nf2_linux_find(struct netfpga *nf, char *path, size_t path_len)
+{
+	struct dirent **ents;
+	const char *root;
+	int i, n, found;
+
+	root = nf2_linux_env(NETFPGA_LINUX_SYSFS_ENV, NETFPGA_LINUX_SYSFS);
+	if (nf->nf_iface != NULL) {
+		if (strchr(nf->nf_iface, '/') != NULL)
+			n = snprintf(path, path_len, "%s", nf->nf_iface);
+		else
+			n = snprintf(path, path_len, "%s/%s", root,
+			    nf->nf_iface);
+		if ((size_t)n >= path_len)
+			return (nf_erri(nf, "Path of %s is too long",
+			    nf->nf_iface));
+		if (!nf2_linux_match(path))
+			return (nf_erri(nf, "%s isn't a NetFPGA card", path));
+		return (0);
+	}
+
+	n = scandir(root, &ents, NULL, alphasort);
+	if (n < 0)
+		return (nf_erri(nf, "Couldn't list PCI devices in %s", root));
+	found = 0;
+	for (i = 0; i < n; i++) {
+		if (!found && ents[i]->d_name[0] != '.' &&
+		    (size_t)snprintf(path, path_len, "%s/%s", root,
+		    ents[i]->d_name) < path_len)
+			found = nf2_linux_match(path);
+		free(ents[i]);
+	}
+	free(ents);
+	if (!found)
+		return (nf_erri(nf, "No NetFPGA card found in %s", root));
+	return (0);
+}
+
+/*
+ * If the card is bound to a UIO driver (uio_pci_generic), open its
+ * /dev/uioN node for interrupt delivery. It's fine if there's none.
+ */
+static int
+nf2_linux_uio_open(struct nf_softc *sc)
+{
+	char path[MAXPATHLEN];
+	struct dirent *de;
+	DIR *dir;
+	int fd;
+
+	if ((size_t)snprintf(path, sizeof(path), "%s/uio", sc->path) >=
+	    sizeof(path))
+		return (-1);
+	dir = opendir(path);
+	if (dir == NULL)
+		return (-1);
+	fd = -1;
+	while (fd == -1 && (de = readdir(dir)) != NULL) {
+		if (strncmp(de->d_name, "uio", 3) != 0)
+			continue;
+		if ((size_t)snprintf(path, sizeof(path), "%s/%s",
+		    nf2_linux_env(NETFPGA_LINUX_DEVDIR_ENV,
+		    NETFPGA_LINUX_DEVDIR), de->d_name) < sizeof(path))
+			fd = open(path, O_RDWR);
+	}
+	closedir(dir);
+	return (fd);
+}
+
+/*
+ * Find the card and map its registers (BAR0) to our address space.
  */
 void *
 nf2_linux_open(struct netfpga *nf)
 {
+	char path[MAXPATHLEN];
+	struct nf_softc *sc;
+	struct stat st;
+	void *regs;
+
+	sc = calloc(1, sizeof(*sc));
+	ASSERT(sc != NULL);
+	sc->fd = sc->uio_fd = -1;
+	if (nf2_linux_find(nf, sc->path, sizeof(sc->path)) != 0)
+		goto errout;
 
-	(void)nf;
+	if ((size_t)snprintf(path, sizeof(path), "%s/resource0", sc->path) >=
+	    sizeof(path)) {
+		(void)nf_erri(nf, "Path of %s is too long", sc->path);
+		goto errout;
+	}
+	sc->fd = open(path, O_RDWR | O_SYNC);
+	if (sc->fd == -1) {
+		(void)nf_erri(nf, "Couldn't open %s", path);
+		goto errout;
+	}
+	if (fstat(sc->fd, &st) != 0 || st.st_size == 0) {
+		(void)nf_erri(nf, "Couldn't get size of %s", path);
+		goto errout;
+	}
+	regs = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    sc->fd, 0);
+	if (regs == MAP_FAILED) {
+		(void)nf_erri(nf, "Couldn't mmap() %s", path);
+		goto errout;
+	}
+	sc->regs = regs;
+	sc->regs_len = st.st_size;
+	sc->uio_fd = nf2_linux_uio_open(sc);
+	DEBUG("NetFPGA at %s, %zu bytes mapped, UIO %s\n", sc->path,
+	    sc->regs_len, sc->uio_fd != -1 ? "present" : "absent");
+	return (sc);
+errout:
+	if (sc->fd != -1)
+		close(sc->fd);
+	free(sc);
 	return (NULL);
 }
 
+/*
+ * Unmap registers and close everything we've opened.
+ */
 int
 nf2_linux_close(struct netfpga *nf, void *ctx)
 {
+	struct nf_softc *sc;
+	int error;
 
-	(void)nf;
-	(void)ctx;
-	return (0);
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	error = 0;
+	if (sc->uio_fd != -1)
+		(void)close(sc->uio_fd);
+	(void)munmap((void *)(uintptr_t)sc->regs, sc->regs_len);
+	if (close(sc->fd) != 0)
+		error = nf_erri(nf, "Couldn't close %s/resource0", sc->path);
+	free(sc);
+	return (error);
 }
 
+/*
+ * Read ``buf_len'' bytes of registers starting at ``reg''.
+ */
 int
 nf2_linux_read(struct netfpga *nf, void *ctx, uint32_t reg, void *buf, size_t buf_len)
 {
+	struct nf_softc *sc;
+	uint32_t *u32;
+	unsigned int i;
 
-	(void)nf;
-	(void)ctx;
-	(void)reg;
-	(void)buf;
-	(void)buf_len;
-	return (0);
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	if (buf_len % 4 != 0)
+		return (nf_erri(nf, "Buffer length must be a multiple of"
+		    " 4 bytes"));
+	if ((size_t)reg + buf_len > sc->regs_len)
+		return (nf_erri(nf, "Register %#x out of range", reg));
+	u32 = buf;
+	for (i = 0; i < buf_len / 4; i++)
+		u32[i] = sc->regs[reg / 4 + i];
+	return (buf_len);
 }
 
+/*
+ * Write ``buf_len'' bytes of registers starting at ``reg''.
+ */
 int
 nf2_linux_write(struct netfpga *nf, void *ctx, uint32_t reg, void *buf, size_t buf_len)
 {
+	struct nf_softc *sc;
+	uint32_t *u32;
+	unsigned int i;
 
-	(void)nf;
-	(void)ctx;
-	(void)reg;
-	(void)buf;
-	(void)buf_len;
-	return (0);
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	if (buf_len % 4 != 0)
+		return (nf_erri(nf, "Buffer length must be a multiple of"
+		    " 4 bytes"));
+	if ((size_t)reg + buf_len > sc->regs_len)
+		return (nf_erri(nf, "Register %#x out of range", reg));
+	u32 = buf;
+	for (i = 0; i < buf_len / 4; i++)
+		sc->regs[reg / 4 + i] = u32[i];
+	return (buf_len);
+}
+
+/*
+ * Wait for an interrupt delivered through UIO. Writing 1 re-enables
+ * the interrupt, which UIO masks every time it fires.
+ */
+int
+nf2_linux_intr(struct netfpga *nf, void *ctx, uint32_t *status, int timeout)
+{
+	struct nf_softc *sc;
+	struct pollfd pfd;
+	uint32_t cnt;
+	int ret;
+
+	ASSERT(ctx != NULL);
+	ASSERT(status != NULL);
+	sc = ctx;
+	if (sc->uio_fd == -1)
+		return (-1);
+	cnt = 1;
+	(void)write(sc->uio_fd, &cnt, sizeof(cnt));
+	pfd.fd = sc->uio_fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	ret = poll(&pfd, 1, timeout);
+	if (ret < 0)
+		return (nf_erri(nf, "poll() on UIO device failed"));
+	if (ret == 0)
+		return (0);
+	if (read(sc->uio_fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+		return (nf_erri(nf, "Couldn't read UIO interrupt count"));
+	*status = sc->regs[CPCI_REG_INTERRUPT_STATUS / 4];
+	return (1);
 }
 
 /*
  * Linux NetFPGA handler.
  */
 struct nf_module nf2_linux = {
-	.nf_version =	0,
+	.nf_version =	NETFPGA_MODULE_VERSION,
+	.nf_flags =	NF_MODULE_FLAG_HW | NF_MODULE_FLAG_MMAP,
+	.nf_name =	"linux",
 	.nf_open =	nf2_linux_open,
 	.nf_close = 	nf2_linux_close,
 	.nf_read =	nf2_linux_read,
 	.nf_write =	nf2_linux_write,
+	.nf_intr =	nf2_linux_intr,
 };
 #endif
@@ -0,0 +1,1020 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Card of another host, served by "nfutil server". ``nf_iface'' is the
+ * server's host[:port], 127.0.0.1 on port NF_NET_PORT by default, or
+ * path of a UNIX socket. The protocol is described in
+ * include/netfpga_net.h.
+ *
+ * Requests are pipelined: up to NF_NET_WINDOW of them are in flight and
+ * replies are collected only when a result is needed or the window is
+ * full. Writes (nf_write(), memory writes and nf_regv() batches without
+ * reads) are posted that way, so an error of one is reported by the
+ * next call. Transfers bigger than a frame are split into frames which
+ * all go out before the first reply is read.
+ *
+ * The server's side, nf_net_exec(), is here too, and so is the "broker"
+ * module: "net" on nfbrokerd(8)'s UNIX socket, which also reads hot
+ * registers straight from the broker's shared memory.
+ */
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../include/netfpga_net.h"
+
+#include "netfpga.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL	0	/* SO_NOSIGPIPE is set instead */
+#endif
+
+nf_open_t nf2_net_open;
+nf_close_t nf2_net_close;
+nf_read_t nf2_net_read;
+nf_write_t nf2_net_write;
+nf_regv_t nf2_net_regv;
+nf_mem_t nf2_net_mem;
+nf_link_t nf2_net_link;
+nf_open_t nf2_broker_open;
+nf_close_t nf2_broker_close;
+nf_read_t nf2_broker_read;
+nf_regv_t nf2_broker_regv;
+
+#define NF_NET_WINDOW		64	/* Requests in flight */
+#define NF_NET_CHUNK_OPS	1024	/* Register ops the server does at once */
+#define NF_NET_MEM_CHUNK	(NF_NET_PAYLOAD_MAX / 2)
+#define NF_NET_HDR_LEN		sizeof(struct nf_net_hdr)
+#define NF_BROKER_HOT_OPS	64	/* Biggest batch looked up there */
+#define NF_BROKER_STALE		4	/* Ticks hot values are good for */
+
+/* Request waiting for its reply */
+struct nf_net_pend {
+	uint32_t	 np_seq;
+	int		 np_type;
+	void		*np_dst;	/* Where reply's payload goes */
+	size_t		 np_len;	/* Ops for NF_NET_REGV, bytes otherwise */
+};
+
+struct nf_net_softc {
+	int		 fd;
+	uint32_t	 seq;
+	struct nf_net_pend pend[NF_NET_WINDOW];
+	int		 pend_head;
+	int		 pend_num;
+	int32_t		 status;	/* Of the last reply */
+	char		 err[256];	/* Failure of a posted request */
+	uint8_t		 tx[NF_NET_FRAME_MAX];
+	uint8_t		 rx[2 * NF_NET_FRAME_MAX];
+	size_t		 rx_off;
+	size_t		 rx_len;
+	struct nf_broker_hot *hot;	/* Broker's shared memory */
+	int		 wrote;		/* Since hot_after was set */
+	uint64_t	 hot_after;	/* Older hot values miss our writes */
+};
+
+/*
+ * Returns the length of the message at ``buf'' if all of it is within
+ * ``len'' bytes, 0 if more is needed and -1 if it isn't a message.
+ */
+int
+nf_net_frame(const void *buf, size_t len)
+{
+	struct nf_net_hdr h;
+	uint32_t plen;
+
+	ASSERT(buf != NULL || len == 0);
+	if (len < NF_NET_HDR_LEN)
+		return (0);
+	memcpy(&h, buf, sizeof(h));
+	plen = ntohl(h.nnh_len);
+	if (ntohs(h.nnh_magic) != NF_NET_MAGIC ||
+	    h.nnh_version != NF_NET_VERSION || plen > NF_NET_PAYLOAD_MAX)
+		return (-1);
+	if (len < NF_NET_HDR_LEN + plen)
+		return (0);
+	return (NF_NET_HDR_LEN + plen);
+}
+
+static void
+nf_net_hdr_put(void *buf, int type, uint32_t seq, int32_t status,
+    size_t len)
+{
+	struct nf_net_hdr h;
+
+	h.nnh_magic = htons(NF_NET_MAGIC);
+	h.nnh_version = NF_NET_VERSION;
+	h.nnh_type = type;
+	h.nnh_seq = htonl(seq);
+	h.nnh_status = htonl(status);
+	h.nnh_len = htonl(len);
+	memcpy(buf, &h, sizeof(h));
+}
+
+/* Copy ``len'' bytes of 32-bit words, swapping them to or from the wire */
+static void
+nf_net_words(void *dst, const void *src, size_t len, int to_wire)
+{
+	uint32_t w;
+	size_t i;
+
+	for (i = 0; i < len; i += 4) {
+		memcpy(&w, (const uint8_t *)src + i, 4);
+		w = to_wire ? htonl(w) : ntohl(w);
+		memcpy((uint8_t *)dst + i, &w, 4);
+	}
+}
+
+static uint32_t
+nf_net_word(const uint8_t *p)
+{
+	uint32_t w;
+
+	memcpy(&w, p, 4);
+	return (ntohl(w));
+}
+
+static void
+nf_net_word_put(uint8_t *p, uint32_t w)
+{
+
+	w = htonl(w);
+	memcpy(p, &w, 4);
+}
+
+/*----------------------------------------------------------------------------
+ * Client
+ */
+
+static int
+nf_net_recv(struct netfpga *nf, struct nf_net_softc *sc,
+    struct nf_net_hdr *h, uint8_t **payload)
+{
+	ssize_t n;
+	int flen;
+
+	for (;;) {
+		flen = nf_net_frame(sc->rx + sc->rx_off, sc->rx_len);
+		if (flen < 0) {
+			(void)nf_erri(nf, "Garbage from the server");
+			return (-1);
+		}
+		if (flen > 0)
+			break;
+		if (sc->rx_off > 0) {
+			memmove(sc->rx, sc->rx + sc->rx_off, sc->rx_len);
+			sc->rx_off = 0;
+		}
+		n = recv(sc->fd, sc->rx + sc->rx_len,
+		    sizeof(sc->rx) - sc->rx_len, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			(void)nf_erri(nf, "Couldn't receive from the server: "
+			    "%s", n == 0 ? "connection closed" :
+			    strerror(errno));
+			return (-1);
+		}
+		sc->rx_len += n;
+	}
+	memcpy(h, sc->rx + sc->rx_off, sizeof(*h));
+	h->nnh_seq = ntohl(h->nnh_seq);
+	h->nnh_status = ntohl(h->nnh_status);
+	h->nnh_len = ntohl(h->nnh_len);
+	*payload = sc->rx + sc->rx_off + NF_NET_HDR_LEN;
+	sc->rx_off += flen;
+	sc->rx_len -= flen;
+	return (0);
+}
+
+/*
+ * Collect the oldest reply and put its payload where its request
+ * wanted it. Failed requests are only noted, to be reported once all
+ * replies are in; -1 means the connection is broken and nothing is
+ * pending any more.
+ */
+static int
+nf_net_reply(struct netfpga *nf, struct nf_net_softc *sc)
+{
+	struct nf_net_pend *np;
+	struct nf_net_hdr h;
+	struct nf_regop *ops;
+	uint8_t *p;
+	size_t i, w;
+
+	ASSERT(sc->pend_num > 0);
+	np = &sc->pend[sc->pend_head];
+	if (nf_net_recv(nf, sc, &h, &p) != 0) {
+		sc->pend_num = 0;
+		return (-1);
+	}
+	sc->pend_head = (sc->pend_head + 1) % NF_NET_WINDOW;
+	sc->pend_num--;
+	sc->status = h.nnh_status;
+	if (sc->err[0] != '\0')
+		return (0);
+	if (h.nnh_seq != np->np_seq ||
+	    h.nnh_type != (np->np_type | NF_NET_REPLY)) {
+		snprintf(sc->err, sizeof(sc->err), "Reply %u doesn't match "
+		    "request %u", h.nnh_seq, np->np_seq);
+		return (0);
+	}
+	if (h.nnh_status < 0) {
+		snprintf(sc->err, sizeof(sc->err), "Server: %.*s",
+		    (int)h.nnh_len, p);
+		return (0);
+	}
+	if (np->np_dst == NULL)
+		return (0);
+	switch (np->np_type) {
+	case NF_NET_REGV:
+		ops = np->np_dst;
+		for (i = w = 0; i < np->np_len; i++) {
+			if (ops[i].nro_op != NF_REGOP_READ)
+				continue;
+			if (w + 4 > h.nnh_len)
+				break;
+			ops[i].nro_value = nf_net_word(p + w);
+			w += 4;
+		}
+		if (i < np->np_len || w != h.nnh_len)
+			snprintf(sc->err, sizeof(sc->err), "Bad reply from "
+			    "the server");
+		break;
+	case NF_NET_HELLO:
+		snprintf(np->np_dst, np->np_len, "%.*s", (int)h.nnh_len, p);
+		break;
+	default:
+		if (h.nnh_len != np->np_len) {
+			snprintf(sc->err, sizeof(sc->err), "Bad reply from "
+			    "the server");
+			break;
+		}
+		nf_net_words(np->np_dst, p, np->np_len, 0);
+		break;
+	}
+	return (0);
+}
+
+/*
+ * Wait for all replies and report the first failure among them, which
+ * may be one of a request posted by an earlier call.
+ */
+static int
+nf_net_drain(struct netfpga *nf, struct nf_net_softc *sc)
+{
+
+	while (sc->pend_num > 0)
+		if (nf_net_reply(nf, sc) != 0)
+			return (-1);
+	if (sc->err[0] != '\0') {
+		(void)nf_erri(nf, "%s", sc->err);
+		sc->err[0] = '\0';
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Send request of ``type'' with ``len'' bytes of payload built in
+ * ``tx''. Reply's payload goes to ``dst'' (NULL for posted requests).
+ */
+static int
+nf_net_request(struct netfpga *nf, struct nf_net_softc *sc, int type,
+    size_t len, void *dst, size_t dst_len)
+{
+	struct nf_net_pend *np;
+	ssize_t n;
+	size_t off;
+
+	ASSERT(len <= NF_NET_PAYLOAD_MAX);
+	if (sc->pend_num == NF_NET_WINDOW && nf_net_reply(nf, sc) != 0)
+		return (-1);
+	nf_net_hdr_put(sc->tx, type, sc->seq, 0, len);
+	len += NF_NET_HDR_LEN;
+	for (off = 0; off < len; off += n) {
+		n = send(sc->fd, sc->tx + off, len - off, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			n = 0;
+			continue;
+		}
+		if (n < 0) {
+			sc->pend_num = 0;
+			return (nf_erri(nf, "Couldn't send to the server: %s",
+			    strerror(errno)));
+		}
+	}
+	np = &sc->pend[(sc->pend_head + sc->pend_num) % NF_NET_WINDOW];
+	np->np_seq = sc->seq++;
+	np->np_type = type;
+	np->np_dst = dst;
+	np->np_len = dst_len;
+	sc->pend_num++;
+	return (0);
+}
+
+static int
+nf_net_connect_unix(struct netfpga *nf, const char *path)
+{
+	struct sockaddr_un sun;
+	int fd;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun.sun_path))
+		return (nf_erri(nf, "Socket path '%s' too long", path));
+	strcpy(sun.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return (nf_erri(nf, "socket: %s", strerror(errno)));
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+		close(fd);
+		return (nf_erri(nf, "Couldn't connect to %s: %s", path,
+		    strerror(errno)));
+	}
+	return (fd);
+}
+
+/*
+ * Connect to the server at ``iface'': host[:port], or path of a UNIX
+ * socket if it starts with a slash.
+ */
+static int
+nf_net_connect(struct netfpga *nf, const char *iface)
+{
+	struct addrinfo hints, *res, *ai;
+	char host[256], port[16];
+	char *p;
+	int error, fd, one;
+
+	if (iface != NULL && iface[0] == '/')
+		return (nf_net_connect_unix(nf, iface));
+	snprintf(host, sizeof(host), "%s", "127.0.0.1");
+	snprintf(port, sizeof(port), "%d", NF_NET_PORT);
+	if (iface != NULL && *iface != '\0') {
+		snprintf(host, sizeof(host), "%s", iface);
+		/* One colon separates the port, more make an IPv6 address */
+		p = strrchr(host, ':');
+		if (p != NULL && strchr(host, ':') == p) {
+			*p = '\0';
+			snprintf(port, sizeof(port), "%s", p + 1);
+		}
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	error = getaddrinfo(host, port, &hints, &res);
+	if (error != 0)
+		return (nf_erri(nf, "Couldn't resolve '%s' port '%s': %s",
+		    host, port, gai_strerror(error)));
+	fd = -1;
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd < 0)
+		return (nf_erri(nf, "Couldn't connect to %s port %s: %s",
+		    host, port, strerror(errno)));
+	one = 1;
+	(void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+	(void)setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+	return (fd);
+}
+
+static struct nf_net_softc *
+nf_net_open_iface(struct netfpga *nf, const char *iface)
+{
+	struct nf_net_softc *sc;
+	char name[64];
+	int fd;
+
+	fd = nf_net_connect(nf, iface);
+	if (fd < 0)
+		return (NULL);
+	sc = calloc(1, sizeof(*sc));
+	ASSERT(sc != NULL);
+	sc->fd = fd;
+	if (nf_net_request(nf, sc, NF_NET_HELLO, 0, name, sizeof(name)) != 0 ||
+	    nf_net_drain(nf, sc) != 0)
+		goto fail;
+	if (sc->status != NF_NET_VERSION) {
+		(void)nf_erri(nf, "Server speaks version %d, not %d",
+		    sc->status, NF_NET_VERSION);
+		goto fail;
+	}
+	DEBUG("Connected to server with module '%s'\n", name);
+	return (sc);
+fail:
+	close(fd);
+	free(sc);
+	return (NULL);
+}
+
+void *
+nf2_net_open(struct netfpga *nf)
+{
+
+	return (nf_net_open_iface(nf, nf->nf_iface));
+}
+
+int
+nf2_net_close(struct netfpga *nf, void *ctx)
+{
+	struct nf_net_softc *sc;
+	int error;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	error = nf_net_drain(nf, sc);
+	close(sc->fd);
+	free(sc);
+	return (error);
+}
+
+int
+nf2_net_read(struct netfpga *nf, void *ctx, uint32_t reg, void *buf,
+    size_t buf_len)
+{
+	struct nf_net_softc *sc;
+	size_t off, n;
+
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	for (off = 0; off < buf_len; off += n) {
+		n = buf_len - off;
+		if (n > NF_NET_PAYLOAD_MAX)
+			n = NF_NET_PAYLOAD_MAX;
+		nf_net_word_put(sc->tx + NF_NET_HDR_LEN, reg + off);
+		nf_net_word_put(sc->tx + NF_NET_HDR_LEN + 4, n);
+		if (nf_net_request(nf, sc, NF_NET_READ, 8,
+		    (uint8_t *)buf + off, n) != 0)
+			return (-1);
+	}
+	if (nf_net_drain(nf, sc) != 0)
+		return (-1);
+	return (buf_len);
+}
+
+int
+nf2_net_write(struct netfpga *nf, void *ctx, uint32_t reg, void *buf,
+    size_t buf_len)
+{
+	struct nf_net_softc *sc;
+	size_t off, n;
+
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	for (off = 0; off < buf_len; off += n) {
+		n = buf_len - off;
+		if (n > NF_NET_PAYLOAD_MAX - 4)
+			n = NF_NET_PAYLOAD_MAX - 4;
+		nf_net_word_put(sc->tx + NF_NET_HDR_LEN, reg + off);
+		nf_net_words(sc->tx + NF_NET_HDR_LEN + 4, (uint8_t *)buf + off,
+		    n, 1);
+		if (nf_net_request(nf, sc, NF_NET_WRITE, 4 + n, NULL, 0) != 0)
+			return (-1);
+		sc->wrote = 1;
+	}
+	if (sc->err[0] != '\0' && nf_net_drain(nf, sc) != 0)
+		return (-1);
+	return (buf_len);
+}
+
+int
+nf2_net_regv(struct netfpga *nf, void *ctx, struct nf_regop *ops,
+    int ops_num)
+{
+	struct nf_net_softc *sc;
+	uint8_t *p;
+	size_t len;
+	int i, first, reads, frame_reads;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	reads = 0;
+	for (first = 0; first < ops_num; first = i) {
+		p = sc->tx + NF_NET_HDR_LEN;
+		len = 0;
+		frame_reads = 0;
+		for (i = first; i < ops_num && len + 8 <= NF_NET_PAYLOAD_MAX;
+		    i++) {
+			if (ops[i].nro_op == NF_REGOP_READ) {
+				nf_net_word_put(p + len, ops[i].nro_reg |
+				    NF_NET_OP_READ);
+				len += 4;
+				frame_reads++;
+				continue;
+			}
+			nf_net_word_put(p + len, ops[i].nro_reg |
+			    NF_NET_OP_WRITE);
+			nf_net_word_put(p + len + 4, ops[i].nro_value);
+			len += 8;
+			sc->wrote = 1;
+		}
+		if (nf_net_request(nf, sc, NF_NET_REGV, len,
+		    frame_reads > 0 ? &ops[first] : NULL, i - first) != 0)
+			return (-1);
+		reads += frame_reads;
+	}
+	if ((reads > 0 || sc->err[0] != '\0') && nf_net_drain(nf, sc) != 0)
+		return (-1);
+	return (ops_num);
+}
+
+int
+nf2_net_mem(struct netfpga *nf, void *ctx, int write, uint32_t addr,
+    void *buf, size_t len)
+{
+	struct nf_net_softc *sc;
+	uint8_t *p;
+	size_t off, n;
+
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	p = sc->tx + NF_NET_HDR_LEN;
+	for (off = 0; off < len; off += n) {
+		n = len - off;
+		if (n > NF_NET_MEM_CHUNK)
+			n = NF_NET_MEM_CHUNK;
+		nf_net_word_put(p, write ? NF_NET_OP_WRITE : NF_NET_OP_READ);
+		nf_net_word_put(p + 4, addr + off);
+		nf_net_word_put(p + 8, n);
+		if (write) {
+			nf_net_words(p + 12, (uint8_t *)buf + off, n, 1);
+			if (nf_net_request(nf, sc, NF_NET_MEM, 12 + n, NULL,
+			    0) != 0)
+				return (-1);
+			sc->wrote = 1;
+		} else if (nf_net_request(nf, sc, NF_NET_MEM, 12,
+		    (uint8_t *)buf + off, n) != 0)
+			return (-1);
+	}
+	if ((!write || sc->err[0] != '\0') && nf_net_drain(nf, sc) != 0)
+		return (-1);
+	return (len);
+}
+
+int
+nf2_net_link(struct netfpga *nf, void *ctx, uint32_t *up, uint32_t *changes)
+{
+	struct nf_net_softc *sc;
+	uint32_t w[1 + NF_LINK_PORTS];
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	if (nf_net_request(nf, sc, NF_NET_LINK, 0, w, sizeof(w)) != 0 ||
+	    nf_net_drain(nf, sc) != 0)
+		return (-1);
+	if (sc->status != 1)
+		return (0);
+	*up = w[0];
+	memcpy(changes, w + 1, NF_LINK_PORTS * sizeof(*changes));
+	return (1);
+}
+
+/*----------------------------------------------------------------------------
+ * Broker
+ */
+
+static uint64_t
+nf_broker_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * Map broker's hot registers, if it publishes any.
+ */
+static struct nf_broker_hot *
+nf_broker_map(const char *sock)
+{
+	struct nf_broker_hot *hot;
+	struct stat st;
+	char path[256];
+	void *p;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s.hot", sock);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return (NULL);
+	p = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(*hot))
+		p = mmap(NULL, sizeof(*hot), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return (NULL);
+	hot = p;
+	if (hot->nbh_magic != NF_BROKER_MAGIC ||
+	    hot->nbh_num > NF_BROKER_HOT_MAX) {
+		munmap(p, sizeof(*hot));
+		return (NULL);
+	}
+	return (hot);
+}
+
+/*
+ * Do reads of ``ops'' from broker's hot registers. Returns 1 if all of
+ * them are there and the values are fresh, and were read after our
+ * writes were done; 0 sends the batch to the broker instead, and -1
+ * means one of the writes failed.
+ */
+static int
+nf_broker_hot_read(struct netfpga *nf, struct nf_net_softc *sc,
+    struct nf_regop *ops, int ops_num)
+{
+	struct nf_broker_hot *hot;
+	int idx[NF_BROKER_HOT_OPS];
+	uint64_t t, stale;
+	uint32_t gen;
+	int i, lo, hi, mid, tries;
+
+	hot = sc->hot;
+	if (hot == NULL || ops_num > NF_BROKER_HOT_OPS)
+		return (0);
+	for (i = 0; i < ops_num; i++) {
+		if (ops[i].nro_op != NF_REGOP_READ)
+			return (0);
+		/* Registers are set when the broker starts, and sorted */
+		lo = 0;
+		hi = hot->nbh_num;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (hot->nbh_reg[mid] < ops[i].nro_reg)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == (int)hot->nbh_num ||
+		    hot->nbh_reg[lo] != ops[i].nro_reg)
+			return (0);
+		idx[i] = lo;
+	}
+	if (sc->wrote) {
+		/* Writes still in flight would land after the values */
+		if (nf_net_drain(nf, sc) != 0)
+			return (-1);
+		sc->hot_after = nf_broker_now();
+		sc->wrote = 0;
+	}
+	for (tries = 0; tries < 8; tries++) {
+		gen = atomic_load_explicit(&hot->nbh_gen,
+		    memory_order_acquire);
+		if ((gen & 1) != 0)
+			continue;
+		for (i = 0; i < ops_num; i++)
+			ops[i].nro_value = hot->nbh_value[idx[i]];
+		t = hot->nbh_time;
+		stale = (uint64_t)NF_BROKER_STALE * hot->nbh_tick_us * 1000;
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&hot->nbh_gen,
+		    memory_order_relaxed) == gen)
+			return (t >= sc->hot_after &&
+			    nf_broker_now() - t <= stale);
+	}
+	return (0);
+}
+
+/*
+ * ``nf_iface'' is the broker's socket, NF_BROKER_SOCK by default.
+ */
+void *
+nf2_broker_open(struct netfpga *nf)
+{
+	struct nf_net_softc *sc;
+	const char *sock;
+
+	sock = nf->nf_iface;
+	if (sock == NULL || *sock == '\0')
+		sock = NF_BROKER_SOCK;
+	if (sock[0] != '/') {
+		(void)nf_erri(nf, "Broker's socket '%s' isn't a path", sock);
+		return (NULL);
+	}
+	sc = nf_net_open_iface(nf, sock);
+	if (sc == NULL)
+		return (NULL);
+	sc->hot = nf_broker_map(sock);
+	DEBUG("Broker at %s, %u hot registers\n", sock,
+	    sc->hot != NULL ? sc->hot->nbh_num : 0);
+	return (sc);
+}
+
+int
+nf2_broker_close(struct netfpga *nf, void *ctx)
+{
+	struct nf_net_softc *sc;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	if (sc->hot != NULL)
+		munmap(sc->hot, sizeof(*sc->hot));
+	return (nf2_net_close(nf, ctx));
+}
+
+int
+nf2_broker_read(struct netfpga *nf, void *ctx, uint32_t reg, void *buf,
+    size_t buf_len)
+{
+	struct nf_net_softc *sc;
+	struct nf_regop op;
+	int ret;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	if (buf_len == sizeof(op.nro_value)) {
+		op.nro_op = NF_REGOP_READ;
+		op.nro_reg = reg;
+		ret = nf_broker_hot_read(nf, sc, &op, 1);
+		if (ret < 0)
+			return (-1);
+		if (ret > 0) {
+			memcpy(buf, &op.nro_value, sizeof(op.nro_value));
+			return (buf_len);
+		}
+	}
+	return (nf2_net_read(nf, ctx, reg, buf, buf_len));
+}
+
+int
+nf2_broker_regv(struct netfpga *nf, void *ctx, struct nf_regop *ops,
+    int ops_num)
+{
+	struct nf_net_softc *sc;
+	int ret;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	ret = nf_broker_hot_read(nf, sc, ops, ops_num);
+	if (ret < 0)
+		return (-1);
+	if (ret > 0)
+		return (ops_num);
+	return (nf2_net_regv(nf, ctx, ops, ops_num));
+}
+
+/*----------------------------------------------------------------------------
+ * Server
+ */
+
+static int
+nf_net_exec_regv(struct netfpga *nf, const uint8_t *in, size_t len,
+    uint8_t *out, size_t *out_len)
+{
+	struct nf_regop ops[NF_NET_CHUNK_OPS];
+	uint32_t w;
+	size_t off, olen;
+	int i, n, done;
+
+	if (len % 4 != 0)
+		return (nf_erri(nf, "Register operations are words"));
+	done = 0;
+	olen = 0;
+	for (off = 0; off < len; done += n) {
+		for (n = 0; n < NF_NET_CHUNK_OPS && off < len; n++) {
+			w = nf_net_word(in + off);
+			off += 4;
+			if ((w & 2) != 0)
+				return (nf_erri(nf, "Bad register operation "
+				    "%#x", w));
+			ops[n].nro_reg = w & ~3U;
+			ops[n].nro_value = 0;
+			if ((w & NF_NET_OP_WRITE) == 0) {
+				ops[n].nro_op = NF_REGOP_READ;
+				continue;
+			}
+			if (off + 4 > len)
+				return (nf_erri(nf, "Write without a value"));
+			ops[n].nro_op = NF_REGOP_WRITE;
+			ops[n].nro_value = nf_net_word(in + off);
+			off += 4;
+		}
+		if (nf_regv(nf, ops, n) != n)
+			return (-1);
+		for (i = 0; i < n; i++)
+			if (ops[i].nro_op == NF_REGOP_READ) {
+				nf_net_word_put(out + olen, ops[i].nro_value);
+				olen += 4;
+			}
+	}
+	*out_len = olen;
+	return (done);
+}
+
+/*
+ * Do request ``req'', a whole message as checked by nf_net_frame(), and
+ * build its reply in ``rep'' (NF_NET_FRAME_MAX bytes). Returns length of
+ * the reply. Requests are checked before they get to the card, so a
+ * client can't make the library assert.
+ */
+int
+nf_net_exec(struct netfpga *nf, const void *req, void *rep)
+{
+	struct nf_net_hdr h;
+	struct nf_link lk;
+	const uint8_t *in;
+	const char *msg;
+	uint8_t *out;
+	uint32_t reg, len, op;
+	size_t olen;
+	int i, status;
+
+	nf_assert(nf);
+	ASSERT(req != NULL);
+	ASSERT(rep != NULL);
+	memcpy(&h, req, sizeof(h));
+	h.nnh_seq = ntohl(h.nnh_seq);
+	h.nnh_len = ntohl(h.nnh_len);
+	in = (const uint8_t *)req + NF_NET_HDR_LEN;
+	out = (uint8_t *)rep + NF_NET_HDR_LEN;
+	olen = 0;
+	switch (h.nnh_type) {
+	case NF_NET_HELLO:
+		olen = strlen(nf->__nf_mod->nf_name);
+		memcpy(out, nf->__nf_mod->nf_name, olen);
+		status = NF_NET_VERSION;
+		break;
+	case NF_NET_REGV:
+		status = nf_net_exec_regv(nf, in, h.nnh_len, out, &olen);
+		break;
+	case NF_NET_READ:
+	case NF_NET_WRITE:
+		if (h.nnh_len < 4 || h.nnh_len % 4 != 0) {
+			status = nf_erri(nf, "Bad request length %u",
+			    h.nnh_len);
+			break;
+		}
+		reg = nf_net_word(in);
+		len = h.nnh_len - 4;
+		if (h.nnh_type == NF_NET_READ) {
+			if (h.nnh_len != 8) {
+				status = nf_erri(nf, "Bad request length %u",
+				    h.nnh_len);
+				break;
+			}
+			len = nf_net_word(in + 4);
+		}
+		if (reg % 4 != 0 || len % 4 != 0 || len > NF_NET_PAYLOAD_MAX) {
+			status = nf_erri(nf, "Bad register %#x or length %u",
+			    reg, len);
+			break;
+		}
+		if (h.nnh_type == NF_NET_READ) {
+			status = nf_read(nf, reg, out, len);
+			nf_net_words(out, out, len, 1);
+			olen = len;
+		} else {
+			/* Reply's buffer is free to swap the words in */
+			nf_net_words(out, in + 4, len, 0);
+			status = nf_write(nf, reg, out, len);
+		}
+		if (status == (int)len)
+			status = 0;
+		else if (status >= 0)
+			status = nf_erri(nf, "Only %d of %u bytes at %#x done",
+			    status, len, reg);
+		break;
+	case NF_NET_MEM:
+		if (h.nnh_len < 12) {
+			status = nf_erri(nf, "Bad request length %u",
+			    h.nnh_len);
+			break;
+		}
+		op = nf_net_word(in);
+		reg = nf_net_word(in + 4);
+		len = nf_net_word(in + 8);
+		if (len > NF_NET_PAYLOAD_MAX || (op == NF_NET_OP_WRITE &&
+		    len != h.nnh_len - 12)) {
+			status = nf_erri(nf, "Bad memory length %u", len);
+			break;
+		}
+		if (op == NF_NET_OP_WRITE) {
+			nf_net_words(out, in + 12, len, 0);
+			status = nf_mem_write(nf, reg, out, len);
+		} else {
+			status = nf_mem_read(nf, reg, out, len);
+			nf_net_words(out, out, len, 1);
+			olen = len;
+		}
+		if (status == 0)
+			status = len;
+		break;
+	case NF_NET_LINK:
+		status = nf_link_read(nf, &lk);
+		if (status != 0)
+			break;
+		nf_net_word_put(out, lk.nl_up);
+		for (i = 0; i < NF_LINK_PORTS; i++)
+			nf_net_word_put(out + 4 + i * 4, lk.nl_changes[i]);
+		olen = 4 + NF_LINK_PORTS * 4;
+		status = lk.nl_driver;
+		break;
+	default:
+		status = nf_erri(nf, "Unknown request %d", h.nnh_type);
+		break;
+	}
+	if (status < 0) {
+		msg = nf_strerror(nf);
+		if (*msg == '\0')
+			msg = "Failed";
+		olen = strlen(msg);
+		memcpy(out, msg, olen);
+		nf_err_clear(nf);
+		status = -1;
+	}
+	nf_net_hdr_put(rep, h.nnh_type | NF_NET_REPLY, h.nnh_seq, status,
+	    olen);
+	return (NF_NET_HDR_LEN + olen);
+}
+
+/*
+ * Card behind "nfutil server".
+ */
+struct nf_module nf2_net = {
+	.nf_version =	NETFPGA_MODULE_VERSION,
+	.nf_flags =	0,
+	.nf_name =	"net",
+	.nf_open =	nf2_net_open,
+	.nf_close = 	nf2_net_close,
+	.nf_read =	nf2_net_read,
+	.nf_write =	nf2_net_write,
+	.nf_regv =	nf2_net_regv,
+	.nf_mem =	nf2_net_mem,
+	.nf_link =	nf2_net_link,
+};
+
+/*
+ * Card owned by nfbrokerd(8).
+ */
+struct nf_module nf2_broker = {
+	.nf_version =	NETFPGA_MODULE_VERSION,
+	.nf_flags =	0,
+	.nf_name =	"broker",
+	.nf_open =	nf2_broker_open,
+	.nf_close = 	nf2_broker_close,
+	.nf_read =	nf2_broker_read,
+	.nf_write =	nf2_net_write,
+	.nf_regv =	nf2_broker_regv,
+	.nf_mem =	nf2_net_mem,
+	.nf_link =	nf2_net_link,
+};
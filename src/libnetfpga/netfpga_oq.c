@@ -0,0 +1,670 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Output queue statistics: occupancy histograms and drop attribution,
+ * built from samples of the queues' registers.
+ *
+ * Histograms are log-linear, like HDR histograms: values below 16 get a
+ * bucket each, and every power of two above is split in 16 buckets, so
+ * any value is known within 1/16 of itself in a fixed NF_HIST_BUCKETS
+ * counters, whatever the run length.
+ *
+ * Drops are counted per queue in windows of fixed length; the windows
+ * with most drops are kept along with the highest occupancy seen in
+ * them and the average size of packets stored, which turns dropped
+ * packets into bytes the queue lacked.
+ *
+ * The planner splits the queues' SRAM to minimise expected drops, a
+ * queue's being the rate of packets into it times the fraction of time
+ * it wants more than it has. What a queue wants comes from a profile:
+ * statistics of a run, with samples taken while it was full moved up
+ * to what nf_oq_stats_need() says, or a declared one. With 8 queues
+ * and a few hundred quanta of SRAM, dynamic programming finds the
+ * exact optimum cheaply; quanta which don't buy anything are then
+ * shared out evenly, so idle queues keep some headroom. None of this
+ * touches the card, so it can be tried on profiles offline.
+ */
+#include <sys/types.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+#define NF_HIST_SUB		(1 << NF_HIST_SUB_BITS)
+
+/* Indices of sampled registers, NF_OQ_QUEUES of each */
+#define NF_OQ_S_WORDS		0	/* OQ_NUM_WORDS_IN_Q_REG */
+#define NF_OQ_S_DROPPED		1	/* OQ_NUM_PKTS_DROPPED_REG */
+#define NF_OQ_S_PKTS		2	/* OQ_NUM_PKTS_STORED_REG */
+#define NF_OQ_S_BYTES		3	/* OQ_NUM_PKT_BYTES_STORED_REG */
+
+static int
+nf_hist_bucket(uint32_t v)
+{
+	int e;
+
+	if (v < NF_HIST_SUB)
+		return (v);
+	e = 31 - __builtin_clz(v);
+	return ((e - NF_HIST_SUB_BITS + 1) * NF_HIST_SUB +
+	    ((v >> (e - NF_HIST_SUB_BITS)) & (NF_HIST_SUB - 1)));
+}
+
+/* Highest value which falls in bucket ``b'' */
+static uint32_t
+nf_hist_value(int b)
+{
+	int e;
+
+	if (b < NF_HIST_SUB)
+		return (b);
+	e = b / NF_HIST_SUB + NF_HIST_SUB_BITS - 1;
+	return ((uint32_t)(((uint64_t)(NF_HIST_SUB | (b % NF_HIST_SUB)) + 1) <<
+	    (e - NF_HIST_SUB_BITS)) - 1);
+}
+
+/* Lowest value which falls in bucket ``b'' */
+static uint32_t
+nf_hist_value_lo(int b)
+{
+
+	return (b == 0 ? 0 : nf_hist_value(b - 1) + 1);
+}
+
+void
+nf_hist_init(struct nf_hist *h)
+{
+
+	ASSERT(h != NULL);
+	memset(h, 0, sizeof(*h));
+	h->nh_min = UINT32_MAX;
+}
+
+void
+nf_hist_add(struct nf_hist *h, uint32_t v)
+{
+
+	ASSERT(h != NULL);
+	h->nh_counts[nf_hist_bucket(v)]++;
+	h->nh_total++;
+	if (v < h->nh_min)
+		h->nh_min = v;
+	if (v > h->nh_max)
+		h->nh_max = v;
+}
+
+/*
+ * Value below which fraction ``q'' of values fall, rounded up to the
+ * end of its bucket but never above the largest value seen.
+ */
+uint32_t
+nf_hist_quantile(const struct nf_hist *h, double q)
+{
+	uint64_t want, seen;
+	uint32_t v;
+	int b;
+
+	ASSERT(h != NULL);
+	if (h->nh_total == 0)
+		return (0);
+	want = (uint64_t)(q * h->nh_total + 0.5);
+	if (want == 0)
+		want = 1;
+	seen = 0;
+	for (b = 0; b < NF_HIST_BUCKETS; b++) {
+		seen += h->nh_counts[b];
+		if (seen >= want)
+			break;
+	}
+	v = nf_hist_value(b);
+	return (v < h->nh_max ? v : h->nh_max);
+}
+
+/*
+ * Fraction of values above ``v'', taking values to be spread evenly
+ * over their buckets.
+ */
+double
+nf_hist_above(const struct nf_hist *h, uint32_t v)
+{
+	uint64_t n;
+	uint32_t lo, hi;
+	double part;
+	int b;
+
+	ASSERT(h != NULL);
+	if (h->nh_total == 0 || v >= h->nh_max)
+		return (0);
+	b = nf_hist_bucket(v);
+	lo = nf_hist_value_lo(b);
+	hi = nf_hist_value(b);
+	part = hi > lo ? (double)(hi - v) / (hi - lo + 1) : 0;
+	n = 0;
+	for (b++; b < NF_HIST_BUCKETS; b++)
+		n += h->nh_counts[b];
+	return ((n + part * h->nh_counts[nf_hist_bucket(v)]) / h->nh_total);
+}
+
+/*
+ * Registers nf_oq_stats_feed() expects in samples, NF_OQ_STATS_REGS of
+ * them.
+ */
+void
+nf_oq_stats_regs(uint32_t *regs)
+{
+	int q;
+
+	ASSERT(regs != NULL);
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		regs[NF_OQ_S_WORDS * NF_OQ_QUEUES + q] =
+		    NF_OQ_REG(OQ_NUM_WORDS_IN_Q_REG_0, q);
+		regs[NF_OQ_S_DROPPED * NF_OQ_QUEUES + q] =
+		    NF_OQ_REG(OQ_NUM_PKTS_DROPPED_REG_0, q);
+		regs[NF_OQ_S_PKTS * NF_OQ_QUEUES + q] =
+		    NF_OQ_REG(OQ_NUM_PKTS_STORED_REG_0, q);
+		regs[NF_OQ_S_BYTES * NF_OQ_QUEUES + q] =
+		    NF_OQ_REG(OQ_NUM_PKT_BYTES_STORED_REG_0, q);
+	}
+}
+
+/*
+ * Read the queues' SRAM windows and thresholds in one batch. Capacity
+ * is in bytes.
+ */
+int
+nf_oq_layout(struct netfpga *nf, uint32_t *lo, uint32_t *hi,
+    uint32_t *thresh)
+{
+	struct nf_regop ops[NF_OQ_QUEUES * 3];
+	int q, i;
+
+	nf_assert(nf);
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		ops[q * 3].nro_reg = NF_OQ_REG(OQ_ADDRESS_LO_REG_0, q);
+		ops[q * 3 + 1].nro_reg = NF_OQ_REG(OQ_ADDRESS_HI_REG_0, q);
+		ops[q * 3 + 2].nro_reg = NF_OQ_REG(OQ_FULL_THRESH_REG_0, q);
+	}
+	for (i = 0; i < NF_OQ_QUEUES * 3; i++) {
+		ops[i].nro_op = NF_REGOP_READ;
+		ops[i].nro_value = 0;
+	}
+	if (nf_regv(nf, ops, NF_OQ_QUEUES * 3) != NF_OQ_QUEUES * 3)
+		return (nf_erri(nf, "Couldn't read output queue layout"));
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		if (lo != NULL)
+			lo[q] = ops[q * 3].nro_value;
+		if (hi != NULL)
+			hi[q] = ops[q * 3 + 1].nro_value;
+		if (thresh != NULL)
+			thresh[q] = ops[q * 3 + 2].nro_value;
+	}
+	return (0);
+}
+
+/*
+ * Start collecting statistics of the queues of ``nf'', with drops
+ * counted in windows of ``window_ms'' milliseconds.
+ */
+int
+nf_oq_stats_init(struct netfpga *nf, struct nf_oq_stats *st,
+    unsigned window_ms)
+{
+	uint32_t lo[NF_OQ_QUEUES], hi[NF_OQ_QUEUES];
+	int q;
+
+	nf_assert(nf);
+	ASSERT(st != NULL);
+	ASSERT(window_ms > 0);
+	memset(st, 0, sizeof(*st));
+	if (nf_oq_layout(nf, lo, hi, st->nos_thresh) != 0)
+		return (-1);
+	st->nos_window_ns = (uint64_t)window_ms * 1000000;
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		nf_hist_init(&st->nos_occ[q]);
+		st->nos_capacity[q] = hi[q] > lo[q] ?
+		    (hi[q] - lo[q]) * NF_OQ_WORD_BYTES : 0;
+	}
+	return (0);
+}
+
+/* Keep window ``w'' among the NF_OQ_WORST ones with most drops */
+static void
+nf_oq_window_close(struct nf_oq_queue_win *worst, const struct
+    nf_oq_queue_win *w)
+{
+	int i, j;
+
+	if (w->nqw_drops == 0)
+		return;
+	for (i = 0; i < NF_OQ_WORST; i++)
+		if (w->nqw_drops > worst[i].nqw_drops)
+			break;
+	if (i == NF_OQ_WORST)
+		return;
+	for (j = NF_OQ_WORST - 1; j > i; j--)
+		worst[j] = worst[j - 1];
+	worst[i] = *w;
+}
+
+/*
+ * Account one sample of the registers from nf_oq_stats_regs().
+ */
+void
+nf_oq_stats_feed(struct nf_oq_stats *st, const struct nf_sample *s)
+{
+	const uint32_t *v;
+	struct nf_oq_queue_win *w;
+	uint32_t occ, drops;
+	int q;
+
+	ASSERT(st != NULL);
+	ASSERT(s != NULL);
+	v = s->nsm_values;
+	if (st->nos_samples == 0)
+		st->nos_t0 = s->nsm_time;
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		occ = v[NF_OQ_S_WORDS * NF_OQ_QUEUES + q] * NF_OQ_WORD_BYTES;
+		nf_hist_add(&st->nos_occ[q], occ);
+		w = &st->nos_cur[q];
+		if (st->nos_samples == 0 ||
+		    s->nsm_time - w->nqw_start >= st->nos_window_ns) {
+			if (st->nos_samples != 0)
+				nf_oq_window_close(st->nos_worst[q], w);
+			memset(w, 0, sizeof(*w));
+			w->nqw_start = s->nsm_time - (s->nsm_time -
+			    st->nos_t0) % st->nos_window_ns;
+		}
+		if (occ > w->nqw_occ_max)
+			w->nqw_occ_max = occ;
+		if (st->nos_samples == 0)
+			continue;
+		drops = v[NF_OQ_S_DROPPED * NF_OQ_QUEUES + q] -
+		    st->nos_prev[NF_OQ_S_DROPPED * NF_OQ_QUEUES + q];
+		w->nqw_drops += drops;
+		st->nos_drops[q] += drops;
+		st->nos_pkts[q] += v[NF_OQ_S_PKTS * NF_OQ_QUEUES + q] -
+		    st->nos_prev[NF_OQ_S_PKTS * NF_OQ_QUEUES + q];
+		st->nos_bytes[q] += v[NF_OQ_S_BYTES * NF_OQ_QUEUES + q] -
+		    st->nos_prev[NF_OQ_S_BYTES * NF_OQ_QUEUES + q];
+	}
+	memcpy(st->nos_prev, v, sizeof(st->nos_prev));
+	st->nos_t1 = s->nsm_time;
+	st->nos_samples++;
+}
+
+/*
+ * Close windows still open. Call once sampling is over.
+ */
+void
+nf_oq_stats_finish(struct nf_oq_stats *st)
+{
+	int q;
+
+	ASSERT(st != NULL);
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		nf_oq_window_close(st->nos_worst[q], &st->nos_cur[q]);
+		memset(&st->nos_cur[q], 0, sizeof(st->nos_cur[q]));
+	}
+}
+
+/*
+ * Bytes queue ``q'' should have had: its 99.9th percentile occupancy if
+ * it dropped nothing, otherwise its capacity plus what it dropped in
+ * the worst window, at the average size of packets it stored.
+ */
+uint64_t
+nf_oq_stats_need(const struct nf_oq_stats *st, int q)
+{
+	uint64_t avg, have;
+
+	ASSERT(st != NULL);
+	ASSERT(q >= 0 && q < NF_OQ_QUEUES);
+	if (st->nos_drops[q] == 0)
+		return (nf_hist_quantile(&st->nos_occ[q], 0.999));
+	avg = st->nos_pkts[q] > 0 ? st->nos_bytes[q] / st->nos_pkts[q] :
+	    NF_OQ_PKT_MAX;
+	have = st->nos_capacity[q];
+	if (st->nos_occ[q].nh_max > have)
+		have = st->nos_occ[q].nh_max;
+	return (have + st->nos_worst[q][0].nqw_drops * avg);
+}
+
+/*
+ * Make a planning profile from statistics of a run. Samples taken when
+ * a queue which dropped packets was full are counted as wanting what
+ * nf_oq_stats_need() says it needed.
+ */
+void
+nf_oq_profile_from_stats(const struct nf_oq_stats *st,
+    struct nf_oq_profile *pr)
+{
+	const struct nf_hist *h;
+	uint64_t moved, need, full;
+	double sec;
+	int q, b;
+
+	ASSERT(st != NULL);
+	ASSERT(pr != NULL);
+	memset(pr, 0, sizeof(*pr));
+	sec = (st->nos_t1 - st->nos_t0) / 1e9;
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		h = &st->nos_occ[q];
+		pr->nop_occ[q] = *h;
+		if (sec > 0)
+			pr->nop_rate[q] = (st->nos_pkts[q] +
+			    st->nos_drops[q]) / sec;
+		if (st->nos_drops[q] == 0 || h->nh_total == 0)
+			continue;
+		full = st->nos_capacity[q] > NF_OQ_PKT_MAX ?
+		    st->nos_capacity[q] - NF_OQ_PKT_MAX : 0;
+		if (h->nh_max < full)
+			full = h->nh_max;
+		need = nf_oq_stats_need(st, q);
+		if (need > UINT32_MAX)
+			need = UINT32_MAX;
+		moved = 0;
+		for (b = nf_hist_bucket(full); b < NF_HIST_BUCKETS; b++) {
+			moved += pr->nop_occ[q].nh_counts[b];
+			pr->nop_occ[q].nh_counts[b] = 0;
+		}
+		pr->nop_occ[q].nh_counts[nf_hist_bucket(need)] += moved;
+		pr->nop_occ[q].nh_max = need;
+	}
+}
+
+/*
+ * Load a declared profile. Lines are either
+ *
+ *	<queue> rate <packets per second>
+ *	<queue> <bytes> <fraction of time the queue wants more>
+ *
+ * and fractions of a queue should go down to 0 as bytes go up.
+ */
+int
+nf_oq_profile_load(struct netfpga *nf, const char *fname,
+    struct nf_oq_profile *pr)
+{
+	struct { uint32_t bytes; double frac; } pts[NF_OQ_QUEUES][64], t;
+	int num[NF_OQ_QUEUES];
+	char line[256], *p;
+	double frac, prev, mass;
+	unsigned long bytes;
+	FILE *fp;
+	int q, i, j, lineno;
+
+	nf_assert(nf);
+	ASSERT(fname != NULL);
+	ASSERT(pr != NULL);
+	fp = fopen(fname, "r");
+	if (fp == NULL)
+		return (nf_erri(nf, "Couldn't open '%s': %s", fname,
+		    strerror(errno)));
+	memset(pr, 0, sizeof(*pr));
+	memset(num, 0, sizeof(num));
+	lineno = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		for (p = line; isspace((unsigned char)*p); p++)
+			;
+		if (*p == '#' || *p == '\0')
+			continue;
+		if (sscanf(p, "%d rate %lf", &q, &frac) == 2 && q >= 0 &&
+		    q < NF_OQ_QUEUES && frac >= 0) {
+			pr->nop_rate[q] = frac;
+			continue;
+		}
+		if (sscanf(p, "%d %lu %lf", &q, &bytes, &frac) != 3 ||
+		    q < 0 || q >= NF_OQ_QUEUES || bytes > UINT32_MAX ||
+		    frac < 0 || frac > 1 || num[q] == 64) {
+			fclose(fp);
+			return (nf_erri(nf, "%s:%d: bad line", fname, lineno));
+		}
+		pts[q][num[q]].bytes = bytes;
+		pts[q][num[q]++].frac = frac;
+	}
+	fclose(fp);
+
+	/*
+	 * Time wanting more than one point but no more than the next
+	 * goes to the next point; time below the first to the first.
+	 */
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		nf_hist_init(&pr->nop_occ[q]);
+		for (i = 1; i < num[q]; i++)
+			for (j = i; j > 0 && pts[q][j - 1].bytes >
+			    pts[q][j].bytes; j--) {
+				t = pts[q][j];
+				pts[q][j] = pts[q][j - 1];
+				pts[q][j - 1] = t;
+			}
+		prev = 1;
+		for (i = 0; i <= num[q]; i++) {
+			frac = i < num[q] ? pts[q][i].frac : 0;
+			mass = prev - frac;
+			prev = frac;
+			if (mass <= 0)
+				continue;
+			bytes = i < num[q] ? pts[q][i].bytes :
+			    pts[q][num[q] - 1].bytes + 1;
+			pr->nop_occ[q].nh_counts[nf_hist_bucket(bytes)] +=
+			    (uint64_t)(mass * NF_OQ_PROFILE_SCALE + 0.5);
+			if (bytes > pr->nop_occ[q].nh_max)
+				pr->nop_occ[q].nh_max = bytes;
+		}
+		for (i = 0; i < NF_HIST_BUCKETS; i++)
+			pr->nop_occ[q].nh_total += pr->nop_occ[q].nh_counts[i];
+	}
+	return (0);
+}
+
+/*
+ * Drops per second queue ``q'' of profile ``pr'' is expected to have
+ * with ``bytes'' of SRAM.
+ */
+double
+nf_oq_expected_drops(const struct nf_oq_profile *pr, int q, uint64_t bytes)
+{
+
+	ASSERT(pr != NULL);
+	ASSERT(q >= 0 && q < NF_OQ_QUEUES);
+	if (bytes > UINT32_MAX)
+		bytes = UINT32_MAX;
+	return (pr->nop_rate[q] * nf_hist_above(&pr->nop_occ[q], bytes));
+}
+
+/*
+ * Split ``words'' of SRAM starting at ``base'' between the queues, in
+ * ``quantum'' word steps on top of ``min_words'' each, to minimise
+ * expected drops of profile ``pr''. Returns -1 if even the minimum
+ * doesn't fit.
+ */
+int
+nf_oq_plan(const struct nf_oq_profile *pr, uint32_t base, uint32_t words,
+    uint32_t quantum, uint32_t min_words, struct nf_oq_plan *plan)
+{
+	double *cost, *best, c;
+	int *choice, units[NF_OQ_QUEUES];
+	uint32_t size, rest;
+	int u, U, q, k, pool;
+
+	ASSERT(pr != NULL);
+	ASSERT(plan != NULL);
+	ASSERT(quantum > 0);
+	if ((uint64_t)min_words * NF_OQ_QUEUES > words)
+		return (-1);
+	U = (words - min_words * NF_OQ_QUEUES) / quantum;
+	cost = calloc((size_t)NF_OQ_QUEUES * (U + 1), sizeof(*cost));
+	best = calloc((size_t)NF_OQ_QUEUES * (U + 1), sizeof(*best));
+	choice = calloc((size_t)NF_OQ_QUEUES * (U + 1), sizeof(*choice));
+	ASSERT(cost != NULL && best != NULL && choice != NULL);
+#define NF_OQ_AT(a, q, u)	((a)[(q) * (U + 1) + (u)])
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		for (u = 0; u <= U; u++)
+			NF_OQ_AT(cost, q, u) = nf_oq_expected_drops(pr, q,
+			    (uint64_t)(min_words + (uint64_t)u * quantum - 1) *
+			    NF_OQ_WORD_BYTES);
+
+	/* best[q][u]: least drops of queues 0..q sharing u quanta */
+	for (u = 0; u <= U; u++) {
+		NF_OQ_AT(best, 0, u) = NF_OQ_AT(cost, 0, u);
+		NF_OQ_AT(choice, 0, u) = u;
+	}
+	for (q = 1; q < NF_OQ_QUEUES; q++)
+		for (u = 0; u <= U; u++) {
+			NF_OQ_AT(best, q, u) = -1;
+			for (k = 0; k <= u; k++) {
+				c = NF_OQ_AT(best, q - 1, u - k) +
+				    NF_OQ_AT(cost, q, k);
+				if (NF_OQ_AT(best, q, u) < 0 ||
+				    c < NF_OQ_AT(best, q, u)) {
+					NF_OQ_AT(best, q, u) = c;
+					NF_OQ_AT(choice, q, u) = k;
+				}
+			}
+		}
+	for (u = U, q = NF_OQ_QUEUES - 1; q >= 0; q--) {
+		units[q] = NF_OQ_AT(choice, q, u);
+		u -= units[q];
+	}
+
+	/* Take back quanta which don't lower drops and share them out */
+	pool = U;
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		c = NF_OQ_AT(cost, q, units[q]);
+		while (units[q] > 0 && NF_OQ_AT(cost, q, units[q] - 1) <= c)
+			units[q]--;
+		pool -= units[q];
+	}
+	for (q = 0; pool > 0; q = (q + 1) % NF_OQ_QUEUES, pool--)
+		units[q]++;
+#undef NF_OQ_AT
+
+	memset(plan, 0, sizeof(*plan));
+	rest = words - min_words * NF_OQ_QUEUES - U * quantum;
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		size = min_words + units[q] * quantum;
+		if (q == NF_OQ_QUEUES - 1)
+			size += rest;
+		plan->nqp_lo[q] = base;
+		plan->nqp_hi[q] = base + size - 1;
+		plan->nqp_thresh[q] = size < NF_OQ_FULL_THRESH ? size :
+		    NF_OQ_FULL_THRESH;
+		base += size;
+		plan->nqp_drops[q] = nf_oq_expected_drops(pr, q,
+		    (uint64_t)(size - 1) * NF_OQ_WORD_BYTES);
+		plan->nqp_drops_total += plan->nqp_drops[q];
+	}
+	free(cost);
+	free(best);
+	free(choice);
+	return (0);
+}
+
+/*
+ * Give the queues the SRAM windows and full thresholds of ``plan'', all
+ * in one batch. There's no switch for storing packets, so every queue
+ * is made to look full first, which drops (and counts) what arrives
+ * meanwhile. Sending is stopped too, and queues are initialised in
+ * their new windows before both are turned back on; packets queued at
+ * the time are lost.
+ */
+int
+nf_oq_plan_apply(struct netfpga *nf, const struct nf_oq_plan *plan)
+{
+	struct nf_regop ops[NF_OQ_QUEUES * 7], *op;
+	uint32_t ctl[NF_OQ_QUEUES], lo[NF_OQ_QUEUES], hi[NF_OQ_QUEUES];
+	uint32_t thresh[NF_OQ_QUEUES];
+	int q;
+
+	nf_assert(nf);
+	ASSERT(plan != NULL);
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		ops[q].nro_op = NF_REGOP_READ;
+		ops[q].nro_reg = NF_OQ_REG(OQ_CONTROL_REG_0, q);
+		ops[q].nro_value = 0;
+	}
+	if (nf_regv(nf, ops, NF_OQ_QUEUES) != NF_OQ_QUEUES)
+		return (nf_erri(nf, "Couldn't read output queue control"));
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		ctl[q] = ops[q].nro_value &
+		    ~(1U << OQ_INITIALIZE_OQ_BIT_NUM);
+
+	op = ops;
+#define NF_OQ_WR(r, v)	do {						\
+	op->nro_op = NF_REGOP_WRITE;					\
+	op->nro_reg = (r);						\
+	op->nro_value = (v);						\
+	op++;								\
+} while (0)
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		NF_OQ_WR(NF_OQ_REG(OQ_FULL_THRESH_REG_0, q), UINT32_MAX);
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		NF_OQ_WR(NF_OQ_REG(OQ_CONTROL_REG_0, q),
+		    ctl[q] & ~(1U << OQ_ENABLE_SEND_BIT_NUM));
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		NF_OQ_WR(NF_OQ_REG(OQ_ADDRESS_LO_REG_0, q), plan->nqp_lo[q]);
+		NF_OQ_WR(NF_OQ_REG(OQ_ADDRESS_HI_REG_0, q), plan->nqp_hi[q]);
+	}
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		NF_OQ_WR(NF_OQ_REG(OQ_CONTROL_REG_0, q),
+		    ctl[q] | (1U << OQ_INITIALIZE_OQ_BIT_NUM));
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		NF_OQ_WR(NF_OQ_REG(OQ_CONTROL_REG_0, q), ctl[q]);
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		NF_OQ_WR(NF_OQ_REG(OQ_FULL_THRESH_REG_0, q),
+		    plan->nqp_thresh[q]);
+#undef NF_OQ_WR
+	if (nf_regv(nf, ops, op - ops) != op - ops)
+		return (nf_erri(nf, "Couldn't change output queue windows"));
+
+	if (nf_oq_layout(nf, lo, hi, thresh) != 0)
+		return (-1);
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		if (lo[q] != plan->nqp_lo[q] || hi[q] != plan->nqp_hi[q])
+			return (nf_erri(nf, "Queue %d window is %#x-%#x, not "
+			    "%#x-%#x", q, lo[q], hi[q], plan->nqp_lo[q],
+			    plan->nqp_hi[q]));
+		if (thresh[q] != plan->nqp_thresh[q])
+			return (nf_erri(nf, "Queue %d full threshold is %u, "
+			    "not %u", q, thresh[q], plan->nqp_thresh[q]));
+	}
+	return (0);
+}
@@ -0,0 +1,139 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Reading classic pcap files, for tools which replay or decode traffic
+ * captured off the card. No libpcap needed.
+ */
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netfpga.h"
+
+#define NF_PCAP_MAGIC		0xa1b2c3d4	/* Microsecond timestamps */
+#define NF_PCAP_MAGIC_NS	0xa1b23c4d	/* Nanosecond timestamps */
+#define NF_PCAP_HDR_LEN		24
+#define NF_PCAP_REC_LEN		16
+#define NF_PCAP_LINKTYPE_ETHER	1
+
+static uint32_t
+nf_pcap_u32(const uint8_t *p, int swap)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	if (swap)
+		v = (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) |
+		    (v << 24);
+	return (v);
+}
+
+/*
+ * Call ``cb'' for every Ethernet frame in pcap file ``fname''. The file
+ * is read in whole first, so that callbacks don't wait for I/O. Stops
+ * early if ``cb'' returns non-zero. Number of frames seen is stored in
+ * ``pkts'' if it's not NULL.
+ */
+int
+nf_pcap_foreach(struct netfpga *nf, const char *fname, nf_pcap_cb_t *cb,
+    void *arg, uint64_t *pkts)
+{
+	uint8_t *buf, *p, *end;
+	uint32_t magic, len;
+	uint64_t ts, n;
+	long size;
+	FILE *fp;
+	int swap, ns, ret;
+
+	nf_assert(nf);
+	ASSERT(fname != NULL);
+	ASSERT(cb != NULL);
+	fp = fopen(fname, "r");
+	if (fp == NULL)
+		return (nf_erri(nf, "Couldn't open '%s': %s", fname,
+		    strerror(errno)));
+	buf = NULL;
+	if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+	    fseek(fp, 0, SEEK_SET) != 0) {
+		ret = nf_erri(nf, "Couldn't get size of '%s'", fname);
+		goto out;
+	}
+	buf = malloc(size + 1);
+	ASSERT(buf != NULL);
+	if (fread(buf, 1, size, fp) != (size_t)size) {
+		ret = nf_erri(nf, "Couldn't read '%s'", fname);
+		goto out;
+	}
+	if (size < NF_PCAP_HDR_LEN) {
+		ret = nf_erri(nf, "'%s' is too short", fname);
+		goto out;
+	}
+	magic = nf_pcap_u32(buf, 0);
+	swap = (magic != NF_PCAP_MAGIC && magic != NF_PCAP_MAGIC_NS);
+	magic = nf_pcap_u32(buf, swap);
+	if (magic != NF_PCAP_MAGIC && magic != NF_PCAP_MAGIC_NS) {
+		ret = nf_erri(nf, "'%s' isn't a pcap file", fname);
+		goto out;
+	}
+	ns = (magic == NF_PCAP_MAGIC_NS);
+	if (nf_pcap_u32(buf + 20, swap) != NF_PCAP_LINKTYPE_ETHER) {
+		ret = nf_erri(nf, "'%s' doesn't hold Ethernet frames", fname);
+		goto out;
+	}
+	n = 0;
+	ret = 0;
+	end = buf + size;
+	for (p = buf + NF_PCAP_HDR_LEN; ret == 0 &&
+	    end - p >= NF_PCAP_REC_LEN; p += NF_PCAP_REC_LEN + len) {
+		len = nf_pcap_u32(p + 8, swap);
+		if ((size_t)(end - p - NF_PCAP_REC_LEN) < len) {
+			ret = nf_erri(nf, "'%s' is truncated", fname);
+			break;
+		}
+		ts = nf_pcap_u32(p, swap) * 1000000000ULL +
+		    nf_pcap_u32(p + 4, swap) * (ns ? 1ULL : 1000ULL);
+		ret = cb(arg, p + NF_PCAP_REC_LEN, len, ts);
+		n++;
+	}
+	if (pkts != NULL)
+		*pkts = n;
+	if (ret > 0)
+		ret = 0;
+out:
+	free(buf);
+	fclose(fp);
+	return (ret);
+}
@@ -0,0 +1,618 @@
+/*
+ * Registers of include/reg_defines.h, for when the driver can't tell us
+ * what it was built with. Generated with:
+ *
+ *	awk '$1 == "#define" && $2 ~ /_REG(_[0-9]+)?$/ {
+ *	    print "NF_REGDEF(" $2 ")" }' include/reg_defines.h
+ */
+NF_REGDEF(CPCI_ID_REG)
+NF_REGDEF(CPCI_BOARD_ID_REG)
+NF_REGDEF(CPCI_CONTROL_REG)
+NF_REGDEF(CPCI_RESET_REG)
+NF_REGDEF(CPCI_ERROR_REG)
+NF_REGDEF(CPCI_DUMMY_REG)
+NF_REGDEF(CPCI_INTERRUPT_MASK_REG)
+NF_REGDEF(CPCI_INTERRUPT_STATUS_REG)
+NF_REGDEF(CPCI_CNET_CLK_SEL_REG)
+NF_REGDEF(CPCI_REPROG_DATA_REG)
+NF_REGDEF(CPCI_REPROG_STATUS_REG)
+NF_REGDEF(CPCI_REPROG_CTRL_REG)
+NF_REGDEF(CPCI_DMA_ADDR_I_REG)
+NF_REGDEF(CPCI_DMA_ADDR_E_REG)
+NF_REGDEF(CPCI_DMA_SIZE_I_REG)
+NF_REGDEF(CPCI_DMA_SIZE_E_REG)
+NF_REGDEF(CPCI_DMA_CTRL_I_REG)
+NF_REGDEF(CPCI_DMA_CTRL_E_REG)
+NF_REGDEF(CPCI_DMA_XFER_TIME_REG)
+NF_REGDEF(CPCI_DMA_RETRIES_REG)
+NF_REGDEF(CPCI_CNET_READ_TIME_REG)
+NF_REGDEF(CPCI_DMA_INGRESS_PKT_CNT_REG)
+NF_REGDEF(CPCI_DMA_EGRESS_PKT_CNT_REG)
+NF_REGDEF(CPCI_CPCI_REG_READ_CNT_REG)
+NF_REGDEF(CPCI_CPCI_REG_WRITE_CNT_REG)
+NF_REGDEF(CPCI_CNET_REG_READ_CNT_REG)
+NF_REGDEF(CPCI_CNET_REG_WRITE_CNT_REG)
+NF_REGDEF(CPCI_CLOCK_CHECK_N_CLK_REG)
+NF_REGDEF(CPCI_CLOCK_CHECK_P_MAX_REG)
+NF_REGDEF(CPCI_CLOCK_CHECK_N_EXP_REG)
+NF_REGDEF(CPCI_PCI_CLK_COUNTER_REG)
+NF_REGDEF(CPCI_CPCI_RESET_COUNTER_REG)
+NF_REGDEF(DEVICE_MD5_1_REG)
+NF_REGDEF(DEVICE_MD5_2_REG)
+NF_REGDEF(DEVICE_MD5_3_REG)
+NF_REGDEF(DEVICE_MD5_4_REG)
+NF_REGDEF(DEVICE_ID_REG)
+NF_REGDEF(DEVICE_REVISION_REG)
+NF_REGDEF(DEVICE_CPCI_ID_REG)
+NF_REGDEF(DEVICE_STR_REG)
+NF_REGDEF(SRAM_BASE_ADDR_REG)
+NF_REGDEF(MAC_GRP_0_CONTROL_REG)
+NF_REGDEF(RX_QUEUE_0_NUM_PKTS_STORED_REG)
+NF_REGDEF(RX_QUEUE_0_NUM_PKTS_DROPPED_FULL_REG)
+NF_REGDEF(RX_QUEUE_0_NUM_PKTS_DROPPED_BAD_REG)
+NF_REGDEF(RX_QUEUE_0_NUM_WORDS_PUSHED_REG)
+NF_REGDEF(RX_QUEUE_0_NUM_BYTES_PUSHED_REG)
+NF_REGDEF(RX_QUEUE_0_NUM_PKTS_DEQUEUED_REG)
+NF_REGDEF(RX_QUEUE_0_NUM_PKTS_IN_QUEUE_REG)
+NF_REGDEF(TX_QUEUE_0_NUM_PKTS_IN_QUEUE_REG)
+NF_REGDEF(TX_QUEUE_0_NUM_PKTS_SENT_REG)
+NF_REGDEF(TX_QUEUE_0_NUM_WORDS_PUSHED_REG)
+NF_REGDEF(TX_QUEUE_0_NUM_BYTES_PUSHED_REG)
+NF_REGDEF(TX_QUEUE_0_NUM_PKTS_ENQUEUED_REG)
+NF_REGDEF(MAC_GRP_1_CONTROL_REG)
+NF_REGDEF(RX_QUEUE_1_NUM_PKTS_STORED_REG)
+NF_REGDEF(RX_QUEUE_1_NUM_PKTS_DROPPED_FULL_REG)
+NF_REGDEF(RX_QUEUE_1_NUM_PKTS_DROPPED_BAD_REG)
+NF_REGDEF(RX_QUEUE_1_NUM_WORDS_PUSHED_REG)
+NF_REGDEF(RX_QUEUE_1_NUM_BYTES_PUSHED_REG)
+NF_REGDEF(RX_QUEUE_1_NUM_PKTS_DEQUEUED_REG)
+NF_REGDEF(RX_QUEUE_1_NUM_PKTS_IN_QUEUE_REG)
+NF_REGDEF(TX_QUEUE_1_NUM_PKTS_IN_QUEUE_REG)
+NF_REGDEF(TX_QUEUE_1_NUM_PKTS_SENT_REG)
+NF_REGDEF(TX_QUEUE_1_NUM_WORDS_PUSHED_REG)
+NF_REGDEF(TX_QUEUE_1_NUM_BYTES_PUSHED_REG)
+NF_REGDEF(TX_QUEUE_1_NUM_PKTS_ENQUEUED_REG)
+NF_REGDEF(MAC_GRP_2_CONTROL_REG)
+NF_REGDEF(RX_QUEUE_2_NUM_PKTS_STORED_REG)
+NF_REGDEF(RX_QUEUE_2_NUM_PKTS_DROPPED_FULL_REG)
+NF_REGDEF(RX_QUEUE_2_NUM_PKTS_DROPPED_BAD_REG)
+NF_REGDEF(RX_QUEUE_2_NUM_WORDS_PUSHED_REG)
+NF_REGDEF(RX_QUEUE_2_NUM_BYTES_PUSHED_REG)
+NF_REGDEF(RX_QUEUE_2_NUM_PKTS_DEQUEUED_REG)
+NF_REGDEF(RX_QUEUE_2_NUM_PKTS_IN_QUEUE_REG)
+NF_REGDEF(TX_QUEUE_2_NUM_PKTS_IN_QUEUE_REG)
+NF_REGDEF(TX_QUEUE_2_NUM_PKTS_SENT_REG)
+NF_REGDEF(TX_QUEUE_2_NUM_WORDS_PUSHED_REG)
+NF_REGDEF(TX_QUEUE_2_NUM_BYTES_PUSHED_REG)
+NF_REGDEF(TX_QUEUE_2_NUM_PKTS_ENQUEUED_REG)
+NF_REGDEF(MAC_GRP_3_CONTROL_REG)
+NF_REGDEF(RX_QUEUE_3_NUM_PKTS_STORED_REG)
+NF_REGDEF(RX_QUEUE_3_NUM_PKTS_DROPPED_FULL_REG)
+NF_REGDEF(RX_QUEUE_3_NUM_PKTS_DROPPED_BAD_REG)
+NF_REGDEF(RX_QUEUE_3_NUM_WORDS_PUSHED_REG)
+NF_REGDEF(RX_QUEUE_3_NUM_BYTES_PUSHED_REG)
+NF_REGDEF(RX_QUEUE_3_NUM_PKTS_DEQUEUED_REG)
+NF_REGDEF(RX_QUEUE_3_NUM_PKTS_IN_QUEUE_REG)
+NF_REGDEF(TX_QUEUE_3_NUM_PKTS_IN_QUEUE_REG)
+NF_REGDEF(TX_QUEUE_3_NUM_PKTS_SENT_REG)
+NF_REGDEF(TX_QUEUE_3_NUM_WORDS_PUSHED_REG)
+NF_REGDEF(TX_QUEUE_3_NUM_BYTES_PUSHED_REG)
+NF_REGDEF(TX_QUEUE_3_NUM_PKTS_ENQUEUED_REG)
+NF_REGDEF(CPU_REG_Q_0_WR_DATA_WORD_REG)
+NF_REGDEF(CPU_REG_Q_0_WR_CTRL_WORD_REG)
+NF_REGDEF(CPU_REG_Q_0_WR_NUM_WORDS_LEFT_REG)
+NF_REGDEF(CPU_REG_Q_0_WR_NUM_PKTS_IN_Q_REG)
+NF_REGDEF(CPU_REG_Q_0_RD_DATA_WORD_REG)
+NF_REGDEF(CPU_REG_Q_0_RD_CTRL_WORD_REG)
+NF_REGDEF(CPU_REG_Q_0_RD_NUM_WORDS_AVAIL_REG)
+NF_REGDEF(CPU_REG_Q_0_RD_NUM_PKTS_IN_Q_REG)
+NF_REGDEF(CPU_REG_Q_0_RX_NUM_PKTS_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_0_TX_NUM_PKTS_SENT_REG)
+NF_REGDEF(CPU_REG_Q_0_RX_NUM_WORDS_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_0_TX_NUM_WORDS_SENT_REG)
+NF_REGDEF(CPU_REG_Q_0_RX_NUM_BYTES_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_0_TX_NUM_BYTES_SENT_REG)
+NF_REGDEF(CPU_REG_Q_1_WR_DATA_WORD_REG)
+NF_REGDEF(CPU_REG_Q_1_WR_CTRL_WORD_REG)
+NF_REGDEF(CPU_REG_Q_1_WR_NUM_WORDS_LEFT_REG)
+NF_REGDEF(CPU_REG_Q_1_WR_NUM_PKTS_IN_Q_REG)
+NF_REGDEF(CPU_REG_Q_1_RD_DATA_WORD_REG)
+NF_REGDEF(CPU_REG_Q_1_RD_CTRL_WORD_REG)
+NF_REGDEF(CPU_REG_Q_1_RD_NUM_WORDS_AVAIL_REG)
+NF_REGDEF(CPU_REG_Q_1_RD_NUM_PKTS_IN_Q_REG)
+NF_REGDEF(CPU_REG_Q_1_RX_NUM_PKTS_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_1_TX_NUM_PKTS_SENT_REG)
+NF_REGDEF(CPU_REG_Q_1_RX_NUM_WORDS_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_1_TX_NUM_WORDS_SENT_REG)
+NF_REGDEF(CPU_REG_Q_1_RX_NUM_BYTES_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_1_TX_NUM_BYTES_SENT_REG)
+NF_REGDEF(CPU_REG_Q_2_WR_DATA_WORD_REG)
+NF_REGDEF(CPU_REG_Q_2_WR_CTRL_WORD_REG)
+NF_REGDEF(CPU_REG_Q_2_WR_NUM_WORDS_LEFT_REG)
+NF_REGDEF(CPU_REG_Q_2_WR_NUM_PKTS_IN_Q_REG)
+NF_REGDEF(CPU_REG_Q_2_RD_DATA_WORD_REG)
+NF_REGDEF(CPU_REG_Q_2_RD_CTRL_WORD_REG)
+NF_REGDEF(CPU_REG_Q_2_RD_NUM_WORDS_AVAIL_REG)
+NF_REGDEF(CPU_REG_Q_2_RD_NUM_PKTS_IN_Q_REG)
+NF_REGDEF(CPU_REG_Q_2_RX_NUM_PKTS_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_2_TX_NUM_PKTS_SENT_REG)
+NF_REGDEF(CPU_REG_Q_2_RX_NUM_WORDS_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_2_TX_NUM_WORDS_SENT_REG)
+NF_REGDEF(CPU_REG_Q_2_RX_NUM_BYTES_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_2_TX_NUM_BYTES_SENT_REG)
+NF_REGDEF(CPU_REG_Q_3_WR_DATA_WORD_REG)
+NF_REGDEF(CPU_REG_Q_3_WR_CTRL_WORD_REG)
+NF_REGDEF(CPU_REG_Q_3_WR_NUM_WORDS_LEFT_REG)
+NF_REGDEF(CPU_REG_Q_3_WR_NUM_PKTS_IN_Q_REG)
+NF_REGDEF(CPU_REG_Q_3_RD_DATA_WORD_REG)
+NF_REGDEF(CPU_REG_Q_3_RD_CTRL_WORD_REG)
+NF_REGDEF(CPU_REG_Q_3_RD_NUM_WORDS_AVAIL_REG)
+NF_REGDEF(CPU_REG_Q_3_RD_NUM_PKTS_IN_Q_REG)
+NF_REGDEF(CPU_REG_Q_3_RX_NUM_PKTS_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_3_TX_NUM_PKTS_SENT_REG)
+NF_REGDEF(CPU_REG_Q_3_RX_NUM_WORDS_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_3_TX_NUM_WORDS_SENT_REG)
+NF_REGDEF(CPU_REG_Q_3_RX_NUM_BYTES_RCVD_REG)
+NF_REGDEF(CPU_REG_Q_3_TX_NUM_BYTES_SENT_REG)
+NF_REGDEF(CLK_SYN_0_TX_LO_REG)
+NF_REGDEF(CLK_SYN_0_TX_HI_REG)
+NF_REGDEF(CLK_SYN_0_RX_LO_REG)
+NF_REGDEF(CLK_SYN_0_RX_HI_REG)
+NF_REGDEF(CLK_SYN_1_TX_LO_REG)
+NF_REGDEF(CLK_SYN_1_TX_HI_REG)
+NF_REGDEF(CLK_SYN_1_RX_LO_REG)
+NF_REGDEF(CLK_SYN_1_RX_HI_REG)
+NF_REGDEF(CLK_SYN_2_TX_LO_REG)
+NF_REGDEF(CLK_SYN_2_TX_HI_REG)
+NF_REGDEF(CLK_SYN_2_RX_LO_REG)
+NF_REGDEF(CLK_SYN_2_RX_HI_REG)
+NF_REGDEF(CLK_SYN_3_TX_LO_REG)
+NF_REGDEF(CLK_SYN_3_TX_HI_REG)
+NF_REGDEF(CLK_SYN_3_RX_LO_REG)
+NF_REGDEF(CLK_SYN_3_RX_HI_REG)
+NF_REGDEF(PTP_VALID_RX_REG)
+NF_REGDEF(PTP_VALID_TX_REG)
+NF_REGDEF(PTP_ENABLE_MASK_RX_REG)
+NF_REGDEF(PTP_ENABLE_MASK_TX_REG)
+NF_REGDEF(PTP_MASK_RX_REG)
+NF_REGDEF(PTP_MASK_TX_REG)
+NF_REGDEF(DMA_TX_QUE_0_REG)
+NF_REGDEF(DMA_TX_QUE_0_LAST_1_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_0_LAST_2_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_0_LAST_3_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_0_LAST_4_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_1_REG)
+NF_REGDEF(DMA_TX_QUE_1_LAST_1_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_1_LAST_2_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_1_LAST_3_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_1_LAST_4_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_2_REG)
+NF_REGDEF(DMA_TX_QUE_2_LAST_1_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_2_LAST_2_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_2_LAST_3_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_2_LAST_4_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_3_REG)
+NF_REGDEF(DMA_TX_QUE_3_LAST_1_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_3_LAST_2_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_3_LAST_3_BYTE_REG)
+NF_REGDEF(DMA_TX_QUE_3_LAST_4_BYTE_REG)
+NF_REGDEF(MDIO_0_CONTROL_REG)
+NF_REGDEF(MDIO_0_STATUS_REG)
+NF_REGDEF(MDIO_0_PHY_ID_0_REG)
+NF_REGDEF(MDIO_0_PHY_ID_1_REG)
+NF_REGDEF(MDIO_0_AUTONEGOTIATION_ADVERT_REG)
+NF_REGDEF(MDIO_0_AUTONEG_LINK_PARTNER_BASE_PAGE_ABILITY_REG)
+NF_REGDEF(MDIO_0_AUTONEG_EXPANSION_REG)
+NF_REGDEF(MDIO_0_AUTONEG_NEXT_PAGE_TX_REG)
+NF_REGDEF(MDIO_0_AUTONEG_LINK_PARTNER_RCVD_NEXT_PAGE_REG)
+NF_REGDEF(MDIO_0_MASTER_SLAVE_CTRL_REG)
+NF_REGDEF(MDIO_0_MASTER_SLAVE_STATUS_REG)
+NF_REGDEF(MDIO_0_PSE_CTRL_REG)
+NF_REGDEF(MDIO_0_PSE_STATUS_REG)
+NF_REGDEF(MDIO_0_MMD_ACCESS_CTRL_REG)
+NF_REGDEF(MDIO_0_MMD_ACCESS_STATUS_REG)
+NF_REGDEF(MDIO_0_EXTENDED_STATUS_REG)
+NF_REGDEF(MDIO_0_INTERRUPT_MASK_REG)
+NF_REGDEF(MDIO_1_CONTROL_REG)
+NF_REGDEF(MDIO_1_STATUS_REG)
+NF_REGDEF(MDIO_1_PHY_ID_0_REG)
+NF_REGDEF(MDIO_1_PHY_ID_1_REG)
+NF_REGDEF(MDIO_1_AUTONEGOTIATION_ADVERT_REG)
+NF_REGDEF(MDIO_1_AUTONEG_LINK_PARTNER_BASE_PAGE_ABILITY_REG)
+NF_REGDEF(MDIO_1_AUTONEG_EXPANSION_REG)
+NF_REGDEF(MDIO_1_AUTONEG_NEXT_PAGE_TX_REG)
+NF_REGDEF(MDIO_1_AUTONEG_LINK_PARTNER_RCVD_NEXT_PAGE_REG)
+NF_REGDEF(MDIO_1_MASTER_SLAVE_CTRL_REG)
+NF_REGDEF(MDIO_1_MASTER_SLAVE_STATUS_REG)
+NF_REGDEF(MDIO_1_PSE_CTRL_REG)
+NF_REGDEF(MDIO_1_PSE_STATUS_REG)
+NF_REGDEF(MDIO_1_MMD_ACCESS_CTRL_REG)
+NF_REGDEF(MDIO_1_MMD_ACCESS_STATUS_REG)
+NF_REGDEF(MDIO_1_EXTENDED_STATUS_REG)
+NF_REGDEF(MDIO_1_INTERRUPT_MASK_REG)
+NF_REGDEF(MDIO_2_CONTROL_REG)
+NF_REGDEF(MDIO_2_STATUS_REG)
+NF_REGDEF(MDIO_2_PHY_ID_0_REG)
+NF_REGDEF(MDIO_2_PHY_ID_1_REG)
+NF_REGDEF(MDIO_2_AUTONEGOTIATION_ADVERT_REG)
+NF_REGDEF(MDIO_2_AUTONEG_LINK_PARTNER_BASE_PAGE_ABILITY_REG)
+NF_REGDEF(MDIO_2_AUTONEG_EXPANSION_REG)
+NF_REGDEF(MDIO_2_AUTONEG_NEXT_PAGE_TX_REG)
+NF_REGDEF(MDIO_2_AUTONEG_LINK_PARTNER_RCVD_NEXT_PAGE_REG)
+NF_REGDEF(MDIO_2_MASTER_SLAVE_CTRL_REG)
+NF_REGDEF(MDIO_2_MASTER_SLAVE_STATUS_REG)
+NF_REGDEF(MDIO_2_PSE_CTRL_REG)
+NF_REGDEF(MDIO_2_PSE_STATUS_REG)
+NF_REGDEF(MDIO_2_MMD_ACCESS_CTRL_REG)
+NF_REGDEF(MDIO_2_MMD_ACCESS_STATUS_REG)
+NF_REGDEF(MDIO_2_EXTENDED_STATUS_REG)
+NF_REGDEF(MDIO_2_INTERRUPT_MASK_REG)
+NF_REGDEF(MDIO_3_CONTROL_REG)
+NF_REGDEF(MDIO_3_STATUS_REG)
+NF_REGDEF(MDIO_3_PHY_ID_0_REG)
+NF_REGDEF(MDIO_3_PHY_ID_1_REG)
+NF_REGDEF(MDIO_3_AUTONEGOTIATION_ADVERT_REG)
+NF_REGDEF(MDIO_3_AUTONEG_LINK_PARTNER_BASE_PAGE_ABILITY_REG)
+NF_REGDEF(MDIO_3_AUTONEG_EXPANSION_REG)
+NF_REGDEF(MDIO_3_AUTONEG_NEXT_PAGE_TX_REG)
+NF_REGDEF(MDIO_3_AUTONEG_LINK_PARTNER_RCVD_NEXT_PAGE_REG)
+NF_REGDEF(MDIO_3_MASTER_SLAVE_CTRL_REG)
+NF_REGDEF(MDIO_3_MASTER_SLAVE_STATUS_REG)
+NF_REGDEF(MDIO_3_PSE_CTRL_REG)
+NF_REGDEF(MDIO_3_PSE_STATUS_REG)
+NF_REGDEF(MDIO_3_MMD_ACCESS_CTRL_REG)
+NF_REGDEF(MDIO_3_MMD_ACCESS_STATUS_REG)
+NF_REGDEF(MDIO_3_EXTENDED_STATUS_REG)
+NF_REGDEF(MDIO_3_INTERRUPT_MASK_REG)
+NF_REGDEF(STAMP_COUNTER_1_REG)
+NF_REGDEF(STAMP_COUNTER_2_REG)
+NF_REGDEF(STAMP_COUNTER_3_REG)
+NF_REGDEF(STAMP_COUNTER_4_REG)
+NF_REGDEF(CLK_TEST_TICKS_REG)
+NF_REGDEF(SERIAL_TEST_CONTROL_0_REG)
+NF_REGDEF(SERIAL_TEST_STATUS_0_REG)
+NF_REGDEF(SERIAL_TEST_NUM_FRAMES_SENT_0_LO_REG)
+NF_REGDEF(SERIAL_TEST_NUM_FRAMES_RCVD_0_LO_REG)
+NF_REGDEF(SERIAL_TEST_NUM_FRAMES_SENT_0_HI_REG)
+NF_REGDEF(SERIAL_TEST_NUM_FRAMES_RCVD_0_HI_REG)
+NF_REGDEF(SERIAL_TEST_CONTROL_1_REG)
+NF_REGDEF(SERIAL_TEST_STATUS_1_REG)
+NF_REGDEF(SERIAL_TEST_NUM_FRAMES_SENT_1_LO_REG)
+NF_REGDEF(SERIAL_TEST_NUM_FRAMES_RCVD_1_LO_REG)
+NF_REGDEF(SERIAL_TEST_NUM_FRAMES_SENT_1_HI_REG)
+NF_REGDEF(SERIAL_TEST_NUM_FRAMES_RCVD_1_HI_REG)
+NF_REGDEF(SERIAL_TEST_CTRL_REG)
+NF_REGDEF(SERIAL_TEST_STAT_REG)
+NF_REGDEF(SRAM_MSB_SRAM1_RD_REG)
+NF_REGDEF(SRAM_MSB_SRAM1_WR_REG)
+NF_REGDEF(SRAM_MSB_SRAM2_RD_REG)
+NF_REGDEF(SRAM_MSB_SRAM2_WR_REG)
+NF_REGDEF(SRAM_TEST_ERR_CNT_REG)
+NF_REGDEF(SRAM_TEST_ITER_NUM_REG)
+NF_REGDEF(SRAM_TEST_BAD_RUNS_REG)
+NF_REGDEF(SRAM_TEST_GOOD_RUNS_REG)
+NF_REGDEF(SRAM_TEST_STATUS_REG)
+NF_REGDEF(SRAM_TEST_EN_REG)
+NF_REGDEF(SRAM_TEST_CTRL_REG)
+NF_REGDEF(SRAM_TEST_RAND_SEED_1_REG)
+NF_REGDEF(SRAM_TEST_RAND_SEED_2_REG)
+NF_REGDEF(SRAM_TEST_LOG_ADDR_REG)
+NF_REGDEF(SRAM_TEST_LOG_EXP_DATA_HI_REG)
+NF_REGDEF(SRAM_TEST_LOG_EXP_DATA_LO_REG)
+NF_REGDEF(SRAM_TEST_LOG_RD_DATA_HI_REG)
+NF_REGDEF(SRAM_TEST_LOG_RD_DATA_LO_REG)
+NF_REGDEF(DRAM_TEST_ERR_CNT_REG)
+NF_REGDEF(DRAM_TEST_ITER_NUM_REG)
+NF_REGDEF(DRAM_TEST_BAD_RUNS_REG)
+NF_REGDEF(DRAM_TEST_GOOD_RUNS_REG)
+NF_REGDEF(DRAM_TEST_STATUS_REG)
+NF_REGDEF(DRAM_TEST_EN_REG)
+NF_REGDEF(DRAM_TEST_CTRL_REG)
+NF_REGDEF(DRAM_TEST_RAND_SEED_REG)
+NF_REGDEF(DRAM_TEST_LOG_ADDR_REG)
+NF_REGDEF(DRAM_TEST_LOG_EXP_DATA_HI_REG)
+NF_REGDEF(DRAM_TEST_LOG_EXP_DATA_LO_REG)
+NF_REGDEF(DRAM_TEST_LOG_RD_DATA_HI_REG)
+NF_REGDEF(DRAM_TEST_LOG_RD_DATA_LO_REG)
+NF_REGDEF(PHY_TEST_STATUS_REG)
+NF_REGDEF(PHY_TEST_CTRL_REG)
+NF_REGDEF(PHY_TEST_SIZE_REG)
+NF_REGDEF(PHY_TEST_PATTERN_REG)
+NF_REGDEF(PHY_TEST_INIT_SEQ_NO_REG)
+NF_REGDEF(PHY_TEST_PHY_0_TX_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_0_TX_ITER_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_0_TX_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_0_TX_SEQ_NO_REG)
+NF_REGDEF(PHY_TEST_PHY_0_TX_RAND_SEED_REG)
+NF_REGDEF(PHY_TEST_PHY_0_RX_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_0_RX_GOOD_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_0_RX_ERR_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_0_RX_SEQ_NO_REG)
+NF_REGDEF(PHY_TEST_PHY_0_RX_CTRL_REG)
+NF_REGDEF(PHY_TEST_PHY_0_RX_LOG_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_0_RX_LOG_EXP_DATA_REG)
+NF_REGDEF(PHY_TEST_PHY_0_RX_LOG_RX_DATA_REG)
+NF_REGDEF(PHY_TEST_PHY_0_RX_LOG_CTRL_REG)
+NF_REGDEF(PHY_TEST_PHY_1_TX_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_1_TX_ITER_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_1_TX_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_1_TX_SEQ_NO_REG)
+NF_REGDEF(PHY_TEST_PHY_1_TX_RAND_SEED_REG)
+NF_REGDEF(PHY_TEST_PHY_1_RX_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_1_RX_GOOD_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_1_RX_ERR_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_1_RX_SEQ_NO_REG)
+NF_REGDEF(PHY_TEST_PHY_1_RX_CTRL_REG)
+NF_REGDEF(PHY_TEST_PHY_1_RX_LOG_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_1_RX_LOG_EXP_DATA_REG)
+NF_REGDEF(PHY_TEST_PHY_1_RX_LOG_RX_DATA_REG)
+NF_REGDEF(PHY_TEST_PHY_1_RX_LOG_CTRL_REG)
+NF_REGDEF(PHY_TEST_PHY_2_TX_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_2_TX_ITER_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_2_TX_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_2_TX_SEQ_NO_REG)
+NF_REGDEF(PHY_TEST_PHY_2_TX_RAND_SEED_REG)
+NF_REGDEF(PHY_TEST_PHY_2_RX_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_2_RX_GOOD_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_2_RX_ERR_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_2_RX_SEQ_NO_REG)
+NF_REGDEF(PHY_TEST_PHY_2_RX_CTRL_REG)
+NF_REGDEF(PHY_TEST_PHY_2_RX_LOG_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_2_RX_LOG_EXP_DATA_REG)
+NF_REGDEF(PHY_TEST_PHY_2_RX_LOG_RX_DATA_REG)
+NF_REGDEF(PHY_TEST_PHY_2_RX_LOG_CTRL_REG)
+NF_REGDEF(PHY_TEST_PHY_3_TX_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_3_TX_ITER_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_3_TX_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_3_TX_SEQ_NO_REG)
+NF_REGDEF(PHY_TEST_PHY_3_TX_RAND_SEED_REG)
+NF_REGDEF(PHY_TEST_PHY_3_RX_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_3_RX_GOOD_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_3_RX_ERR_PKT_CNT_REG)
+NF_REGDEF(PHY_TEST_PHY_3_RX_SEQ_NO_REG)
+NF_REGDEF(PHY_TEST_PHY_3_RX_CTRL_REG)
+NF_REGDEF(PHY_TEST_PHY_3_RX_LOG_STATUS_REG)
+NF_REGDEF(PHY_TEST_PHY_3_RX_LOG_EXP_DATA_REG)
+NF_REGDEF(PHY_TEST_PHY_3_RX_LOG_RX_DATA_REG)
+NF_REGDEF(PHY_TEST_PHY_3_RX_LOG_CTRL_REG)
+NF_REGDEF(REG_FILE_BASE_ADDR_REG)
+NF_REGDEF(IN_ARB_NUM_PKTS_SENT_REG)
+NF_REGDEF(IN_ARB_LAST_PKT_WORD_0_LO_REG)
+NF_REGDEF(IN_ARB_LAST_PKT_WORD_0_HI_REG)
+NF_REGDEF(IN_ARB_LAST_PKT_CTRL_0_REG)
+NF_REGDEF(IN_ARB_LAST_PKT_WORD_1_LO_REG)
+NF_REGDEF(IN_ARB_LAST_PKT_WORD_1_HI_REG)
+NF_REGDEF(IN_ARB_LAST_PKT_CTRL_1_REG)
+NF_REGDEF(IN_ARB_STATE_REG)
+NF_REGDEF(SWITCH_OP_LUT_PORTS_MAC_HI_REG)
+NF_REGDEF(SWITCH_OP_LUT_MAC_LO_REG)
+NF_REGDEF(SWITCH_OP_LUT_NUM_HITS_REG)
+NF_REGDEF(SWITCH_OP_LUT_NUM_MISSES_REG)
+NF_REGDEF(SWITCH_OP_LUT_MAC_LUT_RD_ADDR_REG)
+NF_REGDEF(SWITCH_OP_LUT_MAC_LUT_WR_ADDR_REG)
+NF_REGDEF(ROUTER_OP_LUT_ARP_MAC_HI_REG)
+NF_REGDEF(ROUTER_OP_LUT_ARP_MAC_LO_REG)
+NF_REGDEF(ROUTER_OP_LUT_ARP_NEXT_HOP_IP_REG)
+NF_REGDEF(ROUTER_OP_LUT_ARP_LUT_RD_ADDR_REG)
+NF_REGDEF(ROUTER_OP_LUT_ARP_LUT_WR_ADDR_REG)
+NF_REGDEF(ROUTER_OP_LUT_RT_IP_REG)
+NF_REGDEF(ROUTER_OP_LUT_RT_MASK_REG)
+NF_REGDEF(ROUTER_OP_LUT_RT_NEXT_HOP_IP_REG)
+NF_REGDEF(ROUTER_OP_LUT_RT_OUTPUT_PORT_REG)
+NF_REGDEF(ROUTER_OP_LUT_RT_LUT_RD_ADDR_REG)
+NF_REGDEF(ROUTER_OP_LUT_RT_LUT_WR_ADDR_REG)
+NF_REGDEF(ROUTER_OP_LUT_MAC_0_HI_REG)
+NF_REGDEF(ROUTER_OP_LUT_MAC_0_LO_REG)
+NF_REGDEF(ROUTER_OP_LUT_MAC_1_HI_REG)
+NF_REGDEF(ROUTER_OP_LUT_MAC_1_LO_REG)
+NF_REGDEF(ROUTER_OP_LUT_MAC_2_HI_REG)
+NF_REGDEF(ROUTER_OP_LUT_MAC_2_LO_REG)
+NF_REGDEF(ROUTER_OP_LUT_MAC_3_HI_REG)
+NF_REGDEF(ROUTER_OP_LUT_MAC_3_LO_REG)
+NF_REGDEF(ROUTER_OP_LUT_DST_IP_FILTER_IP_REG)
+NF_REGDEF(ROUTER_OP_LUT_DST_IP_FILTER_RD_ADDR_REG)
+NF_REGDEF(ROUTER_OP_LUT_DST_IP_FILTER_WR_ADDR_REG)
+NF_REGDEF(ROUTER_OP_LUT_ARP_NUM_MISSES_REG)
+NF_REGDEF(ROUTER_OP_LUT_LPM_NUM_MISSES_REG)
+NF_REGDEF(ROUTER_OP_LUT_NUM_CPU_PKTS_SENT_REG)
+NF_REGDEF(ROUTER_OP_LUT_NUM_BAD_OPTS_VER_REG)
+NF_REGDEF(ROUTER_OP_LUT_NUM_BAD_CHKSUMS_REG)
+NF_REGDEF(ROUTER_OP_LUT_NUM_BAD_TTLS_REG)
+NF_REGDEF(ROUTER_OP_LUT_NUM_NON_IP_RCVD_REG)
+NF_REGDEF(ROUTER_OP_LUT_NUM_PKTS_FORWARDED_REG)
+NF_REGDEF(ROUTER_OP_LUT_NUM_WRONG_DEST_REG)
+NF_REGDEF(ROUTER_OP_LUT_NUM_FILTERED_PKTS_REG)
+NF_REGDEF(OQ_NUM_WORDS_LEFT_REG_0)
+NF_REGDEF(OQ_NUM_PKT_BYTES_STORED_REG_0)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_STORED_REG_0)
+NF_REGDEF(OQ_NUM_PKTS_STORED_REG_0)
+NF_REGDEF(OQ_NUM_PKTS_DROPPED_REG_0)
+NF_REGDEF(OQ_NUM_PKT_BYTES_REMOVED_REG_0)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_REMOVED_REG_0)
+NF_REGDEF(OQ_NUM_PKTS_REMOVED_REG_0)
+NF_REGDEF(OQ_ADDRESS_HI_REG_0)
+NF_REGDEF(OQ_ADDRESS_LO_REG_0)
+NF_REGDEF(OQ_WR_ADDRESS_REG_0)
+NF_REGDEF(OQ_RD_ADDRESS_REG_0)
+NF_REGDEF(OQ_NUM_PKTS_IN_Q_REG_0)
+NF_REGDEF(OQ_MAX_PKTS_IN_Q_REG_0)
+NF_REGDEF(OQ_FULL_THRESH_REG_0)
+NF_REGDEF(OQ_NUM_WORDS_IN_Q_REG_0)
+NF_REGDEF(OQ_CONTROL_REG_0)
+NF_REGDEF(OQ_NUM_WORDS_LEFT_REG_1)
+NF_REGDEF(OQ_NUM_PKT_BYTES_STORED_REG_1)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_STORED_REG_1)
+NF_REGDEF(OQ_NUM_PKTS_STORED_REG_1)
+NF_REGDEF(OQ_NUM_PKTS_DROPPED_REG_1)
+NF_REGDEF(OQ_NUM_PKT_BYTES_REMOVED_REG_1)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_REMOVED_REG_1)
+NF_REGDEF(OQ_NUM_PKTS_REMOVED_REG_1)
+NF_REGDEF(OQ_ADDRESS_HI_REG_1)
+NF_REGDEF(OQ_ADDRESS_LO_REG_1)
+NF_REGDEF(OQ_WR_ADDRESS_REG_1)
+NF_REGDEF(OQ_RD_ADDRESS_REG_1)
+NF_REGDEF(OQ_NUM_PKTS_IN_Q_REG_1)
+NF_REGDEF(OQ_MAX_PKTS_IN_Q_REG_1)
+NF_REGDEF(OQ_FULL_THRESH_REG_1)
+NF_REGDEF(OQ_NUM_WORDS_IN_Q_REG_1)
+NF_REGDEF(OQ_CONTROL_REG_1)
+NF_REGDEF(OQ_NUM_WORDS_LEFT_REG_2)
+NF_REGDEF(OQ_NUM_PKT_BYTES_STORED_REG_2)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_STORED_REG_2)
+NF_REGDEF(OQ_NUM_PKTS_STORED_REG_2)
+NF_REGDEF(OQ_NUM_PKTS_DROPPED_REG_2)
+NF_REGDEF(OQ_NUM_PKT_BYTES_REMOVED_REG_2)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_REMOVED_REG_2)
+NF_REGDEF(OQ_NUM_PKTS_REMOVED_REG_2)
+NF_REGDEF(OQ_ADDRESS_HI_REG_2)
+NF_REGDEF(OQ_ADDRESS_LO_REG_2)
+NF_REGDEF(OQ_WR_ADDRESS_REG_2)
+NF_REGDEF(OQ_RD_ADDRESS_REG_2)
+NF_REGDEF(OQ_NUM_PKTS_IN_Q_REG_2)
+NF_REGDEF(OQ_MAX_PKTS_IN_Q_REG_2)
+NF_REGDEF(OQ_FULL_THRESH_REG_2)
+NF_REGDEF(OQ_NUM_WORDS_IN_Q_REG_2)
+NF_REGDEF(OQ_CONTROL_REG_2)
+NF_REGDEF(OQ_NUM_WORDS_LEFT_REG_3)
+NF_REGDEF(OQ_NUM_PKT_BYTES_STORED_REG_3)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_STORED_REG_3)
+NF_REGDEF(OQ_NUM_PKTS_STORED_REG_3)
+NF_REGDEF(OQ_NUM_PKTS_DROPPED_REG_3)
+NF_REGDEF(OQ_NUM_PKT_BYTES_REMOVED_REG_3)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_REMOVED_REG_3)
+NF_REGDEF(OQ_NUM_PKTS_REMOVED_REG_3)
+NF_REGDEF(OQ_ADDRESS_HI_REG_3)
+NF_REGDEF(OQ_ADDRESS_LO_REG_3)
+NF_REGDEF(OQ_WR_ADDRESS_REG_3)
+NF_REGDEF(OQ_RD_ADDRESS_REG_3)
+NF_REGDEF(OQ_NUM_PKTS_IN_Q_REG_3)
+NF_REGDEF(OQ_MAX_PKTS_IN_Q_REG_3)
+NF_REGDEF(OQ_FULL_THRESH_REG_3)
+NF_REGDEF(OQ_NUM_WORDS_IN_Q_REG_3)
+NF_REGDEF(OQ_CONTROL_REG_3)
+NF_REGDEF(OQ_NUM_WORDS_LEFT_REG_4)
+NF_REGDEF(OQ_NUM_PKT_BYTES_STORED_REG_4)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_STORED_REG_4)
+NF_REGDEF(OQ_NUM_PKTS_STORED_REG_4)
+NF_REGDEF(OQ_NUM_PKTS_DROPPED_REG_4)
+NF_REGDEF(OQ_NUM_PKT_BYTES_REMOVED_REG_4)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_REMOVED_REG_4)
+NF_REGDEF(OQ_NUM_PKTS_REMOVED_REG_4)
+NF_REGDEF(OQ_ADDRESS_HI_REG_4)
+NF_REGDEF(OQ_ADDRESS_LO_REG_4)
+NF_REGDEF(OQ_WR_ADDRESS_REG_4)
+NF_REGDEF(OQ_RD_ADDRESS_REG_4)
+NF_REGDEF(OQ_NUM_PKTS_IN_Q_REG_4)
+NF_REGDEF(OQ_MAX_PKTS_IN_Q_REG_4)
+NF_REGDEF(OQ_FULL_THRESH_REG_4)
+NF_REGDEF(OQ_NUM_WORDS_IN_Q_REG_4)
+NF_REGDEF(OQ_CONTROL_REG_4)
+NF_REGDEF(OQ_NUM_WORDS_LEFT_REG_5)
+NF_REGDEF(OQ_NUM_PKT_BYTES_STORED_REG_5)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_STORED_REG_5)
+NF_REGDEF(OQ_NUM_PKTS_STORED_REG_5)
+NF_REGDEF(OQ_NUM_PKTS_DROPPED_REG_5)
+NF_REGDEF(OQ_NUM_PKT_BYTES_REMOVED_REG_5)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_REMOVED_REG_5)
+NF_REGDEF(OQ_NUM_PKTS_REMOVED_REG_5)
+NF_REGDEF(OQ_ADDRESS_HI_REG_5)
+NF_REGDEF(OQ_ADDRESS_LO_REG_5)
+NF_REGDEF(OQ_WR_ADDRESS_REG_5)
+NF_REGDEF(OQ_RD_ADDRESS_REG_5)
+NF_REGDEF(OQ_NUM_PKTS_IN_Q_REG_5)
+NF_REGDEF(OQ_MAX_PKTS_IN_Q_REG_5)
+NF_REGDEF(OQ_FULL_THRESH_REG_5)
+NF_REGDEF(OQ_NUM_WORDS_IN_Q_REG_5)
+NF_REGDEF(OQ_CONTROL_REG_5)
+NF_REGDEF(OQ_NUM_WORDS_LEFT_REG_6)
+NF_REGDEF(OQ_NUM_PKT_BYTES_STORED_REG_6)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_STORED_REG_6)
+NF_REGDEF(OQ_NUM_PKTS_STORED_REG_6)
+NF_REGDEF(OQ_NUM_PKTS_DROPPED_REG_6)
+NF_REGDEF(OQ_NUM_PKT_BYTES_REMOVED_REG_6)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_REMOVED_REG_6)
+NF_REGDEF(OQ_NUM_PKTS_REMOVED_REG_6)
+NF_REGDEF(OQ_ADDRESS_HI_REG_6)
+NF_REGDEF(OQ_ADDRESS_LO_REG_6)
+NF_REGDEF(OQ_WR_ADDRESS_REG_6)
+NF_REGDEF(OQ_RD_ADDRESS_REG_6)
+NF_REGDEF(OQ_NUM_PKTS_IN_Q_REG_6)
+NF_REGDEF(OQ_MAX_PKTS_IN_Q_REG_6)
+NF_REGDEF(OQ_FULL_THRESH_REG_6)
+NF_REGDEF(OQ_NUM_WORDS_IN_Q_REG_6)
+NF_REGDEF(OQ_CONTROL_REG_6)
+NF_REGDEF(OQ_NUM_WORDS_LEFT_REG_7)
+NF_REGDEF(OQ_NUM_PKT_BYTES_STORED_REG_7)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_STORED_REG_7)
+NF_REGDEF(OQ_NUM_PKTS_STORED_REG_7)
+NF_REGDEF(OQ_NUM_PKTS_DROPPED_REG_7)
+NF_REGDEF(OQ_NUM_PKT_BYTES_REMOVED_REG_7)
+NF_REGDEF(OQ_NUM_OVERHEAD_BYTES_REMOVED_REG_7)
+NF_REGDEF(OQ_NUM_PKTS_REMOVED_REG_7)
+NF_REGDEF(OQ_ADDRESS_HI_REG_7)
+NF_REGDEF(OQ_ADDRESS_LO_REG_7)
+NF_REGDEF(OQ_WR_ADDRESS_REG_7)
+NF_REGDEF(OQ_RD_ADDRESS_REG_7)
+NF_REGDEF(OQ_NUM_PKTS_IN_Q_REG_7)
+NF_REGDEF(OQ_MAX_PKTS_IN_Q_REG_7)
+NF_REGDEF(OQ_FULL_THRESH_REG_7)
+NF_REGDEF(OQ_NUM_WORDS_IN_Q_REG_7)
+NF_REGDEF(OQ_CONTROL_REG_7)
+NF_REGDEF(DELAY_ENABLE_REG)
+NF_REGDEF(DELAY_1ST_WORD_HI_REG)
+NF_REGDEF(DELAY_1ST_WORD_LO_REG)
+NF_REGDEF(DELAY_LENGTH_REG)
+NF_REGDEF(RATE_LIMIT_ENABLE_REG)
+NF_REGDEF(RATE_LIMIT_SHIFT_REG)
+NF_REGDEF(EVT_CAP_ENABLE_CAPTURE_REG)
+NF_REGDEF(EVT_CAP_SEND_PKT_REG)
+NF_REGDEF(EVT_CAP_DST_MAC_HI_REG)
+NF_REGDEF(EVT_CAP_DST_MAC_LO_REG)
+NF_REGDEF(EVT_CAP_SRC_MAC_HI_REG)
+NF_REGDEF(EVT_CAP_SRC_MAC_LO_REG)
+NF_REGDEF(EVT_CAP_ETHERTYPE_REG)
+NF_REGDEF(EVT_CAP_IP_DST_REG)
+NF_REGDEF(EVT_CAP_IP_SRC_REG)
+NF_REGDEF(EVT_CAP_UDP_SRC_PORT_REG)
+NF_REGDEF(EVT_CAP_UDP_DST_PORT_REG)
+NF_REGDEF(EVT_CAP_OUTPUT_PORTS_REG)
+NF_REGDEF(EVT_CAP_RESET_TIMERS_REG)
+NF_REGDEF(EVT_CAP_MONITOR_MASK_REG)
+NF_REGDEF(EVT_CAP_TIMER_RESOLUTION_REG)
+NF_REGDEF(EVT_CAP_NUM_EVT_PKTS_SENT_REG)
+NF_REGDEF(EVT_CAP_NUM_EVTS_SENT_REG)
+NF_REGDEF(EVT_CAP_NUM_EVTS_DROPPED_REG)
+NF_REGDEF(EVT_CAP_SIGNAL_ID_MASK_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKT_BYTES_RECEIVED_0_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_RECEIVED_0_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_DROPPED_0_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKT_BYTES_RECEIVED_1_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_RECEIVED_1_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_DROPPED_1_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKT_BYTES_RECEIVED_2_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_RECEIVED_2_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_DROPPED_2_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKT_BYTES_RECEIVED_3_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_RECEIVED_3_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_DROPPED_3_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKT_BYTES_RECEIVED_4_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_RECEIVED_4_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_DROPPED_4_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKT_BYTES_RECEIVED_5_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_RECEIVED_5_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_DROPPED_5_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKT_BYTES_RECEIVED_6_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_RECEIVED_6_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_DROPPED_6_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKT_BYTES_RECEIVED_7_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_RECEIVED_7_REG)
+NF_REGDEF(BRAM_OQ_NUM_PKTS_DROPPED_7_REG)
+NF_REGDEF(BRAM_OQ_DISABLE_QUEUES_REG)
+NF_REGDEF(BRAM_OQ_NUM_WORDS_IN_QUEUE_0_REG)
+NF_REGDEF(BRAM_OQ_NUM_WORDS_IN_QUEUE_1_REG)
+NF_REGDEF(BRAM_OQ_NUM_WORDS_IN_QUEUE_2_REG)
+NF_REGDEF(BRAM_OQ_NUM_WORDS_IN_QUEUE_3_REG)
+NF_REGDEF(BRAM_OQ_NUM_WORDS_IN_QUEUE_4_REG)
+NF_REGDEF(BRAM_OQ_NUM_WORDS_IN_QUEUE_5_REG)
+NF_REGDEF(BRAM_OQ_NUM_WORDS_IN_QUEUE_6_REG)
+NF_REGDEF(BRAM_OQ_NUM_WORDS_IN_QUEUE_7_REG)
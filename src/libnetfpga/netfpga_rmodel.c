@@ -0,0 +1,370 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Host model of the reference router's datapath, for checking what the
+ * card will do with some traffic before the tables go to it.
+ *
+ * Packets coming from a CPU port go out of the matching MAC port as
+ * they are. Packets from MAC port n go through the same checks the
+ * output port lookup does, in this order:
+ *
+ *	broadcast/multicast destination		CPU
+ *	destination MAC not port's own		dropped, WRONG_DEST
+ *	not IPv4				CPU, NON_IP_RCVD
+ *	IP version not 4 or options present	CPU, BAD_OPTS_VER
+ *	bad header checksum			dropped, BAD_CHKSUMS
+ *	TTL 1 or less				CPU, BAD_TTLS
+ *	destination in the filter		CPU, FILTERED_PKTS
+ *	no route				CPU, LPM_MISSES
+ *	no ARP entry for the next hop		CPU, ARP_MISSES
+ *
+ * and if none applies, TTL is decremented, the checksum is updated, MAC
+ * addresses are rewritten and the packet goes out of the route's
+ * ports (PKTS_FORWARDED). Everything sent to the CPU counts as
+ * CPU_PKTS_SENT and leaves through CPU port n.
+ */
+#include <sys/types.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+#define NF_RM_ETHER_HDR_LEN	14
+#define NF_RM_IP_HDR_LEN	20
+#define NF_RM_ETHERTYPE_IP	0x0800
+
+static const char *nf_rmodel_ctr_names[NF_RM_CTR_NUM] = {
+	"arp_misses",
+	"lpm_misses",
+	"cpu_pkts_sent",
+	"bad_opts_ver",
+	"bad_chksums",
+	"bad_ttls",
+	"non_ip_rcvd",
+	"pkts_forwarded",
+	"wrong_dest",
+	"filtered_pkts",
+};
+
+const char *
+nf_rmodel_ctr_name(int ctr)
+{
+
+	ASSERT(ctr >= 0 && ctr < NF_RM_CTR_NUM);
+	return (nf_rmodel_ctr_names[ctr]);
+}
+
+/*
+ * Copy routes in, skipping unused slots. If ``sort'' is set, they're
+ * put longest prefix first, which is what nf_router_commit() does.
+ */
+static void
+nf_rmodel_routes(struct nf_rmodel *rm, const struct nf_route *rt, int num,
+    int sort)
+{
+	struct nf_route tmp;
+	int i, j;
+
+	rm->rm_rt_num = 0;
+	for (i = 0; i < num; i++) {
+		if (rt[i].nrt_ip == 0 &&
+		    rt[i].nrt_mask == NF_RT_EMPTY_MASK &&
+		    rt[i].nrt_next_hop == 0 && rt[i].nrt_port == 0)
+			continue;
+		rm->rm_rt[rm->rm_rt_num++] = rt[i];
+	}
+	if (!sort)
+		return;
+	/* Insertion sort; stable, so equal prefixes keep their order */
+	for (i = 1; i < rm->rm_rt_num; i++) {
+		tmp = rm->rm_rt[i];
+		for (j = i; j > 0 && nf_route_plen(rm->rm_rt[j - 1].nrt_mask) <
+		    nf_route_plen(tmp.nrt_mask); j--)
+			rm->rm_rt[j] = rm->rm_rt[j - 1];
+		rm->rm_rt[j] = tmp;
+	}
+}
+
+/*
+ * Build the model from tables as they'd be after commits: routes and
+ * filter addresses wanted in ``nr'' and ``fl'', ARP entries of ``na''.
+ * ``mac'' holds MAC addresses of the router's ports.
+ */
+void
+nf_rmodel_init(struct nf_rmodel *rm, const struct nf_router *nr,
+    const struct nf_arp *na, const struct nf_filter *fl, uint8_t mac[][6])
+{
+
+	ASSERT(rm != NULL);
+	ASSERT(nr != NULL);
+	ASSERT(na != NULL);
+	ASSERT(fl != NULL);
+	ASSERT(mac != NULL);
+	memset(rm, 0, sizeof(*rm));
+	rm->rm_nf = nr->nr_nf;
+	nf_rmodel_routes(rm, nr->nr_routes, nr->nr_routes_num, 1);
+	rm->rm_arp = *na;
+	memcpy(rm->rm_filter, fl->nfl_ips, fl->nfl_ips_num * sizeof(uint32_t));
+	rm->rm_filter_num = fl->nfl_ips_num;
+	memcpy(rm->rm_mac, mac, sizeof(rm->rm_mac));
+}
+
+/*
+ * Build the model from tables in the card, routes in slot order.
+ */
+int
+nf_rmodel_load(struct netfpga *nf, struct nf_rmodel *rm)
+{
+	struct nf_regop ops[NF_ROUTER_PORTS * 2];
+	uint8_t mac[NF_ROUTER_PORTS][6];
+	struct nf_router nr;
+	struct nf_arp na;
+	struct nf_filter fl;
+	uint32_t hi, lo;
+	int i, j;
+
+	nf_assert(nf);
+	if (nf_router_init(nf, &nr) != 0 || nf_arp_init(nf, &na) != 0 ||
+	    nf_filter_init(nf, &fl) != 0)
+		return (-1);
+	for (i = 0; i < NF_ROUTER_PORTS * 2; i++) {
+		ops[i].nro_op = NF_REGOP_READ;
+		ops[i].nro_reg = ROUTER_OP_LUT_MAC_0_HI_REG + i * 4;
+		ops[i].nro_value = 0;
+	}
+	if (nf_regv(nf, ops, NF_ROUTER_PORTS * 2) != NF_ROUTER_PORTS * 2)
+		return (nf_erri(nf, "Couldn't read router's MAC addresses"));
+	for (i = 0; i < NF_ROUTER_PORTS; i++) {
+		hi = ops[i * 2].nro_value;
+		lo = ops[i * 2 + 1].nro_value;
+		mac[i][0] = hi >> 8;
+		mac[i][1] = hi;
+		for (j = 0; j < 4; j++)
+			mac[i][2 + j] = lo >> (24 - j * 8);
+	}
+	nf_rmodel_init(rm, &nr, &na, &fl, mac);
+	nf_rmodel_routes(rm, nr.nr_hw, NF_ROUTER_RT_SIZE, 0);
+	return (0);
+}
+
+/*
+ * Read router's counters, in NF_RM_* order, in one batch.
+ */
+int
+nf_rmodel_counters(struct netfpga *nf, uint32_t *ctr)
+{
+	struct nf_regop ops[NF_RM_CTR_NUM];
+	int i;
+
+	nf_assert(nf);
+	ASSERT(ctr != NULL);
+	for (i = 0; i < NF_RM_CTR_NUM; i++) {
+		ops[i].nro_op = NF_REGOP_READ;
+		ops[i].nro_reg = ROUTER_OP_LUT_ARP_NUM_MISSES_REG + i * 4;
+		ops[i].nro_value = 0;
+	}
+	if (nf_regv(nf, ops, NF_RM_CTR_NUM) != NF_RM_CTR_NUM)
+		return (nf_erri(nf, "Couldn't read router's counters"));
+	for (i = 0; i < NF_RM_CTR_NUM; i++)
+		ctr[i] = ops[i].nro_value;
+	return (0);
+}
+
+/*
+ * Check IP header checksum. The header is summed 32 bits at a time into
+ * a 64-bit accumulator and folded once at the end, instead of going
+ * through it 16 bits at a time; the one's complement sum doesn't care
+ * about byte order, so no swapping is needed either.
+ */
+static int
+nf_rmodel_cksum_ok(const uint8_t *ip)
+{
+	uint32_t w[NF_RM_IP_HDR_LEN / 4];
+	uint64_t sum;
+
+	memcpy(w, ip, sizeof(w));
+	sum = (uint64_t)w[0] + w[1] + w[2] + w[3] + w[4];
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return (sum == 0xffff);
+}
+
+static int
+nf_rmodel_out(struct nf_rmodel *rm, uint32_t port)
+{
+	int i;
+
+	for (i = 0; i < NF_ROUTER_PORTS * 2; i++)
+		if (port & (1 << i))
+			rm->rm_out[i]++;
+	return (port);
+}
+
+static int
+nf_rmodel_cpu(struct nf_rmodel *rm, int n, int ctr)
+{
+
+	if (ctr >= 0)
+		rm->rm_ctr[ctr]++;
+	rm->rm_ctr[NF_RM_CPU_PKTS_SENT]++;
+	return (nf_rmodel_out(rm, NF_ROUTER_PORT_CPU(n)));
+}
+
+static int
+nf_rmodel_drop(struct nf_rmodel *rm, int ctr)
+{
+
+	if (ctr >= 0)
+		rm->rm_ctr[ctr]++;
+	rm->rm_dropped++;
+	return (0);
+}
+
+/*
+ * Pass packet ``pkt'' arriving on port ``in_port'' (one NF_ROUTER_PORT_*
+ * bit) through the model. The packet is changed the way the router
+ * would change it. Returns ports it leaves through, or 0 if dropped.
+ */
+int
+nf_rmodel_packet(struct nf_rmodel *rm, uint32_t in_port, uint8_t *pkt,
+    size_t len)
+{
+	const struct nf_route *rt;
+	uint8_t *ip;
+	uint32_t dip, nh, sum;
+	uint16_t csum;
+	int n, i, s;
+
+	ASSERT(rm != NULL);
+	ASSERT(pkt != NULL);
+	for (n = 0; n < NF_ROUTER_PORTS; n++) {
+		if (in_port == NF_ROUTER_PORT_CPU(n))
+			return (nf_rmodel_out(rm, NF_ROUTER_PORT_MAC(n)));
+		if (in_port == NF_ROUTER_PORT_MAC(n))
+			break;
+	}
+	ASSERT(n < NF_ROUTER_PORTS && "in_port must be one port bit");
+
+	if (len < NF_RM_ETHER_HDR_LEN)
+		return (nf_rmodel_drop(rm, -1));
+	if (pkt[0] & 1)
+		return (nf_rmodel_cpu(rm, n, -1));
+	if (memcmp(pkt, rm->rm_mac[n], 6) != 0)
+		return (nf_rmodel_drop(rm, NF_RM_WRONG_DEST));
+	if ((pkt[12] << 8 | pkt[13]) != NF_RM_ETHERTYPE_IP)
+		return (nf_rmodel_cpu(rm, n, NF_RM_NON_IP_RCVD));
+	ip = pkt + NF_RM_ETHER_HDR_LEN;
+	if (len < NF_RM_ETHER_HDR_LEN + NF_RM_IP_HDR_LEN || ip[0] != 0x45)
+		return (nf_rmodel_cpu(rm, n, NF_RM_BAD_OPTS_VER));
+	if (!nf_rmodel_cksum_ok(ip))
+		return (nf_rmodel_drop(rm, NF_RM_BAD_CHKSUMS));
+	if (ip[8] <= 1)
+		return (nf_rmodel_cpu(rm, n, NF_RM_BAD_TTLS));
+
+	dip = (uint32_t)ip[16] << 24 | ip[17] << 16 | ip[18] << 8 | ip[19];
+	for (i = 0; i < rm->rm_filter_num; i++)
+		if (rm->rm_filter[i] == dip)
+			return (nf_rmodel_cpu(rm, n, NF_RM_FILTERED_PKTS));
+	rt = NULL;
+	for (i = 0; i < rm->rm_rt_num; i++)
+		if ((dip & rm->rm_rt[i].nrt_mask) == rm->rm_rt[i].nrt_ip) {
+			rt = &rm->rm_rt[i];
+			break;
+		}
+	if (rt == NULL)
+		return (nf_rmodel_cpu(rm, n, NF_RM_LPM_MISSES));
+	nh = (rt->nrt_next_hop != 0) ? rt->nrt_next_hop : dip;
+	s = nf_arp_lookup(&rm->rm_arp, nh);
+	if (s < 0)
+		return (nf_rmodel_cpu(rm, n, NF_RM_ARP_MISSES));
+
+	/* TTL is the high byte of its 16-bit word: checksum goes up 0x100 */
+	ip[8]--;
+	memcpy(&csum, ip + 10, sizeof(csum));
+	sum = ntohs(csum) + 0x100;
+	sum = (sum & 0xffff) + (sum >> 16);
+	csum = htons(sum);
+	memcpy(ip + 10, &csum, sizeof(csum));
+	memcpy(pkt, rm->rm_arp.na_ent[s].nae_mac, 6);
+	for (i = 0; i < NF_ROUTER_PORTS; i++)
+		if (rt->nrt_port & NF_ROUTER_PORT_MAC(i)) {
+			memcpy(pkt + 6, rm->rm_mac[i], 6);
+			break;
+		}
+	rm->rm_ctr[NF_RM_PKTS_FORWARDED]++;
+	return (nf_rmodel_out(rm, rt->nrt_port));
+}
+
+struct nf_rmodel_pcap_arg {
+	struct nf_rmodel	*rm;
+	uint32_t		 in_port;
+};
+
+static int
+nf_rmodel_pcap_pkt(void *arg, uint8_t *pkt, size_t len, uint64_t ts_ns)
+{
+	struct nf_rmodel_pcap_arg *a;
+
+	(void)ts_ns;
+	a = arg;
+	(void)nf_rmodel_packet(a->rm, a->in_port, pkt, len);
+	return (0);
+}
+
+/*
+ * Run all packets of pcap file ``fname'' through the model as if they
+ * came on ``in_port''. Number of packets is stored in ``pkts''.
+ */
+int
+nf_rmodel_pcap(struct nf_rmodel *rm, const char *fname, uint32_t in_port,
+    uint64_t *pkts)
+{
+	struct nf_rmodel_pcap_arg a;
+
+	ASSERT(rm != NULL);
+	a.rm = rm;
+	a.in_port = in_port;
+	return (nf_pcap_foreach(rm->rm_nf, fname, nf_rmodel_pcap_pkt, &a,
+	    pkts));
+}
@@ -0,0 +1,377 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Route table manager for the reference router design.
+ *
+ * Hardware walks its LPM table from slot 0 and the first matching entry
+ * wins, so every prefix has to be placed before all shorter ones. We
+ * keep what's in the hardware in ``nr_hw'' and the wanted routes in
+ * ``nr_routes''. On commit, a new layout is computed which keeps as
+ * many routes as possible in the slots they already occupy: kept slots
+ * form the heaviest run of non-increasing prefix lengths, and the
+ * remaining routes are fitted into free slots between them. Only slots
+ * which differ from the shadow get written, all in one nf_regv() batch.
+ */
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+/* Registers of one route, in order they're laid out in */
+#define NF_RT_REGS_NUM		4
+
+/*
+ * Prefix length of ``mask'' or -1 if it's not contiguous.
+ */
+int
+nf_route_plen(uint32_t mask)
+{
+	int plen;
+
+	for (plen = 0; plen < 32 && (mask & (1U << (31 - plen))); plen++)
+		;
+	if (plen < 32 && (mask << plen) != 0)
+		return (-1);
+	return (plen);
+}
+
+static void
+nf_route_set_empty(struct nf_route *rt)
+{
+
+	memset(rt, 0, sizeof(*rt));
+	rt->nrt_mask = NF_RT_EMPTY_MASK;
+}
+
+static int
+nf_route_is_empty(const struct nf_route *rt)
+{
+
+	return (rt->nrt_ip == 0 && rt->nrt_mask == NF_RT_EMPTY_MASK &&
+	    rt->nrt_next_hop == 0 && rt->nrt_port == 0);
+}
+
+static int
+nf_route_same_prefix(const struct nf_route *a, const struct nf_route *b)
+{
+
+	return (a->nrt_ip == b->nrt_ip && a->nrt_mask == b->nrt_mask);
+}
+
+static int
+nf_route_cmp(const void *a, const void *b)
+{
+	const struct nf_route *ra, *rb;
+	int pa, pb;
+
+	ra = a;
+	rb = b;
+	pa = nf_route_plen(ra->nrt_mask);
+	pb = nf_route_plen(rb->nrt_mask);
+	if (pa != pb)
+		return (pb - pa);
+	return ((ra->nrt_ip > rb->nrt_ip) - (ra->nrt_ip < rb->nrt_ip));
+}
+
+/*
+ * Find route ``ip/mask'' among wanted routes.
+ */
+static int
+nf_router_find(struct nf_router *nr, uint32_t ip, uint32_t mask)
+{
+	int i;
+
+	for (i = 0; i < nr->nr_routes_num; i++)
+		if (nr->nr_routes[i].nrt_ip == ip &&
+		    nr->nr_routes[i].nrt_mask == mask)
+			return (i);
+	return (-1);
+}
+
+/*
+ * Read the hardware table into the shadow copy and start with routes
+ * found there.
+ */
+int
+nf_router_init(struct netfpga *nf, struct nf_router *nr)
+{
+	struct nf_regop ops[NF_ROUTER_RT_SIZE * (NF_RT_REGS_NUM + 1)];
+	struct nf_regop *op;
+	struct nf_route *rt;
+	int i, j;
+
+	nf_assert(nf);
+	ASSERT(nr != NULL);
+	memset(nr, 0, sizeof(*nr));
+	nr->nr_nf = nf;
+	op = ops;
+	for (i = 0; i < NF_ROUTER_RT_SIZE; i++) {
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = ROUTER_OP_LUT_RT_LUT_RD_ADDR_REG;
+		op->nro_value = i;
+		op++;
+		for (j = 0; j < NF_RT_REGS_NUM; j++, op++) {
+			op->nro_op = NF_REGOP_READ;
+			op->nro_reg = ROUTER_OP_LUT_RT_IP_REG + j * 4;
+			op->nro_value = 0;
+		}
+	}
+	if (nf_regv(nf, ops, op - ops) != op - ops)
+		return (nf_erri(nf, "Couldn't read the route table"));
+
+	op = ops;
+	for (i = 0; i < NF_ROUTER_RT_SIZE; i++, op += NF_RT_REGS_NUM + 1) {
+		rt = &nr->nr_hw[i];
+		rt->nrt_ip = op[1].nro_value;
+		rt->nrt_mask = op[2].nro_value;
+		rt->nrt_next_hop = op[3].nro_value;
+		rt->nrt_port = op[4].nro_value;
+		if (nf_route_is_empty(rt) || nf_route_plen(rt->nrt_mask) < 0 ||
+		    nf_router_find(nr, rt->nrt_ip, rt->nrt_mask) >= 0)
+			continue;
+		nr->nr_routes[nr->nr_routes_num++] = *rt;
+	}
+	return (0);
+}
+
+/*
+ * Add route ``rt'', or replace the one for the same prefix. Hardware
+ * isn't touched until nf_router_commit().
+ */
+int
+nf_router_add(struct nf_router *nr, const struct nf_route *rt)
+{
+	struct netfpga *nf;
+	int i;
+
+	ASSERT(nr != NULL);
+	ASSERT(rt != NULL);
+	nf = nr->nr_nf;
+	if (nf_route_plen(rt->nrt_mask) < 0)
+		return (nf_erri(nf, "Mask %#x isn't contiguous",
+		    rt->nrt_mask));
+	if ((rt->nrt_ip & ~rt->nrt_mask) != 0)
+		return (nf_erri(nf, "Address %#x has bits outside of mask %#x",
+		    rt->nrt_ip, rt->nrt_mask));
+	if (nf_route_is_empty(rt))
+		return (nf_erri(nf, "Route 0.0.0.0/32 without a port is "
+		    "reserved for empty slots"));
+	i = nf_router_find(nr, rt->nrt_ip, rt->nrt_mask);
+	if (i < 0) {
+		if (nr->nr_routes_num == NF_ROUTER_RT_SIZE)
+			return (nf_erri(nf, "Route table is full (%d entries)",
+			    NF_ROUTER_RT_SIZE));
+		i = nr->nr_routes_num++;
+	}
+	nr->nr_routes[i] = *rt;
+	return (0);
+}
+
+/*
+ * Remove route for prefix ``ip/mask''.
+ */
+int
+nf_router_del(struct nf_router *nr, uint32_t ip, uint32_t mask)
+{
+	int i;
+
+	ASSERT(nr != NULL);
+	i = nf_router_find(nr, ip, mask);
+	if (i < 0)
+		return (nf_erri(nr->nr_nf, "No route for %#x/%#x", ip, mask));
+	nr->nr_routes[i] = nr->nr_routes[--nr->nr_routes_num];
+	return (0);
+}
+
+/*
+ * Remove all routes.
+ */
+void
+nf_router_flush(struct nf_router *nr)
+{
+
+	ASSERT(nr != NULL);
+	nr->nr_routes_num = 0;
+}
+
+/*
+ * Compute a layout of wanted routes which reuses current slots as much
+ * as possible. Returns 0 or -1 if the routes don't fit around the
+ * slots we've decided to keep.
+ */
+static int
+nf_router_layout_keep(struct nf_router *nr, struct nf_route *layout)
+{
+	struct nf_route rest[NF_ROUTER_RT_SIZE];
+	int cand[NF_ROUTER_RT_SIZE], plen[NF_ROUTER_RT_SIZE];
+	int weight[NF_ROUTER_RT_SIZE], best[NF_ROUTER_RT_SIZE];
+	int prev[NF_ROUTER_RT_SIZE], kept[NF_ROUTER_RT_SIZE];
+	int used[NF_ROUTER_RT_SIZE], next_plen[NF_ROUTER_RT_SIZE + 1];
+	int i, j, s, last, rest_num, r;
+
+	/*
+	 * Slots holding a wanted prefix are candidates for keeping. Ones
+	 * with the same next hop and port are worth more, since they don't
+	 * need to be written at all.
+	 */
+	memset(used, 0, sizeof(used));
+	for (s = 0; s < NF_ROUTER_RT_SIZE; s++) {
+		cand[s] = -1;
+		weight[s] = 0;
+		for (i = 0; i < nr->nr_routes_num; i++) {
+			if (used[i] || !nf_route_same_prefix(&nr->nr_hw[s],
+			    &nr->nr_routes[i]))
+				continue;
+			used[i] = 1;
+			cand[s] = i;
+			plen[s] = nf_route_plen(nr->nr_routes[i].nrt_mask);
+			weight[s] = memcmp(&nr->nr_hw[s], &nr->nr_routes[i],
+			    sizeof(struct nf_route)) == 0 ? 2 : 1;
+			break;
+		}
+	}
+
+	/* Heaviest chain of candidates with non-increasing prefixes */
+	last = -1;
+	for (s = 0; s < NF_ROUTER_RT_SIZE; s++) {
+		best[s] = 0;
+		prev[s] = -1;
+		if (cand[s] < 0)
+			continue;
+		best[s] = weight[s];
+		for (j = 0; j < s; j++)
+			if (cand[j] >= 0 && plen[j] >= plen[s] &&
+			    best[j] + weight[s] > best[s]) {
+				best[s] = best[j] + weight[s];
+				prev[s] = j;
+			}
+		if (last < 0 || best[s] > best[last])
+			last = s;
+	}
+	memset(kept, 0, sizeof(kept));
+	memset(used, 0, sizeof(used));
+	for (s = last; s >= 0; s = prev[s]) {
+		kept[s] = 1;
+		used[cand[s]] = 1;
+	}
+
+	/* Whatever isn't kept goes to free slots, longest first */
+	rest_num = 0;
+	for (i = 0; i < nr->nr_routes_num; i++)
+		if (!used[i])
+			rest[rest_num++] = nr->nr_routes[i];
+	qsort(rest, rest_num, sizeof(rest[0]), nf_route_cmp);
+	next_plen[NF_ROUTER_RT_SIZE] = -1;
+	for (s = NF_ROUTER_RT_SIZE - 1; s >= 0; s--)
+		next_plen[s] = kept[s] ? plen[s] : next_plen[s + 1];
+	r = 0;
+	for (s = 0; s < NF_ROUTER_RT_SIZE; s++) {
+		if (kept[s]) {
+			if (r < rest_num &&
+			    nf_route_plen(rest[r].nrt_mask) > plen[s])
+				return (-1);
+			layout[s] = nr->nr_routes[cand[s]];
+		} else if (r < rest_num &&
+		    nf_route_plen(rest[r].nrt_mask) >= next_plen[s + 1])
+			layout[s] = rest[r++];
+		else
+			nf_route_set_empty(&layout[s]);
+	}
+	return (r == rest_num ? 0 : -1);
+}
+
+/*
+ * Make the hardware table hold wanted routes. Returns the number of
+ * slots written or -1 on error.
+ */
+int
+nf_router_commit(struct nf_router *nr)
+{
+	struct nf_regop ops[NF_ROUTER_RT_SIZE * (NF_RT_REGS_NUM + 1)];
+	struct nf_route layout[NF_ROUTER_RT_SIZE];
+	struct nf_route sorted[NF_ROUTER_RT_SIZE];
+	struct nf_regop *op;
+	uint32_t val[NF_RT_REGS_NUM];
+	int s, j;
+
+	ASSERT(nr != NULL);
+	nf_assert(nr->nr_nf);
+	if (nf_router_layout_keep(nr, layout) != 0) {
+		DEBUG("Routes don't fit around kept slots, re-laying out\n");
+		memcpy(sorted, nr->nr_routes,
+		    nr->nr_routes_num * sizeof(sorted[0]));
+		qsort(sorted, nr->nr_routes_num, sizeof(sorted[0]),
+		    nf_route_cmp);
+		/*
+		 * Spread free slots evenly between routes, so that the
+		 * following additions are likely to find one where they
+		 * belong instead of shifting everything again.
+		 */
+		for (s = 0; s < NF_ROUTER_RT_SIZE; s++)
+			nf_route_set_empty(&layout[s]);
+		for (j = 0; j < nr->nr_routes_num; j++)
+			layout[j * NF_ROUTER_RT_SIZE / nr->nr_routes_num] =
+			    sorted[j];
+	}
+
+	op = ops;
+	for (s = 0; s < NF_ROUTER_RT_SIZE; s++) {
+		if (memcmp(&layout[s], &nr->nr_hw[s], sizeof(layout[s])) == 0)
+			continue;
+		val[0] = layout[s].nrt_ip;
+		val[1] = layout[s].nrt_mask;
+		val[2] = layout[s].nrt_next_hop;
+		val[3] = layout[s].nrt_port;
+		for (j = 0; j < NF_RT_REGS_NUM; j++, op++) {
+			op->nro_op = NF_REGOP_WRITE;
+			op->nro_reg = ROUTER_OP_LUT_RT_IP_REG + j * 4;
+			op->nro_value = val[j];
+		}
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = ROUTER_OP_LUT_RT_LUT_WR_ADDR_REG;
+		op->nro_value = s;
+		op++;
+	}
+	nr->nr_slots_written = (op - ops) / (NF_RT_REGS_NUM + 1);
+	if (nf_regv(nr->nr_nf, ops, op - ops) != op - ops)
+		return (nf_erri(nr->nr_nf, "Couldn't write the route table"));
+	memcpy(nr->nr_hw, layout, sizeof(nr->nr_hw));
+	return (nr->nr_slots_written);
+}
@@ -0,0 +1,672 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * High-frequency register sampler.
+ *
+ * A thread reads a fixed set of registers every period in one
+ * nf_regv() batch, which is as fast as the module nf_start() picked
+ * can go, and stores timestamped samples in a ring. It never waits for
+ * readers: each reader keeps its own position and finds out from the
+ * slot's sequence number whether the sample it wanted was overwritten.
+ *
+ * A slot's sequence is odd while the sampler writes it and 2 * (sample
+ * number + 1) once it's done, so a reader copies a slot and checks the
+ * sequence again to know it got a whole sample. Any number of readers
+ * can read at once; there's one writer.
+ *
+ * The burst detector is a plain consumer of samples: a register is in
+ * a burst from the sample it reaches its high threshold until it falls
+ * below the low one. So is the watch, which reports registers changing
+ * and triggers firing; it can also take the samples itself, to act on a
+ * trigger right after the read which fired it.
+ */
+#include <sys/types.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "netfpga.h"
+
+/*
+ * The sampler sleeps until a bit before the deadline and spins the
+ * rest. How early it wakes adapts to how late sleeps have been coming
+ * back, which is tens of microseconds on a quiet host and a lot more
+ * in a VM.
+ */
+#define NF_SAMPLER_SPIN_NS	20000
+#define NF_SAMPLER_WAKE_NS	50000	/* Initial guess */
+
+struct nf_sampler_slot {
+	atomic_uint_fast64_t	 nss_seq;
+	struct nf_sample	 nss_sample;
+};
+
+struct nf_sampler {
+	struct netfpga		*nsp_nf;
+	struct nf_regop		 nsp_ops[NF_SAMPLER_REGS_MAX];
+	int			 nsp_regs_num;
+	uint64_t		 nsp_period_ns;
+	uint64_t		 nsp_wake_ns;	/* Average sleep overshoot */
+	struct nf_sampler_slot	*nsp_ring;
+	uint64_t		 nsp_mask;
+	pthread_t		 nsp_thread;
+	int			 nsp_running;
+	atomic_int		 nsp_stop;
+	atomic_int		 nsp_failed;
+	atomic_uint_fast64_t	 nsp_head;	/* Samples written */
+	atomic_uint_fast64_t	 nsp_overruns;	/* Periods missed */
+};
+
+static uint64_t
+nf_sampler_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * Create a sampler of ``regs_num'' registers ``regs'' taken every
+ * ``period_us'' microseconds into a ring of at least ``ring_size''
+ * samples.
+ */
+struct nf_sampler *
+nf_sampler_new(struct netfpga *nf, const uint32_t *regs, int regs_num,
+    unsigned period_us, unsigned ring_size)
+{
+	struct nf_sampler *sp;
+	uint64_t size;
+	int i;
+
+	nf_assert(nf);
+	ASSERT(regs != NULL);
+	if (regs_num <= 0 || regs_num > NF_SAMPLER_REGS_MAX) {
+		nf_erri(nf, "Can sample 1-%d registers, not %d",
+		    NF_SAMPLER_REGS_MAX, regs_num);
+		return (NULL);
+	}
+	if (period_us == 0) {
+		nf_erri(nf, "Sampling period can't be 0");
+		return (NULL);
+	}
+	for (size = 2; size < ring_size; size <<= 1)
+		;
+	sp = calloc(1, sizeof(*sp));
+	ASSERT(sp != NULL);
+	sp->nsp_ring = calloc(size, sizeof(*sp->nsp_ring));
+	ASSERT(sp->nsp_ring != NULL);
+	sp->nsp_mask = size - 1;
+	sp->nsp_nf = nf;
+	sp->nsp_regs_num = regs_num;
+	sp->nsp_period_ns = (uint64_t)period_us * 1000;
+	sp->nsp_wake_ns = NF_SAMPLER_WAKE_NS;
+	for (i = 0; i < regs_num; i++) {
+		sp->nsp_ops[i].nro_op = NF_REGOP_READ;
+		sp->nsp_ops[i].nro_reg = regs[i];
+	}
+	return (sp);
+}
+
+static void
+nf_sampler_wait(struct nf_sampler *sp, uint64_t deadline)
+{
+	struct timespec ts;
+	uint64_t now, margin, target, late;
+
+	now = nf_sampler_now();
+	if (now >= deadline)
+		return;
+	margin = 2 * sp->nsp_wake_ns + NF_SAMPLER_SPIN_NS;
+	if (deadline - now > margin) {
+		target = deadline - margin;
+		ts.tv_sec = target / 1000000000;
+		ts.tv_nsec = target % 1000000000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+		    NULL) == EINTR)
+			;
+		late = nf_sampler_now() - target;
+		if (late > sp->nsp_period_ns)
+			late = sp->nsp_period_ns;
+		sp->nsp_wake_ns = sp->nsp_wake_ns - sp->nsp_wake_ns / 8 +
+		    late / 8;
+	}
+	while (nf_sampler_now() < deadline)
+		;
+}
+
+static void *
+nf_sampler_thread(void *arg)
+{
+	struct nf_sampler *sp;
+	struct nf_sampler_slot *slot;
+	uint64_t head, deadline, t0, t1, missed;
+	int i, n;
+
+	sp = arg;
+	n = sp->nsp_regs_num;
+	head = atomic_load_explicit(&sp->nsp_head, memory_order_relaxed);
+	deadline = nf_sampler_now();
+	while (!atomic_load_explicit(&sp->nsp_stop, memory_order_relaxed)) {
+		nf_sampler_wait(sp, deadline);
+		t0 = nf_sampler_now();
+		if (nf_regv(sp->nsp_nf, sp->nsp_ops, n) != n) {
+			atomic_store(&sp->nsp_failed, 1);
+			break;
+		}
+		t1 = nf_sampler_now();
+
+		slot = &sp->nsp_ring[head & sp->nsp_mask];
+		atomic_store_explicit(&slot->nss_seq, 2 * head + 1,
+		    memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		slot->nss_sample.nsm_seq = head;
+		slot->nss_sample.nsm_time = t0 + (t1 - t0) / 2;
+		for (i = 0; i < n; i++)
+			slot->nss_sample.nsm_values[i] =
+			    sp->nsp_ops[i].nro_value;
+		atomic_store_explicit(&slot->nss_seq, 2 * head + 2,
+		    memory_order_release);
+		atomic_store_explicit(&sp->nsp_head, ++head,
+		    memory_order_release);
+
+		/* Don't try to catch up on periods we've missed */
+		deadline += sp->nsp_period_ns;
+		if (t1 > deadline) {
+			missed = (t1 - deadline) / sp->nsp_period_ns + 1;
+			atomic_fetch_add(&sp->nsp_overruns, missed);
+			deadline += missed * sp->nsp_period_ns;
+		}
+	}
+	return (NULL);
+}
+
+/*
+ * Start the sampling thread. Until nf_sampler_stop(), nothing else may
+ * use ``nf'': modules don't expect to be called from two threads.
+ */
+int
+nf_sampler_start(struct nf_sampler *sp)
+{
+	int error;
+
+	ASSERT(sp != NULL);
+	ASSERT(!sp->nsp_running);
+	atomic_store(&sp->nsp_stop, 0);
+	atomic_store(&sp->nsp_failed, 0);
+	error = pthread_create(&sp->nsp_thread, NULL, nf_sampler_thread, sp);
+	if (error != 0)
+		return (nf_erri(sp->nsp_nf, "Couldn't start sampler: %s",
+		    strerror(error)));
+	sp->nsp_running = 1;
+	return (0);
+}
+
+/*
+ * Stop the sampling thread. Returns -1 if it stopped on its own before
+ * because register reads failed.
+ */
+int
+nf_sampler_stop(struct nf_sampler *sp)
+{
+
+	ASSERT(sp != NULL);
+	if (!sp->nsp_running)
+		return (0);
+	atomic_store(&sp->nsp_stop, 1);
+	pthread_join(sp->nsp_thread, NULL);
+	sp->nsp_running = 0;
+	if (atomic_load(&sp->nsp_failed))
+		return (nf_erri(sp->nsp_nf, "Sampler couldn't read registers"));
+	return (0);
+}
+
+void
+nf_sampler_free(struct nf_sampler *sp)
+{
+
+	if (sp == NULL)
+		return;
+	(void)nf_sampler_stop(sp);
+	free(sp->nsp_ring);
+	free(sp);
+}
+
+/*
+ * Samples taken and periods missed so far; either may be NULL. Returns
+ * non-zero if the sampler is still going.
+ */
+int
+nf_sampler_stats(struct nf_sampler *sp, uint64_t *samples,
+    uint64_t *overruns)
+{
+
+	ASSERT(sp != NULL);
+	if (samples != NULL)
+		*samples = atomic_load(&sp->nsp_head);
+	if (overruns != NULL)
+		*overruns = atomic_load(&sp->nsp_overruns);
+	return (sp->nsp_running && !atomic_load(&sp->nsp_failed));
+}
+
+/*
+ * Make ``rd'' start reading from the next sample taken.
+ */
+void
+nf_sampler_reader_init(struct nf_sampler *sp, struct nf_sampler_reader *rd)
+{
+
+	ASSERT(sp != NULL);
+	ASSERT(rd != NULL);
+	rd->nsr_next = atomic_load_explicit(&sp->nsp_head,
+	    memory_order_acquire);
+	rd->nsr_lost = 0;
+}
+
+/*
+ * Copy up to ``out_num'' samples ``rd'' hasn't seen yet into ``out''.
+ * Never blocks; samples overwritten before the reader got to them are
+ * counted in nsr_lost and skipped. Returns number of samples copied.
+ */
+int
+nf_sampler_read(struct nf_sampler *sp, struct nf_sampler_reader *rd,
+    struct nf_sample *out, int out_num)
+{
+	struct nf_sampler_slot *slot;
+	uint64_t head, seq, size;
+	int n;
+
+	ASSERT(sp != NULL);
+	ASSERT(rd != NULL);
+	size = sp->nsp_mask + 1;
+	n = 0;
+	while (n < out_num) {
+		head = atomic_load_explicit(&sp->nsp_head,
+		    memory_order_acquire);
+		if (rd->nsr_next >= head)
+			break;
+		if (head - rd->nsr_next > size) {
+			rd->nsr_lost += head - size - rd->nsr_next;
+			rd->nsr_next = head - size;
+		}
+		slot = &sp->nsp_ring[rd->nsr_next & sp->nsp_mask];
+		seq = atomic_load_explicit(&slot->nss_seq,
+		    memory_order_acquire);
+		if (seq == 2 * rd->nsr_next + 2) {
+			memcpy(&out[n], &slot->nss_sample, sizeof(out[n]));
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&slot->nss_seq,
+			    memory_order_relaxed) == seq) {
+				n++;
+				rd->nsr_next++;
+				continue;
+			}
+		}
+		/* Overwritten under us; the head check above catches up */
+		rd->nsr_lost++;
+		rd->nsr_next++;
+	}
+	return (n);
+}
+
+/*
+ * Set up burst detection on ``regs_num'' sampled registers. A register
+ * is in a burst from when its value reaches ``hi'' until it drops below
+ * ``lo''. For registers whose bit is set in ``delta'' (counters), the
+ * increase since the previous sample is used instead of the value. A
+ * ``hi'' of 0 turns detection off for that register.
+ */
+void
+nf_burst_init(struct nf_burst_det *bd, int regs_num, const uint32_t *hi,
+    const uint32_t *lo, uint32_t delta)
+{
+	int i;
+
+	ASSERT(bd != NULL);
+	ASSERT(regs_num > 0 && regs_num <= NF_SAMPLER_REGS_MAX);
+	memset(bd, 0, sizeof(*bd));
+	bd->nbd_regs_num = regs_num;
+	bd->nbd_delta = delta;
+	for (i = 0; i < regs_num; i++) {
+		bd->nbd_hi[i] = hi[i];
+		bd->nbd_lo[i] = lo[i] < hi[i] ? lo[i] : hi[i];
+	}
+}
+
+/*
+ * Run sample ``s'' through the detector. Bursts which ended with it are
+ * stored in ``out'', at most ``out_num'' of them, and their number is
+ * returned.
+ */
+int
+nf_burst_feed(struct nf_burst_det *bd, const struct nf_sample *s,
+    struct nf_burst *out, int out_num)
+{
+	struct nf_burst *b;
+	uint32_t v, bit;
+	int i, n;
+
+	ASSERT(bd != NULL);
+	ASSERT(s != NULL);
+	n = 0;
+	for (i = 0; i < bd->nbd_regs_num; i++) {
+		bit = 1U << i;
+		v = s->nsm_values[i];
+		if (bd->nbd_delta & bit) {
+			v = bd->nbd_primed ? v - bd->nbd_prev[i] : 0;
+			bd->nbd_prev[i] = s->nsm_values[i];
+		}
+		if (bd->nbd_hi[i] == 0)
+			continue;
+		b = &bd->nbd_cur[i];
+		if (bd->nbd_active & bit) {
+			if (v > b->nb_peak)
+				b->nb_peak = v;
+			b->nb_samples++;
+			if (v >= bd->nbd_lo[i])
+				continue;
+			b->nb_end = s->nsm_time;
+			bd->nbd_active &= ~bit;
+			bd->nbd_bursts++;
+			if (n < out_num)
+				out[n++] = *b;
+			else
+				bd->nbd_dropped++;
+		} else if (v >= bd->nbd_hi[i]) {
+			b->nb_reg = i;
+			b->nb_start = s->nsm_time;
+			b->nb_end = 0;
+			b->nb_peak = v;
+			b->nb_samples = 1;
+			bd->nbd_active |= bit;
+		}
+	}
+	bd->nbd_primed = 1;
+	return (n);
+}
+
+/*
+ * Parse trigger expression ``expr'': [+]<reg>[&<mask>] <op> <value>,
+ * where <reg> is a name or an offset, <op> one of == != < <= > >= and a
+ * leading + compares the increase since the previous sample instead of
+ * the value.
+ */
+int
+nf_trig_parse(struct netfpga *nf, const char *expr, struct nf_trig *tg)
+{
+	static const char *ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+	static const int opv[] = { NF_TRIG_EQ, NF_TRIG_NE, NF_TRIG_LE,
+	    NF_TRIG_GE, NF_TRIG_LT, NF_TRIG_GT };
+	char buf[sizeof(tg->ntg_expr)], *p, *q, *end;
+	size_t i, n;
+
+	nf_assert(nf);
+	ASSERT(expr != NULL);
+	ASSERT(tg != NULL);
+	memset(tg, 0, sizeof(*tg));
+	if (strlen(expr) >= sizeof(buf))
+		return (nf_erri(nf, "Trigger '%s' too long", expr));
+	snprintf(tg->ntg_expr, sizeof(tg->ntg_expr), "%s", expr);
+	for (p = buf; *expr != '\0'; expr++)
+		if (!isspace((unsigned char)*expr))
+			*p++ = *expr;
+	*p = '\0';
+
+	p = buf;
+	if (*p == '+') {
+		tg->ntg_delta = 1;
+		p++;
+	}
+	q = p + strcspn(p, "=!<>");
+	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+		if (strncmp(q, ops[i], strlen(ops[i])) == 0)
+			break;
+	if (*q == '\0' || i == sizeof(ops) / sizeof(ops[0]))
+		return (nf_erri(nf, "No comparison in trigger '%s'",
+		    tg->ntg_expr));
+	tg->ntg_op = opv[i];
+	tg->ntg_value = strtoul(q + strlen(ops[i]), &end, 0);
+	if (end == q + strlen(ops[i]) || *end != '\0')
+		return (nf_erri(nf, "Bad value in trigger '%s'",
+		    tg->ntg_expr));
+	*q = '\0';
+
+	tg->ntg_mask = 0xffffffff;
+	if ((q = strchr(p, '&')) != NULL) {
+		*q++ = '\0';
+		tg->ntg_mask = strtoul(q, &end, 0);
+		if (end == q || *end != '\0')
+			return (nf_erri(nf, "Bad mask in trigger '%s'",
+			    tg->ntg_expr));
+	}
+	n = strlen(p);
+	if (n == 0 || n >= sizeof(tg->ntg_name))
+		return (nf_erri(nf, "Bad register in trigger '%s'",
+		    tg->ntg_expr));
+	memcpy(tg->ntg_name, p, n + 1);
+	tg->ntg_reg = strtoul(p, &end, 0);
+	if (*end != '\0' && nf_reg_byname(nf, p, &tg->ntg_reg) != 1)
+		return (nf_erri(nf, "Unknown register '%s'", p));
+	if (tg->ntg_reg % 4 != 0)
+		return (nf_erri(nf, "Register %#x isn't aligned",
+		    tg->ntg_reg));
+	return (0);
+}
+
+/*
+ * Set up a watch of ``regs_num'' registers ``regs''. Changes of those
+ * whose bit is set in ``changes'' are reported.
+ */
+void
+nf_watch_init(struct netfpga *nf, struct nf_watch *w, const uint32_t *regs,
+    int regs_num, uint32_t changes)
+{
+	int i;
+
+	nf_assert(nf);
+	ASSERT(w != NULL);
+	ASSERT(regs != NULL || regs_num == 0);
+	ASSERT(regs_num >= 0 && regs_num <= NF_SAMPLER_REGS_MAX);
+	memset(w, 0, sizeof(*w));
+	w->nw_nf = nf;
+	w->nw_regs_num = regs_num;
+	w->nw_changes = changes;
+	for (i = 0; i < regs_num; i++) {
+		w->nw_ops[i].nro_op = NF_REGOP_READ;
+		w->nw_ops[i].nro_reg = regs[i];
+	}
+}
+
+/*
+ * Add trigger ``tg'', and its register if it isn't watched yet. Returns
+ * the trigger's index or -1 on error.
+ */
+int
+nf_watch_trig(struct nf_watch *w, const struct nf_trig *tg)
+{
+	struct nf_trig *t;
+	int i;
+
+	ASSERT(w != NULL);
+	ASSERT(tg != NULL);
+	if (w->nw_trigs_num == NF_WATCH_TRIGS_MAX)
+		return (nf_erri(w->nw_nf, "More than %d triggers",
+		    NF_WATCH_TRIGS_MAX));
+	for (i = 0; i < w->nw_regs_num; i++)
+		if (w->nw_ops[i].nro_reg == tg->ntg_reg)
+			break;
+	if (i == w->nw_regs_num) {
+		if (i == NF_SAMPLER_REGS_MAX)
+			return (nf_erri(w->nw_nf, "More than %d registers",
+			    NF_SAMPLER_REGS_MAX));
+		w->nw_ops[i].nro_op = NF_REGOP_READ;
+		w->nw_ops[i].nro_reg = tg->ntg_reg;
+		w->nw_regs_num++;
+	}
+	t = &w->nw_trigs[w->nw_trigs_num];
+	*t = *tg;
+	t->ntg_idx = i;
+	t->ntg_active = 0;
+	t->ntg_fired = 0;
+	return (w->nw_trigs_num++);
+}
+
+static int
+nf_trig_test(const struct nf_trig *tg, uint32_t v)
+{
+
+	v &= tg->ntg_mask;
+	switch (tg->ntg_op) {
+	case NF_TRIG_EQ:
+		return (v == tg->ntg_value);
+	case NF_TRIG_NE:
+		return (v != tg->ntg_value);
+	case NF_TRIG_LT:
+		return (v < tg->ntg_value);
+	case NF_TRIG_LE:
+		return (v <= tg->ntg_value);
+	case NF_TRIG_GT:
+		return (v > tg->ntg_value);
+	case NF_TRIG_GE:
+		return (v >= tg->ntg_value);
+	}
+	return (0);
+}
+
+static void
+nf_watch_ev_add(struct nf_watch *w, struct nf_watch_ev *out, int out_num,
+    int *n, int reg, int trig, uint32_t v, uint64_t t)
+{
+	struct nf_watch_ev *e;
+
+	w->nw_events++;
+	if (*n == out_num) {
+		w->nw_dropped++;
+		return;
+	}
+	e = &out[(*n)++];
+	e->nwe_reg = reg;
+	e->nwe_trig = trig;
+	e->nwe_old = w->nw_prev[reg];
+	e->nwe_new = v;
+	e->nwe_time = t;
+	e->nwe_snap = 0;
+}
+
+/*
+ * Run sample ``s'' of the watched registers, in order, through the
+ * watch. Changes and triggers which fired with it (a trigger fires
+ * when its expression becomes true) are stored in ``out'', at most
+ * ``out_num'' of them, and their number is returned. The first sample
+ * only sets the values changes are seen against.
+ */
+int
+nf_watch_feed(struct nf_watch *w, const struct nf_sample *s,
+    struct nf_watch_ev *out, int out_num)
+{
+	struct nf_trig *tg;
+	uint32_t v;
+	int i, n, hit;
+
+	ASSERT(w != NULL);
+	ASSERT(s != NULL);
+	n = 0;
+	if (w->nw_primed)
+		for (i = 0; i < w->nw_regs_num; i++)
+			if ((w->nw_changes & (1U << i)) &&
+			    s->nsm_values[i] != w->nw_prev[i])
+				nf_watch_ev_add(w, out, out_num, &n, i, -1,
+				    s->nsm_values[i], s->nsm_time);
+	for (i = 0; i < w->nw_trigs_num; i++) {
+		tg = &w->nw_trigs[i];
+		v = s->nsm_values[tg->ntg_idx];
+		if (tg->ntg_delta) {
+			if (!w->nw_primed)
+				continue;
+			v -= w->nw_prev[tg->ntg_idx];
+		}
+		hit = nf_trig_test(tg, v);
+		if (hit && !tg->ntg_active) {
+			tg->ntg_fired++;
+			if (tg->ntg_snap)
+				w->nw_snap_due = 1;
+			nf_watch_ev_add(w, out, out_num, &n, tg->ntg_idx, i,
+			    s->nsm_values[tg->ntg_idx], s->nsm_time);
+		}
+		tg->ntg_active = hit;
+	}
+	for (i = 0; i < w->nw_regs_num; i++)
+		w->nw_prev[i] = s->nsm_values[i];
+	w->nw_primed = 1;
+	return (n);
+}
+
+/*
+ * Read the watched registers in one nf_regv() batch and feed them to
+ * the watch. If a trigger with ``ntg_snap'' set fired, ``nw_snap'' is
+ * read right after, and its events get ``nwe_snap''. Returns what
+ * nf_watch_feed() does or -1 on error.
+ */
+int
+nf_watch_poll(struct nf_watch *w, struct nf_watch_ev *out, int out_num)
+{
+	struct nf_sample s;
+	struct timespec ts;
+	int i, n;
+
+	ASSERT(w != NULL);
+	if (nf_regv(w->nw_nf, w->nw_ops, w->nw_regs_num) != w->nw_regs_num)
+		return (-1);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s.nsm_seq = w->nw_polls++;
+	s.nsm_time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	for (i = 0; i < w->nw_regs_num; i++)
+		s.nsm_values[i] = w->nw_ops[i].nro_value;
+	n = nf_watch_feed(w, &s, out, out_num);
+	if (w->nw_snap_due && w->nw_snap != NULL) {
+		if (nf_snap_read(w->nw_snap) < 0)
+			return (-1);
+		for (i = 0; i < n; i++)
+			if (out[i].nwe_trig >= 0 &&
+			    w->nw_trigs[out[i].nwe_trig].ntg_snap)
+				out[i].nwe_snap = 1;
+	}
+	w->nw_snap_due = 0;
+	return (n);
+}
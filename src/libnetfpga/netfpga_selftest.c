@@ -0,0 +1,398 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Self-test engines of the selftest bitfile: SRAM and DRAM pattern
+ * testers, two serial link testers and a packet generator/checker on
+ * each PHY. Engines run until stopped and keep counting, so a test is
+ * judged by its counters, not by a "done" bit.
+ *
+ * Engines are described by a table: registers holding their counters
+ * and error log, and the writes which start and stop them. Starting or
+ * polling any set of engines is one nf_regv() batch, so many engines on
+ * many cards can be driven from one thread without the bus becoming
+ * the bottleneck.
+ *
+ * SRAM and DRAM testers log up to NF_TEST_LOG_MAX bad words since start
+ * (address, 64 bits expected and read). PHY checkers keep the last bad
+ * word only. Serial testers don't log; frames sent but not received are
+ * their errors, which while they run includes frames in flight.
+ */
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+#define NF_TEST_OPS		5	/* Start or stop writes, at most */
+
+/* Per port offsets of serial and PHY testers */
+#define NF_TEST_SERIAL_OFFSET	(SERIAL_TEST_CONTROL_1_REG - \
+				    SERIAL_TEST_CONTROL_0_REG)
+#define NF_TEST_PHY(reg, p)	((reg) + (p) * PHY_TEST_PORT_OFFSET)
+
+/* Value of a start write is added to the seed */
+#define NF_TEST_F_SEED		(1 << 0)
+
+struct nf_test_op {
+	uint32_t		 nto_reg;
+	uint32_t		 nto_value;
+	int			 nto_flags;
+};
+
+struct nf_test_desc {
+	const char		*ntd_name;
+	uint32_t		 ntd_runs_lo, ntd_runs_hi;	/* 0: none */
+	uint32_t		 ntd_good_lo, ntd_good_hi;
+	uint32_t		 ntd_bad;
+	uint32_t		 ntd_errors;
+	int			 ntd_loss;	/* Errors are runs - good */
+	uint32_t		 ntd_log;	/* First log register */
+	uint32_t		 ntd_log_stride;
+	int			 ntd_log_num;
+	int			 ntd_log_wide;	/* 64-bit data in hi, lo */
+	struct nf_test_op	 ntd_start[NF_TEST_OPS];
+	struct nf_test_op	 ntd_stop[NF_TEST_OPS];
+};
+
+#define NF_TEST_MEM(name, pfx, ...)					\
+{									\
+	.ntd_name = name,						\
+	.ntd_runs_lo = pfx##_TEST_ITER_NUM_REG,				\
+	.ntd_good_lo = pfx##_TEST_GOOD_RUNS_REG,			\
+	.ntd_bad = pfx##_TEST_BAD_RUNS_REG,				\
+	.ntd_errors = pfx##_TEST_ERR_CNT_REG,				\
+	.ntd_log = pfx##_TEST_LOG_ADDR_REG,				\
+	.ntd_log_stride = pfx##_TEST_LOG_OFFSET,			\
+	.ntd_log_num = NF_TEST_LOG_MAX,					\
+	.ntd_log_wide = 1,						\
+	.ntd_start = {							\
+		{ pfx##_TEST_EN_REG, 0, 0 },				\
+		__VA_ARGS__,						\
+		{ pfx##_TEST_CTRL_REG, 1, 0 },				\
+		{ pfx##_TEST_EN_REG, 1, 0 },				\
+	},								\
+	.ntd_stop = { { pfx##_TEST_EN_REG, 0, 0 } },			\
+}
+
+#define NF_TEST_SERIAL(name, p)						\
+{									\
+	.ntd_name = name,						\
+	.ntd_runs_lo = SERIAL_TEST_NUM_FRAMES_SENT_0_LO_REG +		\
+	    (p) * NF_TEST_SERIAL_OFFSET,				\
+	.ntd_runs_hi = SERIAL_TEST_NUM_FRAMES_SENT_0_HI_REG +		\
+	    (p) * NF_TEST_SERIAL_OFFSET,				\
+	.ntd_good_lo = SERIAL_TEST_NUM_FRAMES_RCVD_0_LO_REG +		\
+	    (p) * NF_TEST_SERIAL_OFFSET,				\
+	.ntd_good_hi = SERIAL_TEST_NUM_FRAMES_RCVD_0_HI_REG +		\
+	    (p) * NF_TEST_SERIAL_OFFSET,				\
+	.ntd_loss = 1,							\
+	.ntd_start = {							\
+		{ SERIAL_TEST_CONTROL_0_REG + (p) * NF_TEST_SERIAL_OFFSET, \
+		    2, 0 },						\
+		{ SERIAL_TEST_CONTROL_0_REG + (p) * NF_TEST_SERIAL_OFFSET, \
+		    1, 0 },						\
+	},								\
+	.ntd_stop = { { SERIAL_TEST_CONTROL_0_REG +			\
+	    (p) * NF_TEST_SERIAL_OFFSET, 0, 0 } },			\
+}
+
+/* PHY_TEST_CTRL_REG, which starts and stops ports, is set separately */
+#define NF_TEST_PHY_PORT(name, p)					\
+{									\
+	.ntd_name = name,						\
+	.ntd_runs_lo = NF_TEST_PHY(PHY_TEST_PHY_0_TX_PKT_CNT_REG, p),	\
+	.ntd_good_lo = NF_TEST_PHY(PHY_TEST_PHY_0_RX_GOOD_PKT_CNT_REG, p), \
+	.ntd_errors = NF_TEST_PHY(PHY_TEST_PHY_0_RX_ERR_PKT_CNT_REG, p), \
+	.ntd_log = NF_TEST_PHY(PHY_TEST_PHY_0_RX_LOG_STATUS_REG, p),	\
+	.ntd_log_num = 1,						\
+	.ntd_start = {							\
+		{ NF_TEST_PHY(PHY_TEST_PHY_0_TX_RAND_SEED_REG, p), (p),	\
+		    NF_TEST_F_SEED },					\
+		{ NF_TEST_PHY(PHY_TEST_PHY_0_RX_CTRL_REG, p), 1, 0 },	\
+	},								\
+}
+
+static const struct nf_test_desc nf_test_descs[NF_TEST_NUM] = {
+	NF_TEST_MEM("sram", SRAM, { SRAM_TEST_RAND_SEED_1_REG, 0,
+	    NF_TEST_F_SEED }, { SRAM_TEST_RAND_SEED_2_REG, 0x5a5a5a5a,
+	    NF_TEST_F_SEED }),
+	NF_TEST_MEM("dram", DRAM, { DRAM_TEST_RAND_SEED_REG, 0,
+	    NF_TEST_F_SEED }),
+	NF_TEST_SERIAL("serial0", 0),
+	NF_TEST_SERIAL("serial1", 1),
+	NF_TEST_PHY_PORT("phy0", 0),
+	NF_TEST_PHY_PORT("phy1", 1),
+	NF_TEST_PHY_PORT("phy2", 2),
+	NF_TEST_PHY_PORT("phy3", 3),
+};
+
+#define NF_TEST_PHY_MASK(mask)	(((mask) >> NF_TEST_PHY0) & 0xf)
+
+/*
+ * Name of engine ``t''.
+ */
+const char *
+nf_test_name(int t)
+{
+
+	ASSERT(t >= 0 && t < NF_TEST_NUM);
+	return (nf_test_descs[t].ntd_name);
+}
+
+/*
+ * Engine number of ``name'', or -1.
+ */
+int
+nf_test_byname(const char *name)
+{
+	int t;
+
+	ASSERT(name != NULL);
+	for (t = 0; t < NF_TEST_NUM; t++)
+		if (strcmp(nf_test_descs[t].ntd_name, name) == 0)
+			return (t);
+	return (-1);
+}
+
+/*
+ * Queue start or stop writes of engines in ``mask''. PHY ports share
+ * PHY_TEST_CTRL_REG: ``phy_ctl'' is its new value, or -1 to leave it.
+ */
+static int
+nf_test_ops(struct netfpga *nf, unsigned mask, int start, uint32_t seed,
+    int64_t phy_ctl)
+{
+	struct nf_regop ops[NF_TEST_NUM * NF_TEST_OPS + 4], *op;
+	const struct nf_test_op *to;
+	int t, i;
+
+	op = ops;
+	if (start && NF_TEST_PHY_MASK(mask) != 0) {
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = PHY_TEST_SIZE_REG;
+		op->nro_value = NF_OQ_PKT_MAX;
+		op++;
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = PHY_TEST_PATTERN_REG;
+		op->nro_value = seed;
+		op++;
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = PHY_TEST_INIT_SEQ_NO_REG;
+		op->nro_value = 0;
+		op++;
+	}
+	for (t = 0; t < NF_TEST_NUM; t++) {
+		if ((mask & (1U << t)) == 0)
+			continue;
+		to = start ? nf_test_descs[t].ntd_start :
+		    nf_test_descs[t].ntd_stop;
+		for (i = 0; i < NF_TEST_OPS && to[i].nto_reg != 0; i++) {
+			op->nro_op = NF_REGOP_WRITE;
+			op->nro_reg = to[i].nto_reg;
+			op->nro_value = to[i].nto_value;
+			if (to[i].nto_flags & NF_TEST_F_SEED)
+				op->nro_value += seed;
+			op++;
+		}
+	}
+	if (phy_ctl >= 0) {
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = PHY_TEST_CTRL_REG;
+		op->nro_value = (uint32_t)phy_ctl;
+		op++;
+	}
+	if (nf_regv(nf, ops, op - ops) != op - ops)
+		return (nf_erri(nf, "Couldn't %s self-test engines",
+		    start ? "start" : "stop"));
+	return (0);
+}
+
+/*
+ * Reset counters of engines in ``mask'' and start them with random
+ * patterns from ``seed''.
+ */
+int
+nf_test_start(struct netfpga *nf, unsigned mask, uint32_t seed)
+{
+	int64_t phy_ctl;
+
+	nf_assert(nf);
+	ASSERT((mask & ~NF_TEST_ALL) == 0);
+	phy_ctl = -1;
+	if (NF_TEST_PHY_MASK(mask) != 0)
+		phy_ctl = nf_rd32(nf, PHY_TEST_CTRL_REG) |
+		    NF_TEST_PHY_MASK(mask);
+	return (nf_test_ops(nf, mask, 1, seed, phy_ctl));
+}
+
+/*
+ * Stop engines in ``mask''. Counters keep their values.
+ */
+int
+nf_test_stop(struct netfpga *nf, unsigned mask)
+{
+	int64_t phy_ctl;
+
+	nf_assert(nf);
+	ASSERT((mask & ~NF_TEST_ALL) == 0);
+	phy_ctl = -1;
+	if (NF_TEST_PHY_MASK(mask) != 0)
+		phy_ctl = nf_rd32(nf, PHY_TEST_CTRL_REG) &
+		    ~NF_TEST_PHY_MASK(mask);
+	return (nf_test_ops(nf, mask, 0, 0, phy_ctl));
+}
+
+static void
+nf_test_rd(struct nf_regop **op, uint32_t reg)
+{
+
+	if (reg == 0)
+		return;
+	(*op)->nro_op = NF_REGOP_READ;
+	(*op)->nro_reg = reg;
+	(*op)->nro_value = 0;
+	(*op)++;
+}
+
+static uint64_t
+nf_test_val(struct nf_regop **op, uint32_t lo, uint32_t hi)
+{
+	uint64_t v;
+
+	if (lo == 0)
+		return (0);
+	v = (*op)++->nro_value;
+	if (hi != 0)
+		v |= (uint64_t)(*op)++->nro_value << 32;
+	return (v);
+}
+
+/*
+ * Read counters of engines in ``mask'' into ``res'', indexed by engine,
+ * in one batch.
+ */
+int
+nf_test_poll(struct netfpga *nf, unsigned mask, struct nf_test_res *res)
+{
+	struct nf_regop ops[NF_TEST_NUM * 6], *op;
+	const struct nf_test_desc *td;
+	int t, n;
+
+	nf_assert(nf);
+	ASSERT(res != NULL);
+	op = ops;
+	for (t = 0; t < NF_TEST_NUM; t++) {
+		if ((mask & (1U << t)) == 0)
+			continue;
+		td = &nf_test_descs[t];
+		nf_test_rd(&op, td->ntd_runs_lo);
+		nf_test_rd(&op, td->ntd_runs_hi);
+		nf_test_rd(&op, td->ntd_good_lo);
+		nf_test_rd(&op, td->ntd_good_hi);
+		nf_test_rd(&op, td->ntd_bad);
+		nf_test_rd(&op, td->ntd_errors);
+	}
+	n = op - ops;
+	if (nf_regv(nf, ops, n) != n)
+		return (nf_erri(nf, "Couldn't read self-test counters"));
+
+	op = ops;
+	for (t = 0; t < NF_TEST_NUM; t++) {
+		if ((mask & (1U << t)) == 0)
+			continue;
+		td = &nf_test_descs[t];
+		res[t].ntr_runs = nf_test_val(&op, td->ntd_runs_lo,
+		    td->ntd_runs_hi);
+		res[t].ntr_good = nf_test_val(&op, td->ntd_good_lo,
+		    td->ntd_good_hi);
+		res[t].ntr_bad = nf_test_val(&op, td->ntd_bad, 0);
+		res[t].ntr_errors = nf_test_val(&op, td->ntd_errors, 0);
+		if (td->ntd_loss)
+			res[t].ntr_errors = res[t].ntr_runs > res[t].ntr_good ?
+			    res[t].ntr_runs - res[t].ntr_good : 0;
+	}
+	return (0);
+}
+
+/*
+ * Read entries ``first'' and on of error log of engine ``t'', up to
+ * ``log_num''. Returns the number of entries read.
+ */
+int
+nf_test_log(struct netfpga *nf, int t, unsigned first, struct nf_test_log *log,
+    int log_num)
+{
+	struct nf_regop ops[NF_TEST_LOG_MAX * 5], *op;
+	const struct nf_test_desc *td;
+	uint32_t reg;
+	int i, j, n, fields;
+
+	nf_assert(nf);
+	ASSERT(t >= 0 && t < NF_TEST_NUM);
+	ASSERT(log != NULL || log_num == 0);
+	td = &nf_test_descs[t];
+	n = (int)first < td->ntd_log_num ? td->ntd_log_num - first : 0;
+	if (n > log_num)
+		n = log_num;
+	if (n == 0)
+		return (0);
+	fields = td->ntd_log_wide ? 5 : 3;
+	op = ops;
+	for (i = 0; i < n; i++) {
+		reg = td->ntd_log + (first + i) * td->ntd_log_stride;
+		for (j = 0; j < fields; j++)
+			nf_test_rd(&op, reg + j * 4);
+	}
+	if (nf_regv(nf, ops, op - ops) != op - ops)
+		return (nf_erri(nf, "Couldn't read %s error log",
+		    td->ntd_name));
+	for (op = ops, i = 0; i < n; i++, op += fields) {
+		log[i].ntl_addr = op[0].nro_value;
+		if (td->ntd_log_wide) {
+			log[i].ntl_exp = (uint64_t)op[1].nro_value << 32 |
+			    op[2].nro_value;
+			log[i].ntl_got = (uint64_t)op[3].nro_value << 32 |
+			    op[4].nro_value;
+		} else {
+			log[i].ntl_exp = op[1].nro_value;
+			log[i].ntl_got = op[2].nro_value;
+		}
+	}
+	return (n);
+}
@@ -0,0 +1,374 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Calibration of the rate limiter and delay modules.
+ *
+ * Both sit between one MAC port's output queue and the MAC. The rate
+ * limiter has a single knob, RATE_LIMIT_SHIFT_REG, whose mapping to
+ * throughput is coarse and not documented; the delay module holds
+ * packets for DELAY_LENGTH_REG units, nominally core clock ticks, plus
+ * whatever its pipeline adds. So instead of computing register values
+ * from a formula, they are set, what the port does is measured, and
+ * the values are corrected until it's within tolerance.
+ *
+ * A measurement is a run of samples, each one nf_regv() batch latching
+ * and reading the stamp counter, the queue's removed byte counter and
+ * the MAC's pushed byte counter, the latter before and after the former
+ * so that the time between reads cancels out. Rate is MAC bytes over
+ * stamp ticks. Bytes between the two counters are those the modules
+ * hold, so by Little's law their median (a batch stretched by an
+ * interrupt is way off) divided by the rate is the time a byte spends
+ * there. The counters are independent and never match, which is why
+ * delay is measured against a baseline taken with the module disabled.
+ *
+ * Rate limiter is searched from the guess that every shift halves the
+ * rate, walking one shift at a time towards the target and stopping
+ * when a shift was already tried. Delay length is corrected by secant
+ * steps through the last two measurements, starting from the nominal
+ * tick. Both leave the best setting found in place.
+ */
+#include <sys/types.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+#define NF_SHAPE_PORTS		4
+#define NF_SHAPE_PERIOD_US	1000
+#define NF_SHAPE_SETTLE_MS	20	/* After a change, before measuring */
+#define NF_SHAPE_MAC_REG(reg0, p)	((reg0) + (p) *			\
+	(MAC_GRP_1_CONTROL_REG - MAC_GRP_0_CONTROL_REG))
+
+static void
+nf_shape_sleep(unsigned us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000L;
+	nanosleep(&ts, NULL);
+}
+
+/*
+ * Difference of two byte counts taken modulo 2^32.
+ */
+static double
+nf_shape_fold(double bytes)
+{
+
+	bytes = fmod(bytes, 4294967296.0);
+	if (bytes >= 2147483648.0)
+		bytes -= 4294967296.0;
+	else if (bytes < -2147483648.0)
+		bytes += 4294967296.0;
+	return (bytes);
+}
+
+static int
+nf_shape_cmp(const void *a, const void *b)
+{
+	double x, y;
+
+	x = *(const double *)a;
+	y = *(const double *)b;
+	return ((x > y) - (x < y));
+}
+
+/*
+ * Measure port ``port'' for ``ms'' milliseconds.
+ */
+int
+nf_shape_measure(struct netfpga *nf, int port, unsigned ms,
+    struct nf_shape_meas *m)
+{
+	struct nf_regop ops[6];
+	uint64_t ticks0, ticks, sent;
+	uint32_t pushed;
+	double held0, held, *lag;
+	int i, n, num;
+
+	nf_assert(nf);
+	ASSERT(m != NULL);
+	if (port < 0 || port >= NF_SHAPE_PORTS)
+		return (nf_erri(nf, "Port %d out of range", port));
+	num = ms * 1000 / NF_SHAPE_PERIOD_US + 1;
+	if (num < 2)
+		num = 2;
+	ops[0].nro_op = NF_REGOP_WRITE;
+	ops[0].nro_reg = STAMP_COUNTER_READ_ENABLE;
+	ops[0].nro_value = 1;
+	ops[1].nro_reg = STAMP_COUNTER_BIT_63_32;
+	ops[2].nro_reg = STAMP_COUNTER_BIT_31_0;
+	ops[3].nro_reg = NF_SHAPE_MAC_REG(TX_QUEUE_0_NUM_BYTES_PUSHED_REG,
+	    port);
+	ops[4].nro_reg = NF_OQ_REG(OQ_NUM_PKT_BYTES_REMOVED_REG_0, port * 2);
+	ops[5].nro_reg = ops[3].nro_reg;
+	lag = malloc(num * sizeof(*lag));
+	if (lag == NULL)
+		return (nf_erri(nf, "Couldn't allocate %d samples", num));
+	ticks0 = ticks = sent = 0;
+	pushed = 0;
+	held0 = 0;
+	for (n = 0; n < num; n++) {
+		if (n > 0)
+			nf_shape_sleep(NF_SHAPE_PERIOD_US);
+		for (i = 1; i < 6; i++) {
+			ops[i].nro_op = NF_REGOP_READ;
+			ops[i].nro_value = 0;
+		}
+		if (nf_regv(nf, ops, 6) != 6) {
+			free(lag);
+			return (nf_erri(nf, "Couldn't sample port %d", port));
+		}
+		ticks = (uint64_t)ops[1].nro_value << 32 | ops[2].nro_value;
+		held = (uint32_t)(ops[4].nro_value - ops[3].nro_value) -
+		    (uint32_t)(ops[5].nro_value - ops[3].nro_value) / 2.0;
+		if (n == 0) {
+			ticks0 = ticks;
+			held0 = held;
+		} else
+			sent += (uint32_t)(ops[5].nro_value - pushed);
+		pushed = ops[5].nro_value;
+		lag[n] = nf_shape_fold(held - held0);
+	}
+	qsort(lag, num, sizeof(*lag), nf_shape_cmp);
+	memset(m, 0, sizeof(*m));
+	m->nsh_samples = num;
+	m->nsh_ticks = ticks - ticks0;
+	m->nsh_bytes = sent;
+	m->nsh_held = held0 + lag[num / 2];
+	free(lag);
+	if (sent == 0 || m->nsh_ticks == 0)
+		return (nf_erri(nf, "No traffic sent out of port %d", port));
+	m->nsh_rate = (double)sent * 1e9 / m->nsh_ticks / NF_HWTIME_TICK_NS;
+	return (0);
+}
+
+/*
+ * Time in ns bytes spend in the modules during ``m'' more than they
+ * did during ``base''. Counters' difference is modulo 2^32.
+ */
+static double
+nf_shape_lag(const struct nf_shape_meas *m, const struct nf_shape_meas *base)
+{
+
+	return (nf_shape_fold(m->nsh_held - base->nsh_held) / m->nsh_rate *
+	    1e9);
+}
+
+static int
+nf_shape_set(struct netfpga *nf, uint32_t enable_reg, int enable,
+    uint32_t value_reg, uint32_t value)
+{
+	struct nf_regop ops[2];
+
+	ops[0].nro_op = NF_REGOP_WRITE;
+	ops[0].nro_reg = value_reg;
+	ops[0].nro_value = value;
+	ops[1].nro_op = NF_REGOP_WRITE;
+	ops[1].nro_reg = enable_reg;
+	ops[1].nro_value = enable ? 1 : 0;
+	if (nf_regv(nf, ops, 2) != 2)
+		return (nf_erri(nf, "Couldn't write %#x", enable_reg));
+	nf_shape_sleep(NF_SHAPE_SETTLE_MS * 1000);
+	return (0);
+}
+
+/*
+ * Find the rate limiter's shift which makes the port send closest to
+ * ``rate'' bytes per second, and leave it set. The limiter stays off
+ * if the port doesn't send more than that without it.
+ */
+int
+nf_shape_rate(struct netfpga *nf, double rate, struct nf_shape_cal *cal)
+{
+	double got[NF_SHAPE_SHIFT_MAX + 1], line;
+	struct nf_shape_meas m;
+	int s, best, next, set;
+
+	nf_assert(nf);
+	ASSERT(cal != NULL);
+	if (rate <= 0)
+		return (nf_erri(nf, "Rate must be positive"));
+	cal->nsc_iters = 0;
+	if (nf_shape_set(nf, RATE_LIMIT_ENABLE_REG, 0, RATE_LIMIT_SHIFT_REG,
+	    0) != 0 || nf_shape_measure(nf, cal->nsc_port, cal->nsc_ms,
+	    &m) != 0)
+		return (-1);
+	cal->nsc_iters++;
+	line = m.nsh_rate;
+	if (rate >= line * (1 - cal->nsc_tol)) {
+		cal->nsc_enabled = 0;
+		cal->nsc_value = 0;
+		cal->nsc_got = line;
+		cal->nsc_ok = (line >= rate * (1 - cal->nsc_tol));
+		return (0);
+	}
+
+	for (s = 0; s <= NF_SHAPE_SHIFT_MAX; s++)
+		got[s] = -1;
+	s = (int)lround(log2(line / rate));
+	if (s > NF_SHAPE_SHIFT_MAX)
+		s = NF_SHAPE_SHIFT_MAX;
+	best = set = s;
+	while (cal->nsc_iters < NF_SHAPE_ITER_MAX) {
+		if (nf_shape_set(nf, RATE_LIMIT_ENABLE_REG, 1,
+		    RATE_LIMIT_SHIFT_REG, s) != 0 ||
+		    nf_shape_measure(nf, cal->nsc_port, cal->nsc_ms, &m) != 0)
+			return (-1);
+		cal->nsc_iters++;
+		set = s;
+		got[s] = m.nsh_rate;
+		if (fabs(got[s] - rate) < fabs(got[best] - rate))
+			best = s;
+		if (fabs(got[s] - rate) <= rate * cal->nsc_tol)
+			break;
+		next = (got[s] > rate) ? s + 1 : s - 1;
+		if (next < 0 || next > NF_SHAPE_SHIFT_MAX || got[next] >= 0)
+			break;
+		s = next;
+	}
+	if (best != set && nf_shape_set(nf, RATE_LIMIT_ENABLE_REG, 1,
+	    RATE_LIMIT_SHIFT_REG, best) != 0)
+		return (-1);
+	cal->nsc_enabled = 1;
+	cal->nsc_value = best;
+	cal->nsc_got = got[best];
+	cal->nsc_ok = (fabs(got[best] - rate) <= rate * cal->nsc_tol);
+	return (0);
+}
+
+/*
+ * Find the delay module's length which makes bytes spend ``ns'' more
+ * nanoseconds on their way to the MAC, and leave it set. Zero turns
+ * the module off.
+ */
+int
+nf_shape_delay(struct netfpga *nf, double ns, struct nf_shape_cal *cal)
+{
+	struct nf_shape_meas base, m;
+	double d, pd, tol, slope, best_d, next;
+	uint32_t len, plen, best, set;
+
+	nf_assert(nf);
+	ASSERT(cal != NULL);
+	if (ns < 0)
+		return (nf_erri(nf, "Delay can't be negative"));
+	cal->nsc_iters = 0;
+	if (nf_shape_set(nf, DELAY_ENABLE_REG, 0, DELAY_LENGTH_REG, 0) != 0 ||
+	    nf_shape_measure(nf, cal->nsc_port, cal->nsc_ms, &base) != 0)
+		return (-1);
+	cal->nsc_iters++;
+	cal->nsc_enabled = 0;
+	cal->nsc_value = 0;
+	cal->nsc_got = 0;
+	cal->nsc_ok = 1;
+	if (ns == 0)
+		return (0);
+
+	tol = ns * cal->nsc_tol;
+	if (tol < NF_HWTIME_TICK_NS)
+		tol = NF_HWTIME_TICK_NS;
+	len = (uint32_t)lround(ns / NF_HWTIME_TICK_NS);
+	plen = best = set = 0;
+	pd = best_d = 0;
+	while (cal->nsc_iters < NF_SHAPE_ITER_MAX) {
+		if (nf_shape_set(nf, DELAY_ENABLE_REG, 1, DELAY_LENGTH_REG,
+		    len) != 0 ||
+		    nf_shape_measure(nf, cal->nsc_port, cal->nsc_ms, &m) != 0)
+			return (-1);
+		set = len;
+		d = nf_shape_lag(&m, &base);
+		if (cal->nsc_iters == 1 || fabs(d - ns) < fabs(best_d - ns)) {
+			best = len;
+			best_d = d;
+		}
+		cal->nsc_iters++;
+		if (fabs(d - ns) <= tol)
+			break;
+		/* Through the last two points, or the origin at first */
+		if (cal->nsc_iters > 2 && len != plen)
+			slope = (d - pd) / ((double)len - plen);
+		else
+			slope = (len > 0) ? d / len : NF_HWTIME_TICK_NS;
+		if (slope <= 0)
+			slope = NF_HWTIME_TICK_NS;
+		next = len + (ns - d) / slope;
+		if (next < 0)
+			next = 0;
+		if (next > UINT32_MAX)
+			next = UINT32_MAX;
+		plen = len;
+		pd = d;
+		len = (uint32_t)lround(next);
+		if (len == plen)
+			break;
+	}
+	if (best != set && nf_shape_set(nf, DELAY_ENABLE_REG, 1,
+	    DELAY_LENGTH_REG, best) != 0)
+		return (-1);
+	cal->nsc_enabled = 1;
+	cal->nsc_value = best;
+	cal->nsc_got = best_d;
+	cal->nsc_ok = (fabs(best_d - ns) <= tol);
+	return (0);
+}
+
+/*
+ * Turn both modules off.
+ */
+int
+nf_shape_off(struct netfpga *nf)
+{
+	struct nf_regop ops[2];
+
+	nf_assert(nf);
+	ops[0].nro_op = NF_REGOP_WRITE;
+	ops[0].nro_reg = RATE_LIMIT_ENABLE_REG;
+	ops[0].nro_value = 0;
+	ops[1].nro_op = NF_REGOP_WRITE;
+	ops[1].nro_reg = DELAY_ENABLE_REG;
+	ops[1].nro_value = 0;
+	if (nf_regv(nf, ops, 2) != 2)
+		return (nf_erri(nf, "Couldn't turn rate limiter and delay "
+		    "off"));
+	return (0);
+}
@@ -0,0 +1,869 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Simulated NetFPGA card. Registers live in a sparse, lazily allocated
+ * memory; a handful of them are preset so that the card looks like one
+ * running a reference design. Options are passed through ``nf_iface''
+ * as a comma separated list:
+ *
+ *	latency=<ns>		cost of every 32-bit register access;
+ *				nf_regv() batches and bulk copies pay
+ *				it once, as one system call would
+ *	design=nic|router|switch	which reference design to pretend
+ *	done=<us>		time DONE takes to go high after the
+ *				whole Virtex bitstream was pushed
+ *	drift=<ppb>		how fast the stamp counter runs against
+ *				CLOCK_MONOTONIC, in parts per billion
+ *	oq=1			drive the output queues with on/off
+ *				traffic, see nf_sim_oq_traffic
+ *	testfail=<mask>		self-test engines (NF_TEST_*) which
+ *				find errors
+ *	flap=<ms>		port 3 loses and regains link every
+ *				<ms> milliseconds
+ *	shape=<port>		send traffic out of MAC port <port>
+ *				through the rate limiter and delay
+ *				modules, see nf_sim_shape_update
+ *
+ * It's meant for benchmarking and testing the library without a card.
+ */
+#include <sys/types.h>
+
+#include <netinet/in.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+nf_open_t nf2_sim_open;
+nf_close_t nf2_sim_close;
+nf_read_t nf2_sim_read;
+nf_write_t nf2_sim_write;
+nf_regv_t nf2_sim_regv;
+nf_mem_t nf2_sim_mem;
+
+#define NF_SIM_MEM_SIZE		0x8000000	/* BAR0 of a real card */
+#define NF_SIM_PAGE_SHIFT	12
+#define NF_SIM_PAGE_SIZE	(1 << NF_SIM_PAGE_SHIFT)
+#define NF_SIM_PAGE_NUM		(NF_SIM_MEM_SIZE >> NF_SIM_PAGE_SHIFT)
+
+/* CPCI version 2 (NetFPGA 2.1 board) */
+#define NF_SIM_CPCI_ID		0x00000002
+
+/* MDIO status: autonegotiation complete, link up; and the link bit */
+#define NF_SIM_MDIO_STATUS	0x796d
+#define NF_SIM_MDIO_LINK	0x0004
+#define NF_SIM_MDIO_OFFSET	(MDIO_1_STATUS_REG - MDIO_0_STATUS_REG)
+
+/* Output queue model: 1 Gb/s ports, 1000 byte packets */
+#define NF_SIM_OQ_OUT		125.0	/* Bytes per us */
+#define NF_SIM_OQ_PKT		1000
+#define NF_SIM_OQ_WORDS		0x10000	/* Default window of each queue */
+#define NF_SIM_MAC_REG(reg0, p)	((reg0) + (p) *				\
+	(MAC_GRP_1_CONTROL_REG - MAC_GRP_0_CONTROL_REG))
+
+/*
+ * Rate limiter and delay model. Traffic comes at NF_SIM_SHAPE_IN; the
+ * limiter's rate for a shift and the delay for a length are close to,
+ * but not quite, what one would guess. Output queue's byte counter is
+ * NF_SIM_SHAPE_SKEW ahead of the MAC's, so the two never match.
+ */
+#define NF_SIM_SHAPE_IN		110.0	/* Bytes per us */
+#define NF_SIM_SHAPE_STEP	0.75	/* Rate is OUT / (1 + STEP * (2^s - 1)) */
+#define NF_SIM_SHAPE_UNIT_NS	8.2	/* Per DELAY_LENGTH_REG unit */
+#define NF_SIM_SHAPE_PIPE_NS	600.0	/* Delay with the module disabled */
+#define NF_SIM_SHAPE_SKEW	0xfffff000U
+
+/*
+ * Traffic into each output queue: bytes per microsecond while on, and
+ * how long it's on in every period. Queue 0 gets bursts bigger than
+ * its default window, queue 2 bursts which just fit, and the rest less
+ * than the port can send.
+ */
+static const struct {
+	double		 in;
+	long		 on;		/* us */
+	long		 period;	/* us */
+} nf_sim_oq_traffic[NF_OQ_QUEUES] = {
+	{ 250.0,	8000,	20000 },
+	{ 100.0,	20000,	20000 },
+	{ 200.0,	6000,	20000 },
+	{ 60.0,		20000,	20000 },
+	{ 60.0,		20000,	20000 },
+	{ 30.0,		20000,	20000 },
+	{ 30.0,		20000,	20000 },
+	{ 10.0,		20000,	20000 },
+};
+
+struct nf_sim_design {
+	const char	*name;
+	uint32_t	 id;
+	const char	*str;
+	int		 is_switch;	/* Switch LUT, not router's tables */
+};
+
+static struct nf_sim_design nf_sim_designs[] = {
+	{ "nic",	0x00000001,	"Reference NIC (simulated)",	0 },
+	{ "router",	0x00000002,	"Reference router (simulated)",	0 },
+	{ "switch",	0x00000003,	"Reference switch (simulated)",	1 },
+	{ NULL,		0,		NULL,				0 }
+};
+
+struct nf_softc {
+	uint32_t	*pages[NF_SIM_PAGE_NUM];
+	long		 latency;	/* ns per register access */
+	struct nf_sim_design *design;
+
+	/* Router's LPM table: IP, mask, next hop, output port */
+	uint32_t	 rt[ROUTER_RT_SIZE][4];
+	/* Router's ARP table: MAC high, MAC low, next hop */
+	uint32_t	 arp[ROUTER_ARP_SIZE][3];
+	/* Router's destination IP filter */
+	uint32_t	 filter[ROUTER_DST_IP_FILTER_TABLE_DEPTH];
+	/* Switch's MAC table: ports and MAC high, MAC low */
+	uint32_t	 lut[NF_SWITCH_LUT_SIZE][2];
+
+	/* Virtex programming interface */
+	long		 done_delay;	/* ns */
+	long		 prog_words;
+	long		 prog_t1;	/* when the last word came */
+
+	/* Port 3's link goes down and up every ``flap'' ns */
+	long		 flap;
+
+	/* Stamp counter: 125 MHz ticks since open, off by ``drift'' */
+	long		 stamp_t0;
+	long		 drift;		/* ppb */
+
+	/* Output queue model, all in bytes */
+	int		 oq_model;
+	long		 oq_t;		/* ns, time the model is at */
+	double		 oq_occ[NF_OQ_QUEUES];
+	double		 oq_dropped[NF_OQ_QUEUES];
+	double		 oq_stored[NF_OQ_QUEUES];
+
+	/* Self-test engines: when started and stopped (0 if running) */
+	long		 test_t0[NF_TEST_NUM];
+	long		 test_t1[NF_TEST_NUM];
+	unsigned	 test_fail;	/* Engines finding errors */
+
+	/* Rate limiter and delay model, -1 if there's no traffic */
+	int		 shape_port;
+	long		 shape_t;	/* ns, time the model is at */
+	double		 shape_sent;	/* Bytes */
+};
+
+static long
+nf_sim_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000000L + ts.tv_nsec);
+}
+
+/*
+ * Burn ``ns'' nanoseconds the way a slow bus would.
+ */
+static void
+nf_sim_delay(long ns)
+{
+	struct timespec ts0, ts1;
+
+	if (ns <= 0)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+	} while ((ts1.tv_sec - ts0.tv_sec) * 1000000000L +
+	    (ts1.tv_nsec - ts0.tv_nsec) < ns);
+}
+
+/*
+ * Return pointer to the register ``reg''. Pages are allocated only if
+ * ``alloc'' is set; otherwise NULL means the register reads as 0.
+ */
+static uint32_t *
+nf_sim_reg(struct nf_softc *sc, uint32_t reg, int alloc)
+{
+	uint32_t **pg;
+
+	pg = &sc->pages[reg >> NF_SIM_PAGE_SHIFT];
+	if (*pg == NULL) {
+		if (!alloc)
+			return (NULL);
+		*pg = calloc(1, NF_SIM_PAGE_SIZE);
+		ASSERT(*pg != NULL);
+	}
+	return (&(*pg)[(reg & (NF_SIM_PAGE_SIZE - 1)) / 4]);
+}
+
+static void
+nf_sim_set(struct nf_softc *sc, uint32_t reg, uint32_t value)
+{
+
+	*nf_sim_reg(sc, reg, 1) = value;
+}
+
+/* Register value, without side effects */
+static uint32_t
+nf_sim_get(struct nf_softc *sc, uint32_t reg)
+{
+	uint32_t *r;
+
+	r = nf_sim_reg(sc, reg, 0);
+	return ((r != NULL) ? *r : 0);
+}
+
+/*
+ * Parse options passed in ``opts''.
+ */
+static int
+nf_sim_opts(struct netfpga *nf, struct nf_softc *sc, const char *opts)
+{
+	char buf[256], *s, *opt, *val;
+	struct nf_sim_design *d;
+
+	if (opts == NULL)
+		return (0);
+	if (strlen(opts) >= sizeof(buf))
+		return (nf_erri(nf, "Options '%s' too long", opts));
+	strcpy(buf, opts);
+	s = buf;
+	while ((opt = strsep(&s, ",")) != NULL) {
+		if (*opt == '\0')
+			continue;
+		val = strchr(opt, '=');
+		if (val == NULL)
+			return (nf_erri(nf, "Option '%s' needs a value", opt));
+		*val++ = '\0';
+		if (strcmp(opt, "latency") == 0) {
+			sc->latency = strtol(val, NULL, 0);
+		} else if (strcmp(opt, "oq") == 0) {
+			sc->oq_model = strtol(val, NULL, 0) != 0;
+		} else if (strcmp(opt, "flap") == 0) {
+			sc->flap = strtol(val, NULL, 0) * 1000000;
+		} else if (strcmp(opt, "shape") == 0) {
+			sc->shape_port = strtol(val, NULL, 0);
+			if (sc->shape_port < 0 || sc->shape_port > 3)
+				return (nf_erri(nf, "Port %s out of range",
+				    val));
+		} else if (strcmp(opt, "testfail") == 0) {
+			sc->test_fail = strtoul(val, NULL, 0);
+		} else if (strcmp(opt, "drift") == 0) {
+			sc->drift = strtol(val, NULL, 0);
+		} else if (strcmp(opt, "done") == 0) {
+			sc->done_delay = strtol(val, NULL, 0) * 1000;
+		} else if (strcmp(opt, "design") == 0) {
+			for (d = nf_sim_designs; d->name != NULL; d++)
+				if (strcmp(d->name, val) == 0)
+					break;
+			if (d->name == NULL)
+				return (nf_erri(nf, "Unknown design '%s'",
+				    val));
+			sc->design = d;
+		} else
+			return (nf_erri(nf, "Unknown option '%s'", opt));
+	}
+	return (0);
+}
+
+/*
+ * Make the card look like the one with a design already loaded.
+ */
+static void
+nf_sim_reset(struct nf_softc *sc)
+{
+	char str[NF2_DEVICE_STR_LEN];
+	uint32_t u32;
+	int i;
+
+	nf_sim_set(sc, CPCI_REG_ID, NF_SIM_CPCI_ID);
+	nf_sim_set(sc, CPCI_REG_PROG_STATUS, PROG_DONE | PROG_INIT);
+	nf_sim_set(sc, DEVICE_MD5_1_REG, DEVICE_MD5_1_VAL);
+	nf_sim_set(sc, DEVICE_MD5_2_REG, DEVICE_MD5_2_VAL);
+	nf_sim_set(sc, DEVICE_MD5_3_REG, DEVICE_MD5_3_VAL);
+	nf_sim_set(sc, DEVICE_MD5_4_REG, DEVICE_MD5_4_VAL);
+	nf_sim_set(sc, DEVICE_ID_REG, sc->design->id);
+	nf_sim_set(sc, DEVICE_REVISION_REG, 1);
+	nf_sim_set(sc, DEVICE_CPCI_ID_REG, NF_SIM_CPCI_ID);
+	for (i = 0; i < ROUTER_RT_SIZE; i++)
+		sc->rt[i][1] = 0xffffffff;	/* Empty: 0.0.0.0/32 */
+	for (i = 0; i < 4; i++)
+		nf_sim_set(sc, MDIO_0_STATUS_REG + i * NF_SIM_MDIO_OFFSET,
+		    NF_SIM_MDIO_STATUS);
+	for (i = 0; i < NF_OQ_QUEUES; i++) {
+		nf_sim_set(sc, NF_OQ_REG(OQ_ADDRESS_LO_REG_0, i),
+		    i * NF_SIM_OQ_WORDS);
+		nf_sim_set(sc, NF_OQ_REG(OQ_ADDRESS_HI_REG_0, i),
+		    (i + 1) * NF_SIM_OQ_WORDS - 1);
+		nf_sim_set(sc, NF_OQ_REG(OQ_CONTROL_REG_0, i),
+		    1 << OQ_ENABLE_SEND_BIT_NUM);
+	}
+
+	/* Device string is kept big endian, as the hardware does */
+	memset(str, 0, sizeof(str));
+	strncpy(str, sc->design->str, sizeof(str) - 1);
+	for (i = 0; i < NF2_DEVICE_STR_LEN; i += 4) {
+		memcpy(&u32, str + i, sizeof(u32));
+		nf_sim_set(sc, DEVICE_STR_REG + i, ntohl(u32));
+	}
+}
+
+/*
+ * Bring output queue ``q'' up to time ``t'' (us), in stretches during
+ * which traffic coming in doesn't change.
+ */
+static void
+nf_sim_oq_run(struct nf_softc *sc, int q, double t0, double t)
+{
+	double cap, in, out, end, dt, occ, over;
+	long phase;
+	uint32_t lo, hi;
+
+	lo = nf_sim_get(sc, NF_OQ_REG(OQ_ADDRESS_LO_REG_0, q));
+	hi = nf_sim_get(sc, NF_OQ_REG(OQ_ADDRESS_HI_REG_0, q));
+	cap = hi > lo ? (double)(hi - lo) * NF_OQ_WORD_BYTES : 0;
+	out = (nf_sim_get(sc, NF_OQ_REG(OQ_CONTROL_REG_0, q)) &
+	    (1 << OQ_ENABLE_SEND_BIT_NUM)) ? NF_SIM_OQ_OUT : 0;
+	while (t0 < t) {
+		phase = (long)t0 % nf_sim_oq_traffic[q].period;
+		if (phase < nf_sim_oq_traffic[q].on) {
+			in = nf_sim_oq_traffic[q].in;
+			end = t0 + nf_sim_oq_traffic[q].on - phase;
+		} else {
+			in = 0;
+			end = t0 + nf_sim_oq_traffic[q].period - phase;
+		}
+		if (end > t)
+			end = t;
+		dt = end - t0;
+		occ = sc->oq_occ[q] + (in - out) * dt;
+		if (occ < 0)
+			occ = 0;
+		over = occ > cap ? occ - cap : 0;
+		sc->oq_occ[q] = occ - over;
+		sc->oq_dropped[q] += over;
+		sc->oq_stored[q] += in * dt - over;
+		t0 = end;
+	}
+}
+
+/*
+ * Bring the output queue model up to now and show it in registers.
+ */
+static void
+nf_sim_oq_update(struct nf_softc *sc)
+{
+	long now;
+	uint32_t words;
+	int q;
+
+	now = nf_sim_now();
+	if (sc->oq_t == 0)
+		sc->oq_t = now;
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		nf_sim_oq_run(sc, q, sc->oq_t / 1000.0, now / 1000.0);
+		words = (uint32_t)(sc->oq_occ[q] / NF_OQ_WORD_BYTES);
+		nf_sim_set(sc, NF_OQ_REG(OQ_NUM_WORDS_IN_Q_REG_0, q), words);
+		nf_sim_set(sc, NF_OQ_REG(OQ_NUM_PKTS_IN_Q_REG_0, q),
+		    (uint32_t)(sc->oq_occ[q] / NF_SIM_OQ_PKT));
+		nf_sim_set(sc, NF_OQ_REG(OQ_NUM_PKTS_DROPPED_REG_0, q),
+		    (uint32_t)(uint64_t)(sc->oq_dropped[q] / NF_SIM_OQ_PKT));
+		nf_sim_set(sc, NF_OQ_REG(OQ_NUM_PKTS_STORED_REG_0, q),
+		    (uint32_t)(uint64_t)(sc->oq_stored[q] / NF_SIM_OQ_PKT));
+		nf_sim_set(sc, NF_OQ_REG(OQ_NUM_PKT_BYTES_STORED_REG_0, q),
+		    (uint32_t)(uint64_t)sc->oq_stored[q]);
+	}
+	sc->oq_t = now;
+}
+
+/*
+ * Start (``on'') or stop self-test engine ``t''.
+ */
+static void
+nf_sim_test_run(struct nf_softc *sc, int t, int on)
+{
+
+	if (on && (sc->test_t0[t] == 0 || sc->test_t1[t] != 0)) {
+		sc->test_t0[t] = nf_sim_now();
+		sc->test_t1[t] = 0;
+	} else if (!on && sc->test_t0[t] != 0 && sc->test_t1[t] == 0)
+		sc->test_t1[t] = nf_sim_now();
+}
+
+/*
+ * Show self-test counters in registers. Engines do NF_SIM_TEST_RATE
+ * runs a second; failing ones have every 4th memory run bad with 2 bad
+ * words, lose 1 in 100000 serial frames and 1 in 10000 PHY packets.
+ */
+static void
+nf_sim_test_update(struct nf_softc *sc)
+{
+	static const double rate[NF_TEST_NUM] = { 20, 4, 1e6, 1e6,
+	    81274, 81274, 81274, 81274 };
+	static const uint32_t mem[2][5] = {
+		{ SRAM_TEST_ITER_NUM_REG, SRAM_TEST_GOOD_RUNS_REG,
+		  SRAM_TEST_BAD_RUNS_REG, SRAM_TEST_ERR_CNT_REG,
+		  SRAM_TEST_LOG_ADDR_REG },
+		{ DRAM_TEST_ITER_NUM_REG, DRAM_TEST_GOOD_RUNS_REG,
+		  DRAM_TEST_BAD_RUNS_REG, DRAM_TEST_ERR_CNT_REG,
+		  DRAM_TEST_LOG_ADDR_REG },
+	};
+	uint64_t runs, bad, exp, got;
+	uint32_t reg, off;
+	long now;
+	int t, i, fail;
+
+	now = nf_sim_now();
+	for (t = 0; t < NF_TEST_NUM; t++) {
+		if (sc->test_t0[t] == 0)
+			continue;
+		runs = (uint64_t)(((sc->test_t1[t] != 0 ? sc->test_t1[t] :
+		    now) - sc->test_t0[t]) / 1e9 * rate[t]);
+		fail = (sc->test_fail >> t) & 1;
+		if (t == NF_TEST_SRAM || t == NF_TEST_DRAM) {
+			bad = fail ? runs / 4 : 0;
+			nf_sim_set(sc, mem[t][0], runs);
+			nf_sim_set(sc, mem[t][1], runs - bad);
+			nf_sim_set(sc, mem[t][2], bad);
+			nf_sim_set(sc, mem[t][3], bad * 2);
+			for (i = 0; i < NF_TEST_LOG_MAX && i < bad * 2; i++) {
+				reg = mem[t][4] + i * SRAM_TEST_LOG_OFFSET;
+				exp = 0x0123456789abcdefULL * (i + 1);
+				got = exp ^ (1ULL << (i * 7 % 64));
+				nf_sim_set(sc, reg, (i * 0x9e37) & 0x7ffff);
+				nf_sim_set(sc, reg + 4, exp >> 32);
+				nf_sim_set(sc, reg + 8, (uint32_t)exp);
+				nf_sim_set(sc, reg + 12, got >> 32);
+				nf_sim_set(sc, reg + 16, (uint32_t)got);
+			}
+		} else if (t < NF_TEST_PHY0) {
+			off = (t - NF_TEST_SERIAL0) *
+			    (SERIAL_TEST_CONTROL_1_REG -
+			    SERIAL_TEST_CONTROL_0_REG);
+			bad = fail ? runs / 100000 : 0;
+			reg = SERIAL_TEST_NUM_FRAMES_SENT_0_LO_REG + off;
+			nf_sim_set(sc, reg, (uint32_t)runs);
+			reg = SERIAL_TEST_NUM_FRAMES_SENT_0_HI_REG + off;
+			nf_sim_set(sc, reg, runs >> 32);
+			reg = SERIAL_TEST_NUM_FRAMES_RCVD_0_LO_REG + off;
+			nf_sim_set(sc, reg, (uint32_t)(runs - bad));
+			reg = SERIAL_TEST_NUM_FRAMES_RCVD_0_HI_REG + off;
+			nf_sim_set(sc, reg, (runs - bad) >> 32);
+		} else {
+			off = (t - NF_TEST_PHY0) * PHY_TEST_PORT_OFFSET;
+			bad = fail ? runs / 10000 : 0;
+			reg = PHY_TEST_PHY_0_TX_PKT_CNT_REG + off;
+			nf_sim_set(sc, reg, runs);
+			reg = PHY_TEST_PHY_0_RX_GOOD_PKT_CNT_REG + off;
+			nf_sim_set(sc, reg, runs - bad);
+			reg = PHY_TEST_PHY_0_RX_ERR_PKT_CNT_REG + off;
+			nf_sim_set(sc, reg, bad);
+			if (bad > 0) {
+				reg = PHY_TEST_PHY_0_RX_LOG_STATUS_REG + off;
+				nf_sim_set(sc, reg, 1);
+				nf_sim_set(sc, reg + 4, 0xa5a5a5a5);
+				nf_sim_set(sc, reg + 8, 0xa5a5a5a4);
+			}
+		}
+	}
+}
+
+/*
+ * Bring the rate limiter and delay model up to now and show it in the
+ * byte counters of the port's output queue and MAC. Bytes between the
+ * two are the ones the delay module holds: rate times delay.
+ */
+static void
+nf_sim_shape_update(struct nf_softc *sc)
+{
+	double rate, delay, removed;
+	uint32_t shift;
+	long now;
+	int p;
+
+	p = sc->shape_port;
+	now = nf_sim_now();
+	if (sc->shape_t == 0)
+		sc->shape_t = now;
+	rate = NF_SIM_OQ_OUT;
+	if (nf_sim_get(sc, RATE_LIMIT_ENABLE_REG) & 1) {
+		shift = nf_sim_get(sc, RATE_LIMIT_SHIFT_REG) & 0x1f;
+		rate /= 1 + NF_SIM_SHAPE_STEP * ((double)(1U << shift) - 1);
+	}
+	if (rate > NF_SIM_SHAPE_IN)
+		rate = NF_SIM_SHAPE_IN;
+	delay = NF_SIM_SHAPE_PIPE_NS;
+	if (nf_sim_get(sc, DELAY_ENABLE_REG) & 1)
+		delay += nf_sim_get(sc, DELAY_LENGTH_REG) *
+		    NF_SIM_SHAPE_UNIT_NS;
+	sc->shape_sent += rate * (now - sc->shape_t) / 1000.0;
+	removed = sc->shape_sent + rate * delay / 1000.0;
+	nf_sim_set(sc, NF_SIM_MAC_REG(TX_QUEUE_0_NUM_BYTES_PUSHED_REG, p),
+	    (uint32_t)(uint64_t)sc->shape_sent);
+	nf_sim_set(sc, NF_SIM_MAC_REG(TX_QUEUE_0_NUM_PKTS_SENT_REG, p),
+	    (uint32_t)(uint64_t)(sc->shape_sent / NF_SIM_OQ_PKT));
+	nf_sim_set(sc, NF_OQ_REG(OQ_NUM_PKT_BYTES_REMOVED_REG_0, p * 2),
+	    (uint32_t)(uint64_t)removed + NF_SIM_SHAPE_SKEW);
+	sc->shape_t = now;
+}
+
+/* Registers of self-test engines */
+#define NF_SIM_IS_TEST(reg)						\
+	(((reg) >= SERIAL_TEST_CONTROL_0_REG &&				\
+	(reg) <= SERIAL_TEST_STAT_REG) ||				\
+	((reg) >= SRAM_TEST_ERR_CNT_REG && (reg) < 0xa00000))
+
+/* Registers of the output queues, which the model keeps up to date */
+#define NF_SIM_IS_OQ(reg)	((reg) >= OQ_NUM_WORDS_LEFT_REG_0 &&	\
+	(reg) < NF_OQ_REG(OQ_NUM_WORDS_LEFT_REG_0, NF_OQ_QUEUES))
+
+/*
+ * Reading registers with side effects.
+ */
+static uint32_t
+nf_sim_rd(struct nf_softc *sc, uint32_t reg)
+{
+	uint32_t *r;
+
+	if (NF_SIM_IS_TEST(reg))
+		nf_sim_test_update(sc);
+	if (sc->shape_port >= 0 && (reg == NF_SIM_MAC_REG(
+	    TX_QUEUE_0_NUM_BYTES_PUSHED_REG, sc->shape_port) ||
+	    reg == NF_SIM_MAC_REG(TX_QUEUE_0_NUM_PKTS_SENT_REG,
+	    sc->shape_port) || reg == NF_OQ_REG(
+	    OQ_NUM_PKT_BYTES_REMOVED_REG_0, sc->shape_port * 2)))
+		nf_sim_shape_update(sc);
+	if (sc->oq_model && NF_SIM_IS_OQ(reg) &&
+	    (reg & 0xff) != (OQ_ADDRESS_LO_REG_0 & 0xff) &&
+	    (reg & 0xff) != (OQ_ADDRESS_HI_REG_0 & 0xff) &&
+	    (reg & 0xff) != (OQ_CONTROL_REG_0 & 0xff))
+		nf_sim_oq_update(sc);
+	if (sc->flap > 0 && reg == MDIO_3_STATUS_REG)
+		nf_sim_set(sc, reg, ((nf_sim_now() - sc->stamp_t0) / sc->flap) &
+		    1 ? NF_SIM_MDIO_STATUS & ~NF_SIM_MDIO_LINK :
+		    NF_SIM_MDIO_STATUS);
+	r = nf_sim_reg(sc, reg, 0);
+	if (reg == CPCI_REG_PROG_STATUS && r != NULL &&
+	    sc->prog_words * 4 >= VIRTEX_BIN_SIZE_V2_1 &&
+	    nf_sim_now() - sc->prog_t1 >= sc->done_delay)
+		*r |= PROG_DONE;
+	return ((r != NULL) ? *r : 0);
+}
+
+/*
+ * Switch's MAC table lives at the same offsets as router's ARP table.
+ * Returns 1 if ``reg'' was one of its address registers.
+ */
+static int
+nf_sim_switch_wr(struct nf_softc *sc, uint32_t reg, uint32_t value)
+{
+
+	switch (reg) {
+	case SWITCH_OP_LUT_MAC_LUT_WR_ADDR_REG:
+		if (value < NF_SWITCH_LUT_SIZE) {
+			sc->lut[value][0] = nf_sim_rd(sc,
+			    SWITCH_OP_LUT_PORTS_MAC_HI_REG);
+			sc->lut[value][1] = nf_sim_rd(sc,
+			    SWITCH_OP_LUT_MAC_LO_REG);
+		}
+		return (1);
+	case SWITCH_OP_LUT_MAC_LUT_RD_ADDR_REG:
+		if (value < NF_SWITCH_LUT_SIZE) {
+			nf_sim_set(sc, SWITCH_OP_LUT_PORTS_MAC_HI_REG,
+			    sc->lut[value][0]);
+			nf_sim_set(sc, SWITCH_OP_LUT_MAC_LO_REG,
+			    sc->lut[value][1]);
+		}
+		return (1);
+	}
+	return (0);
+}
+
+/*
+ * Writing registers with side effects. Virtex programming interface
+ * expects VIRTEX_BIN_SIZE_V2_1 bytes after a reset. Lookup tables are
+ * written and read through the address registers.
+ */
+static void
+nf_sim_wr(struct nf_softc *sc, uint32_t reg, uint32_t value)
+{
+	uint64_t ticks;
+	long ns;
+	int i;
+
+	if (sc->design->is_switch && nf_sim_switch_wr(sc, reg, value))
+		return;
+	/* Queues run as they were set up until they change */
+	if (sc->oq_model && NF_SIM_IS_OQ(reg)) {
+		nf_sim_oq_update(sc);
+		if ((reg & 0xff) == (OQ_CONTROL_REG_0 & 0xff) &&
+		    (value & (1 << OQ_INITIALIZE_OQ_BIT_NUM)))
+			sc->oq_occ[(reg - OQ_NUM_WORDS_LEFT_REG_0) >> 8] = 0;
+	}
+	if (sc->shape_port >= 0 && (reg == RATE_LIMIT_ENABLE_REG ||
+	    reg == RATE_LIMIT_SHIFT_REG || reg == DELAY_ENABLE_REG ||
+	    reg == DELAY_LENGTH_REG))
+		nf_sim_shape_update(sc);
+	switch (reg) {
+	case SRAM_TEST_EN_REG:
+		nf_sim_test_run(sc, NF_TEST_SRAM, value & 1);
+		nf_sim_set(sc, reg, value);
+		break;
+	case DRAM_TEST_EN_REG:
+		nf_sim_test_run(sc, NF_TEST_DRAM, value & 1);
+		nf_sim_set(sc, reg, value);
+		break;
+	case SERIAL_TEST_CONTROL_0_REG:
+	case SERIAL_TEST_CONTROL_1_REG:
+		nf_sim_test_run(sc, NF_TEST_SERIAL0 +
+		    (reg != SERIAL_TEST_CONTROL_0_REG), value == 1);
+		nf_sim_set(sc, reg, value);
+		break;
+	case PHY_TEST_CTRL_REG:
+		for (i = 0; i < 4; i++)
+			nf_sim_test_run(sc, NF_TEST_PHY0 + i, (value >> i) & 1);
+		nf_sim_set(sc, reg, value);
+		break;
+	case CPCI_REG_PROG_CTRL:
+		if (value & PROG_CTRL_RESET) {
+			sc->prog_words = 0;
+			nf_sim_set(sc, CPCI_REG_PROG_STATUS,
+			    PROG_INIT | PROG_FIFO_EMPTY);
+		}
+		break;
+	case CPCI_REG_PROG_DATA:
+		sc->prog_words++;
+		if (sc->prog_words * 4 == VIRTEX_BIN_SIZE_V2_1)
+			sc->prog_t1 = nf_sim_now();
+		break;
+	case STAMP_COUNTER_READ_ENABLE:
+		ns = nf_sim_now() - sc->stamp_t0;
+		ticks = (ns + ns / 1000000000 * sc->drift +
+		    ns % 1000000000 * sc->drift / 1000000000) /
+		    NF_HWTIME_TICK_NS;
+		nf_sim_set(sc, STAMP_COUNTER_BIT_95_64, 0);
+		nf_sim_set(sc, STAMP_COUNTER_BIT_63_32, ticks >> 32);
+		nf_sim_set(sc, STAMP_COUNTER_BIT_31_0, (uint32_t)ticks);
+		break;
+	case ROUTER_OP_LUT_ARP_LUT_WR_ADDR_REG:
+		if (value >= ROUTER_ARP_SIZE)
+			break;
+		for (i = 0; i < 3; i++)
+			sc->arp[value][i] = nf_sim_rd(sc,
+			    ROUTER_OP_LUT_ARP_MAC_HI_REG + i * 4);
+		break;
+	case ROUTER_OP_LUT_ARP_LUT_RD_ADDR_REG:
+		if (value >= ROUTER_ARP_SIZE)
+			break;
+		for (i = 0; i < 3; i++)
+			nf_sim_set(sc, ROUTER_OP_LUT_ARP_MAC_HI_REG + i * 4,
+			    sc->arp[value][i]);
+		break;
+	case ROUTER_OP_LUT_DST_IP_FILTER_WR_ADDR_REG:
+		if (value < ROUTER_DST_IP_FILTER_TABLE_DEPTH)
+			sc->filter[value] = nf_sim_rd(sc,
+			    ROUTER_OP_LUT_DST_IP_FILTER_IP_REG);
+		break;
+	case ROUTER_OP_LUT_DST_IP_FILTER_RD_ADDR_REG:
+		if (value < ROUTER_DST_IP_FILTER_TABLE_DEPTH)
+			nf_sim_set(sc, ROUTER_OP_LUT_DST_IP_FILTER_IP_REG,
+			    sc->filter[value]);
+		break;
+	case ROUTER_OP_LUT_RT_LUT_WR_ADDR_REG:
+		if (value >= ROUTER_RT_SIZE)
+			break;
+		for (i = 0; i < 4; i++)
+			sc->rt[value][i] = nf_sim_rd(sc,
+			    ROUTER_OP_LUT_RT_IP_REG + i * 4);
+		break;
+	case ROUTER_OP_LUT_RT_LUT_RD_ADDR_REG:
+		if (value >= ROUTER_RT_SIZE)
+			break;
+		for (i = 0; i < 4; i++)
+			nf_sim_set(sc, ROUTER_OP_LUT_RT_IP_REG + i * 4,
+			    sc->rt[value][i]);
+		break;
+	default:
+		nf_sim_set(sc, reg, value);
+	}
+}
+
+void *
+nf2_sim_open(struct netfpga *nf)
+{
+	struct nf_softc *sc;
+
+	sc = calloc(1, sizeof(*sc));
+	ASSERT(sc != NULL);
+	sc->design = &nf_sim_designs[0];
+	sc->stamp_t0 = nf_sim_now();
+	sc->shape_port = -1;
+	if (nf_sim_opts(nf, sc, nf->nf_iface) != 0) {
+		free(sc);
+		return (NULL);
+	}
+	nf_sim_reset(sc);
+	return (sc);
+}
+
+int
+nf2_sim_close(struct netfpga *nf, void *ctx)
+{
+	struct nf_softc *sc;
+	int i;
+
+	(void)nf;
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	for (i = 0; i < NF_SIM_PAGE_NUM; i++)
+		free(sc->pages[i]);
+	free(sc);
+	return (0);
+}
+
+int
+nf2_sim_read(struct netfpga *nf, void *ctx, uint32_t reg, void *buf, size_t buf_len)
+{
+	struct nf_softc *sc;
+	uint32_t *u32;
+	unsigned int i;
+
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	if ((size_t)reg + buf_len > NF_SIM_MEM_SIZE)
+		return (nf_erri(nf, "Register %#x out of range", reg));
+	u32 = buf;
+	for (i = 0; i < buf_len / 4; i++) {
+		nf_sim_delay(sc->latency);
+		u32[i] = nf_sim_rd(sc, reg + i * 4);
+	}
+	return (buf_len);
+}
+
+int
+nf2_sim_write(struct netfpga *nf, void *ctx, uint32_t reg, void *buf, size_t buf_len)
+{
+	struct nf_softc *sc;
+	uint32_t *u32;
+	unsigned int i;
+
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	if ((size_t)reg + buf_len > NF_SIM_MEM_SIZE)
+		return (nf_erri(nf, "Register %#x out of range", reg));
+	u32 = buf;
+	for (i = 0; i < buf_len / 4; i++) {
+		nf_sim_delay(sc->latency);
+		nf_sim_wr(sc, reg + i * 4, u32[i]);
+	}
+	return (buf_len);
+}
+
+/*
+ * Bulk copy, the way a driver's copy loop would do it: one access
+ * worth of latency for the whole block.
+ */
+int
+nf2_sim_mem(struct netfpga *nf, void *ctx, int write, uint32_t addr,
+    void *buf, size_t len)
+{
+	struct nf_softc *sc;
+	uint32_t *u32;
+	unsigned int i;
+
+	ASSERT(ctx != NULL);
+	ASSERT(buf != NULL);
+	sc = ctx;
+	if ((size_t)addr + len > NF_SIM_MEM_SIZE)
+		return (nf_erri(nf, "Memory at %#x out of range", addr));
+	nf_sim_delay(sc->latency);
+	u32 = buf;
+	for (i = 0; i < len / 4; i++)
+		if (write)
+			nf_sim_wr(sc, addr + i * 4, u32[i]);
+		else
+			u32[i] = nf_sim_rd(sc, addr + i * 4);
+	return (len);
+}
+
+/*
+ * Batch of register operations, one access worth of latency for all of
+ * them, like the driver's SIOCREGRWV.
+ */
+int
+nf2_sim_regv(struct netfpga *nf, void *ctx, struct nf_regop *ops,
+    int ops_num)
+{
+	struct nf_softc *sc;
+	int i;
+
+	ASSERT(ctx != NULL);
+	sc = ctx;
+	for (i = 0; i < ops_num; i++)
+		if ((size_t)ops[i].nro_reg + 4 > NF_SIM_MEM_SIZE)
+			return (nf_erri(nf, "Register %#x out of range",
+			    ops[i].nro_reg));
+	nf_sim_delay(sc->latency);
+	for (i = 0; i < ops_num; i++)
+		if (ops[i].nro_op == NF_REGOP_READ)
+			ops[i].nro_value = nf_sim_rd(sc, ops[i].nro_reg);
+		else
+			nf_sim_wr(sc, ops[i].nro_reg, ops[i].nro_value);
+	return (ops_num);
+}
+
+/*
+ * Simulated NetFPGA handler.
+ */
+struct nf_module nf2_sim = {
+	.nf_version =	NETFPGA_MODULE_VERSION,
+	.nf_flags =	0,
+	.nf_name =	"sim",
+	.nf_open =	nf2_sim_open,
+	.nf_close = 	nf2_sim_close,
+	.nf_read =	nf2_sim_read,
+	.nf_write =	nf2_sim_write,
+	.nf_regv =	nf2_sim_regv,
+	.nf_mem =	nf2_sim_mem,
+};
@@ -0,0 +1,549 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Register space snapshots.
+ *
+ * A snapshot is a set of registers, from the catalog nf_reg_byname()
+ * uses and/or address ranges, kept sorted by offset and read in one
+ * nf_regv() pass, so it takes as long as the module needs for that many
+ * reads and not a system call each. Sorted snapshots are compared in
+ * one merge pass, even if they don't cover the same registers.
+ *
+ * Files hold, all in network byte order, a header (struct
+ * nf_snap_hdr), the (offset, value) pairs and then a NUL terminated
+ * name per register, empty for those added by offset: 8 bytes per
+ * register plus names, about 20 KB for the whole catalog.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <arpa/inet.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+#define NF_SNAP_MAGIC		0x6e66736e	/* "nfsn" */
+#define NF_SNAP_VERSION		1
+
+struct nf_snap_hdr {
+	uint32_t	nsh_magic;
+	uint32_t	nsh_version;
+	uint32_t	nsh_num;
+	uint32_t	nsh_names_len;
+	uint32_t	nsh_time_hi;
+	uint32_t	nsh_time_lo;
+	uint32_t	nsh_read_ns;
+	char		nsh_design[NF_SNAP_DESIGN_LEN];
+	char		nsh_module[16];
+};
+
+/*
+ * Catalog registers which can't be read without side effects: these
+ * pop words of the packet being sent to the host.
+ */
+static const char *nf_snap_skip[] = {
+	"_RD_DATA_WORD_REG",
+	"_RD_CTRL_WORD_REG",
+	NULL
+};
+
+/* Name parts of counters, and of gauges which would look like them */
+static const char *nf_snap_counters[] = {
+	"NUM_", "_CNT_", "COUNTER", "TICKS", "_RUNS_", NULL
+};
+static const char *nf_snap_gauges[] = {
+	"_IN_Q", "WORDS_LEFT", "WORDS_AVAIL", "MAX_", NULL
+};
+
+static int
+nf_snap_match(const char *name, const char **parts)
+{
+
+	for (; *parts != NULL; parts++)
+		if (strstr(name, *parts) != NULL)
+			return (1);
+	return (0);
+}
+
+/*
+ * Tell if register ``name'' counts something, so that differences
+ * are deltas and rates and not just new values.
+ */
+int
+nf_snap_counter(const char *name)
+{
+
+	if (name == NULL)
+		return (0);
+	return (nf_snap_match(name, nf_snap_counters) &&
+	    !nf_snap_match(name, nf_snap_gauges));
+}
+
+static uint64_t
+nf_snap_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+struct nf_snap *
+nf_snap_new(struct netfpga *nf)
+{
+	struct nf_snap *s;
+
+	nf_assert(nf);
+	s = calloc(1, sizeof(*s));
+	ASSERT(s != NULL);
+	s->ns_nf = nf;
+	s->ns_sorted = 1;
+	return (s);
+}
+
+void
+nf_snap_free(struct nf_snap *s)
+{
+	int i;
+
+	if (s == NULL)
+		return;
+	for (i = 0; i < s->ns_num; i++)
+		free(s->ns_regs[i].nsr_name);
+	free(s->ns_regs);
+	free(s->ns_ops);
+	free(s);
+}
+
+/*
+ * Add register ``reg'', named ``name'' unless it's NULL.
+ */
+void
+nf_snap_add(struct nf_snap *s, const char *name, uint32_t reg)
+{
+	struct nf_snap_reg *r;
+
+	ASSERT(s != NULL);
+	if (s->ns_num == s->ns_size) {
+		s->ns_size = (s->ns_size == 0) ? 256 : s->ns_size * 2;
+		s->ns_regs = realloc(s->ns_regs,
+		    s->ns_size * sizeof(*s->ns_regs));
+		ASSERT(s->ns_regs != NULL);
+	}
+	r = &s->ns_regs[s->ns_num++];
+	r->nsr_reg = reg;
+	r->nsr_value = 0;
+	r->nsr_name = NULL;
+	if (name != NULL) {
+		r->nsr_name = strdup(name);
+		ASSERT(r->nsr_name != NULL);
+	}
+	s->ns_sorted = 0;
+}
+
+/*
+ * Add every register from ``lo'' to ``hi'', both included, but those
+ * the catalog names in nf_snap_skip.
+ */
+int
+nf_snap_add_range(struct nf_snap *s, uint32_t lo, uint32_t hi)
+{
+	struct nf_reg *nfr;
+	uint32_t reg;
+	int first, i, j;
+
+	ASSERT(s != NULL);
+	lo &= ~3U;
+	if (hi < lo || (hi - lo) / 4 >= NF_SNAP_RANGE_MAX)
+		return (nf_erri(s->ns_nf, "Bad range %#x-%#x, at most %d "
+		    "registers", lo, hi, NF_SNAP_RANGE_MAX));
+	first = s->ns_num;
+	for (reg = lo; reg <= hi && reg >= lo; reg += 4)
+		nf_snap_add(s, NULL, reg);
+
+	/* Mark those with an unaligned offset, which no register has */
+	(void)nf_reg_byname(s->ns_nf, "", NULL);
+	TAILQ_FOREACH(nfr, s->ns_nf->__nf_regs, next) {
+		reg = nfr->nfr_offset;
+		if (reg % 4 == 0 && reg >= lo && reg <= hi &&
+		    nf_snap_match(nfr->nfr_name, nf_snap_skip))
+			s->ns_regs[first + (reg - lo) / 4].nsr_reg = 1;
+	}
+	for (i = j = first; i < s->ns_num; i++)
+		if (s->ns_regs[i].nsr_reg != 1)
+			s->ns_regs[j++] = s->ns_regs[i];
+	s->ns_num = j;
+	return (0);
+}
+
+/*
+ * Add registers of the catalog. The driver's list has every #define of
+ * reg_defines.h, so only names of registers are taken.
+ */
+int
+nf_snap_add_catalog(struct nf_snap *s)
+{
+	struct netfpga *nf;
+	struct nf_reg *nfr;
+	const char *p;
+	int num;
+
+	ASSERT(s != NULL);
+	nf = s->ns_nf;
+	(void)nf_reg_byname(nf, "", NULL);
+	num = 0;
+	TAILQ_FOREACH(nfr, nf->__nf_regs, next) {
+		p = strstr(nfr->nfr_name, "_REG");
+		if (p == NULL || (p[4] != '\0' && p[4] != '_'))
+			continue;
+		if (p[4] == '_' && strspn(p + 5, "0123456789") !=
+		    strlen(p + 5))
+			continue;
+		if (nfr->nfr_offset % 4 != 0 ||
+		    nf_snap_match(nfr->nfr_name, nf_snap_skip))
+			continue;
+		nf_snap_add(s, nfr->nfr_name, nfr->nfr_offset);
+		num++;
+	}
+	if (num == 0)
+		return (nf_erri(nf, "Register catalog is empty"));
+	return (0);
+}
+
+static int
+nf_snap_reg_cmp(const void *a, const void *b)
+{
+	const struct nf_snap_reg *ra, *rb;
+
+	ra = a;
+	rb = b;
+	if (ra->nsr_reg != rb->nsr_reg)
+		return (ra->nsr_reg < rb->nsr_reg ? -1 : 1);
+	/* Named first, then alphabetically, to keep the same one */
+	if (ra->nsr_name == NULL || rb->nsr_name == NULL)
+		return ((ra->nsr_name == NULL) - (rb->nsr_name == NULL));
+	return (strcmp(ra->nsr_name, rb->nsr_name));
+}
+
+/*
+ * Sort registers by offset and drop duplicates: aliases in the catalog,
+ * ranges over registers also added by name.
+ */
+static void
+nf_snap_sort(struct nf_snap *s)
+{
+	struct nf_snap_reg *r;
+	int i, n;
+
+	qsort(s->ns_regs, s->ns_num, sizeof(*s->ns_regs), nf_snap_reg_cmp);
+	for (i = n = 0; i < s->ns_num; i++) {
+		r = &s->ns_regs[i];
+		if (n > 0 && r->nsr_reg == s->ns_regs[n - 1].nsr_reg) {
+			free(r->nsr_name);
+			continue;
+		}
+		s->ns_regs[n++] = *r;
+	}
+	s->ns_num = n;
+	free(s->ns_ops);
+	s->ns_ops = calloc(n > 0 ? n : 1, sizeof(*s->ns_ops));
+	ASSERT(s->ns_ops != NULL);
+	for (i = 0; i < n; i++) {
+		s->ns_ops[i].nro_op = NF_REGOP_READ;
+		s->ns_ops[i].nro_reg = s->ns_regs[i].nsr_reg;
+	}
+	s->ns_sorted = 1;
+}
+
+/*
+ * Read all registers of ``s'', and the design's name the first time.
+ * Returns the number of registers read or -1 on error.
+ */
+int
+nf_snap_read(struct nf_snap *s)
+{
+	struct netfpga *nf;
+	char design[NF2_DEVICE_STR_LEN];
+	uint64_t t0;
+	int i;
+
+	ASSERT(s != NULL);
+	nf = s->ns_nf;
+	if (!s->ns_sorted || s->ns_ops == NULL)
+		nf_snap_sort(s);
+	if (s->ns_module[0] == '\0') {
+		if (nf_image_name(nf, design, sizeof(design)) != 0)
+			return (-1);
+		memcpy(s->ns_design, design, sizeof(s->ns_design));
+		s->ns_design[sizeof(s->ns_design) - 1] = '\0';
+		snprintf(s->ns_module, sizeof(s->ns_module), "%s",
+		    nf->__nf_mod->nf_name);
+	}
+	t0 = nf_snap_ns(CLOCK_MONOTONIC);
+	if (nf_regv(nf, s->ns_ops, s->ns_num) != s->ns_num)
+		return (-1);
+	s->ns_read_ns = nf_snap_ns(CLOCK_MONOTONIC) - t0;
+	s->ns_time = nf_snap_ns(CLOCK_REALTIME);
+	for (i = 0; i < s->ns_num; i++)
+		s->ns_regs[i].nsr_value = s->ns_ops[i].nro_value;
+	return (s->ns_num);
+}
+
+/*
+ * Save ``s'' to file ``fname'', in one write.
+ */
+int
+nf_snap_save(struct nf_snap *s, const char *fname)
+{
+	struct nf_snap_hdr *h;
+	struct nf_snap_reg *r;
+	uint32_t *w;
+	size_t names_len, len, n;
+	uint8_t *buf;
+	char *p;
+	FILE *fp;
+	int i, error;
+
+	ASSERT(s != NULL);
+	ASSERT(fname != NULL);
+	if (!s->ns_sorted)
+		nf_snap_sort(s);
+	names_len = 0;
+	for (i = 0; i < s->ns_num; i++)
+		if (s->ns_regs[i].nsr_name != NULL)
+			names_len += strlen(s->ns_regs[i].nsr_name);
+	names_len += s->ns_num;
+	len = sizeof(*h) + s->ns_num * 8 + names_len;
+	buf = calloc(1, len);
+	ASSERT(buf != NULL);
+
+	h = (struct nf_snap_hdr *)buf;
+	h->nsh_magic = htonl(NF_SNAP_MAGIC);
+	h->nsh_version = htonl(NF_SNAP_VERSION);
+	h->nsh_num = htonl(s->ns_num);
+	h->nsh_names_len = htonl(names_len);
+	h->nsh_time_hi = htonl(s->ns_time >> 32);
+	h->nsh_time_lo = htonl(s->ns_time & 0xffffffff);
+	h->nsh_read_ns = htonl(s->ns_read_ns);
+	memcpy(h->nsh_design, s->ns_design, sizeof(h->nsh_design));
+	memcpy(h->nsh_module, s->ns_module, sizeof(h->nsh_module));
+	w = (uint32_t *)(h + 1);
+	p = (char *)(w + s->ns_num * 2);
+	for (i = 0; i < s->ns_num; i++) {
+		r = &s->ns_regs[i];
+		*w++ = htonl(r->nsr_reg);
+		*w++ = htonl(r->nsr_value);
+		if (r->nsr_name != NULL) {
+			n = strlen(r->nsr_name);
+			memcpy(p, r->nsr_name, n);
+			p += n;
+		}
+		*p++ = '\0';
+	}
+
+	error = 0;
+	fp = fopen(fname, "w");
+	if (fp == NULL)
+		error = nf_erri(s->ns_nf, "Couldn't create '%s': %s", fname,
+		    strerror(errno));
+	else {
+		if (fwrite(buf, 1, len, fp) != len)
+			error = nf_erri(s->ns_nf, "Couldn't write '%s': %s",
+			    fname, strerror(errno));
+		if (fclose(fp) != 0 && error == 0)
+			error = nf_erri(s->ns_nf, "Couldn't write '%s': %s",
+			    fname, strerror(errno));
+	}
+	free(buf);
+	return (error);
+}
+
+/*
+ * Load snapshot from file ``fname''. Returns NULL on error.
+ */
+struct nf_snap *
+nf_snap_load(struct netfpga *nf, const char *fname)
+{
+	struct nf_snap_hdr h;
+	struct nf_snap *s;
+	struct stat st;
+	uint32_t *w, reg, num, names_len;
+	uint8_t *buf;
+	char *p, *end;
+	FILE *fp;
+	size_t len;
+	int i;
+
+	nf_assert(nf);
+	ASSERT(fname != NULL);
+	fp = fopen(fname, "r");
+	if (fp == NULL) {
+		nf_erri(nf, "Couldn't open '%s': %s", fname, strerror(errno));
+		return (NULL);
+	}
+	buf = NULL;
+	s = NULL;
+	if (fstat(fileno(fp), &st) != 0 || st.st_size < (off_t)sizeof(h)) {
+		nf_erri(nf, "'%s' isn't a register snapshot", fname);
+		goto out;
+	}
+	len = st.st_size;
+	buf = malloc(len);
+	ASSERT(buf != NULL);
+	if (fread(buf, 1, len, fp) != len) {
+		nf_erri(nf, "Couldn't read '%s': %s", fname, strerror(errno));
+		goto out;
+	}
+	memcpy(&h, buf, sizeof(h));
+	num = ntohl(h.nsh_num);
+	names_len = ntohl(h.nsh_names_len);
+	if (ntohl(h.nsh_magic) != NF_SNAP_MAGIC ||
+	    ntohl(h.nsh_version) != NF_SNAP_VERSION ||
+	    num > (len - sizeof(h)) / 8 ||
+	    len != sizeof(h) + (size_t)num * 8 + names_len) {
+		nf_erri(nf, "'%s' isn't a register snapshot", fname);
+		goto out;
+	}
+
+	s = nf_snap_new(nf);
+	s->ns_time = (uint64_t)ntohl(h.nsh_time_hi) << 32 |
+	    ntohl(h.nsh_time_lo);
+	s->ns_read_ns = ntohl(h.nsh_read_ns);
+	memcpy(s->ns_design, h.nsh_design, sizeof(s->ns_design));
+	s->ns_design[sizeof(s->ns_design) - 1] = '\0';
+	memcpy(s->ns_module, h.nsh_module, sizeof(s->ns_module));
+	s->ns_module[sizeof(s->ns_module) - 1] = '\0';
+	w = (uint32_t *)(buf + sizeof(h));
+	p = (char *)(w + num * 2);
+	end = p + names_len;
+	for (i = 0; i < (int)num; i++, w += 2) {
+		reg = ntohl(w[0]);
+		if (memchr(p, '\0', end - p) == NULL ||
+		    (i > 0 && reg <= s->ns_regs[i - 1].nsr_reg)) {
+			nf_erri(nf, "'%s' is corrupt at register %d", fname,
+			    i);
+			nf_snap_free(s);
+			s = NULL;
+			goto out;
+		}
+		nf_snap_add(s, (*p != '\0') ? p : NULL, reg);
+		s->ns_regs[i].nsr_value = ntohl(w[1]);
+		p += strlen(p) + 1;
+	}
+	/* For the read ops; they're sorted already */
+	nf_snap_sort(s);
+out:
+	free(buf);
+	fclose(fp);
+	return (s);
+}
+
+static void
+nf_snap_diff_add(struct nf_snap_diff *d, const struct nf_snap_reg *o,
+    const struct nf_snap_reg *n, double secs)
+{
+	const struct nf_snap_reg *r;
+
+	r = (n != NULL) ? n : o;
+	memset(d, 0, sizeof(*d));
+	d->nsd_reg = r->nsr_reg;
+	d->nsd_name = r->nsr_name;
+	if (d->nsd_name == NULL && o != NULL)
+		d->nsd_name = o->nsr_name;
+	if (o == NULL)
+		d->nsd_flags |= NF_SNAP_ONLY_NEW;
+	else
+		d->nsd_old = o->nsr_value;
+	if (n == NULL)
+		d->nsd_flags |= NF_SNAP_ONLY_OLD;
+	else
+		d->nsd_new = n->nsr_value;
+	if (o != NULL && n != NULL && nf_snap_counter(d->nsd_name)) {
+		d->nsd_flags |= NF_SNAP_COUNTER;
+		d->nsd_delta = d->nsd_new - d->nsd_old;
+		if (d->nsd_new < d->nsd_old)
+			d->nsd_flags |= NF_SNAP_WRAPPED;
+		if (secs > 0)
+			d->nsd_rate = d->nsd_delta / secs;
+	}
+}
+
+/*
+ * Compare two snapshots and store registers which changed, or are in
+ * just one of them, in ``diffs''. Returns the number of differences,
+ * which may be more than ``diffs_num'' -- only that many are stored.
+ * Differences point to names of the snapshots.
+ */
+int
+nf_snap_diff(const struct nf_snap *old, const struct nf_snap *new,
+    struct nf_snap_diff *diffs, int diffs_num)
+{
+	const struct nf_snap_reg *o, *n;
+	double secs;
+	int i, j, num;
+
+	ASSERT(old != NULL && old->ns_sorted);
+	ASSERT(new != NULL && new->ns_sorted);
+	ASSERT(diffs != NULL || diffs_num == 0);
+	secs = ((double)new->ns_time - (double)old->ns_time) / 1e9;
+	num = i = j = 0;
+	while (i < old->ns_num || j < new->ns_num) {
+		o = (i < old->ns_num) ? &old->ns_regs[i] : NULL;
+		n = (j < new->ns_num) ? &new->ns_regs[j] : NULL;
+		if (n == NULL || (o != NULL && o->nsr_reg < n->nsr_reg)) {
+			n = NULL;
+			i++;
+		} else if (o == NULL || n->nsr_reg < o->nsr_reg) {
+			o = NULL;
+			j++;
+		} else {
+			i++;
+			j++;
+			if (o->nsr_value == n->nsr_value)
+				continue;
+		}
+		if (num < diffs_num)
+			nf_snap_diff_add(&diffs[num], o, n, secs);
+		num++;
+	}
+	return (num);
+}
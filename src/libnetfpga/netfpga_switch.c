@@ -0,0 +1,182 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * MAC table of the reference switch design.
+ *
+ * Each entry is read by writing its index to the RD_ADDR register and
+ * reading PORTS_MAC_HI (ports in the upper, MAC bits 47:32 in the lower
+ * half) and MAC_LO. With one ioctl per access that's 96 system calls
+ * for the table; here it's all one nf_regv() batch, which the FreeBSD
+ * module does in the kernel.
+ */
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/nf2_common.h"
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+
+#include "netfpga.h"
+
+static int
+nf_lut_ent_cmp(const void *a, const void *b)
+{
+	const struct nf_lut_ent *ea, *eb;
+
+	ea = a;
+	eb = b;
+	return (memcmp(ea->nle_mac, eb->nle_mac, sizeof(ea->nle_mac)));
+}
+
+/*
+ * Read the MAC table and its counters into ``lut''. Returns the number
+ * of entries in use or -1 on error.
+ */
+int
+nf_switch_lut_dump(struct netfpga *nf, struct nf_switch_lut *lut)
+{
+	struct nf_regop ops[NF_SWITCH_LUT_SIZE * 3 + 2];
+	struct nf_regop *op;
+	struct nf_lut_ent *e;
+	uint32_t hi, lo;
+	int i, j;
+
+	nf_assert(nf);
+	ASSERT(lut != NULL);
+	op = ops;
+	for (i = 0; i < NF_SWITCH_LUT_SIZE; i++) {
+		op->nro_op = NF_REGOP_WRITE;
+		op->nro_reg = SWITCH_OP_LUT_MAC_LUT_RD_ADDR_REG;
+		op->nro_value = i;
+		op++;
+		op->nro_op = NF_REGOP_READ;
+		op->nro_reg = SWITCH_OP_LUT_PORTS_MAC_HI_REG;
+		op++;
+		op->nro_op = NF_REGOP_READ;
+		op->nro_reg = SWITCH_OP_LUT_MAC_LO_REG;
+		op++;
+	}
+	op->nro_op = NF_REGOP_READ;
+	op->nro_reg = SWITCH_OP_LUT_NUM_HITS_REG;
+	op++;
+	op->nro_op = NF_REGOP_READ;
+	op->nro_reg = SWITCH_OP_LUT_NUM_MISSES_REG;
+	op++;
+	if (nf_regv(nf, ops, op - ops) != op - ops)
+		return (nf_erri(nf, "Couldn't read the MAC table"));
+
+	lut->nsl_hits = op[-2].nro_value;
+	lut->nsl_misses = op[-1].nro_value;
+	lut->nsl_num = 0;
+	for (op = ops, i = 0; i < NF_SWITCH_LUT_SIZE; i++, op += 3) {
+		hi = op[1].nro_value;
+		lo = op[2].nro_value;
+		if (hi == 0 && lo == 0)
+			continue;
+		e = &lut->nsl_ents[lut->nsl_num++];
+		e->nle_ports = hi >> 16;
+		e->nle_mac[0] = hi >> 8;
+		e->nle_mac[1] = hi;
+		for (j = 0; j < 4; j++)
+			e->nle_mac[2 + j] = lo >> (24 - j * 8);
+	}
+	qsort(lut->nsl_ents, lut->nsl_num, sizeof(lut->nsl_ents[0]),
+	    nf_lut_ent_cmp);
+	return (lut->nsl_num);
+}
+
+static void
+nf_lut_diff_add(struct nf_lut_diff *d, const uint8_t *mac,
+    uint16_t old_ports, uint16_t new_ports)
+{
+
+	memcpy(d->nld_mac, mac, sizeof(d->nld_mac));
+	d->nld_old_ports = old_ports;
+	d->nld_new_ports = new_ports;
+}
+
+/*
+ * Compare two dumps and store entries added, removed or moved to other
+ * ports in ``diffs''. Returns the number of differences, which may be
+ * more than ``diffs_num'' -- only that many are stored.
+ */
+int
+nf_switch_lut_diff(const struct nf_switch_lut *old,
+    const struct nf_switch_lut *new, struct nf_lut_diff *diffs,
+    int diffs_num)
+{
+	const struct nf_lut_ent *o, *n;
+	int i, j, num, c;
+
+	ASSERT(old != NULL);
+	ASSERT(new != NULL);
+	ASSERT(diffs != NULL || diffs_num == 0);
+	num = i = j = 0;
+	while (i < old->nsl_num || j < new->nsl_num) {
+		o = (i < old->nsl_num) ? &old->nsl_ents[i] : NULL;
+		n = (j < new->nsl_num) ? &new->nsl_ents[j] : NULL;
+		if (o == NULL)
+			c = 1;
+		else if (n == NULL)
+			c = -1;
+		else
+			c = nf_lut_ent_cmp(o, n);
+		if (c < 0) {
+			if (num < diffs_num)
+				nf_lut_diff_add(&diffs[num], o->nle_mac,
+				    o->nle_ports, 0);
+			num++;
+			i++;
+		} else if (c > 0) {
+			if (num < diffs_num)
+				nf_lut_diff_add(&diffs[num], n->nle_mac, 0,
+				    n->nle_ports);
+			num++;
+			j++;
+		} else {
+			if (o->nle_ports != n->nle_ports) {
+				if (num < diffs_num)
+					nf_lut_diff_add(&diffs[num],
+					    n->nle_mac, o->nle_ports,
+					    n->nle_ports);
+				num++;
+			}
+			i++;
+			j++;
+		}
+	}
+	return (num);
+}
@@ -30,11 +30,15 @@
 
 #include <sys/param.h>
 #include <sys/kernel.h>
+#include <sys/malloc.h>
 #include <sys/module.h>
 #include <sys/systm.h>
 #include <sys/conf.h>
+#include <sys/event.h>
 #include <sys/ioccom.h>
 #include <sys/pcpu.h>
+#include <sys/poll.h>
+#include <sys/selinfo.h>
 #include <sys/sysctl.h>
 #include <sys/taskqueue.h>
 
@@ -44,6 +48,9 @@
 #include <machine/atomic.h>
 #include <sys/rman.h>
 
+#include <vm/vm.h>
+#include <vm/pmap.h>
+
 #include <sys/socket.h>
 #include <sys/sockio.h>
 #include <net/if.h>
@@ -105,9 +112,23 @@ static devclass_t nfc_devclass;
 
 DRIVER_MODULE(nfc, pci, nfc_driver, nfc_devclass, 0, 0);
 
+static MALLOC_DEFINE(M_NETFPGA, "netfpga", "NetFPGA driver");
+
 static d_ioctl_t	nfc_dev_ioctl;
 static d_open_t		nfc_dev_open;
 static d_close_t	nfc_dev_close;
+static d_mmap_t		nfc_dev_mmap;
+static d_poll_t		nfc_dev_poll;
+static d_kqfilter_t	nfc_dev_kqfilter;
+
+static void	nfc_kqdetach(struct knote *kn);
+static int	nfc_kqevent(struct knote *kn, long hint);
+
+static struct filterops nfc_kqops = {
+	.f_isfd =	1,
+	.f_detach =	nfc_kqdetach,
+	.f_event =	nfc_kqevent,
+};
 
 static struct cdevsw nfc_cdevsw = {
 	.d_version =	D_VERSION,
@@ -115,6 +136,9 @@ static struct cdevsw nfc_cdevsw = {
 	.d_ioctl =	nfc_dev_ioctl,
 	.d_open =	nfc_dev_open,
 	.d_close =	nfc_dev_close,
+	.d_mmap =	nfc_dev_mmap,
+	.d_poll =	nfc_dev_poll,
+	.d_kqfilter =	nfc_dev_kqfilter,
 	.d_name =	"netfpga",
 };
 
@@ -127,7 +151,7 @@ static int	nfp_ifmedia_change(struct ifnet *ifp);
 static void	nfp_ifmedia_status(struct ifnet *ifp, struct ifmediareq *ifmr);
 static int	nfp_sysctl_node(struct nfp_softc *sc);
 static void	nfp_watchdog(void *arg);
-static void	nfp_tick(void *arg);
+static void	nfc_link_poll(void *arg);
 
 static int	nfp_probe(device_t);
 static int	nfp_attach(device_t);
@@ -136,6 +160,7 @@ static int	nfp_miibus_readreg(device_t dev, int phy, int reg);
 static int	nfp_miibus_writereg(device_t dev, int phy, int reg, int val);
 static void	nfp_miibus_statchg(device_t dev);
 static void	nfp_task_statchg(void *arg, int pending);
+static void	nfp_task_tick(void *arg, int pending);
 
 static int	nfp_ioctl(struct ifnet *ifp, u_long cmd, caddr_t data);
 static void	nfp_start(struct ifnet *ifp);
@@ -201,6 +226,7 @@ nfp_attach(device_t dev)
 	mtx_init(&nfp->nfp_mtx, device_get_nameunit(dev), MTX_NETWORK_LOCK,
 	    MTX_DEF);
 	TASK_INIT(&nfp->task_statchg, 0, nfp_task_statchg, nfp);
+	TASK_INIT(&nfp->task_tick, 0, nfp_task_tick, nfp);
 
 	error = nfp_dma_alloc(nfp);
 	if (error != 0) {
@@ -259,7 +285,6 @@ nfp_attach(device_t dev)
 	if (error != 0)
 		NF_DEBUG("couldn't allocate nfp's sysctl tree");
 
-	callout_init_mtx(&nfp->callout_tick, &nfp->nfp_mtx, 0);
 	callout_init_mtx(&nfp->callout_watchdog, &nfp->nfp_mtx, 0);
 
 	ether_ifattach(ifp, eaddr);
@@ -290,8 +315,9 @@ nfp_detach(device_t dev)
 		ether_ifdetach(ifp);
 		if_free(ifp);
 	}
-	callout_drain(&nfp->callout_tick);
 	callout_drain(&nfp->callout_watchdog);
+	taskqueue_drain(taskqueue_swi, &nfp->task_statchg);
+	taskqueue_drain(taskqueue_swi, &nfp->task_tick);
 	return (0);
 }
 
@@ -357,7 +383,6 @@ nfp_reset(struct nfp_softc *nfp)
 	WR4(sc, TX_QUEUE_0_NUM_PKTS_ENQUEUED_REG + o, 0);
 
 	callout_reset(&nfp->callout_watchdog, hz, nfp_watchdog, nfp);
-	callout_reset(&nfp->callout_tick, hz, nfp_tick, nfp);
 }
 
 static void
@@ -466,7 +491,6 @@ nfp_miibus_readreg(device_t dev, int phy, int reg)
 		return (-1);
 	}
 	nfpval = RD4(nfp->nfp_psc, nfpreg + nfp->nfp_mdioregoff);
-	DELAY(10);
 	return (nfpval);
 }
 
@@ -486,6 +510,7 @@ nfp_miibus_writereg(device_t dev, int phy, int reg, int val)
 		    val);
 		return (-1);
 	}
+	/* Let the MDIO write go out to the PHY */
 	WR4(nfp->nfp_psc, nfpreg + nfp->nfp_mdioregoff, val);
 	DELAY(10);
 	return (0);
@@ -502,33 +527,113 @@ nfp_miibus_statchg(device_t dev)
 }
 
 /*
- * For MII
+ * MII ticks drive autonegotiation, which only ports without link need.
+ * The link monitor queues them once per NFC_LINK_IVAL_MAX.
  */
 static void
-nfp_tick(void *arg)
+nfp_task_tick(void *arg, int pending)
 {
 	struct nfp_softc *nfp;
 	struct mii_data *mii;
 
 	nfp = arg;
-	mii = device_get_softc(nfp->nfp_miibus);
-	mii_tick(mii);
-	callout_reset(&nfp->callout_tick, hz, nfp_tick, nfp);
+	(void)pending;
+	NF_ASSERT(nfp != NULL);
+	NFP_LOCK(nfp);
+	if (nfp->nfp_ifp != NULL) {
+		mii = device_get_softc(nfp->nfp_miibus);
+		mii_tick(mii);
+	}
+	NFP_UNLOCK(nfp);
 }
 
 /*
- * Task handler for MII statchg method.
+ * Task handler for MII statchg method and link monitor's polls: pick
+ * up media from the PHY and tell ifnet about the link. Link state comes
+ * from the MII layer only, as reading BMSR elsewhere would clear its
+ * latched low link bit under mii_tick() and mii_pollstat(). A change
+ * is latched as INT_PHY_INTERRUPT for SIOCEVENTS waiters and makes the
+ * monitor poll fast until things settle down.
  */
 static void
 nfp_task_statchg(void *arg, int pending)
 {
+	struct nfc_softc *sc;
 	struct nfp_softc *nfp;
+	struct mii_data *mii;
+	struct ifnet *ifp;
+	uint32_t bit;
+	int up;
 
 	nfp = arg;
 	(void)pending;
 	NF_ASSERT(nfp != NULL);
+	NFP_LOCK(nfp);
+	ifp = nfp->nfp_ifp;
+	if (ifp == NULL) {
+		NFP_UNLOCK(nfp);
+		return;
+	}
+	mii = device_get_softc(nfp->nfp_miibus);
+	mii_pollstat(mii);
+	up = (mii->mii_media_status & (IFM_AVALID | IFM_ACTIVE)) ==
+	    (IFM_AVALID | IFM_ACTIVE);
+	if (up)
+		ifp->if_baudrate = ifmedia_baudrate(mii->mii_media_active);
+	bit = 1 << nfp->nfp_port_num;
+	NFP_UNLOCK(nfp);
 
-	TBD();
+	sc = nfp->nfp_psc;
+	NFC_LOCK(sc);
+	if (((sc->nfc_link & bit) != 0) != up) {
+		sc->nfc_link ^= bit;
+		/* The first report of a port isn't a change */
+		if (sc->nfc_link_known & bit)
+			nfp->link_changes++;
+		sc->nfc_events |= INT_PHY_INTERRUPT;
+		selwakeup(&sc->nfc_rsel);
+		KNOTE_LOCKED(&sc->nfc_rsel.si_note, 0);
+		sc->nfc_link_ival = NFC_LINK_IVAL_MIN;
+		/* Not once detach has stopped the monitor */
+		if (callout_active(&sc->nfc_link_callout))
+			callout_reset(&sc->nfc_link_callout,
+			    sc->nfc_link_ival, nfc_link_poll, sc);
+	}
+	sc->nfc_link_known |= bit;
+	NFC_UNLOCK(sc);
+	if_link_state_change(ifp, up ? LINK_STATE_UP : LINK_STATE_DOWN);
+}
+
+/*
+ * Link monitor. One callout queues the statchg task of every port,
+ * which updates nfc_link. The interval starts at NFC_LINK_IVAL_MIN
+ * after a change and doubles up to NFC_LINK_IVAL_MAX, where ports
+ * without link also get an MII tick for autonegotiation.
+ */
+static void
+nfc_link_poll(void *arg)
+{
+	struct nfc_softc *sc;
+	int i;
+
+	sc = arg;
+	NFC_LOCK_ASSERT(sc);
+	for (i = 0; i < NFC_PORT_NUM; i++)
+		taskqueue_enqueue(taskqueue_swi, &sc->ports[i].task_statchg);
+	if (sc->nfc_link_ival == 0)
+		sc->nfc_link_ival = NFC_LINK_IVAL_MIN;
+	else if (sc->nfc_link_ival < NFC_LINK_IVAL_MAX) {
+		sc->nfc_link_ival *= 2;
+		if (sc->nfc_link_ival > NFC_LINK_IVAL_MAX)
+			sc->nfc_link_ival = NFC_LINK_IVAL_MAX;
+	} else {
+		for (i = 0; i < NFC_PORT_NUM; i++)
+			if ((sc->nfc_link & (1 << i)) == 0)
+				taskqueue_enqueue(taskqueue_swi,
+				    &sc->ports[i].task_tick);
+	}
+	callout_reset(&sc->nfc_link_callout, sc->nfc_link_ival,
+	    nfc_link_poll, sc);
 }
 
 /*--------------------------------------------------------------------------*/
@@ -574,6 +679,11 @@ nfc_attach(device_t dev)
 	NFC_SOFTC_ASSERT(sc);
 
 	mtx_init(&sc->nfc_mtx, "netfpga_sc", NULL, MTX_DEF);
+	knlist_init_mtx(&sc->nfc_rsel.si_note, &sc->nfc_mtx);
+	callout_init_mtx(&sc->nfc_link_callout, &sc->nfc_mtx, 0);
+	sc->nfc_link = 0;
+	sc->nfc_link_known = 0;
+	sc->nfc_events = 0;
 	sc->dev = dev;
 	sc->mem = NULL;
 	sc->irq = NULL;
@@ -679,6 +789,12 @@ nfc_attach(device_t dev)
 	/* Enable interrupts */
 	nfc_irq_enable(sc, NULL);
 
+	/* Start watching links */
+	NFC_LOCK(sc);
+	sc->nfc_link_ival = 0;
+	callout_reset(&sc->nfc_link_callout, 1, nfc_link_poll, sc);
+	NFC_UNLOCK(sc);
+
 errout:
 	if (error != 0) 
 		error = nfc_detach(dev);
@@ -704,6 +820,7 @@ nfc_detach(device_t dev)
 		if (error != 0)
 			NF_DEBUG("Couldn't tear down interrupt");
 	}
+	callout_drain(&sc->nfc_link_callout);
 
 	error = bus_generic_detach(dev);
 	if (error != 0)
@@ -716,6 +833,9 @@ nfc_detach(device_t dev)
 
 	if (sc->cdev)
 		destroy_dev(sc->cdev);
+	knlist_clear(&sc->nfc_rsel.si_note, 0);
+	seldrain(&sc->nfc_rsel);
+	knlist_destroy(&sc->nfc_rsel.si_note);
 	if (sc->mem != NULL) {
 		rid = rman_get_rid(sc->mem);
 		error = bus_release_resource(dev, SYS_RES_MEMORY, rid, sc->mem);
@@ -789,6 +909,15 @@ nfc_intr(void *arg)
 	status = nfc_irq_status(sc);
 	nfc_irq_disable(sc);
 
+	/*
+	 * Let userland waiting in nf_wait_event() know what happened.
+	 */
+	if (status != 0) {
+		sc->nfc_events |= status;
+		selwakeup(&sc->nfc_rsel);
+		KNOTE_LOCKED(&sc->nfc_rsel.si_note, 0);
+	}
+
 	/*
 	 * In order to operate in per-port context, we must know the
 	 * port's number. Since interrupts that sygnalize errors appear
@@ -1412,6 +1541,9 @@ nfp_sysctl_node(struct nfp_softc *sc)
 	    CTLTYPE_UINT|CTLFLAG_RD, sc, TX_QUEUE_0_NUM_BYTES_PUSHED_REG,
 	    nfp_sysctl_handler, "IU", "TX bytes pushed");
 
+	SYSCTL_ADD_UINT(ctx, children, OID_AUTO, "link_changes", CTLFLAG_RD,
+	    &sc->link_changes, 0, "Link state changes seen");
+
 	return (0);
 }
 
@@ -1455,6 +1587,128 @@ nfc_dev_close(struct cdev *dev, int flags, int fmt, struct thread *td)
 		nfc_clear_flag(sc, NFC_FLAG_RESET_CPCI);
 	}
 	nfc_clear_flag(sc, NFC_FLAG_OPENED);
+	sc->nfc_events = 0;
+	NFC_UNLOCK(sc);
+	return (0);
+}
+
+/*
+ * Perform a batch of register operations passed from the userland.
+ * Programming registers have side effects handled in nfc_dev_ioctl(),
+ * so they aren't allowed here.
+ */
+static int
+nfc_dev_regrwv(struct nfc_softc *sc, struct nf_reqv *reqv)
+{
+	struct nf_reqv_ent *ents, *e;
+	size_t len;
+	uint32_t i;
+	int maxoff;
+	int error;
+
+	if (reqv->num == 0)
+		return (0);
+	if (reqv->num > NF_REQV_MAX)
+		return (EINVAL);
+	len = reqv->num * sizeof(*ents);
+	ents = malloc(len, M_NETFPGA, M_WAITOK);
+	error = copyin((void *)(uintptr_t)reqv->ents, ents, len);
+	if (error != 0)
+		goto out;
+	maxoff = rman_get_size(sc->mem);
+	for (i = 0; i < reqv->num; i++) {
+		e = &ents[i];
+		if (e->offset >= maxoff || e->offset % 4 != 0 ||
+		    e->offset == CPCI_REG_PROG_DATA ||
+		    (e->offset >= VIRTEX_PROGRAM_RAM_BASE_ADDR &&
+		    e->offset <= VIRTEX_PROGRAM_RAM_BASE_ADDR + CPCI_BIN_SIZE)) {
+			error = EINVAL;
+			goto out;
+		}
+	}
+	NFC_LOCK(sc);
+	for (i = 0; i < reqv->num; i++) {
+		e = &ents[i];
+		if (e->op == NF_REQV_WRITE)
+			WR4(sc, e->offset, e->value);
+		else
+			e->value = RD4(sc, e->offset);
+	}
+	NFC_UNLOCK(sc);
+	error = copyout(ents, (void *)(uintptr_t)reqv->ents, len);
+out:
+	free(ents, M_NETFPGA);
+	return (error);
+}
+
+/*
+ * Copy a block of card's memory to or from the userland through a
+ * bounce buffer of NF_REQM_CHUNK bytes, with the lock held over
+ * NFC_MEM_LOCKED bytes at a time.
+ */
+static int
+nfc_dev_memrw(struct nfc_softc *sc, struct nf_reqm *reqm)
+{
+	uint32_t *buf;
+	uint32_t off, n, i, m;
+	uint64_t end;
+	int error;
+
+	end = (uint64_t)reqm->offset + reqm->len;
+	if (reqm->offset % 4 != 0 || reqm->len % 4 != 0 ||
+	    end > rman_get_size(sc->mem) ||
+	    (reqm->offset <= CPCI_REG_PROG_DATA && end > CPCI_REG_PROG_DATA) ||
+	    (reqm->offset <= VIRTEX_PROGRAM_RAM_BASE_ADDR + CPCI_BIN_SIZE &&
+	    end > VIRTEX_PROGRAM_RAM_BASE_ADDR))
+		return (EINVAL);
+	buf = malloc(NF_REQM_CHUNK, M_NETFPGA, M_WAITOK);
+	error = 0;
+	for (off = 0; off < reqm->len && error == 0; off += n) {
+		n = MIN(reqm->len - off, NF_REQM_CHUNK);
+		if (reqm->op == NF_REQV_WRITE) {
+			error = copyin((void *)(uintptr_t)(reqm->buf + off),
+			    buf, n);
+			if (error != 0)
+				break;
+			for (i = 0; i < n; i += m) {
+				m = MIN(n - i, NFC_MEM_LOCKED);
+				NFC_LOCK(sc);
+				bus_space_write_region_4(sc->mem_tag,
+				    sc->mem_handle, reqm->offset + off + i,
+				    buf + i / 4, m / 4);
+				NFC_UNLOCK(sc);
+			}
+		} else {
+			for (i = 0; i < n; i += m) {
+				m = MIN(n - i, NFC_MEM_LOCKED);
+				NFC_LOCK(sc);
+				bus_space_read_region_4(sc->mem_tag,
+				    sc->mem_handle, reqm->offset + off + i,
+				    buf + i / 4, m / 4);
+				NFC_UNLOCK(sc);
+			}
+			error = copyout(buf, (void *)(uintptr_t)(reqm->buf +
+			    off), n);
+		}
+	}
+	free(buf, M_NETFPGA);
+	return (error);
+}
+
+/*
+ * Link state as the monitor last saw it.
+ */
+static int
+nfc_dev_link(struct nfc_softc *sc, struct nf_reqlink *reql)
+{
+	int i;
+
+	memset(reql, 0, sizeof(*reql));
+	NFC_LOCK(sc);
+	reql->up = sc->nfc_link;
+	for (i = 0; i < NFC_PORT_NUM; i++)
+		reql->changes[i] = sc->ports[i].link_changes;
+	reql->ival = sc->nfc_link_ival * tick;
 	NFC_UNLOCK(sc);
 	return (0);
 }
@@ -1477,6 +1731,26 @@ nfc_dev_ioctl(struct cdev *dev, unsigned long cmd, caddr_t data, int fflag,
 
 	/* Don't let user to read memory not belonging to the card */
 	maxoff = rman_get_size(sc->mem);
+	if (cmd == SIOCMEMSIZE) {
+		req->value = maxoff;
+		return (0);
+	}
+	if (cmd == SIOCREGRWV)
+		return (nfc_dev_regrwv(sc, (struct nf_reqv *)data));
+	if (cmd == SIOCMEMRW)
+		return (nfc_dev_memrw(sc, (struct nf_reqm *)data));
+	if (cmd == SIOCLINK)
+		return (nfc_dev_link(sc, (struct nf_reqlink *)data));
+	if (cmd == SIOCEVENTS) {
+		NFC_LOCK(sc);
+		req->value = sc->nfc_events & req->offset;
+		sc->nfc_events &= ~req->offset;
+		NFC_UNLOCK(sc);
+		return (0);
+	}
+	/* ENOTTY tells libnetfpga(3) we lack a request, not a bad offset */
+	if (cmd != SIOCREGREAD && cmd != SIOCREGWRITE)
+		return (ENOTTY);
 	if (req->offset >= maxoff)
 		return (EINVAL);
 
@@ -1518,9 +1792,89 @@ nfc_dev_ioctl(struct cdev *dev, unsigned long cmd, caddr_t data, int fflag,
 		WR4(sc, req->offset, req->value);
 		break;
 	default:
-		error = EINVAL;
+		error = ENOTTY;
 	}
 	NFC_UNLOCK(sc);
 	NF_DEBUG3("ioctl() error = 0");
 	return (error);
 }
+
+/*
+ * Let libnetfpga(3) map card's registers, so that register access
+ * doesn't cost a system call. Programming still goes through ioctl().
+ */
+static int
+nfc_dev_mmap(struct cdev *dev, vm_ooffset_t offset, vm_paddr_t *paddr,
+    int nprot, vm_memattr_t *memattr)
+{
+	struct nfc_softc *sc;
+
+	sc = dev->si_drv1;
+	NFC_SOFTC_ASSERT(sc);
+	if (offset >= rman_get_size(sc->mem))
+		return (EINVAL);
+	*paddr = rman_get_start(sc->mem) + offset;
+	*memattr = VM_MEMATTR_UNCACHEABLE;
+	return (0);
+}
+
+/*
+ * Descriptor is readable as long as some interrupt status bits wait for
+ * being picked up with SIOCEVENTS.
+ */
+static int
+nfc_dev_poll(struct cdev *dev, int events, struct thread *td)
+{
+	struct nfc_softc *sc;
+	int revents;
+
+	sc = dev->si_drv1;
+	NFC_SOFTC_ASSERT(sc);
+	revents = 0;
+	NFC_LOCK(sc);
+	if (events & (POLLIN | POLLRDNORM)) {
+		if (sc->nfc_events != 0)
+			revents |= events & (POLLIN | POLLRDNORM);
+		else
+			selrecord(td, &sc->nfc_rsel);
+	}
+	NFC_UNLOCK(sc);
+	return (revents);
+}
+
+static int
+nfc_dev_kqfilter(struct cdev *dev, struct knote *kn)
+{
+	struct nfc_softc *sc;
+
+	sc = dev->si_drv1;
+	NFC_SOFTC_ASSERT(sc);
+	if (kn->kn_filter != EVFILT_READ)
+		return (EINVAL);
+	kn->kn_fop = &nfc_kqops;
+	kn->kn_hook = sc;
+	knlist_add(&sc->nfc_rsel.si_note, kn, 0);
+	return (0);
+}
+
+static void
+nfc_kqdetach(struct knote *kn)
+{
+	struct nfc_softc *sc;
+
+	sc = kn->kn_hook;
+	knlist_remove(&sc->nfc_rsel.si_note, kn, 0);
+}
+
+/*
+ * Called with nfc_mtx held. ``kn_data'' carries pending status bits.
+ */
+static int
+nfc_kqevent(struct knote *kn, long hint)
+{
+	struct nfc_softc *sc;
+
+	sc = kn->kn_hook;
+	kn->kn_data = sc->nfc_events;
+	return (sc->nfc_events != 0);
+}
@@ -114,13 +114,15 @@ struct nfp_softc {
 	unsigned int		 txd_freeidx;
 	unsigned int		 txd_free;
 
-	/* Callouts for MII/ifnet layer */
-	struct callout		 callout_tick;
+	/* Callout for ifnet layer */
 	struct callout		 callout_watchdog;
 	unsigned int		 watchdog_timer;
 
-	/* Task for MII statchg() method */
+	/* Task for MII statchg() method and link monitor's polls */
 	struct task		 task_statchg;
+	/* Task for MII autonegotiation ticks while there's no link */
+	struct task		 task_tick;
+	unsigned int		 link_changes;
 };
 #define NFC_PORT_NUM	4
 
@@ -152,9 +154,19 @@ struct nfc_softc {
 	struct cdev		*cdev;
 	unsigned int		 flags;
 
+	/* Interrupt status bits not yet picked up by SIOCEVENTS */
+	uint32_t		 nfc_events;
+	struct selinfo		 nfc_rsel;
+
 	/* Particular ports */
 	struct nfp_softc	 ports[NFC_PORT_NUM];
 
+	/* Link monitor: one callout polls all ports through their MII */
+	struct callout		 nfc_link_callout;
+	int			 nfc_link_ival;	/* ticks */
+	uint32_t		 nfc_link;	/* Bit per port with link */
+	uint32_t		 nfc_link_known; /* Bit per port reported */
+
 	/* Card specific */
 	unsigned int		 revid;
 	unsigned int		 devid;
@@ -169,6 +181,19 @@ struct nfc_softc {
 	uint32_t	pcir[NF_PCI_REG_NUM];
 };
 
+/*
+ * Link monitor polls every NFC_LINK_IVAL_MIN right after a change and
+ * doubles the interval with every quiet poll up to NFC_LINK_IVAL_MAX.
+ */
+#define NFC_LINK_IVAL_MIN	(hz / 50 > 0 ? hz / 50 : 1)
+#define NFC_LINK_IVAL_MAX	(hz)
+
+/*
+ * Bulk copies take the lock for NFC_MEM_LOCKED bytes at a time, so that
+ * the interrupt handler and the link monitor don't wait for long.
+ */
+#define NFC_MEM_LOCKED		(4 * 1024)
+
 #define NFC_FLAG_OPENED		(1 << 0)
 #define NFC_FLAG_RESET_CPCI	(1 << 1)
 #define NFC_FLAG_RESET_CNET	(1 << 2)
@@ -0,0 +1,580 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * nfbrokerd -- owns the card and shares it with many local clients.
+ *
+ * The driver lets one process at a time open the card. Programs which
+ * need it at the same time use libnetfpga's "broker" module instead
+ * ("-m broker -i <socket>"), which speaks the protocol of
+ * include/netfpga_net.h to us over the UNIX socket given with -s.
+ *
+ * Clients' requests are interleaved by deficit round robin on register
+ * operations: every round a client with work may do -q more of them,
+ * and a request which costs more waits until the client has saved up
+ * enough. A client doing big batches gets the same share of the card
+ * as one doing single reads, not more.
+ *
+ * Registers given with -H are hot: they're read with one nf_regv()
+ * every -t milliseconds and published in "<socket>.hot", where clients
+ * read them without asking us. However many clients poll counters like
+ * these, the card sees one batch per tick.
+ *
+ * SIGUSR1 prints statistics; SIGINT and SIGTERM stop the broker.
+ */
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <netfpga.h>
+
+#include "../../include/netfpga_net.h"
+
+#define BR_CLIENTS_MAX	64
+#define BR_QUANTUM	256	/* Register ops per client per round */
+#define BR_TICK_MS	10
+#define BR_IN		(2 * NF_NET_FRAME_MAX)
+#define BR_OUT		(4 * NF_NET_FRAME_MAX)
+
+struct br_client {
+	int		 bc_fd;
+	unsigned	 bc_id;
+	uint8_t		*bc_in;
+	size_t		 bc_in_len;
+	uint8_t		*bc_out;
+	size_t		 bc_out_off;
+	size_t		 bc_out_len;
+	long		 bc_deficit;
+	unsigned long	 bc_reqs;
+	unsigned long	 bc_ops;
+};
+
+struct br_stats {
+	unsigned long	 bs_clients;
+	unsigned long	 bs_ticks;
+	unsigned long	 bs_overruns;	/* Ticks missed */
+	unsigned long	 bs_reqs;	/* Of clients gone */
+	unsigned long	 bs_ops;
+};
+
+static struct netfpga	 br_nf;
+static struct br_client	 br_clients[BR_CLIENTS_MAX];
+static int		 br_clients_num;
+static struct nf_broker_hot *br_hot;
+static struct nf_regop	 br_hot_ops[NF_BROKER_HOT_MAX];
+static char		 br_hot_path[256];
+static long		 br_quantum = BR_QUANTUM;
+static struct br_stats	 br_st;
+static int		 br_verbose;
+static volatile sig_atomic_t br_quit;
+static volatile sig_atomic_t br_report;
+
+static void
+br_sig(int sig)
+{
+
+	if (sig == SIGUSR1)
+		br_report = 1;
+	else
+		br_quit = 1;
+}
+
+static uint64_t
+br_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static int
+br_reg_cmp(const void *a, const void *b)
+{
+	uint32_t x, y;
+
+	x = *(const uint32_t *)a;
+	y = *(const uint32_t *)b;
+	return (x < y ? -1 : x > y);
+}
+
+/*
+ * Add hot registers from a comma separated list of offsets and names.
+ */
+static void
+br_hot_add(uint32_t *regs, int *regs_num, char *list)
+{
+	uint32_t reg;
+	char *name, *end;
+
+	while ((name = strsep(&list, ",")) != NULL) {
+		if (*name == '\0')
+			continue;
+		reg = strtoul(name, &end, 0);
+		if (*end != '\0' && nf_reg_byname(&br_nf, name, &reg) != 1)
+			errx(EX_USAGE, "Unknown register '%s'", name);
+		if (reg % 4 != 0)
+			errx(EX_USAGE, "Register %#x isn't aligned", reg);
+		if (*regs_num == NF_BROKER_HOT_MAX)
+			errx(EX_USAGE, "More than %d hot registers",
+			    NF_BROKER_HOT_MAX);
+		regs[(*regs_num)++] = reg;
+	}
+}
+
+/*
+ * Publish hot registers in shared memory. Clients look them up by
+ * binary search, so they're sorted and without duplicates.
+ */
+static void
+br_hot_setup(const char *sock, uint32_t *regs, int regs_num, int tick_ms)
+{
+	void *p;
+	int fd, i, n;
+
+	qsort(regs, regs_num, sizeof(*regs), br_reg_cmp);
+	for (i = n = 0; i < regs_num; i++)
+		if (n == 0 || regs[i] != regs[n - 1])
+			regs[n++] = regs[i];
+
+	snprintf(br_hot_path, sizeof(br_hot_path), "%s.hot", sock);
+	fd = open(br_hot_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		err(EXIT_FAILURE, "%s", br_hot_path);
+	if (ftruncate(fd, sizeof(*br_hot)) != 0)
+		err(EXIT_FAILURE, "ftruncate %s", br_hot_path);
+	p = mmap(NULL, sizeof(*br_hot), PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0);
+	if (p == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap %s", br_hot_path);
+	close(fd);
+	br_hot = p;
+	br_hot->nbh_num = n;
+	br_hot->nbh_tick_us = tick_ms * 1000;
+	for (i = 0; i < n; i++) {
+		br_hot->nbh_reg[i] = regs[i];
+		br_hot_ops[i].nro_op = NF_REGOP_READ;
+		br_hot_ops[i].nro_reg = regs[i];
+	}
+	/* Clients check it last */
+	atomic_thread_fence(memory_order_release);
+	br_hot->nbh_magic = NF_BROKER_MAGIC;
+}
+
+/*
+ * Sample hot registers, in one batch.
+ */
+static void
+br_tick(void)
+{
+	uint64_t t;
+	uint32_t gen;
+	int i, n;
+
+	/* Clients take values read after this as having their writes */
+	t = br_now();
+	n = br_hot->nbh_num;
+	if (nf_regv(&br_nf, br_hot_ops, n) != n) {
+		warnx("Hot registers: %s", nf_strerror(&br_nf));
+		nf_err_clear(&br_nf);
+		return;
+	}
+	gen = atomic_load_explicit(&br_hot->nbh_gen, memory_order_relaxed);
+	atomic_store_explicit(&br_hot->nbh_gen, gen + 1,
+	    memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	for (i = 0; i < n; i++)
+		br_hot->nbh_value[i] = br_hot_ops[i].nro_value;
+	br_hot->nbh_time = t;
+	br_hot->nbh_ticks = ++br_st.bs_ticks;
+	atomic_store_explicit(&br_hot->nbh_gen, gen + 2,
+	    memory_order_release);
+}
+
+/*
+ * What a request costs in register operations, for fair queuing.
+ */
+static long
+br_cost(const uint8_t *frame)
+{
+	struct nf_net_hdr h;
+	const uint8_t *p;
+	uint32_t w;
+	long cost;
+
+	memcpy(&h, frame, sizeof(h));
+	p = frame + sizeof(h);
+	h.nnh_len = ntohl(h.nnh_len);
+	cost = 1;
+	switch (h.nnh_type) {
+	case NF_NET_REGV:
+		cost = h.nnh_len / 4;
+		break;
+	case NF_NET_WRITE:
+		cost = h.nnh_len / 4 - 1;
+		break;
+	case NF_NET_READ:
+	case NF_NET_MEM:
+		if (h.nnh_len < (h.nnh_type == NF_NET_READ ? 8U : 12U))
+			break;
+		memcpy(&w, p + (h.nnh_type == NF_NET_READ ? 4 : 8), 4);
+		cost = ntohl(w) / 4;
+		break;
+	}
+	return (cost > 0 ? cost : 1);
+}
+
+/*
+ * One round for client ``c'': it may do ``br_quantum'' more register
+ * operations' worth of requests. Returns 1 if it has more to do, 0 if
+ * not (or it's waiting for us to send replies) and -1 on garbage.
+ */
+static int
+br_serve(struct br_client *c)
+{
+	size_t off;
+	long cost;
+	int flen;
+
+	if (c->bc_out_off > 0 && c->bc_out_len + NF_NET_FRAME_MAX > BR_OUT) {
+		memmove(c->bc_out, c->bc_out + c->bc_out_off,
+		    c->bc_out_len - c->bc_out_off);
+		c->bc_out_len -= c->bc_out_off;
+		c->bc_out_off = 0;
+	}
+	if (c->bc_out_len + NF_NET_FRAME_MAX > BR_OUT)
+		return (0);
+	flen = nf_net_frame(c->bc_in, c->bc_in_len);
+	if (flen <= 0) {
+		c->bc_deficit = 0;
+		return (flen);
+	}
+	c->bc_deficit += br_quantum;
+	for (off = 0; ; off += flen) {
+		flen = nf_net_frame(c->bc_in + off, c->bc_in_len - off);
+		if (flen < 0)
+			return (-1);
+		if (flen == 0) {
+			/* Nothing saved up while there's nothing to do */
+			c->bc_deficit = 0;
+			break;
+		}
+		cost = br_cost(c->bc_in + off);
+		if (cost > c->bc_deficit ||
+		    c->bc_out_len + NF_NET_FRAME_MAX > BR_OUT)
+			break;
+		c->bc_deficit -= cost;
+		c->bc_out_len += nf_net_exec(&br_nf, c->bc_in + off,
+		    c->bc_out + c->bc_out_len);
+		c->bc_reqs++;
+		c->bc_ops += cost;
+	}
+	memmove(c->bc_in, c->bc_in + off, c->bc_in_len - off);
+	c->bc_in_len -= off;
+	return (nf_net_frame(c->bc_in, c->bc_in_len) != 0);
+}
+
+static void
+br_accept(int lfd)
+{
+	struct br_client *c;
+	int fd;
+
+	fd = accept(lfd, NULL, NULL);
+	if (fd < 0)
+		return;
+	if (br_clients_num == BR_CLIENTS_MAX) {
+		warnx("Too many clients");
+		close(fd);
+		return;
+	}
+	(void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	c = &br_clients[br_clients_num++];
+	memset(c, 0, sizeof(*c));
+	c->bc_fd = fd;
+	c->bc_id = ++br_st.bs_clients;
+	c->bc_in = malloc(BR_IN);
+	c->bc_out = malloc(BR_OUT);
+	if (c->bc_in == NULL || c->bc_out == NULL)
+		err(EXIT_FAILURE, "malloc");
+	if (br_verbose)
+		fprintf(stderr, "Client %u connected\n", c->bc_id);
+}
+
+static void
+br_drop(int i, const char *why)
+{
+	struct br_client *c;
+
+	c = &br_clients[i];
+	if (br_verbose)
+		fprintf(stderr, "Client %u %s, %lu requests, %lu ops\n",
+		    c->bc_id, why, c->bc_reqs, c->bc_ops);
+	br_st.bs_reqs += c->bc_reqs;
+	br_st.bs_ops += c->bc_ops;
+	close(c->bc_fd);
+	free(c->bc_in);
+	free(c->bc_out);
+	br_clients[i] = br_clients[--br_clients_num];
+}
+
+static void
+br_stats_print(FILE *fp)
+{
+	struct nf_stats st;
+	struct br_client *c;
+	unsigned long reqs, ops;
+	int i;
+
+	reqs = br_st.bs_reqs;
+	ops = br_st.bs_ops;
+	for (i = 0; i < br_clients_num; i++) {
+		c = &br_clients[i];
+		fprintf(fp, "client %u: %lu requests, %lu ops\n", c->bc_id,
+		    c->bc_reqs, c->bc_ops);
+		reqs += c->bc_reqs;
+		ops += c->bc_ops;
+	}
+	nf_stats_get(&br_nf, &st);
+	fprintf(fp, "%lu clients, %lu requests, %lu ops; %lu ticks of %u "
+	    "hot registers, %lu missed; %lu card accesses\n",
+	    br_st.bs_clients, reqs, ops, br_st.bs_ticks,
+	    br_hot != NULL ? br_hot->nbh_num : 0, br_st.bs_overruns,
+	    st.st_reads + st.st_writes);
+}
+
+static int
+br_listen(const char *path)
+{
+	struct sockaddr_un sun;
+	int fd;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun.sun_path))
+		errx(EX_USAGE, "Socket path '%s' too long", path);
+	strcpy(sun.sun_path, path);
+	(void)unlink(path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		err(EXIT_FAILURE, "socket");
+	if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0)
+		err(EXIT_FAILURE, "bind %s", path);
+	if (listen(fd, BR_CLIENTS_MAX) != 0)
+		err(EXIT_FAILURE, "listen");
+	return (fd);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: nfbrokerd [-v] [-i iface] [-m module] "
+	    "[-s socket] [-q quantum]\n"
+	    "\t[-t tick_ms] [-H reg,...] ...\n");
+	exit(EX_USAGE);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct pollfd pfd[BR_CLIENTS_MAX + 1];
+	struct br_client *c;
+	uint32_t hot_regs[NF_BROKER_HOT_MAX];
+	const char *arg_sock;
+	char *hot_lists[16];
+	uint64_t now, next, tick_ns;
+	ssize_t n;
+	int hot_lists_num, hot_num, tick_ms, lfd, busy, timeout, i, o, ret;
+
+	arg_sock = NF_BROKER_SOCK;
+	tick_ms = BR_TICK_MS;
+	hot_lists_num = 0;
+	nf_init(&br_nf);
+	while ((o = getopt(argc, argv, "H:i:m:q:s:t:v")) != -1)
+		switch (o) {
+		case 'H':
+			if (hot_lists_num == 16)
+				usage();
+			hot_lists[hot_lists_num++] = optarg;
+			break;
+		case 'i':
+			br_nf.nf_iface = optarg;
+			break;
+		case 'm':
+			br_nf.nf_module = optarg;
+			break;
+		case 'q':
+			br_quantum = strtol(optarg, NULL, 0);
+			if (br_quantum <= 0)
+				usage();
+			break;
+		case 's':
+			arg_sock = optarg;
+			break;
+		case 't':
+			tick_ms = atoi(optarg);
+			if (tick_ms <= 0)
+				usage();
+			break;
+		case 'v':
+			br_verbose++;
+			break;
+		default:
+			usage();
+		}
+	if (optind != argc)
+		usage();
+
+	br_nf.nf_verbose = br_verbose;
+	if (nf_start(&br_nf) != 0)
+		errx(EXIT_FAILURE, "%s", nf_strerror(&br_nf));
+	hot_num = 0;
+	for (i = 0; i < hot_lists_num; i++)
+		br_hot_add(hot_regs, &hot_num, hot_lists[i]);
+
+	signal(SIGUSR1, br_sig);
+	signal(SIGINT, br_sig);
+	signal(SIGTERM, br_sig);
+	signal(SIGPIPE, SIG_IGN);
+
+	lfd = br_listen(arg_sock);
+	tick_ns = (uint64_t)tick_ms * 1000000;
+	next = 0;
+	if (hot_num > 0) {
+		br_hot_setup(arg_sock, hot_regs, hot_num, tick_ms);
+		br_tick();
+		next = br_now() + tick_ns;
+	}
+
+	busy = 0;
+	while (!br_quit) {
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		for (i = 0; i < br_clients_num; i++) {
+			c = &br_clients[i];
+			pfd[1 + i].fd = c->bc_fd;
+			pfd[1 + i].events = 0;
+			if (c->bc_in_len < BR_IN)
+				pfd[1 + i].events |= POLLIN;
+			if (c->bc_out_len > c->bc_out_off)
+				pfd[1 + i].events |= POLLOUT;
+		}
+		timeout = -1;
+		if (br_hot != NULL) {
+			now = br_now();
+			timeout = (next > now) ?
+			    (next - now + 999999) / 1000000 : 0;
+		}
+		if (busy)
+			timeout = 0;
+		if (poll(pfd, 1 + br_clients_num, timeout) < 0) {
+			if (errno != EINTR)
+				err(EXIT_FAILURE, "poll");
+			continue;
+		}
+		if (br_report) {
+			br_report = 0;
+			br_stats_print(stderr);
+		}
+		if (br_hot != NULL && br_now() >= next) {
+			br_tick();
+			next += tick_ns;
+			now = br_now();
+			/* Don't try to catch up on ticks we've missed */
+			if (now >= next) {
+				br_st.bs_overruns += (now - next) / tick_ns + 1;
+				next += ((now - next) / tick_ns + 1) * tick_ns;
+			}
+		}
+
+		/* Clients move around when one goes away, go backwards */
+		busy = 0;
+		for (i = br_clients_num - 1; i >= 0; i--) {
+			c = &br_clients[i];
+			if (pfd[1 + i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				n = recv(c->bc_fd, c->bc_in + c->bc_in_len,
+				    BR_IN - c->bc_in_len, 0);
+				if (n == 0 || (n < 0 && errno != EAGAIN &&
+				    errno != EINTR)) {
+					br_drop(i, "went away");
+					continue;
+				}
+				if (n > 0)
+					c->bc_in_len += n;
+			}
+			ret = br_serve(c);
+			if (ret < 0) {
+				br_drop(i, "sent garbage");
+				continue;
+			}
+			busy |= ret;
+			if (c->bc_out_len > c->bc_out_off) {
+				n = send(c->bc_fd, c->bc_out + c->bc_out_off,
+				    c->bc_out_len - c->bc_out_off, 0);
+				if (n > 0)
+					c->bc_out_off += n;
+				if (c->bc_out_off == c->bc_out_len)
+					c->bc_out_off = c->bc_out_len = 0;
+			}
+		}
+		if (pfd[0].revents & POLLIN)
+			br_accept(lfd);
+	}
+
+	br_stats_print(stderr);
+	while (br_clients_num > 0)
+		br_drop(br_clients_num - 1, "dropped");
+	(void)unlink(arg_sock);
+	if (br_hot != NULL)
+		(void)unlink(br_hot_path);
+	if (nf_stop(&br_nf) != 0)
+		errx(EXIT_FAILURE, "%s", nf_strerror(&br_nf));
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,388 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * nfevcap -- decodes event capture packets into a timeline of output
+ * queue occupancy.
+ *
+ * Event packets are read from a pcap file (-f) or received on a UDP
+ * port (-l), optionally after starting capture on the card towards
+ * this host (-S). Decoded events go to a timeline file (-o), text
+ * (-t), or both; a summary goes to stderr.
+ *
+ * With -S the card's stamp counter is also correlated with the host's
+ * CLOCK_REALTIME, refitted as events come, and text lines get a last
+ * column with host time of the event. Time 0 of the events is taken
+ * as the stamp counter read right after capture started, which is off
+ * by no more than one nf_regv() batch.
+ *
+ * A timeline file is a header followed by ``struct nf_evt'' records,
+ * all in host byte order:
+ *
+ *	char	 magic[4]	"NFEV"
+ *	uint16_t version	1
+ *	uint16_t queues		NF_EVCAP_QUEUES
+ *	uint32_t tick_ns	Timer resolution
+ *	uint32_t rec_len	sizeof(struct nf_evt)
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <netfpga.h>
+
+#define EC_PORT		5000	/* Default UDP port of event packets */
+#define EC_PKT_MAX	9018
+#define EC_EVTS_MAX	1024	/* More than an event packet can hold */
+#define EC_TL_VERSION	1
+#define EC_SYNC_MS	100	/* Stamp counter sampling when listening */
+
+struct ec_tl_hdr {
+	char			 eth_magic[4];
+	uint16_t		 eth_version;
+	uint16_t		 eth_queues;
+	uint32_t		 eth_tick_ns;
+	uint32_t		 eth_rec_len;
+};
+
+static struct netfpga	 ec_nf;
+static struct nf_hwtime	 ec_ht;
+static uint64_t		 ec_stamp0;	/* Stamp counter at event time 0 */
+static struct nf_evcap_dec ec_dec;
+static struct nf_evt	 ec_evts[EC_EVTS_MAX];
+static uint32_t		 ec_occ_max[NF_EVCAP_QUEUES];
+static uint64_t		 ec_drops[NF_EVCAP_QUEUES];
+static uint64_t		 ec_decode_ns;
+static uint64_t		 ec_first = UINT64_MAX, ec_last;
+static uint16_t		 ec_port = EC_PORT;
+static FILE		*ec_out;
+static int		 ec_text;
+static volatile sig_atomic_t ec_quit;
+
+static const char *ec_type_names[] = { "ts", "store", "remove", "drop" };
+
+static uint64_t
+ec_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static void
+ec_sig(int sig)
+{
+
+	(void)sig;
+	ec_quit = 1;
+}
+
+/*
+ * Decode one event packet payload and pass its events on.
+ */
+static void
+ec_payload(const uint8_t *p, size_t len)
+{
+	struct nf_evt *e;
+	uint64_t t0;
+	int n, i;
+
+	t0 = ec_now();
+	n = nf_evcap_decode(&ec_dec, p, len, ec_evts, EC_EVTS_MAX);
+	ec_decode_ns += ec_now() - t0;
+	if (n <= 0)
+		return;
+	for (i = 0; i < n; i++) {
+		e = &ec_evts[i];
+		if (e->ne_time < ec_first)
+			ec_first = e->ne_time;
+		if (e->ne_time > ec_last)
+			ec_last = e->ne_time;
+		if (e->ne_occ > ec_occ_max[e->ne_queue])
+			ec_occ_max[e->ne_queue] = e->ne_occ;
+		if (e->ne_type == NF_EVT_DROP)
+			ec_drops[e->ne_queue]++;
+		if (!ec_text)
+			continue;
+		printf("%" PRIu64 " %u %s %u %u", e->ne_time, e->ne_queue,
+		    ec_type_names[e->ne_type], e->ne_len, e->ne_occ);
+		if (ec_ht.nht_fitted)
+			printf(" %" PRIu64, nf_hwtime_to_host(&ec_ht, ec_stamp0 +
+			    e->ne_time / NF_HWTIME_TICK_NS, NULL));
+		printf("\n");
+	}
+	if (ec_out != NULL &&
+	    fwrite(ec_evts, sizeof(ec_evts[0]), n, ec_out) != (size_t)n)
+		err(EXIT_FAILURE, "fwrite");
+}
+
+static int
+ec_pcap_pkt(void *arg, uint8_t *pkt, size_t len, uint64_t ts_ns)
+{
+	const uint8_t *p;
+	size_t plen;
+
+	(void)arg;
+	(void)ts_ns;
+	p = nf_evcap_udp(pkt, len, ec_port, &plen);
+	if (p != NULL)
+		ec_payload(p, plen);
+	return (ec_quit);
+}
+
+/*
+ * Take a stamp counter sample every EC_SYNC_MS and refit.
+ */
+static void
+ec_sync(int force)
+{
+	static uint64_t last;
+	uint64_t now;
+
+	if (ec_ht.nht_nf == NULL)
+		return;
+	now = ec_now();
+	if (!force && now - last < EC_SYNC_MS * 1000000ULL)
+		return;
+	last = now;
+	if (nf_hwtime_sample(&ec_ht) != 0 ||
+	    (ec_ht.nht_num > 1 && nf_hwtime_fit(&ec_ht) != 0))
+		errx(EXIT_FAILURE, "%s", nf_strerror(&ec_nf));
+}
+
+static void
+ec_listen(uint64_t count)
+{
+	struct sockaddr_in sin;
+	struct timeval tv;
+	uint8_t buf[EC_PKT_MAX];
+	ssize_t len;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd == -1)
+		err(EXIT_FAILURE, "socket");
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(ec_port);
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0)
+		err(EXIT_FAILURE, "bind");
+	tv.tv_sec = 0;
+	tv.tv_usec = EC_SYNC_MS * 1000;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0)
+		err(EXIT_FAILURE, "setsockopt");
+	while (!ec_quit && (count == 0 || ec_dec.ned_pkts < count)) {
+		ec_sync(0);
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN ||
+			    errno == EWOULDBLOCK)
+				continue;
+			err(EXIT_FAILURE, "recv");
+		}
+		ec_payload(buf, len);
+	}
+	close(fd);
+}
+
+static void
+ec_summary(FILE *fp)
+{
+	double sec;
+	int q;
+
+	fprintf(fp, "%" PRIu64 " packets, %" PRIu64 " events, %" PRIu64
+	    " lost, %" PRIu64 " bad, %" PRIu64 " cut off\n",
+	    ec_dec.ned_pkts, ec_dec.ned_events, ec_dec.ned_lost,
+	    ec_dec.ned_bad, ec_dec.ned_overflows);
+	if (ec_dec.ned_events > 0)
+		fprintf(fp, "%.6f s of events\n", (ec_last - ec_first) / 1e9);
+	for (q = 0; q < NF_EVCAP_QUEUES; q++) {
+		if (ec_occ_max[q] == 0 && ec_drops[q] == 0)
+			continue;
+		fprintf(fp, "queue %d: max %u bytes, %" PRIu64 " drops\n", q,
+		    ec_occ_max[q], ec_drops[q]);
+	}
+	sec = ec_decode_ns / 1e9;
+	if (sec > 0)
+		fprintf(fp, "decoded at %.2f M events/s\n",
+		    ec_dec.ned_events / sec / 1e6);
+	if (ec_ht.nht_fitted)
+		fprintf(fp, "stamp counter drift %+.3f ppm, host time within "
+		    "%u ns\n", (NF_HWTIME_TICK_NS / ec_ht.nht_slope - 1) * 1e6,
+		    ec_ht.nht_err);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: nfevcap [-tv] [-i iface] [-m module] "
+	    "[-p port] [-r resolution] [-o timeline]\n"
+	    "\t(-f pcap | -l [-n count] [-S ip])\n");
+	exit(EX_USAGE);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct nf_evcap_cfg cfg;
+	struct ec_tl_hdr hdr;
+	struct in_addr in;
+	const char *arg_pcap, *arg_out, *arg_start;
+	uint64_t count, pkts;
+	unsigned resolution;
+	int flag_listen, verbose, i, o;
+
+	arg_pcap = arg_out = arg_start = NULL;
+	count = 0;
+	resolution = 0;
+	flag_listen = verbose = 0;
+	nf_init(&ec_nf);
+	while ((o = getopt(argc, argv, "f:i:lm:n:o:p:r:S:tv")) != -1)
+		switch (o) {
+		case 'f':
+			arg_pcap = optarg;
+			break;
+		case 'i':
+			ec_nf.nf_iface = optarg;
+			break;
+		case 'l':
+			flag_listen = 1;
+			break;
+		case 'm':
+			ec_nf.nf_module = optarg;
+			break;
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 'o':
+			arg_out = optarg;
+			break;
+		case 'p':
+			ec_port = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			resolution = strtoul(optarg, NULL, 0);
+			if (resolution > NF_EVCAP_RES_MAX)
+				usage();
+			break;
+		case 'S':
+			arg_start = optarg;
+			break;
+		case 't':
+			ec_text = 1;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default:
+			usage();
+		}
+	if (optind != argc || (arg_pcap == NULL) == !flag_listen ||
+	    (arg_start != NULL && !flag_listen))
+		usage();
+
+	nf_evcap_dec_init(&ec_dec, resolution);
+	if (arg_out != NULL) {
+		ec_out = fopen(arg_out, "w");
+		if (ec_out == NULL)
+			err(EXIT_FAILURE, "%s", arg_out);
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.eth_magic, "NFEV", sizeof(hdr.eth_magic));
+		hdr.eth_version = EC_TL_VERSION;
+		hdr.eth_queues = NF_EVCAP_QUEUES;
+		hdr.eth_tick_ns = ec_dec.ned_tick_ns;
+		hdr.eth_rec_len = sizeof(struct nf_evt);
+		if (fwrite(&hdr, sizeof(hdr), 1, ec_out) != 1)
+			err(EXIT_FAILURE, "fwrite");
+	}
+	signal(SIGINT, ec_sig);
+	signal(SIGTERM, ec_sig);
+
+	if (arg_pcap != NULL) {
+		if (nf_pcap_foreach(&ec_nf, arg_pcap, ec_pcap_pkt, NULL,
+		    &pkts) != 0)
+			errx(EXIT_FAILURE, "%s", nf_strerror(&ec_nf));
+		if (verbose)
+			fprintf(stderr, "%" PRIu64 " frames read\n", pkts);
+	} else {
+		if (arg_start != NULL) {
+			if (inet_pton(AF_INET, arg_start, &in) != 1)
+				errx(EX_USAGE, "'%s' isn't an IPv4 address",
+				    arg_start);
+			memset(&cfg, 0, sizeof(cfg));
+			memset(cfg.nec_dst_mac, 0xff, sizeof(cfg.nec_dst_mac));
+			cfg.nec_ip_dst = ntohl(in.s_addr);
+			cfg.nec_udp_src = cfg.nec_udp_dst = ec_port;
+			cfg.nec_output_ports = NF_ROUTER_PORT_MAC(0);
+			cfg.nec_monitor_mask = NF_EVCAP_MON_STORE |
+			    NF_EVCAP_MON_REMOVE | NF_EVCAP_MON_DROP;
+			cfg.nec_queue_mask = (1 << NF_EVCAP_QUEUES) - 1;
+			cfg.nec_resolution = resolution;
+			ec_nf.nf_verbose = verbose;
+			if (nf_start(&ec_nf) != 0)
+				errx(EXIT_FAILURE, "%s", nf_strerror(&ec_nf));
+			nf_hwtime_init(&ec_nf, &ec_ht, CLOCK_REALTIME);
+			for (i = 0; i < 2; i++)
+				ec_sync(1);
+			if (nf_evcap_config(&ec_nf, &cfg) != 0 ||
+			    nf_hwtime_read(&ec_nf, &ec_stamp0) != 0)
+				errx(EXIT_FAILURE, "%s", nf_strerror(&ec_nf));
+		}
+		ec_listen(count);
+		ec_sync(1);
+		if (arg_start != NULL && (nf_evcap_stop(&ec_nf, 0) != 0 ||
+		    nf_stop(&ec_nf) != 0))
+			errx(EXIT_FAILURE, "%s", nf_strerror(&ec_nf));
+	}
+	if (ec_out != NULL && fclose(ec_out) != 0)
+		err(EXIT_FAILURE, "%s", arg_out);
+	ec_summary(stderr);
+	return (0);
+}
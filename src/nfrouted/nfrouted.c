@@ -0,0 +1,638 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * nfrouted -- keeps the reference router's tables in sync with a stream
+ * of route and neighbour updates.
+ *
+ * Updates come one per line, from a file, stdin or clients of a UNIX
+ * socket:
+ *
+ *	route add <prefix>/<len> <next hop> <port>
+ *	route del <prefix>/<len>
+ *	arp add <next hop> <mac>
+ *	arp del <next hop>
+ *	flush
+ *
+ * <port> is mac0-mac3, cpu0-cpu3 or a NF_ROUTER_PORT_* mask. Updates
+ * arriving close to each other are collected and applied together once
+ * the input goes quiet for a while, so a burst turns into one
+ * nf_router_commit() and one nf_arp_commit().
+ *
+ * The hardware holds only NF_ROUTER_RT_SIZE routes. Routes which don't
+ * fit stay here; the card sends packets which match nothing to the CPU
+ * anyway, and routes in hardware which cover a route that didn't fit get
+ * their ports turned into CPU ports so that the host, which has the
+ * whole table, makes the decision.
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <netfpga.h>
+
+#define RD_RIB_MAX	4096	/* Routes we know about */
+#define RD_CLIENTS_MAX	16
+#define RD_LINE_MAX	256
+#define RD_LAT_NUM	8192	/* Latencies kept for percentiles */
+
+/* All MAC port bits */
+#define RD_PORTS_MAC	(NF_ROUTER_PORT_MAC(0) | NF_ROUTER_PORT_MAC(1) | \
+			NF_ROUTER_PORT_MAC(2) | NF_ROUTER_PORT_MAC(3))
+
+struct rd_route {
+	struct nf_route	 rr_rt;
+	uint64_t	 rr_seq;	/* When added */
+	int		 rr_hw;		/* In hardware after last commit */
+};
+
+struct rd_client {
+	int		 rc_fd;
+	char		 rc_buf[RD_LINE_MAX];
+	size_t		 rc_len;
+};
+
+struct rd_stats {
+	unsigned long	 rs_updates;
+	unsigned long	 rs_errors;
+	unsigned long	 rs_commits;
+	unsigned long	 rs_rt_slots;
+	unsigned long	 rs_arp_slots;
+	unsigned long	 rs_lat_num;
+	long		 rs_lat_max;
+	double		 rs_lat_sum;
+	long		 rs_lat[RD_LAT_NUM];	/* Ring */
+};
+
+static struct netfpga	 rd_nf;
+static struct nf_router	 rd_router;
+static struct nf_arp	 rd_arp;
+static struct rd_route	 rd_rib[RD_RIB_MAX];
+static int		 rd_rib_num;
+static uint64_t		 rd_seq;
+static int		 rd_overflow;	/* Routes left out of hardware */
+static struct rd_stats	 rd_st;
+static struct rd_client	 rd_clients[RD_CLIENTS_MAX];
+static int		 rd_verbose;
+static volatile sig_atomic_t rd_report;
+static volatile sig_atomic_t rd_quit;
+
+/* Updates waiting for a commit, by arrival time */
+static long		*rd_pend;
+static int		 rd_pend_num;
+static int		 rd_batch_max = 512;
+
+static long
+rd_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000000L + ts.tv_nsec);
+}
+
+static int
+rd_parse_ip(const char *s, uint32_t *ip)
+{
+	struct in_addr in;
+
+	if (inet_pton(AF_INET, s, &in) != 1)
+		return (-1);
+	*ip = ntohl(in.s_addr);
+	return (0);
+}
+
+static int
+rd_parse_prefix(const char *s, uint32_t *ip, uint32_t *mask)
+{
+	char buf[32], *slash;
+	int plen;
+
+	if (strlen(s) >= sizeof(buf))
+		return (-1);
+	strcpy(buf, s);
+	slash = strchr(buf, '/');
+	if (slash == NULL)
+		return (-1);
+	*slash++ = '\0';
+	if (sscanf(slash, "%d", &plen) != 1 || plen < 0 || plen > 32)
+		return (-1);
+	if (rd_parse_ip(buf, ip) != 0)
+		return (-1);
+	*mask = (plen == 0) ? 0 : 0xffffffff << (32 - plen);
+	*ip &= *mask;
+	return (0);
+}
+
+static int
+rd_parse_port(const char *s, uint32_t *port)
+{
+	int n;
+
+	if (sscanf(s, "mac%d", &n) == 1 && n >= 0 && n < 4)
+		*port = NF_ROUTER_PORT_MAC(n);
+	else if (sscanf(s, "cpu%d", &n) == 1 && n >= 0 && n < 4)
+		*port = NF_ROUTER_PORT_CPU(n);
+	else if (sscanf(s, "%i", &n) == 1 && n > 0 && n <= 0xff)
+		*port = n;
+	else
+		return (-1);
+	return (0);
+}
+
+static int
+rd_parse_mac(const char *s, uint8_t *mac)
+{
+	unsigned m[6];
+	int i;
+
+	if (sscanf(s, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3],
+	    &m[4], &m[5]) != 6)
+		return (-1);
+	for (i = 0; i < 6; i++) {
+		if (m[i] > 0xff)
+			return (-1);
+		mac[i] = m[i];
+	}
+	return (0);
+}
+
+static int
+rd_rib_find(uint32_t ip, uint32_t mask)
+{
+	int i;
+
+	for (i = 0; i < rd_rib_num; i++)
+		if (rd_rib[i].rr_rt.nrt_ip == ip &&
+		    rd_rib[i].rr_rt.nrt_mask == mask)
+			return (i);
+	return (-1);
+}
+
+/*
+ * Apply one update line to in-memory state. Returns 0 or -1 with
+ * a message printed.
+ */
+static int
+rd_update(char *line)
+{
+	struct nf_route rt;
+	char *av[6];
+	uint8_t mac[6];
+	uint32_t ip;
+	int ac, i;
+
+	for (ac = 0; ac < 6 && (av[ac] = strsep(&line, " \t")) != NULL;)
+		if (*av[ac] != '\0')
+			ac++;
+	if (ac == 0 || av[0][0] == '#')
+		return (0);
+	memset(&rt, 0, sizeof(rt));
+	if (ac == 5 && strcmp(av[0], "route") == 0 &&
+	    strcmp(av[1], "add") == 0) {
+		if (rd_parse_prefix(av[2], &rt.nrt_ip, &rt.nrt_mask) != 0 ||
+		    rd_parse_ip(av[3], &rt.nrt_next_hop) != 0 ||
+		    rd_parse_port(av[4], &rt.nrt_port) != 0)
+			goto bad;
+		i = rd_rib_find(rt.nrt_ip, rt.nrt_mask);
+		if (i < 0) {
+			if (rd_rib_num == RD_RIB_MAX) {
+				warnx("More than %d routes", RD_RIB_MAX);
+				return (-1);
+			}
+			i = rd_rib_num++;
+			rd_rib[i].rr_seq = rd_seq++;
+			rd_rib[i].rr_hw = 0;
+		}
+		rd_rib[i].rr_rt = rt;
+		nf_arp_touch(&rd_arp, rt.nrt_next_hop);
+	} else if (ac == 3 && strcmp(av[0], "route") == 0 &&
+	    strcmp(av[1], "del") == 0) {
+		if (rd_parse_prefix(av[2], &rt.nrt_ip, &rt.nrt_mask) != 0)
+			goto bad;
+		i = rd_rib_find(rt.nrt_ip, rt.nrt_mask);
+		if (i < 0) {
+			warnx("No route %s", av[2]);
+			return (-1);
+		}
+		rd_rib[i] = rd_rib[--rd_rib_num];
+	} else if (ac == 4 && strcmp(av[0], "arp") == 0 &&
+	    strcmp(av[1], "add") == 0) {
+		if (rd_parse_ip(av[2], &ip) != 0 ||
+		    rd_parse_mac(av[3], mac) != 0)
+			goto bad;
+		if (nf_arp_set(&rd_arp, ip, mac, 0) < 0) {
+			warnx("%s", nf_strerror(&rd_nf));
+			return (-1);
+		}
+		/* Next hops of routes we already have count as used */
+		for (i = 0; i < rd_rib_num; i++)
+			if (rd_rib[i].rr_rt.nrt_next_hop == ip)
+				nf_arp_touch(&rd_arp, ip);
+	} else if (ac == 3 && strcmp(av[0], "arp") == 0 &&
+	    strcmp(av[1], "del") == 0) {
+		if (rd_parse_ip(av[2], &ip) != 0)
+			goto bad;
+		if (nf_arp_del(&rd_arp, ip) != 0) {
+			warnx("%s", nf_strerror(&rd_nf));
+			return (-1);
+		}
+	} else if (ac == 1 && strcmp(av[0], "flush") == 0) {
+		rd_rib_num = 0;
+		nf_arp_flush(&rd_arp);
+	} else
+		goto bad;
+	return (0);
+bad:
+	warnx("Bad update '%s ...'", av[0]);
+	return (-1);
+}
+
+static int
+rd_rib_cmp_hw(const void *a, const void *b)
+{
+	const struct rd_route *ra, *rb;
+
+	ra = a;
+	rb = b;
+	/* Routes already in hardware first, then the oldest */
+	if (ra->rr_hw != rb->rr_hw)
+		return (rb->rr_hw - ra->rr_hw);
+	return ((ra->rr_seq > rb->rr_seq) - (ra->rr_seq < rb->rr_seq));
+}
+
+/*
+ * Put routes into the router. If they don't fit, routes which are in
+ * hardware keep their place, and ones covering a route that didn't
+ * make it send to the CPU instead.
+ */
+static int
+rd_router_sync(void)
+{
+	struct nf_route rt;
+	int i, j, hw_num;
+
+	qsort(rd_rib, rd_rib_num, sizeof(rd_rib[0]), rd_rib_cmp_hw);
+	hw_num = rd_rib_num < NF_ROUTER_RT_SIZE ? rd_rib_num :
+	    NF_ROUTER_RT_SIZE;
+	rd_overflow = rd_rib_num - hw_num;
+	nf_router_flush(&rd_router);
+	for (i = 0; i < rd_rib_num; i++) {
+		rd_rib[i].rr_hw = (i < hw_num);
+		if (i >= hw_num)
+			continue;
+		rt = rd_rib[i].rr_rt;
+		for (j = hw_num; j < rd_rib_num; j++)
+			if ((rd_rib[j].rr_rt.nrt_ip & rt.nrt_mask) ==
+			    rt.nrt_ip &&
+			    nf_route_plen(rd_rib[j].rr_rt.nrt_mask) >
+			    nf_route_plen(rt.nrt_mask))
+				break;
+		if (j < rd_rib_num)
+			rt.nrt_port = ((rt.nrt_port & RD_PORTS_MAC) << 1) |
+			    (rt.nrt_port & ~RD_PORTS_MAC);
+		if (nf_router_add(&rd_router, &rt) != 0)
+			return (-1);
+	}
+	return (nf_router_commit(&rd_router));
+}
+
+/*
+ * Write pending updates to the card and account for them.
+ */
+static void
+rd_commit(void)
+{
+	long t, lat;
+	int rt_slots, arp_slots, i;
+
+	if (rd_pend_num == 0)
+		return;
+	rt_slots = rd_router_sync();
+	arp_slots = nf_arp_commit(&rd_arp);
+	if (rt_slots < 0 || arp_slots < 0)
+		errx(EXIT_FAILURE, "Couldn't update tables: %s",
+		    nf_strerror(&rd_nf));
+	t = rd_now();
+	for (i = 0; i < rd_pend_num; i++) {
+		lat = t - rd_pend[i];
+		rd_st.rs_lat[rd_st.rs_lat_num++ % RD_LAT_NUM] = lat;
+		rd_st.rs_lat_sum += lat;
+		if (lat > rd_st.rs_lat_max)
+			rd_st.rs_lat_max = lat;
+	}
+	rd_st.rs_commits++;
+	rd_st.rs_rt_slots += rt_slots;
+	rd_st.rs_arp_slots += arp_slots;
+	if (rd_verbose)
+		fprintf(stderr, "commit: %d updates, %d route slots, "
+		    "%d ARP slots, %d routes not in hardware\n", rd_pend_num,
+		    rt_slots, arp_slots, rd_overflow);
+	rd_pend_num = 0;
+}
+
+static int
+long_cmp(const void *a, const void *b)
+{
+	const long *la, *lb;
+
+	la = a;
+	lb = b;
+	return ((*la > *lb) - (*la < *lb));
+}
+
+static void
+rd_stats_print(FILE *fp)
+{
+	long lat[RD_LAT_NUM];
+	unsigned long n, upd;
+
+	n = rd_st.rs_lat_num < RD_LAT_NUM ? rd_st.rs_lat_num : RD_LAT_NUM;
+	memcpy(lat, rd_st.rs_lat, n * sizeof(lat[0]));
+	qsort(lat, n, sizeof(lat[0]), long_cmp);
+	upd = rd_st.rs_lat_num;
+	fprintf(fp, "updates %lu (errors %lu), commits %lu, %.1f updates "
+	    "per commit\n", rd_st.rs_updates, rd_st.rs_errors,
+	    rd_st.rs_commits, rd_st.rs_commits ?
+	    (double)upd / rd_st.rs_commits : 0.0);
+	fprintf(fp, "slots written: route %lu, ARP %lu, %.2f per update\n",
+	    rd_st.rs_rt_slots, rd_st.rs_arp_slots, upd ?
+	    (double)(rd_st.rs_rt_slots + rd_st.rs_arp_slots) / upd : 0.0);
+	fprintf(fp, "routes %d, not in hardware %d, ARP entries %d, "
+	    "evicted %u\n", rd_rib_num, rd_overflow, rd_arp.na_num,
+	    rd_arp.na_evictions);
+	if (n > 0)
+		fprintf(fp, "latency us: mean %.1f p50 %.1f p99 %.1f "
+		    "max %.1f\n", rd_st.rs_lat_sum / upd / 1000.0,
+		    lat[(n - 1) / 2] / 1000.0, lat[(n - 1) * 99 / 100] / 1000.0,
+		    rd_st.rs_lat_max / 1000.0);
+}
+
+static void
+rd_sig(int sig)
+{
+
+	if (sig == SIGUSR1)
+		rd_report = 1;
+	else
+		rd_quit = 1;
+}
+
+/*
+ * Take complete lines out of client's buffer. Returns -1 on EOF or
+ * error.
+ */
+static int
+rd_client_read(struct rd_client *rc)
+{
+	char *nl;
+	ssize_t r;
+
+	r = read(rc->rc_fd, rc->rc_buf + rc->rc_len,
+	    sizeof(rc->rc_buf) - 1 - rc->rc_len);
+	if (r < 0 && (errno == EINTR || errno == EAGAIN))
+		return (0);
+	if (r <= 0)
+		return (-1);
+	rc->rc_len += r;
+	rc->rc_buf[rc->rc_len] = '\0';
+	while ((nl = strchr(rc->rc_buf, '\n')) != NULL) {
+		*nl = '\0';
+		if (nl > rc->rc_buf && nl[-1] == '\r')
+			nl[-1] = '\0';
+		rd_st.rs_updates++;
+		if (rd_update(rc->rc_buf) != 0)
+			rd_st.rs_errors++;
+		else
+			rd_pend[rd_pend_num++] = rd_now();
+		rc->rc_len -= nl + 1 - rc->rc_buf;
+		memmove(rc->rc_buf, nl + 1, rc->rc_len + 1);
+		if (rd_pend_num == rd_batch_max)
+			rd_commit();
+	}
+	if (rc->rc_len == sizeof(rc->rc_buf) - 1) {
+		warnx("Line too long, dropped");
+		rd_st.rs_errors++;
+		rc->rc_len = 0;
+	}
+	return (0);
+}
+
+static int
+rd_listen(const char *path)
+{
+	struct sockaddr_un sun;
+	int fd;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun.sun_path))
+		errx(EX_USAGE, "Socket path '%s' too long", path);
+	strcpy(sun.sun_path, path);
+	(void)unlink(path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		err(EXIT_FAILURE, "socket");
+	if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0)
+		err(EXIT_FAILURE, "bind %s", path);
+	if (listen(fd, RD_CLIENTS_MAX) != 0)
+		err(EXIT_FAILURE, "listen");
+	return (fd);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: nfrouted [-v] [-i iface] [-m module] "
+	    "[-c coalesce_us] [-b batch]\n"
+	    "\t[-f file | -s socket]\n");
+	exit(EX_USAGE);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct pollfd pfd[RD_CLIENTS_MAX + 1];
+	const char *arg_file, *arg_sock;
+	long coalesce_us, last;
+	int lfd, nfds, timeout, i, o, fd;
+
+	arg_file = arg_sock = NULL;
+	coalesce_us = 2000;
+	nf_init(&rd_nf);
+	while ((o = getopt(argc, argv, "b:c:f:i:m:s:v")) != -1)
+		switch (o) {
+		case 'b':
+			rd_batch_max = atoi(optarg);
+			if (rd_batch_max <= 0)
+				usage();
+			break;
+		case 'c':
+			coalesce_us = strtol(optarg, NULL, 0);
+			break;
+		case 'f':
+			arg_file = optarg;
+			break;
+		case 'i':
+			rd_nf.nf_iface = optarg;
+			break;
+		case 'm':
+			rd_nf.nf_module = optarg;
+			break;
+		case 's':
+			arg_sock = optarg;
+			break;
+		case 'v':
+			rd_verbose++;
+			break;
+		default:
+			usage();
+		}
+	if (optind != argc || (arg_file != NULL && arg_sock != NULL))
+		usage();
+
+	rd_pend = calloc(rd_batch_max, sizeof(*rd_pend));
+	if (rd_pend == NULL)
+		err(EXIT_FAILURE, "calloc");
+	rd_nf.nf_verbose = rd_verbose;
+	if (nf_start(&rd_nf) != 0)
+		errx(EXIT_FAILURE, "%s", nf_strerror(&rd_nf));
+	if (nf_router_init(&rd_nf, &rd_router) != 0 ||
+	    nf_arp_init(&rd_nf, &rd_arp) != 0)
+		errx(EXIT_FAILURE, "%s", nf_strerror(&rd_nf));
+	/* We're the control plane now: whatever was there goes */
+	nf_arp_flush(&rd_arp);
+
+	signal(SIGUSR1, rd_sig);
+	signal(SIGINT, rd_sig);
+	signal(SIGTERM, rd_sig);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (i = 0; i < RD_CLIENTS_MAX; i++)
+		rd_clients[i].rc_fd = -1;
+	lfd = -1;
+	if (arg_sock != NULL)
+		lfd = rd_listen(arg_sock);
+	else if (arg_file != NULL && strcmp(arg_file, "-") != 0) {
+		rd_clients[0].rc_fd = open(arg_file, O_RDONLY);
+		if (rd_clients[0].rc_fd == -1)
+			err(EXIT_FAILURE, "%s", arg_file);
+	} else
+		rd_clients[0].rc_fd = STDIN_FILENO;
+
+	last = 0;
+	while (!rd_quit) {
+		nfds = 0;
+		if (lfd != -1) {
+			pfd[nfds].fd = lfd;
+			pfd[nfds++].events = POLLIN;
+		}
+		for (i = 0; i < RD_CLIENTS_MAX; i++)
+			if (rd_clients[i].rc_fd != -1) {
+				pfd[nfds].fd = rd_clients[i].rc_fd;
+				pfd[nfds++].events = POLLIN;
+			}
+		if (nfds == 0)
+			break;		/* Input file is over */
+
+		/* Commit once the input has been quiet for a while */
+		timeout = -1;
+		if (rd_pend_num > 0) {
+			timeout = (last + coalesce_us * 1000 - rd_now() +
+			    999999) / 1000000;
+			if (timeout < 0)
+				timeout = 0;
+		}
+		if (poll(pfd, nfds, timeout) < 0 && errno != EINTR)
+			err(EXIT_FAILURE, "poll");
+		if (rd_report) {
+			rd_report = 0;
+			rd_stats_print(stderr);
+		}
+		if (rd_pend_num > 0 && rd_now() - last >= coalesce_us * 1000) {
+			rd_commit();
+			continue;
+		}
+
+		for (i = 0; i < nfds; i++) {
+			if ((pfd[i].revents & (POLLIN | POLLHUP)) == 0)
+				continue;
+			if (pfd[i].fd == lfd) {
+				fd = accept(lfd, NULL, NULL);
+				if (fd == -1)
+					continue;
+				for (o = 0; o < RD_CLIENTS_MAX; o++)
+					if (rd_clients[o].rc_fd == -1)
+						break;
+				if (o == RD_CLIENTS_MAX) {
+					warnx("Too many clients");
+					close(fd);
+					continue;
+				}
+				rd_clients[o].rc_fd = fd;
+				rd_clients[o].rc_len = 0;
+				continue;
+			}
+			for (o = 0; rd_clients[o].rc_fd != pfd[i].fd; o++)
+				;
+			if (rd_client_read(&rd_clients[o]) != 0) {
+				if (rd_clients[o].rc_fd != STDIN_FILENO)
+					close(rd_clients[o].rc_fd);
+				rd_clients[o].rc_fd = -1;
+			}
+			last = rd_now();
+		}
+	}
+	rd_commit();
+	rd_stats_print(stderr);
+	if (lfd != -1)
+		(void)unlink(arg_sock);
+	if (nf_stop(&rd_nf) != 0)
+		errx(EXIT_FAILURE, "%s", nf_strerror(&rd_nf));
+	exit(EXIT_SUCCESS);
+}
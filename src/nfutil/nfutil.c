@@ -37,35 +37,41 @@
  * --
  *
  * Original NetFPGA code passes information about operating on
- * socket/file descriptor. If we really need remote functionality,
- * instead of passing fd/socket as it's done in the original NetFPGA's
- * code, we should simply implemented something like this:
+ * socket/file descriptor. Remote access is done by "nfutil server"
+ * instead, which serves the card to the library's "net" module:
  *
- * netfpga server [-l addr] [-p port]
- *
- * 	starts simple TCP server and wait for connections. When a client
- * 	arrives, we should simply use the very same syntax we use on the
- * 	command line:
- *
- * 		reg read ...
- * 		reg write ...
- *
- * Either "nfutil client" or simply "telnet" could be used to connect to
- * this server. 
+ * 	nfutil server start [-l addr] [-p port]
+ * 	nfutil -m net -i host[:port] reg read ...
  */
 #include <sys/types.h>
+#include <sys/socket.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
+#include <assert.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <xbf.h>
 #include <cla.h>
 #include <netfpga.h>
 
+#include "../../include/nf2.h"
+#include "../../include/reg_defines.h"
+#include "../../include/netfpga_net.h"
+
 static int	flag_quiet = 0;
 
 static cla_func_t	nfu_cnet_write;
@@ -75,6 +81,35 @@ static cla_func_t	nfu_cpci_info;
 static cla_func_t	nfu_reg_read;
 static cla_func_t	nfu_reg_write;
 static cla_func_t	nfu_reg_list;
+static cla_func_t	nfu_reg_snapshot;
+static cla_func_t	nfu_reg_diff;
+static cla_func_t	nfu_reg_watch;
+static cla_func_t	nfu_event_wait;
+static cla_func_t	nfu_switch_lut;
+static cla_func_t	nfu_filter_list;
+static cla_func_t	nfu_filter_load;
+static cla_func_t	nfu_filter_add;
+static cla_func_t	nfu_filter_del;
+static cla_func_t	nfu_router_model;
+static cla_func_t	nfu_evcap_start;
+static cla_func_t	nfu_evcap_stop;
+static cla_func_t	nfu_evcap_stats;
+static cla_func_t	nfu_hwtime_sync;
+static cla_func_t	nfu_oq_watch;
+static cla_func_t	nfu_oq_stats;
+static cla_func_t	nfu_oq_plan;
+static cla_func_t	nfu_sram_dump;
+static cla_func_t	nfu_sram_load;
+static cla_func_t	nfu_selftest_run;
+static cla_func_t	nfu_shape_rate;
+static cla_func_t	nfu_shape_delay;
+static cla_func_t	nfu_shape_off;
+static cla_func_t	nfu_link_show;
+static cla_func_t	nfu_link_watch;
+static cla_func_t	nfu_batch_run;
+static cla_func_t	nfu_server;
+
+static struct cla	*nfu_cmdtree;	/* For commands run by "batch" */
 
 #define	TBD()	do {						\
 	printf("%s(%d) This function isn't implemented yet.\n",	\
@@ -145,6 +180,53 @@ nfu_cpci_info(struct cla *cla, int argc, char **argv)
 	return (0);
 }
 
+/*
+ * Convert register argument, an offset or a name, to the offset.
+ */
+static int
+nfu_reg_parse(struct netfpga *nf, const char *str, uint32_t *reg)
+{
+	int ret;
+
+	ret = sscanf(str, "0x%x", reg);
+	if (ret != 1)
+		ret = sscanf(str, "%u", reg);
+	if (ret != 1)
+		ret = nf_reg_byname(nf, str, reg);
+	return (ret == 1 ? 0 : -1);
+}
+
+static int
+nfu_value_parse(const char *str, uint32_t *value)
+{
+	int ret;
+
+	ret = sscanf(str, "0x%x", value);
+	if (ret != 1)
+		ret = sscanf(str, "%u", value);
+	return (ret == 1 ? 0 : -1);
+}
+
+static void
+nfu_reg_print(const char *name, uint32_t value)
+{
+
+	if (!flag_quiet)
+		printf("Register %s = ", name);
+	printf("%#x\n", value);
+}
+
+/*
+ * Report the library's last error as the command's failure.
+ */
+static int
+nfu_nf_error(struct netfpga *nf)
+{
+
+	fprintf(stderr, "%s", nf_strerror(nf));
+	return -1;
+}
+
 /*
  * Read register by name or offset.
  */
@@ -154,27 +236,19 @@ nfu_reg_read(struct cla *cla, int argc, char **argv)
 	struct netfpga *nf;
 	uint32_t reg;
 	uint32_t value;
-	int ret;
 
 	nf = cla_get_func_arg(cla);
 	if (argc != 2) {
 		fprintf(stderr, "Command requires an argument <reg>");
 		return -1;
 	}
-	ret = sscanf(argv[1], "0x%x", &reg);
-	if (ret != 1)
-		ret = sscanf(argv[1], "%d", &reg);
-	if (ret != 1)
-		ret = nf_reg_byname(nf, argv[1], &reg);
-	if (ret != 1) {
+	if (nfu_reg_parse(nf, argv[1], &reg) != 0) {
 		fprintf(stderr, "Couldn't convert register name"
 		    " %s to the offset value", argv[1]);
 		return -1;
 	}
 	value = nf_rd32(nf, reg);
-	if (!flag_quiet)
-		printf("Register %s = ", argv[1]);
-	printf("%#x\n", value);
+	nfu_reg_print(argv[1], value);
 	return (0);
 }
 
@@ -185,7 +259,6 @@ static int
 nfu_reg_write(struct cla *cla, int argc, char **argv)
 {
 	struct netfpga *nf;
-	int ret;
 	uint32_t value;
 	uint32_t reg;
 
@@ -197,23 +270,12 @@ nfu_reg_write(struct cla *cla, int argc, char **argv)
 	}
 
 	nf = cla_get_func_arg(cla);
-	/* Read register offset or name */
-	ret = sscanf(argv[1], "0x%x", &reg);
-	if (ret != 1)
-		ret = sscanf(argv[1], "%d", &reg);
-	if (ret != 1)
-		reg = nf_reg_byname(nf, argv[1], &reg);
-	if (ret != 1) {
+	if (nfu_reg_parse(nf, argv[1], &reg) != 0) {
 		fprintf(stderr, "Register format '%s' is wrong",
 		    argv[1]);
 		return -1;
 	}
-
-	/* Read value */
-	ret = sscanf(argv[2], "0x%x", &value);
-	if (ret != 1)
-		ret = sscanf(argv[2], "%d", &value);
-	if (ret != 1) {
+	if (nfu_value_parse(argv[2], &value) != 0) {
 		fprintf(stderr, "Value format '%s' is wrong", argv[2]);
 		return -1;
 	}
@@ -240,55 +302,2336 @@ nfu_reg_list(struct cla *cla, int argc, char **argv)
 	return (0);
 }
 
+static double
+nfu_batch_us(const struct timespec *ts0, const struct timespec *ts1)
+{
+
+	return ((ts1->tv_sec - ts0->tv_sec) * 1e6 +
+	    (ts1->tv_nsec - ts0->tv_nsec) / 1e3);
+}
+
 /*
- * Build command line tree for nfutil(8).
+ * Save registers of the catalog, or of ranges given with -r <lo>-<hi>
+ * (and the catalog too with -c), to <file>.
  */
-static struct cla *
-nfu_cmdlist_build(void *softc)
+static int
+nfu_reg_snapshot(struct cla *cla, int argc, char **argv)
 {
-	struct cla *nf;
-	struct cla *reg;
-	struct cla *cpci;
-	struct cla *cnet;
-	struct cla *cnet_write;
-	struct cla *cnet_info;
-	struct cla *cpci_write;
-	struct cla *cpci_info;
-	struct cla *reg_read;
-	struct cla *reg_write;
-	struct cla *reg_list;
+	struct netfpga *nf;
+	struct nf_snap *s;
+	struct timespec ts0, ts1;
+	uint32_t lo, hi;
+	int catalog, ranges, n;
 
-	nf = cla_new(NULL, NULL, NULL, NULL, "nfutil");
-	reg = cla_new(NULL, NULL, NULL, NULL, "reg");
-	cpci = cla_new(NULL, NULL, NULL, NULL, "cpci");
-	cnet = cla_new(NULL, NULL, NULL, NULL, "cnet");
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	s = nf_snap_new(nf);
+	catalog = ranges = 0;
+	for (argc--, argv++; argc > 1 && argv[0][0] == '-'; argc--, argv++) {
+		if (strcmp(argv[0], "-c") == 0) {
+			catalog = 1;
+			continue;
+		}
+		if (strcmp(argv[0], "-r") == 0 && argc > 2 &&
+		    sscanf(argv[1], "%x-%x", &lo, &hi) == 2) {
+			if (nf_snap_add_range(s, lo, hi) != 0)
+				goto fail;
+			ranges++;
+			argc--, argv++;
+			continue;
+		}
+		fprintf(stderr, "Bad option '%s'", argv[0]);
+		nf_snap_free(s);
+		return -1;
+	}
+	if (argc != 1) {
+		fprintf(stderr, "Command requires an argument <file>");
+		nf_snap_free(s);
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	if ((catalog || ranges == 0) && nf_snap_add_catalog(s) != 0)
+		goto fail;
+	n = nf_snap_read(s);
+	if (n < 0 || nf_snap_save(s, argv[0]) != 0)
+		goto fail;
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	if (!flag_quiet)
+		printf("%d registers read in %.3f ms, saved in %.3f ms\n", n,
+		    s->ns_read_ns / 1e6, nfu_batch_us(&ts0, &ts1) / 1e3);
+	nf_snap_free(s);
+	return (0);
+fail:
+	nf_snap_free(s);
+	return (nfu_nf_error(nf));
+}
 
-	cnet_write = cla_new(nfu_cnet_write, NULL, NULL,
-	    "Write CNET bitstream", "write <file>");
-	cnet_info = cla_new(nfu_cnet_info, NULL, NULL,
-	    "Obtain information about CNET bitstream", "info");
-	cla_add_subcmd(cnet, cnet_write);
-	cla_add_subcmd(cnet, cnet_info);
+/*
+ * Print registers which differ between snapshot <old> and <new>, or
+ * the card now if there's no <new>. Counters get deltas and rates.
+ */
+static int
+nfu_reg_diff(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_snap *old, *new;
+	struct nf_snap_diff *diffs, *d;
+	struct timespec ts0, ts1;
+	char name[16];
+	const char *nm;
+	int i, n;
 
-	reg_read = cla_new(nfu_reg_read, NULL, NULL,
-	    "Reads NetFPGA register", "read <reg>");
-	reg_write = cla_new(nfu_reg_write, NULL, NULL,
-	    "Writes NetFPGA register", "write <reg> <value>");
-	reg_list = cla_new(nfu_reg_list, NULL, NULL,
-	    "Lists all NetFPGA registers", "list");
-	cla_add_subcmd(reg, reg_read);
-	cla_add_subcmd(reg, reg_write);
-	cla_add_subcmd(reg, reg_list);
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "Command requires arguments <old> [<new>]");
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	old = nf_snap_load(nf, argv[1]);
+	if (old == NULL)
+		return (nfu_nf_error(nf));
+	if (argc == 3)
+		new = nf_snap_load(nf, argv[2]);
+	else {
+		/* The same registers, as they are now */
+		new = nf_snap_new(nf);
+		for (i = 0; i < old->ns_num; i++)
+			nf_snap_add(new, old->ns_regs[i].nsr_name,
+			    old->ns_regs[i].nsr_reg);
+		if (nf_snap_read(new) < 0) {
+			nf_snap_free(new);
+			new = NULL;
+		}
+	}
+	if (new == NULL) {
+		nf_snap_free(old);
+		return (nfu_nf_error(nf));
+	}
+	if (strcmp(old->ns_design, new->ns_design) != 0)
+		printf("Design changed from '%s' to '%s'\n", old->ns_design,
+		    new->ns_design);
+	n = nf_snap_diff(old, new, NULL, 0);
+	diffs = calloc(n > 0 ? n : 1, sizeof(*diffs));
+	if (diffs == NULL)
+		err(EXIT_FAILURE, "calloc");
+	nf_snap_diff(old, new, diffs, n);
+	for (i = 0; i < n; i++) {
+		d = &diffs[i];
+		nm = d->nsd_name;
+		if (nm == NULL) {
+			snprintf(name, sizeof(name), "%#x", d->nsd_reg);
+			nm = name;
+		}
+		if (d->nsd_flags & NF_SNAP_ONLY_OLD)
+			printf("%-44s %#10x -> -\n", nm, d->nsd_old);
+		else if (d->nsd_flags & NF_SNAP_ONLY_NEW)
+			printf("%-44s %10s -> %#x\n", nm, "-", d->nsd_new);
+		else if (d->nsd_flags & NF_SNAP_COUNTER)
+			printf("%-44s %#10x -> %#-10x +%u, %.1f/s%s\n", nm,
+			    d->nsd_old, d->nsd_new, d->nsd_delta,
+			    d->nsd_rate, (d->nsd_flags & NF_SNAP_WRAPPED) ?
+			    " (wrapped or reset)" : "");
+		else
+			printf("%-44s %#10x -> %#x\n", nm, d->nsd_old,
+			    d->nsd_new);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	if (!flag_quiet)
+		printf("%d of %d and %d registers differ over %.3f s, "
+		    "compared in %.3f ms\n", n, old->ns_num, new->ns_num,
+		    ((double)new->ns_time - (double)old->ns_time) / 1e9,
+		    nfu_batch_us(&ts0, &ts1) / 1e3);
+	free(diffs);
+	nf_snap_free(old);
+	nf_snap_free(new);
+	return (0);
+}
 
-	cpci_write = cla_new(nfu_cpci_write, NULL, NULL,
-	    "Write CPCI bitstream", "write <file>");
-	cpci_info = cla_new(nfu_cpci_info, NULL, NULL,
-	    "Obtain information about CPCI bitstream", "info");
-	cla_add_subcmd(cpci, cpci_write);
-	cla_add_subcmd(cpci, cpci_info);
+#define NFU_WATCH_EVS	64
+
+static volatile sig_atomic_t nfu_watch_stop;
+
+static void
+nfu_watch_sig(int sig)
+{
+
+	nfu_watch_stop = 1;
+}
+
+/*
+ * Poll registers every -p <period> microseconds, for -d <seconds> or
+ * until interrupted, and print their changes. Triggers given with -t
+ * are printed when they fire; with -s <prefix>, each one also saves a
+ * snapshot of the register catalog, read right after the poll which
+ * fired it, to <prefix>.<n>.
+ */
+static int
+nfu_reg_watch(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_watch *w;
+	struct nf_trig tg;
+	struct nf_watch_ev evs[NFU_WATCH_EVS], *e;
+	struct timespec next, now;
+	const char *names[NF_SAMPLER_REGS_MAX], *prefix;
+	char *exprs[NF_WATCH_TRIGS_MAX];
+	char fname[256];
+	uint32_t regs[NF_SAMPLER_REGS_MAX];
+	uint64_t t0, missed;
+	unsigned period, snaps;
+	double seconds, t;
+	int exprs_num, regs_num, error, i, n;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	period = 1000;
+	seconds = -1;
+	prefix = NULL;
+	exprs_num = 0;
+	for (argc--, argv++; argc > 1 && argv[0][0] == '-'; argc -= 2,
+	    argv += 2) {
+		if (strcmp(argv[0], "-p") == 0 &&
+		    sscanf(argv[1], "%u", &period) == 1 && period > 0)
+			continue;
+		if (strcmp(argv[0], "-d") == 0 &&
+		    sscanf(argv[1], "%lf", &seconds) == 1 && seconds > 0)
+			continue;
+		if (strcmp(argv[0], "-s") == 0) {
+			prefix = argv[1];
+			continue;
+		}
+		if (strcmp(argv[0], "-t") == 0 &&
+		    exprs_num < NF_WATCH_TRIGS_MAX) {
+			exprs[exprs_num++] = argv[1];
+			continue;
+		}
+		fprintf(stderr, "Bad option '%s %s'", argv[0], argv[1]);
+		return -1;
+	}
+	if (argc + exprs_num == 0 || argc > NF_SAMPLER_REGS_MAX) {
+		fprintf(stderr, "Command requires registers <reg> ... or "
+		    "triggers, at most %d registers", NF_SAMPLER_REGS_MAX);
+		return -1;
+	}
+	for (regs_num = 0; regs_num < argc; regs_num++) {
+		if (nfu_reg_parse(nf, argv[regs_num], &regs[regs_num]) != 0 ||
+		    regs[regs_num] % 4 != 0) {
+			fprintf(stderr, "Register format '%s' is wrong",
+			    argv[regs_num]);
+			return -1;
+		}
+		names[regs_num] = argv[regs_num];
+	}
+
+	w = malloc(sizeof(*w));
+	if (w == NULL)
+		err(EXIT_FAILURE, "malloc");
+	nf_watch_init(nf, w, regs, regs_num, regs_num == 32 ? 0xffffffff :
+	    (1U << regs_num) - 1);
+	error = 0;
+	for (i = 0; i < exprs_num; i++) {
+		if (nf_trig_parse(nf, exprs[i], &tg) != 0) {
+			error = nfu_nf_error(nf);
+			goto out;
+		}
+		tg.ntg_snap = (prefix != NULL);
+		if (nf_watch_trig(w, &tg) < 0) {
+			error = nfu_nf_error(nf);
+			goto out;
+		}
+		if (w->nw_regs_num > regs_num)
+			names[regs_num++] = w->nw_trigs[i].ntg_name;
+	}
+	if (prefix != NULL) {
+		/* Read once so that a trigger's read is just the batch */
+		w->nw_snap = nf_snap_new(nf);
+		if (nf_snap_add_catalog(w->nw_snap) != 0 ||
+		    nf_snap_read(w->nw_snap) < 0) {
+			error = nfu_nf_error(nf);
+			goto out;
+		}
+	}
+
+	nfu_watch_stop = 0;
+	signal(SIGINT, nfu_watch_sig);
+	signal(SIGTERM, nfu_watch_sig);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	t0 = (uint64_t)next.tv_sec * 1000000000 + next.tv_nsec;
+	missed = 0;
+	snaps = 0;
+	for (t = 0; !nfu_watch_stop && (seconds < 0 || t < seconds); ) {
+		n = nf_watch_poll(w, evs, NFU_WATCH_EVS);
+		if (n < 0) {
+			error = nfu_nf_error(nf);
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			e = &evs[i];
+			printf("%12.6f %s %#x -> %#x", (e->nwe_time - t0) / 1e9,
+			    names[e->nwe_reg], e->nwe_old, e->nwe_new);
+			if (e->nwe_trig >= 0)
+				printf(", '%s' fired",
+				    w->nw_trigs[e->nwe_trig].ntg_expr);
+			if (e->nwe_snap) {
+				snprintf(fname, sizeof(fname), "%s.%u", prefix,
+				    snaps++);
+				if (nf_snap_save(w->nw_snap, fname) != 0) {
+					printf("\n");
+					error = nfu_nf_error(nf);
+					goto stop;
+				}
+				printf(", snapshot %s", fname);
+			}
+			printf("\n");
+		}
+		if (n > 0)
+			fflush(stdout);
+
+		/* Next period, skipping those we're already late for */
+		next.tv_nsec += period * 1000L;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		while (now.tv_sec > next.tv_sec || (now.tv_sec ==
+		    next.tv_sec && now.tv_nsec > next.tv_nsec)) {
+			missed++;
+			next.tv_nsec += period * 1000L;
+			while (next.tv_nsec >= 1000000000) {
+				next.tv_nsec -= 1000000000;
+				next.tv_sec++;
+			}
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		t = (next.tv_sec - t0 / 1000000000) +
+		    (next.tv_nsec - (long)(t0 % 1000000000)) / 1e9;
+	}
+stop:
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	if (!flag_quiet) {
+		printf("%ju polls, %ju changes and triggers, %ju periods "
+		    "missed\n", (uintmax_t)w->nw_polls,
+		    (uintmax_t)w->nw_events, (uintmax_t)missed);
+		for (i = 0; i < w->nw_trigs_num; i++)
+			printf("'%s' fired %ju times\n",
+			    w->nw_trigs[i].ntg_expr,
+			    (uintmax_t)w->nw_trigs[i].ntg_fired);
+	}
+out:
+	nf_snap_free(w->nw_snap);
+	free(w);
+	return (error);
+}
+
+/*
+ * Wait for interrupts and report how long it took. With -p interrupt
+ * status register is polled even if the driver delivers interrupts.
+ */
+static int
+nfu_event_wait(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct timespec ts0, ts1;
+	uint32_t mask, events;
+	int timeout;
+	int ret;
+	long us;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (argc > 1 && strcmp(argv[1], "-p") == 0) {
+		nf->nf_nointr = 1;
+		argc--;
+		argv++;
+	}
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "Command requires an argument <mask>");
+		return -1;
+	}
+	ret = sscanf(argv[1], "0x%x", &mask);
+	if (ret != 1)
+		ret = sscanf(argv[1], "%u", &mask);
+	if (ret != 1 || mask == 0) {
+		fprintf(stderr, "Mask format '%s' is wrong", argv[1]);
+		return -1;
+	}
+	timeout = -1;
+	if (argc == 3 && sscanf(argv[2], "%d", &timeout) != 1) {
+		fprintf(stderr, "Timeout format '%s' is wrong", argv[2]);
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	ret = nf_wait_event(nf, mask, &events, timeout);
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	us = (ts1.tv_sec - ts0.tv_sec) * 1000000L +
+	    (ts1.tv_nsec - ts0.tv_nsec) / 1000;
+	if (ret != 1) {
+		printf("Timeout after %ld us\n", us);
+		return (0);
+	}
+	if (!flag_quiet)
+		printf("Events %#x after %ld us\n", events, us);
+	else
+		printf("%#x\n", events);
+	return (0);
+}
+
+static void
+nfu_mac_print(const uint8_t *mac)
+{
+
+	printf("%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2],
+	    mac[3], mac[4], mac[5]);
+}
+
+/*
+ * Dump switch's MAC table. With -w, dump it every <interval>
+ * milliseconds, <count> times or forever, and print what changed.
+ */
+static int
+nfu_switch_lut(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_switch_lut lut[2];
+	struct nf_lut_diff diffs[NF_SWITCH_LUT_SIZE * 2];
+	struct nf_lut_diff *d;
+	int interval, count;
+	int i, n, cur;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	interval = count = -1;
+	if (argc > 1 && strcmp(argv[1], "-w") == 0) {
+		if (argc < 3 || argc > 4 ||
+		    sscanf(argv[2], "%d", &interval) != 1 || interval <= 0) {
+			fprintf(stderr, "Option -w requires an argument "
+			    "<interval>");
+			return -1;
+		}
+		if (argc == 4 && (sscanf(argv[3], "%d", &count) != 1 ||
+		    count <= 0)) {
+			fprintf(stderr, "Count format '%s' is wrong", argv[3]);
+			return -1;
+		}
+	} else if (argc != 1) {
+		fprintf(stderr, "Command takes only [-w <interval> [<count>]]");
+		return -1;
+	}
+
+	cur = 0;
+	if (nf_switch_lut_dump(nf, &lut[cur]) < 0)
+		return (nfu_nf_error(nf));
+	for (i = 0; i < lut[cur].nsl_num; i++) {
+		nfu_mac_print(lut[cur].nsl_ents[i].nle_mac);
+		printf(" %#06x\n", lut[cur].nsl_ents[i].nle_ports);
+	}
+	if (!flag_quiet)
+		printf("%d entries, %u hits, %u misses\n", lut[cur].nsl_num,
+		    lut[cur].nsl_hits, lut[cur].nsl_misses);
+	for (; interval > 0 && count != 0; count -= (count > 0)) {
+		usleep(interval * 1000);
+		cur ^= 1;
+		if (nf_switch_lut_dump(nf, &lut[cur]) < 0)
+			return (nfu_nf_error(nf));
+		n = nf_switch_lut_diff(&lut[cur ^ 1], &lut[cur], diffs,
+		    NF_SWITCH_LUT_SIZE * 2);
+		for (i = 0; i < n; i++) {
+			d = &diffs[i];
+			if (d->nld_old_ports == 0)
+				printf("+ ");
+			else if (d->nld_new_ports == 0)
+				printf("- ");
+			else
+				printf("~ ");
+			nfu_mac_print(d->nld_mac);
+			if (d->nld_old_ports != 0 && d->nld_new_ports != 0)
+				printf(" %#06x ->", d->nld_old_ports);
+			printf(" %#06x\n", d->nld_new_ports != 0 ?
+			    d->nld_new_ports : d->nld_old_ports);
+		}
+		if (!flag_quiet && (n > 0 ||
+		    lut[cur].nsl_misses != lut[cur ^ 1].nsl_misses))
+			printf("%d entries, +%u hits, +%u misses\n",
+			    lut[cur].nsl_num,
+			    lut[cur].nsl_hits - lut[cur ^ 1].nsl_hits,
+			    lut[cur].nsl_misses - lut[cur ^ 1].nsl_misses);
+	}
+	return (0);
+}
+
+/*
+ * Print router's destination IP filter and the number of packets it
+ * sent to the CPU.
+ */
+static int
+nfu_filter_list(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_filter fl;
+	struct in_addr in;
+	char buf[INET_ADDRSTRLEN];
+	int s;
+
+	(void)argv;
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (argc != 1) {
+		fprintf(stderr, "Command takes no arguments");
+		return -1;
+	}
+	if (nf_filter_init(nf, &fl) != 0)
+		return (nfu_nf_error(nf));
+	for (s = 0; s < NF_FILTER_SIZE; s++) {
+		if (fl.nfl_hw[s] == 0)
+			continue;
+		in.s_addr = htonl(fl.nfl_hw[s]);
+		inet_ntop(AF_INET, &in, buf, sizeof(buf));
+		if (!flag_quiet)
+			printf("%2d ", s);
+		printf("%s\n", buf);
+	}
+	if (!flag_quiet)
+		printf("%d addresses, %u packets filtered\n", fl.nfl_ips_num,
+		    nf_rd32(nf, ROUTER_OP_LUT_NUM_FILTERED_PKTS_REG));
+	return (0);
+}
+
+/*
+ * Apply a change to the filter, writing only slots which need it.
+ */
+static int
+nfu_filter_change(struct cla *cla, int argc, char **argv,
+    int (*change)(struct nf_filter *, const char *))
+{
+	struct netfpga *nf;
+	struct nf_filter fl;
+	int n;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (argc != 2) {
+		fprintf(stderr, "Command requires one argument");
+		return -1;
+	}
+	if (nf_filter_init(nf, &fl) != 0 || change(&fl, argv[1]) != 0)
+		return (nfu_nf_error(nf));
+	n = nf_filter_commit(&fl);
+	if (n < 0)
+		return (nfu_nf_error(nf));
+	if (!flag_quiet)
+		printf("%d addresses, %d slots written\n", fl.nfl_ips_num, n);
+	return (0);
+}
+
+static int
+nfu_filter_ip(struct nf_filter *fl, const char *str, uint32_t *ip)
+{
+	struct in_addr in;
+
+	if (inet_pton(AF_INET, str, &in) != 1)
+		return (nf_erri(fl->nfl_nf, "Address format '%s' is wrong",
+		    str));
+	*ip = ntohl(in.s_addr);
+	return (0);
+}
+
+static int
+nfu_filter_do_load(struct nf_filter *fl, const char *fname)
+{
+
+	return (nf_filter_load(fl, fname));
+}
+
+static int
+nfu_filter_do_add(struct nf_filter *fl, const char *str)
+{
+	uint32_t ip;
+
+	ip = 0;
+	if (nfu_filter_ip(fl, str, &ip) != 0)
+		return (-1);
+	return (nf_filter_add(fl, ip));
+}
+
+static int
+nfu_filter_do_del(struct nf_filter *fl, const char *str)
+{
+	uint32_t ip;
+
+	ip = 0;
+	if (nfu_filter_ip(fl, str, &ip) != 0)
+		return (-1);
+	return (nf_filter_del(fl, ip));
+}
+
+static int
+nfu_filter_load(struct cla *cla, int argc, char **argv)
+{
+
+	return (nfu_filter_change(cla, argc, argv, nfu_filter_do_load));
+}
+
+static int
+nfu_filter_add(struct cla *cla, int argc, char **argv)
+{
+
+	return (nfu_filter_change(cla, argc, argv, nfu_filter_do_add));
+}
+
+static int
+nfu_filter_del(struct cla *cla, int argc, char **argv)
+{
+
+	return (nfu_filter_change(cla, argc, argv, nfu_filter_do_del));
+}
+
+/*
+ * Run a pcap file through the model of the router, built from tables
+ * in the card, and print what its counters should count. With -c the
+ * card's counters are printed next to them.
+ */
+static int
+nfu_router_model(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_rmodel *rm;
+	struct timespec ts0, ts1;
+	uint32_t hw[NF_RM_CTR_NUM];
+	uint32_t in_port;
+	uint64_t pkts;
+	double sec;
+	int n, flag_cmp;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	in_port = NF_ROUTER_PORT_MAC(0);
+	flag_cmp = 0;
+	for (argc--, argv++; argc > 1 && argv[0][0] == '-'; argc--, argv++) {
+		if (strcmp(argv[0], "-c") == 0)
+			flag_cmp = 1;
+		else if (strcmp(argv[0], "-p") == 0 && argc > 2) {
+			argc--;
+			argv++;
+			if (sscanf(argv[0], "mac%d", &n) == 1 && n >= 0 &&
+			    n < NF_ROUTER_PORTS)
+				in_port = NF_ROUTER_PORT_MAC(n);
+			else if (sscanf(argv[0], "cpu%d", &n) == 1 && n >= 0 &&
+			    n < NF_ROUTER_PORTS)
+				in_port = NF_ROUTER_PORT_CPU(n);
+			else {
+				fprintf(stderr, "Port '%s' isn't macN or cpuN",
+				    argv[0]);
+				return -1;
+			}
+		} else
+			break;
+	}
+	if (argc != 1) {
+		fprintf(stderr, "Command requires an argument <pcap>");
+		return -1;
+	}
+
+	rm = malloc(sizeof(*rm));
+	if (rm == NULL)
+		err(EXIT_FAILURE, "malloc");
+	if (nf_rmodel_load(nf, rm) != 0)
+		goto fail;
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	if (nf_rmodel_pcap(rm, argv[0], in_port, &pkts) != 0)
+		goto fail;
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	if (flag_cmp && nf_rmodel_counters(nf, hw) != 0)
+		goto fail;
+
+	for (n = 0; n < NF_RM_CTR_NUM; n++) {
+		printf("%-16s %12ju", nf_rmodel_ctr_name(n),
+		    (uintmax_t)rm->rm_ctr[n]);
+		if (flag_cmp)
+			printf(" %12u", hw[n]);
+		printf("\n");
+	}
+	for (n = 0; n < NF_ROUTER_PORTS; n++)
+		printf("out mac%d %12ju cpu%d %12ju\n", n,
+		    (uintmax_t)rm->rm_out[n * 2], n,
+		    (uintmax_t)rm->rm_out[n * 2 + 1]);
+	printf("dropped          %12ju\n", (uintmax_t)rm->rm_dropped);
+	if (!flag_quiet) {
+		sec = (ts1.tv_sec - ts0.tv_sec) +
+		    (ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+		printf("%ju packets in %.3f s, %.2f Mpps\n", (uintmax_t)pkts,
+		    sec, sec > 0 ? pkts / sec / 1e6 : 0.0);
+	}
+	free(rm);
+	return (0);
+fail:
+	free(rm);
+	return (nfu_nf_error(nf));
+}
+
+/*
+ * Start event capture, sending event packets to <ip>:<port> out of
+ * MAC port 0 unless -p says otherwise. All queues and event types are
+ * monitored unless -q and -e narrow it down.
+ */
+static int
+nfu_evcap_start(struct cla *cla, int argc, char **argv)
+{
+	static const uint8_t src_mac[6] = {
+		0x00, 0x4e, 0x46, 0x32, 0x43, 0x00
+	};
+	struct netfpga *nf;
+	struct nf_evcap_cfg cfg;
+	struct in_addr in;
+	unsigned long n;
+	char *end;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	memset(&cfg, 0, sizeof(cfg));
+	memset(cfg.nec_dst_mac, 0xff, sizeof(cfg.nec_dst_mac));
+	memcpy(cfg.nec_src_mac, src_mac, sizeof(cfg.nec_src_mac));
+	cfg.nec_output_ports = NF_ROUTER_PORT_MAC(0);
+	cfg.nec_monitor_mask = NF_EVCAP_MON_STORE | NF_EVCAP_MON_REMOVE |
+	    NF_EVCAP_MON_DROP;
+	cfg.nec_queue_mask = (1 << NF_EVCAP_QUEUES) - 1;
+	for (argc--, argv++; argc > 2 && argv[0][0] == '-'; argc -= 2,
+	    argv += 2) {
+		n = strtoul(argv[1], &end, 0);
+		if (*end != '\0') {
+			fprintf(stderr, "'%s' isn't a number", argv[1]);
+			return -1;
+		}
+		if (strcmp(argv[0], "-r") == 0 && n <= NF_EVCAP_RES_MAX)
+			cfg.nec_resolution = n;
+		else if (strcmp(argv[0], "-q") == 0)
+			cfg.nec_queue_mask = n;
+		else if (strcmp(argv[0], "-e") == 0)
+			cfg.nec_monitor_mask = n;
+		else if (strcmp(argv[0], "-p") == 0 && n < NF_ROUTER_PORTS)
+			cfg.nec_output_ports = NF_ROUTER_PORT_MAC(n);
+		else {
+			fprintf(stderr, "Bad option '%s %s'", argv[0], argv[1]);
+			return -1;
+		}
+	}
+	if (argc != 2) {
+		fprintf(stderr, "Command requires arguments <ip> <port>");
+		return -1;
+	}
+	if (inet_pton(AF_INET, argv[0], &in) != 1) {
+		fprintf(stderr, "'%s' isn't an IPv4 address", argv[0]);
+		return -1;
+	}
+	cfg.nec_ip_dst = ntohl(in.s_addr);
+	cfg.nec_udp_dst = cfg.nec_udp_src = strtoul(argv[1], NULL, 0);
+	if (nf_evcap_config(nf, &cfg) != 0)
+		return (nfu_nf_error(nf));
+	if (!flag_quiet)
+		printf("Event capture to %s:%u, tick %d ns\n", argv[0],
+		    cfg.nec_udp_dst, 8 << cfg.nec_resolution);
+	return (0);
+}
+
+/*
+ * Stop event capture, sending out events which are still buffered.
+ */
+static int
+nfu_evcap_stop(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+
+	(void)argv;
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (argc != 1) {
+		fprintf(stderr, "Command takes no arguments");
+		return -1;
+	}
+	if (nf_evcap_stop(nf, 1) != 0)
+		return (nfu_nf_error(nf));
+	return (0);
+}
+
+static int
+nfu_evcap_stats(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_evcap_stats st;
+
+	(void)argv;
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (argc != 1) {
+		fprintf(stderr, "Command takes no arguments");
+		return -1;
+	}
+	if (nf_evcap_stats(nf, &st) != 0)
+		return (nfu_nf_error(nf));
+	printf("%u packets, %u events sent, %u events dropped\n",
+	    st.nes_pkts_sent, st.nes_evts_sent, st.nes_evts_dropped);
+	return (0);
+}
+
+/*
+ * Sample the stamp counter <count> times, <interval> milliseconds
+ * apart, and print how it maps to the host's CLOCK_REALTIME.
+ */
+static int
+nfu_hwtime_sync(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_hwtime ht;
+	uint64_t ticks, host, err_ns;
+	int interval, count, i;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	interval = 10;
+	count = 16;
+	if (argc > 3 ||
+	    (argc > 1 && (sscanf(argv[1], "%d", &interval) != 1 ||
+	    interval < 0)) ||
+	    (argc > 2 && (sscanf(argv[2], "%d", &count) != 1 || count < 2 ||
+	    count > NF_HWTIME_SAMPLES))) {
+		fprintf(stderr, "Command takes only [<interval> [<count>]], "
+		    "count 2-%d", NF_HWTIME_SAMPLES);
+		return -1;
+	}
+	nf_hwtime_init(nf, &ht, CLOCK_REALTIME);
+	for (i = 0; i < count; i++) {
+		if (i > 0)
+			usleep(interval * 1000);
+		if (nf_hwtime_sample(&ht) != 0)
+			return (nfu_nf_error(nf));
+	}
+	if (nf_hwtime_fit(&ht) != 0 || nf_hwtime_read(nf, &ticks) != 0)
+		return (nfu_nf_error(nf));
+	host = nf_hwtime_to_host(&ht, ticks, &err_ns);
+	printf("stamp %ju = %ju.%09ju +- %ju ns\n", (uintmax_t)ticks,
+	    (uintmax_t)(host / 1000000000), (uintmax_t)(host % 1000000000),
+	    (uintmax_t)err_ns);
+	if (!flag_quiet)
+		printf("drift %+.3f ppm, %u ns within %d samples\n",
+		    (NF_HWTIME_TICK_NS / ht.nht_slope - 1) * 1e6, ht.nht_err,
+		    ht.nht_num);
+	return (0);
+}
+
+/*
+ * Sample registers ``regs'' every ``period'' microseconds for
+ * ``seconds'' and pass each sample to ``cb''. Returns -1 if the
+ * sampler failed.
+ */
+static int
+nfu_oq_sample(struct netfpga *nf, const uint32_t *regs, int regs_num,
+    unsigned period, double seconds,
+    void (*cb)(void *, const struct nf_sample *), void *arg)
+{
+	struct nf_sampler *sp;
+	struct nf_sampler_reader rd;
+	struct nf_sample smp[256];
+	uint64_t t0, last, samples, overruns;
+	int i, n;
+
+	sp = nf_sampler_new(nf, regs, regs_num, period,
+	    (unsigned)(20000 / period) + 64);
+	if (sp == NULL)
+		return (nfu_nf_error(nf));
+	if (nf_sampler_start(sp) != 0) {
+		nf_sampler_free(sp);
+		return (nfu_nf_error(nf));
+	}
+	nf_sampler_reader_init(sp, &rd);
+	t0 = last = 0;
+	do {
+		usleep(10000);
+		while ((n = nf_sampler_read(sp, &rd, smp, 256)) > 0) {
+			if (t0 == 0)
+				t0 = smp[0].nsm_time;
+			last = smp[n - 1].nsm_time;
+			for (i = 0; i < n; i++)
+				cb(arg, &smp[i]);
+		}
+	} while (nf_sampler_stats(sp, NULL, NULL) &&
+	    (t0 == 0 || last - t0 < seconds * 1e9));
+	if (nf_sampler_stop(sp) != 0) {
+		nf_sampler_free(sp);
+		return (nfu_nf_error(nf));
+	}
+	nf_sampler_stats(sp, &samples, &overruns);
+	nf_sampler_free(sp);
+	if (!flag_quiet)
+		printf("%ju samples, %ju periods missed, %ju not read\n",
+		    (uintmax_t)samples, (uintmax_t)overruns,
+		    (uintmax_t)rd.nsr_lost);
+	return (0);
+}
+
+/*
+ * Parse [-p <period>] [-w <window>] <seconds> of oq commands, -w only
+ * if ``window'' isn't NULL.
+ */
+static int
+nfu_oq_args(int argc, char **argv, unsigned *period, unsigned *pkts,
+    unsigned *window, double *seconds)
+{
+
+	for (argc--, argv++; argc > 2 && argv[0][0] == '-'; argc -= 2,
+	    argv += 2) {
+		if (strcmp(argv[0], "-p") == 0 &&
+		    sscanf(argv[1], "%u", period) == 1 && *period > 0)
+			continue;
+		if (pkts != NULL && strcmp(argv[0], "-t") == 0 &&
+		    sscanf(argv[1], "%u", pkts) == 1 && *pkts > 0)
+			continue;
+		if (window != NULL && strcmp(argv[0], "-w") == 0 &&
+		    sscanf(argv[1], "%u", window) == 1 && *window > 0)
+			continue;
+		fprintf(stderr, "Bad option '%s %s'", argv[0], argv[1]);
+		return -1;
+	}
+	if (argc != 1 || sscanf(argv[0], "%lf", seconds) != 1 ||
+	    *seconds <= 0) {
+		fprintf(stderr, "Command requires an argument <seconds>");
+		return -1;
+	}
+	return (0);
+}
+
+struct nfu_oq_watch {
+	struct nf_burst_det	 bd;
+	uint64_t		 t0;
+};
+
+static void
+nfu_oq_watch_sample(void *arg, const struct nf_sample *s)
+{
+	struct nfu_oq_watch *w;
+	struct nf_burst bursts[NF_SAMPLER_REGS_MAX], *b;
+	int i, n, q;
+
+	w = arg;
+	if (w->t0 == 0)
+		w->t0 = s->nsm_time;
+	n = nf_burst_feed(&w->bd, s, bursts, NF_SAMPLER_REGS_MAX);
+	for (i = 0; i < n; i++) {
+		b = &bursts[i];
+		q = b->nb_reg % NF_OQ_QUEUES;
+		if (b->nb_reg < NF_OQ_QUEUES)
+			printf("%12.6f queue %d: %u packets peak, %.3f ms\n",
+			    (b->nb_start - w->t0) / 1e9, q, b->nb_peak,
+			    (b->nb_end - b->nb_start) / 1e6);
+		else
+			printf("%12.6f queue %d: up to %u drops per sample, "
+			    "%.3f ms\n", (b->nb_start - w->t0) / 1e9, q,
+			    b->nb_peak, (b->nb_end - b->nb_start) / 1e6);
+	}
+}
+
+/*
+ * Sample output queues every <period> microseconds for <seconds> and
+ * print microbursts: queues holding at least <pkts> packets, and
+ * queues dropping packets.
+ */
+static int
+nfu_oq_watch(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nfu_oq_watch w;
+	uint32_t regs[NF_OQ_QUEUES * 2], hi[NF_OQ_QUEUES * 2];
+	uint32_t lo[NF_OQ_QUEUES * 2];
+	unsigned period, pkts;
+	double seconds;
+	int q;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	period = 100;
+	pkts = 32;
+	if (nfu_oq_args(argc, argv, &period, &pkts, NULL, &seconds) != 0)
+		return -1;
+
+	/* Occupancy, then drop counters, of every queue */
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		regs[q] = NF_OQ_REG(OQ_NUM_PKTS_IN_Q_REG_0, q);
+		hi[q] = pkts;
+		lo[q] = pkts / 2;
+		regs[NF_OQ_QUEUES + q] = NF_OQ_REG(OQ_NUM_PKTS_DROPPED_REG_0, q);
+		hi[NF_OQ_QUEUES + q] = lo[NF_OQ_QUEUES + q] = 1;
+	}
+	memset(&w, 0, sizeof(w));
+	nf_burst_init(&w.bd, NF_OQ_QUEUES * 2, hi, lo,
+	    ((1 << NF_OQ_QUEUES) - 1) << NF_OQ_QUEUES);
+	if (nfu_oq_sample(nf, regs, NF_OQ_QUEUES * 2, period, seconds,
+	    nfu_oq_watch_sample, &w) != 0)
+		return -1;
+	if (!flag_quiet)
+		printf("%ju bursts\n", (uintmax_t)w.bd.nbd_bursts);
+	return (0);
+}
+
+static void
+nfu_oq_stats_sample(void *arg, const struct nf_sample *s)
+{
+
+	nf_oq_stats_feed(arg, s);
+}
+
+/*
+ * Sample output queues for <seconds> and print, per queue, occupancy
+ * percentiles, drops and the windows with most of them, and how much
+ * buffer the queue needed.
+ */
+static int
+nfu_oq_stats(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_oq_stats *st;
+	struct nf_oq_queue_win *w;
+	struct nf_hist *h;
+	uint32_t regs[NF_OQ_STATS_REGS];
+	unsigned period, window;
+	double seconds;
+	int q, i;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	period = 100;
+	window = 10;
+	if (nfu_oq_args(argc, argv, &period, NULL, &window, &seconds) != 0)
+		return -1;
+	st = malloc(sizeof(*st));
+	if (st == NULL)
+		err(EXIT_FAILURE, "malloc");
+	if (nf_oq_stats_init(nf, st, window) != 0) {
+		free(st);
+		return (nfu_nf_error(nf));
+	}
+	nf_oq_stats_regs(regs);
+	if (nfu_oq_sample(nf, regs, NF_OQ_STATS_REGS, period, seconds,
+	    nfu_oq_stats_sample, st) != 0) {
+		free(st);
+		return -1;
+	}
+	nf_oq_stats_finish(st);
+
+	printf("%-2s %9s %9s %9s %9s %9s %9s %10s\n", "q", "capacity",
+	    "p50", "p99", "p99.9", "max", "need", "drops");
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		h = &st->nos_occ[q];
+		printf("%-2d %9u %9u %9u %9u %9u %9ju %10ju\n", q,
+		    st->nos_capacity[q], nf_hist_quantile(h, 0.5),
+		    nf_hist_quantile(h, 0.99), nf_hist_quantile(h, 0.999),
+		    h->nh_max, (uintmax_t)nf_oq_stats_need(st, q),
+		    (uintmax_t)st->nos_drops[q]);
+	}
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		for (i = 0; i < NF_OQ_WORST; i++) {
+			w = &st->nos_worst[q][i];
+			if (w->nqw_drops == 0)
+				break;
+			printf("queue %d dropped %ju at %.3f s, up to %u bytes "
+			    "queued\n", q, (uintmax_t)w->nqw_drops,
+			    (w->nqw_start - st->nos_t0) / 1e9, w->nqw_occ_max);
+		}
+	if (!flag_quiet)
+		printf("Occupancy in bytes over %.3f s, drops in %u ms "
+		    "windows\n", (st->nos_t1 - st->nos_t0) / 1e9, window);
+	free(st);
+	return (0);
+}
+
+/*
+ * Gather output queue statistics for ``seconds'' and return total drops
+ * per second, or -1 on error.
+ */
+static double
+nfu_oq_measure(struct netfpga *nf, struct nf_oq_stats *st, unsigned period,
+    unsigned window, double seconds)
+{
+	uint32_t regs[NF_OQ_STATS_REGS];
+	uint64_t drops;
+	int q;
+
+	if (nf_oq_stats_init(nf, st, window) != 0)
+		return (nfu_nf_error(nf));
+	nf_oq_stats_regs(regs);
+	if (nfu_oq_sample(nf, regs, NF_OQ_STATS_REGS, period, seconds,
+	    nfu_oq_stats_sample, st) != 0)
+		return (-1);
+	nf_oq_stats_finish(st);
+	drops = 0;
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		drops += st->nos_drops[q];
+	return (st->nos_t1 > st->nos_t0 ?
+	    drops / ((st->nos_t1 - st->nos_t0) / 1e9) : 0);
+}
+
+/*
+ * Plan output queue SRAM split from a profile in file <profile>, or one
+ * measured over <seconds>, and print it next to the current one. With
+ * -a the plan is applied and drops measured again.
+ */
+static int
+nfu_oq_plan(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_oq_stats *st;
+	struct nf_oq_profile *pr;
+	struct nf_oq_plan plan, cur;
+	uint32_t base, end, words;
+	unsigned period, window;
+	const char *profile;
+	double seconds, before, after;
+	int q, n, apply;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	apply = 0;
+	profile = NULL;
+	while (argc > 1) {
+		if (strcmp(argv[1], "-a") == 0) {
+			apply = 1;
+			n = 1;
+		} else if (strcmp(argv[1], "-f") == 0 && argc > 2) {
+			profile = argv[2];
+			n = 2;
+		} else
+			break;
+		argv[n] = argv[0];
+		argv += n;
+		argc -= n;
+	}
+	period = 100;
+	window = 10;
+	if (nfu_oq_args(argc, argv, &period, NULL, &window, &seconds) != 0)
+		return -1;
+
+	st = malloc(sizeof(*st));
+	pr = malloc(sizeof(*pr));
+	if (st == NULL || pr == NULL)
+		err(EXIT_FAILURE, "malloc");
+	memset(&cur, 0, sizeof(cur));
+	if (nf_oq_layout(nf, cur.nqp_lo, cur.nqp_hi, NULL) != 0)
+		goto fail;
+	base = cur.nqp_lo[0];
+	end = cur.nqp_hi[0];
+	for (q = 1; q < NF_OQ_QUEUES; q++) {
+		if (cur.nqp_lo[q] < base)
+			base = cur.nqp_lo[q];
+		if (cur.nqp_hi[q] > end)
+			end = cur.nqp_hi[q];
+	}
+	words = end - base + 1;
+
+	before = -1;
+	if (profile != NULL) {
+		if (nf_oq_profile_load(nf, profile, pr) != 0)
+			goto fail;
+	} else {
+		before = nfu_oq_measure(nf, st, period, window, seconds);
+		if (before < 0)
+			goto out;
+		nf_oq_profile_from_stats(st, pr);
+	}
+	if (nf_oq_plan(pr, base, words, words / 256 > 0 ? words / 256 : 1,
+	    2 * NF_OQ_PKT_MAX / NF_OQ_WORD_BYTES + 1, &plan) != 0) {
+		fprintf(stderr, "%u words of SRAM is too few", words);
+		goto out;
+	}
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		cur.nqp_drops[q] = nf_oq_expected_drops(pr, q,
+		    (uint64_t)(cur.nqp_hi[q] - cur.nqp_lo[q]) *
+		    NF_OQ_WORD_BYTES);
+		cur.nqp_drops_total += cur.nqp_drops[q];
+	}
+
+	printf("%-2s %15s %10s %15s %10s\n", "q", "current", "drops/s",
+	    "planned", "drops/s");
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		printf("%-2d 0x%05x-0x%05x %10.1f 0x%05x-0x%05x %10.1f\n", q,
+		    cur.nqp_lo[q], cur.nqp_hi[q], cur.nqp_drops[q],
+		    plan.nqp_lo[q], plan.nqp_hi[q], plan.nqp_drops[q]);
+	printf("%-2s %15s %10.1f %15s %10.1f\n", "", "", cur.nqp_drops_total,
+	    "", plan.nqp_drops_total);
+
+	if (apply) {
+		if (before < 0)
+			before = nfu_oq_measure(nf, st, period, window,
+			    seconds);
+		if (before < 0)
+			goto out;
+		if (nf_oq_plan_apply(nf, &plan) != 0)
+			goto fail;
+		after = nfu_oq_measure(nf, st, period, window, seconds);
+		if (after < 0)
+			goto out;
+		printf("Measured %.1f drops/s before, %.1f after\n", before,
+		    after);
+	}
+	free(st);
+	free(pr);
+	return (0);
+fail:
+	(void)nfu_nf_error(nf);
+out:
+	free(st);
+	free(pr);
+	return -1;
+}
+
+/*
+ * Dump or load SRAM bank <bank> (1 or 2) to or from <file>, and report
+ * how fast it went.
+ */
+static int
+nfu_sram(struct cla *cla, int argc, char **argv, int load)
+{
+	struct netfpga *nf;
+	struct nf_stats st0, st1;
+	struct timespec ts0, ts1;
+	uint32_t base;
+	double sec;
+	int bank, ret;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (argc != 3) {
+		fprintf(stderr, "Command requires two arguments <bank> and "
+		    "<file>");
+		return -1;
+	}
+	if (sscanf(argv[1], "%d", &bank) != 1 || (bank != 1 && bank != 2)) {
+		fprintf(stderr, "Bank must be 1 or 2");
+		return -1;
+	}
+	base = (bank == 1) ? SRAM_1_BASE : SRAM_2_BASE;
+
+	nf_stats_get(nf, &st0);
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	if (load)
+		ret = nf_mem_load(nf, base, SRAM_SIZE, argv[2]);
+	else
+		ret = nf_mem_save(nf, base, SRAM_SIZE, argv[2]) == 0 ?
+		    SRAM_SIZE : -1;
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	if (ret < 0)
+		return (nfu_nf_error(nf));
+	nf_stats_get(nf, &st1);
+	sec = (ts1.tv_sec - ts0.tv_sec) + (ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+	if (!flag_quiet)
+		printf("%d bytes %s SRAM %d in %.3f s, %.1f MB/s, %lu "
+		    "accesses\n", ret, load ? "loaded to" : "dumped from",
+		    bank, sec, sec > 0 ? ret / sec / 1e6 : 0,
+		    (st1.st_reads + st1.st_writes) -
+		    (st0.st_reads + st0.st_writes));
+	return (0);
+}
+
+static int
+nfu_sram_dump(struct cla *cla, int argc, char **argv)
+{
+
+	return (nfu_sram(cla, argc, argv, 0));
+}
+
+static int
+nfu_sram_load(struct cla *cla, int argc, char **argv)
+{
+
+	return (nfu_sram(cla, argc, argv, 1));
+}
+
+#define NFU_TEST_CARDS		16
+#define NFU_TEST_POLL_MS	100
+
+struct nfu_test_card {
+	struct netfpga		*nf;
+	const char		*name;
+	struct nf_test_res	 res[NF_TEST_NUM];
+};
+
+/*
+ * Print log entries of engine ``t'' of card ``c'' for errors found
+ * since ``prev'' errors. Returns -1 if the log couldn't be read.
+ */
+static int
+nfu_test_log(struct nfu_test_card *c, int t, uint64_t prev)
+{
+	struct nf_test_log log[NF_TEST_LOG_MAX];
+	uint64_t errors;
+	int i, n;
+
+	errors = c->res[t].ntr_errors;
+	if (t >= NF_TEST_PHY0) {
+		if (nf_test_log(c->nf, t, 0, log, 1) != 1)
+			return (-1);
+		printf("%s %s: %ju errors, last status %#x expected %#010jx "
+		    "read %#010jx\n", c->name, nf_test_name(t),
+		    (uintmax_t)errors, log[0].ntl_addr,
+		    (uintmax_t)log[0].ntl_exp, (uintmax_t)log[0].ntl_got);
+		return (0);
+	}
+	n = nf_test_log(c->nf, t, prev, log, errors - prev < NF_TEST_LOG_MAX ?
+	    errors - prev : NF_TEST_LOG_MAX);
+	if (n < 0)
+		return (-1);
+	for (i = 0; i < n; i++)
+		printf("%s %s: address %#x expected %#018jx read %#018jx\n",
+		    c->name, nf_test_name(t), log[i].ntl_addr,
+		    (uintmax_t)log[i].ntl_exp, (uintmax_t)log[i].ntl_got);
+	if (prev + n < errors)
+		printf("%s %s: %ju errors, log full\n", c->name,
+		    nf_test_name(t), (uintmax_t)errors);
+	return (0);
+}
+
+/*
+ * Run self-test engines on this card and cards <iface> all at once for
+ * <seconds>, printing errors as they are found and a summary at the
+ * end. Engines are picked by -e, all by default. Needs the selftest
+ * bitfile loaded.
+ */
+static int
+nfu_selftest_run(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nfu_test_card cards[NFU_TEST_CARDS], *c;
+	struct nf_test_res prev[NF_TEST_NUM], *r;
+	struct nf_stats st;
+	struct timespec ts0, ts1;
+	unsigned long seed, mask, accesses;
+	double seconds, sec;
+	char *names, *name;
+	int t, i, cards_num, polls, failed, bad, error;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	mask = NF_TEST_ALL;
+	seed = (unsigned long)time(NULL);
+	for (argc--, argv++; argc > 2 && argv[0][0] == '-'; argc -= 2,
+	    argv += 2) {
+		if (strcmp(argv[0], "-s") == 0) {
+			seed = strtoul(argv[1], NULL, 0);
+			continue;
+		}
+		if (strcmp(argv[0], "-e") != 0) {
+			fprintf(stderr, "Bad option '%s %s'", argv[0], argv[1]);
+			return -1;
+		}
+		mask = 0;
+		names = argv[1];
+		while ((name = strsep(&names, ",")) != NULL) {
+			t = nf_test_byname(name);
+			if (t < 0) {
+				fprintf(stderr, "Unknown engine '%s'", name);
+				return -1;
+			}
+			mask |= 1U << t;
+		}
+	}
+	if (argc < 1 || sscanf(argv[0], "%lf", &seconds) != 1 ||
+	    seconds <= 0) {
+		fprintf(stderr, "Command requires an argument <seconds>");
+		return -1;
+	}
+	if (argc > NFU_TEST_CARDS) {
+		fprintf(stderr, "At most %d cards", NFU_TEST_CARDS);
+		return -1;
+	}
+
+	memset(cards, 0, sizeof(cards));
+	cards[0].nf = nf;
+	cards[0].name = nf->nf_iface != NULL ? nf->nf_iface : "card";
+	error = 0;
+	for (cards_num = 1; cards_num < argc; cards_num++) {
+		c = &cards[cards_num];
+		c->nf = malloc(sizeof(*c->nf));
+		if (c->nf == NULL)
+			err(EXIT_FAILURE, "malloc");
+		nf_init(c->nf);
+		c->nf->nf_module = nf->nf_module;
+		c->nf->nf_iface = c->name = argv[cards_num];
+		c->nf->nf_quiet = nf->nf_quiet;
+		if (nf_start(c->nf) != 0) {
+			fprintf(stderr, "%s: %s", c->name, nf_strerror(c->nf));
+			free(c->nf);
+			error = -1;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < cards_num; i++)
+		if (nf_test_start(cards[i].nf, mask, seed) != 0) {
+			c = &cards[i];
+			goto fail;
+		}
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	polls = 0;
+	do {
+		usleep(NFU_TEST_POLL_MS * 1000);
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		sec = (ts1.tv_sec - ts0.tv_sec) +
+		    (ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+		if (sec >= seconds)
+			for (i = 0; i < cards_num; i++)
+				if (nf_test_stop(cards[i].nf, mask) != 0) {
+					c = &cards[i];
+					goto fail;
+				}
+		for (i = 0; i < cards_num; i++) {
+			c = &cards[i];
+			memcpy(prev, c->res, sizeof(prev));
+			if (nf_test_poll(c->nf, mask, c->res) != 0)
+				goto fail;
+			for (t = 0; t < NF_TEST_NUM; t++)
+				if (c->res[t].ntr_errors > prev[t].ntr_errors &&
+				    (t < NF_TEST_SERIAL0 || t >= NF_TEST_PHY0) &&
+				    nfu_test_log(c, t, prev[t].ntr_errors) != 0)
+					goto fail;
+		}
+		polls++;
+	} while (sec < seconds);
+
+	printf("%-12s %-8s %12s %12s %8s %10s %10s %s\n", "card", "engine",
+	    "runs", "per second", "bad", "errors", "error rate", "result");
+	failed = 0;
+	accesses = 0;
+	for (i = 0; i < cards_num; i++) {
+		c = &cards[i];
+		for (t = 0; t < NF_TEST_NUM; t++) {
+			if ((mask & (1U << t)) == 0)
+				continue;
+			r = &c->res[t];
+			bad = r->ntr_bad != 0 || r->ntr_errors != 0;
+			failed += r->ntr_runs == 0 || bad;
+			printf("%-12s %-8s %12ju %12.1f %8ju %10ju %10.3g %s\n",
+			    c->name, nf_test_name(t), (uintmax_t)r->ntr_runs,
+			    r->ntr_runs / sec, (uintmax_t)r->ntr_bad,
+			    (uintmax_t)r->ntr_errors, r->ntr_runs > 0 ?
+			    (double)r->ntr_errors / r->ntr_runs : 0,
+			    r->ntr_runs == 0 ? "IDLE" : bad ? "FAIL" : "ok");
+		}
+		nf_stats_get(c->nf, &st);
+		accesses += st.st_reads + st.st_writes;
+	}
+	if (!flag_quiet)
+		printf("%d cards for %.3f s, seed %#lx, %d polls, %lu register "
+		    "accesses\n", cards_num, sec, seed, polls, accesses);
+	if (failed) {
+		fprintf(stderr, "%d engines failed or didn't run", failed);
+		error = -1;
+	}
+	goto out;
+fail:
+	fprintf(stderr, "%s: %s", c->name, nf_strerror(c->nf));
+	error = -1;
+	for (i = 0; i < cards_num; i++)
+		(void)nf_test_stop(cards[i].nf, mask);
+out:
+	for (i = 1; i < cards_num; i++) {
+		(void)nf_stop(cards[i].nf);
+		free(cards[i].nf);
+	}
+	return (error);
+}
+
+#define NFU_SHAPE_MS		200
+#define NFU_SHAPE_TOL		5	/* % */
+
+/*
+ * Parse [-p <port>] [-m <ms>] [-t <tolerance %>] <value> of shape
+ * commands.
+ */
+static int
+nfu_shape_args(int argc, char **argv, struct nf_shape_cal *cal,
+    double *value, const char *what)
+{
+	double tol;
+
+	memset(cal, 0, sizeof(*cal));
+	cal->nsc_ms = NFU_SHAPE_MS;
+	cal->nsc_tol = NFU_SHAPE_TOL / 100.0;
+	for (argc--, argv++; argc > 2 && argv[0][0] == '-'; argc -= 2,
+	    argv += 2) {
+		if (strcmp(argv[0], "-p") == 0 &&
+		    sscanf(argv[1], "%d", &cal->nsc_port) == 1)
+			continue;
+		if (strcmp(argv[0], "-m") == 0 &&
+		    sscanf(argv[1], "%u", &cal->nsc_ms) == 1 && cal->nsc_ms > 0)
+			continue;
+		if (strcmp(argv[0], "-t") == 0 &&
+		    sscanf(argv[1], "%lf", &tol) == 1 && tol > 0) {
+			cal->nsc_tol = tol / 100.0;
+			continue;
+		}
+		fprintf(stderr, "Bad option '%s %s'", argv[0], argv[1]);
+		return -1;
+	}
+	if (argc != 1 || sscanf(argv[0], "%lf", value) != 1 || *value < 0) {
+		fprintf(stderr, "Command requires an argument <%s>", what);
+		return -1;
+	}
+	return (0);
+}
+
+/*
+ * Set the rate limiter so that the port sends <Mb/s>.
+ */
+static int
+nfu_shape_rate(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_shape_cal cal;
+	double mbps;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (nfu_shape_args(argc, argv, &cal, &mbps, "Mb/s") != 0)
+		return -1;
+	if (nf_shape_rate(nf, mbps * 1e6 / 8, &cal) != 0)
+		return (nfu_nf_error(nf));
+	if (!flag_quiet) {
+		if (cal.nsc_enabled)
+			printf("Port %d: shift %u, ", cal.nsc_port,
+			    cal.nsc_value);
+		else
+			printf("Port %d: rate limiter off, ", cal.nsc_port);
+		printf("%.3f Mb/s for %.3f Mb/s wanted, %d measurements\n",
+		    cal.nsc_got * 8 / 1e6, mbps, cal.nsc_iters);
+	}
+	if (!cal.nsc_ok) {
+		fprintf(stderr, "No setting within %.1f%% of %.3f Mb/s",
+		    cal.nsc_tol * 100, mbps);
+		return -1;
+	}
+	return (0);
+}
+
+/*
+ * Set the delay module so that packets take <us> longer.
+ */
+static int
+nfu_shape_delay(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_shape_cal cal;
+	double us;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (nfu_shape_args(argc, argv, &cal, &us, "us") != 0)
+		return -1;
+	if (nf_shape_delay(nf, us * 1000, &cal) != 0)
+		return (nfu_nf_error(nf));
+	if (!flag_quiet) {
+		if (cal.nsc_enabled)
+			printf("Port %d: length %u, ", cal.nsc_port,
+			    cal.nsc_value);
+		else
+			printf("Port %d: delay off, ", cal.nsc_port);
+		printf("%.3f us for %.3f us wanted, %d measurements\n",
+		    cal.nsc_got / 1000, us, cal.nsc_iters);
+	}
+	if (!cal.nsc_ok) {
+		fprintf(stderr, "No setting within %.1f%% of %.3f us",
+		    cal.nsc_tol * 100, us);
+		return -1;
+	}
+	return (0);
+}
+
+static int
+nfu_shape_off(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+
+	(void)argv;
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (argc != 1) {
+		fprintf(stderr, "Command takes no arguments");
+		return -1;
+	}
+	if (nf_shape_off(nf) != 0)
+		return (nfu_nf_error(nf));
+	return (0);
+}
+
+#define NFU_LINK_POLL_MS	100	/* Without driver's link monitor */
+
+static int
+nfu_link_show(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_link lk;
+	int i;
+
+	(void)argv;
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	if (argc != 1) {
+		fprintf(stderr, "Command takes no arguments");
+		return -1;
+	}
+	if (nf_link_read(nf, &lk) != 0)
+		return (nfu_nf_error(nf));
+	printf("%-6s %-5s %s\n", "port", "link", "changes");
+	for (i = 0; i < NF_LINK_PORTS; i++) {
+		printf("nf2c%d  %-5s ", i, (lk.nl_up & (1 << i)) ? "up" :
+		    "down");
+		if (lk.nl_driver)
+			printf("%u\n", lk.nl_changes[i]);
+		else
+			printf("-\n");
+	}
+	return (0);
+}
+
+/*
+ * Print link changes for [<seconds>] or forever. Drivers with a link
+ * monitor wake us up on changes; otherwise MDIO status is polled.
+ */
+static int
+nfu_link_watch(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nf_link lk, prev;
+	struct timespec ts0, ts1;
+	double seconds, t;
+	uint32_t events;
+	int i, timeout, ret;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	seconds = -1;
+	if (argc > 2 || (argc == 2 && (sscanf(argv[1], "%lf", &seconds) != 1 ||
+	    seconds <= 0))) {
+		fprintf(stderr, "Command takes an optional argument "
+		    "<seconds>");
+		return -1;
+	}
+	if (nf_link_read(nf, &prev) != 0)
+		return (nfu_nf_error(nf));
+	if (!flag_quiet)
+		printf("Links up %#x, %s\n", prev.nl_up, prev.nl_driver ?
+		    "driver's monitor" : "polling MDIO status");
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	for (t = 0; seconds < 0 || t < seconds; ) {
+		timeout = prev.nl_driver ? -1 : NFU_LINK_POLL_MS;
+		if (seconds > 0 && (timeout < 0 ||
+		    timeout > (seconds - t) * 1000))
+			timeout = (seconds - t) * 1000 + 1;
+		ret = nf_wait_event(nf, INT_PHY_INTERRUPT, &events, timeout);
+		if (ret < 0)
+			return (nfu_nf_error(nf));
+		if (nf_link_read(nf, &lk) != 0)
+			return (nfu_nf_error(nf));
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		t = (ts1.tv_sec - ts0.tv_sec) +
+		    (ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+		for (i = 0; i < NF_LINK_PORTS; i++) {
+			if (((lk.nl_up ^ prev.nl_up) & (1 << i)) == 0 &&
+			    lk.nl_changes[i] == prev.nl_changes[i])
+				continue;
+			printf("%.3f nf2c%d %s", t, i, (lk.nl_up & (1 << i)) ?
+			    "up" : "down");
+			if (lk.nl_driver)
+				printf(", %u changes", lk.nl_changes[i] -
+				    prev.nl_changes[i]);
+			printf("\n");
+		}
+		fflush(stdout);
+		prev = lk;
+	}
+	return (0);
+}
+
+/*
+ * Batch mode. Commands are read one per line, in the command line
+ * syntax, and run over one library context. Runs of "reg read" and
+ * "reg write" are held back and done as one nf_regv() transfer when
+ * something else comes up, the run gets NFU_BATCH_OPS long or input
+ * ends; their output is still printed in order. Which operations of a
+ * failed transfer were done isn't known, so all of them count as
+ * failed commands.
+ */
+#define NFU_BATCH_ARGS	32	/* Words per command */
+#define NFU_BATCH_OPS	256	/* Register operations per transfer */
+
+struct nfu_batch {
+	struct netfpga	*nb_nf;
+	int		 nb_timing;
+	int		 nb_keep;
+	int		 nb_failed;	/* Commands */
+	int		 nb_ops_num;
+	struct nf_regop	 nb_ops[NFU_BATCH_OPS];
+	int		 nb_lines[NFU_BATCH_OPS];
+	char		*nb_names[NFU_BATCH_OPS];	/* As written */
+};
+
+/*
+ * Do held back register operations. Time of the transfer is split
+ * evenly between them. Returns the number of commands that failed.
+ */
+static int
+nfu_batch_flush(struct nfu_batch *nb)
+{
+	struct timespec ts0, ts1;
+	double us;
+	int i, n;
+
+	n = nb->nb_ops_num;
+	if (n == 0)
+		return (0);
+	nb->nb_ops_num = 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	if (nf_regv(nb->nb_nf, nb->nb_ops, n) != n) {
+		fprintf(stderr, "lines %d-%d: %s\n", nb->nb_lines[0],
+		    nb->nb_lines[n - 1], nf_strerror(nb->nb_nf));
+		for (i = 0; i < n; i++)
+			free(nb->nb_names[i]);
+		nb->nb_failed += n;
+		return (n);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	us = nfu_batch_us(&ts0, &ts1);
+	for (i = 0; i < n; i++) {
+		if (nb->nb_ops[i].nro_op == NF_REGOP_READ)
+			nfu_reg_print(nb->nb_names[i], nb->nb_ops[i].nro_value);
+		if (nb->nb_timing)
+			fprintf(stderr, "line %d: %.1f us (%d in transfer)\n",
+			    nb->nb_lines[i], us / n, n);
+		free(nb->nb_names[i]);
+	}
+	return (0);
+}
+
+/*
+ * Hold back "reg read <reg>" or "reg write <reg> <value>". Returns 1
+ * if the command was something else, -1 if it's wrong, and 0 without
+ * holding it back if flushing the run failed and we don't keep going.
+ */
+static int
+nfu_batch_reg(struct nfu_batch *nb, int line, int argc, char **argv)
+{
+	struct nf_regop *op;
+	uint32_t reg, value;
+	int write;
+
+	if (argc < 2 || strcmp(argv[0], "reg") != 0)
+		return (1);
+	if (argc == 3 && strcmp(argv[1], "read") == 0)
+		write = 0;
+	else if (argc == 4 && strcmp(argv[1], "write") == 0)
+		write = 1;
+	else
+		return (1);
+	value = 0;
+	if (nfu_reg_parse(nb->nb_nf, argv[2], &reg) != 0 || reg % 4 != 0) {
+		/* Keep output in order */
+		if (nfu_batch_flush(nb) != 0 && !nb->nb_keep)
+			return (0);
+		fprintf(stderr, "line %d: Register '%s' is wrong\n", line,
+		    argv[2]);
+		return (-1);
+	}
+	if (write && nfu_value_parse(argv[3], &value) != 0) {
+		if (nfu_batch_flush(nb) != 0 && !nb->nb_keep)
+			return (0);
+		fprintf(stderr, "line %d: Value format '%s' is wrong\n",
+		    line, argv[3]);
+		return (-1);
+	}
+	if (nb->nb_ops_num == NFU_BATCH_OPS && nfu_batch_flush(nb) != 0 &&
+	    !nb->nb_keep)
+		return (0);
+	op = &nb->nb_ops[nb->nb_ops_num];
+	op->nro_op = write ? NF_REGOP_WRITE : NF_REGOP_READ;
+	op->nro_reg = reg;
+	op->nro_value = value;
+	nb->nb_lines[nb->nb_ops_num] = line;
+	nb->nb_names[nb->nb_ops_num] = strdup(argv[2]);
+	if (nb->nb_names[nb->nb_ops_num] == NULL)
+		err(EXIT_FAILURE, "strdup");
+	nb->nb_ops_num++;
+	return (0);
+}
+
+/*
+ * Run commands from <file> or standard input. Stops at the first
+ * failing command unless -k is given; -t prints time taken by each
+ * command to standard error.
+ */
+static int
+nfu_batch_run(struct cla *cla, int argc, char **argv)
+{
+	static struct nfu_batch nb;
+	struct timespec ts0, ts1;
+	char line[1024];
+	char *words[NFU_BATCH_ARGS + 1];
+	char *p, *w;
+	FILE *fp;
+	int lineno, n, ret;
+
+	memset(&nb, 0, sizeof(nb));
+	nb.nb_nf = cla_get_func_arg(cla);
+	nf_assert(nb.nb_nf);
+	for (argc--, argv++; argc > 0 && argv[0][0] == '-' &&
+	    argv[0][1] != '\0'; argc--, argv++) {
+		if (strcmp(argv[0], "-k") == 0)
+			nb.nb_keep = 1;
+		else if (strcmp(argv[0], "-t") == 0)
+			nb.nb_timing = 1;
+		else {
+			fprintf(stderr, "Bad option '%s'", argv[0]);
+			return -1;
+		}
+	}
+	if (argc > 1) {
+		fprintf(stderr, "Command takes an optional argument <file>");
+		return -1;
+	}
+	fp = stdin;
+	if (argc == 1 && strcmp(argv[0], "-") != 0) {
+		fp = fopen(argv[0], "r");
+		if (fp == NULL) {
+			fprintf(stderr, "Couldn't open '%s': %s", argv[0],
+			    strerror(errno));
+			return -1;
+		}
+	}
+
+	for (lineno = 1; fgets(line, sizeof(line), fp) != NULL; lineno++) {
+		p = strchr(line, '#');
+		if (p != NULL)
+			*p = '\0';
+		p = line;
+		words[0] = "nfutil";
+		n = 1;
+		while ((w = strsep(&p, " \t\r\n")) != NULL) {
+			if (*w == '\0')
+				continue;
+			if (n == NFU_BATCH_ARGS)
+				break;
+			words[n++] = w;
+		}
+		words[n] = NULL;
+		if (n == 1)
+			continue;
+		if (w != NULL) {
+			fprintf(stderr, "line %d: More than %d words\n",
+			    lineno, NFU_BATCH_ARGS - 1);
+			ret = -1;
+		} else if (strcmp(words[1], "batch") == 0) {
+			fprintf(stderr, "line %d: Batches don't nest\n",
+			    lineno);
+			ret = -1;
+		} else
+			ret = nfu_batch_reg(&nb, lineno, n - 1, words + 1);
+		if (ret == 1) {
+			/* Anything else goes through the command tree */
+			ret = 0;
+			if (nfu_batch_flush(&nb) == 0 || nb.nb_keep) {
+				clock_gettime(CLOCK_MONOTONIC, &ts0);
+				ret = cla_dispatch(nfu_cmdtree, "Usage:\n", n,
+				    words, CLADIS_NODE_USAGE);
+				clock_gettime(CLOCK_MONOTONIC, &ts1);
+				if (ret != 0)
+					fprintf(stderr, "\nline %d: %s\n",
+					    lineno, cla_strerror(ret));
+				else if (nb.nb_timing)
+					fprintf(stderr, "line %d: %.1f us\n",
+					    lineno, nfu_batch_us(&ts0, &ts1));
+			}
+		}
+		if (ret != 0)
+			nb.nb_failed++;
+		if (nb.nb_failed != 0 && !nb.nb_keep)
+			break;
+	}
+	(void)nfu_batch_flush(&nb);
+	ret = ferror(fp);
+	if (fp != stdin)
+		fclose(fp);
+	if (ret != 0) {
+		fprintf(stderr, "Couldn't read commands");
+		return -1;
+	}
+	if (nb.nb_failed != 0) {
+		fprintf(stderr, "%d command(s) failed", nb.nb_failed);
+		return -1;
+	}
+	return (0);
+}
+
+/*
+ * Network server for the library's "net" module. Clients are served
+ * from one poll() loop, since there's one library context; each gets
+ * at most NFU_SERVER_BURST requests done per round, so a client with a
+ * deep pipeline can't starve the others. A client isn't read from
+ * while replies it doesn't take pile up.
+ */
+#define NFU_SERVER_CLIENTS	32
+#define NFU_SERVER_BURST	16
+#define NFU_SERVER_IN		(2 * NF_NET_FRAME_MAX)
+#define NFU_SERVER_OUT		(4 * NF_NET_FRAME_MAX)
+
+struct nfu_client {
+	int		 fd;
+	char		 name[64];
+	uint8_t		*in;
+	size_t		 in_len;
+	uint8_t		*out;
+	size_t		 out_off;
+	size_t		 out_len;
+	unsigned long	 reqs;
+};
+
+static int
+nfu_server_listen(const char *addr, const char *port)
+{
+	struct addrinfo hints, *res, *ai;
+	int error, fd, one;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	error = getaddrinfo(addr, port, &hints, &res);
+	if (error != 0) {
+		fprintf(stderr, "Couldn't resolve '%s' port '%s': %s", addr,
+		    port, gai_strerror(error));
+		return (-1);
+	}
+	fd = -1;
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		one = 1;
+		(void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one,
+		    sizeof(one));
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+		    listen(fd, NFU_SERVER_CLIENTS) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	error = errno;
+	freeaddrinfo(res);
+	if (fd < 0)
+		fprintf(stderr, "Couldn't listen on %s port %s: %s", addr,
+		    port, strerror(error));
+	return (fd);
+}
+
+static void
+nfu_server_accept(int lfd, struct nfu_client *cl, int *cl_num)
+{
+	struct sockaddr_storage ss;
+	struct nfu_client *c;
+	socklen_t sslen;
+	char host[48], port[8];
+	int fd, one;
+
+	sslen = sizeof(ss);
+	fd = accept(lfd, (struct sockaddr *)&ss, &sslen);
+	if (fd < 0)
+		return;
+	one = 1;
+	(void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	(void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	c = &cl[(*cl_num)++];
+	memset(c, 0, sizeof(*c));
+	c->fd = fd;
+	if (getnameinfo((struct sockaddr *)&ss, sslen, host, sizeof(host),
+	    port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+		snprintf(host, sizeof(host), "?");
+	snprintf(c->name, sizeof(c->name), "%s port %s", host, port);
+	c->in = malloc(NFU_SERVER_IN);
+	c->out = malloc(NFU_SERVER_OUT);
+	if (c->in == NULL || c->out == NULL)
+		err(EXIT_FAILURE, "malloc");
+	if (!flag_quiet)
+		printf("Client %s connected\n", c->name);
+}
+
+static void
+nfu_server_drop(struct nfu_client *cl, int *cl_num, int i, const char *why)
+{
+	struct nfu_client *c;
+
+	c = &cl[i];
+	if (!flag_quiet)
+		printf("Client %s %s, %lu requests\n", c->name, why, c->reqs);
+	close(c->fd);
+	free(c->in);
+	free(c->out);
+	cl[i] = cl[--(*cl_num)];
+}
+
+/*
+ * Do up to NFU_SERVER_BURST of client's requests. Returns 1 if there
+ * are more to do, 0 if not and -1 if the client sent garbage.
+ */
+static int
+nfu_server_serve(struct netfpga *nf, struct nfu_client *c)
+{
+	size_t off;
+	int flen, n;
+
+	if (c->out_off > 0 && c->out_len + NF_NET_FRAME_MAX > NFU_SERVER_OUT) {
+		memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+		c->out_len -= c->out_off;
+		c->out_off = 0;
+	}
+	flen = 0;
+	for (off = n = 0; n < NFU_SERVER_BURST; n++, off += flen) {
+		if (c->out_len + NF_NET_FRAME_MAX > NFU_SERVER_OUT)
+			break;
+		flen = nf_net_frame(c->in + off, c->in_len - off);
+		if (flen < 0)
+			return (-1);
+		if (flen == 0)
+			break;
+		c->out_len += nf_net_exec(nf, c->in + off, c->out + c->out_len);
+		c->reqs++;
+	}
+	memmove(c->in, c->in + off, c->in_len - off);
+	c->in_len -= off;
+	return (nf_net_frame(c->in, c->in_len) != 0);
+}
+
+/*
+ * Serve the card over TCP to the "net" module of other hosts' library,
+ * on loopback unless told otherwise: there's no authentication.
+ */
+static int
+nfu_server(struct cla *cla, int argc, char **argv)
+{
+	struct netfpga *nf;
+	struct nfu_client cl[NFU_SERVER_CLIENTS], *c;
+	struct pollfd pfd[1 + NFU_SERVER_CLIENTS];
+	char defport[8];
+	const char *addr, *port;
+	ssize_t n;
+	int lfd, cl_num, busy, i, ret;
+
+	nf = cla_get_func_arg(cla);
+	nf_assert(nf);
+	addr = "127.0.0.1";
+	snprintf(defport, sizeof(defport), "%d", NF_NET_PORT);
+	port = defport;
+	for (argc--, argv++; argc >= 2 && argv[0][0] == '-'; argc -= 2,
+	    argv += 2) {
+		if (strcmp(argv[0], "-l") == 0)
+			addr = argv[1];
+		else if (strcmp(argv[0], "-p") == 0)
+			port = argv[1];
+		else
+			break;
+	}
+	if (argc != 0) {
+		fprintf(stderr, "Bad argument '%s'", argv[0]);
+		return -1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	lfd = nfu_server_listen(addr, port);
+	if (lfd < 0)
+		return -1;
+	if (!flag_quiet)
+		printf("Serving card on %s port %s\n", addr, port);
+
+	cl_num = 0;
+	busy = 0;
+	for (;;) {
+		pfd[0].fd = lfd;
+		pfd[0].events = (cl_num < NFU_SERVER_CLIENTS) ? POLLIN : 0;
+		for (i = 0; i < cl_num; i++) {
+			c = &cl[i];
+			pfd[1 + i].fd = c->fd;
+			pfd[1 + i].events = 0;
+			if (c->in_len < NFU_SERVER_IN &&
+			    c->out_len + NF_NET_FRAME_MAX <= NFU_SERVER_OUT)
+				pfd[1 + i].events |= POLLIN;
+			if (c->out_len > c->out_off)
+				pfd[1 + i].events |= POLLOUT;
+		}
+		ret = poll(pfd, 1 + cl_num, busy ? 0 : -1);
+		if (ret < 0 && errno != EINTR)
+			err(EXIT_FAILURE, "poll");
+		if (ret < 0)
+			continue;
+
+		/* Clients may move around when one goes away, go backwards */
+		busy = 0;
+		for (i = cl_num - 1; i >= 0; i--) {
+			c = &cl[i];
+			if (pfd[1 + i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				n = recv(c->fd, c->in + c->in_len,
+				    NFU_SERVER_IN - c->in_len, 0);
+				if (n == 0 || (n < 0 && errno != EAGAIN &&
+				    errno != EINTR)) {
+					nfu_server_drop(cl, &cl_num, i,
+					    "went away");
+					continue;
+				}
+				if (n > 0)
+					c->in_len += n;
+			}
+			ret = nfu_server_serve(nf, c);
+			if (ret < 0) {
+				nfu_server_drop(cl, &cl_num, i, "sent garbage");
+				continue;
+			}
+			busy |= ret;
+			if (c->out_len > c->out_off) {
+				n = send(c->fd, c->out + c->out_off,
+				    c->out_len - c->out_off, 0);
+				if (n > 0)
+					c->out_off += n;
+				if (c->out_off == c->out_len)
+					c->out_off = c->out_len = 0;
+			}
+		}
+		if (pfd[0].revents & POLLIN)
+			nfu_server_accept(lfd, cl, &cl_num);
+	}
+	/* NOTREACHED */
+	return (0);
+}
+
+/*
+ * Build command line tree for nfutil(8).
+ */
+static struct cla *
+nfu_cmdlist_build(void *softc)
+{
+	struct cla *nf;
+	struct cla *reg;
+	struct cla *cpci;
+	struct cla *cnet;
+	struct cla *cnet_write;
+	struct cla *cnet_info;
+	struct cla *cpci_write;
+	struct cla *cpci_info;
+	struct cla *reg_read;
+	struct cla *reg_write;
+	struct cla *reg_list;
+	struct cla *reg_snapshot;
+	struct cla *reg_diff;
+	struct cla *reg_watch;
+	struct cla *event;
+	struct cla *event_wait;
+	struct cla *sw;
+	struct cla *sw_lut;
+	struct cla *filter;
+	struct cla *filter_list;
+	struct cla *filter_load;
+	struct cla *filter_add;
+	struct cla *filter_del;
+	struct cla *router;
+	struct cla *router_model;
+	struct cla *evcap;
+	struct cla *evcap_start;
+	struct cla *evcap_stop;
+	struct cla *evcap_stats;
+	struct cla *hwtime;
+	struct cla *hwtime_sync;
+	struct cla *oq;
+	struct cla *oq_watch;
+	struct cla *oq_stats;
+	struct cla *oq_plan;
+	struct cla *sram;
+	struct cla *sram_dump;
+	struct cla *sram_load;
+	struct cla *selftest;
+	struct cla *selftest_run;
+	struct cla *shape;
+	struct cla *shape_rate;
+	struct cla *shape_delay;
+	struct cla *shape_off;
+	struct cla *link;
+	struct cla *link_show;
+	struct cla *link_watch;
+	struct cla *batch;
+	struct cla *batch_run;
+	struct cla *server;
+	struct cla *server_start;
+
+	nf = cla_new(NULL, NULL, NULL, NULL, "nfutil");
+	reg = cla_new(NULL, NULL, NULL, NULL, "reg");
+	cpci = cla_new(NULL, NULL, NULL, NULL, "cpci");
+	cnet = cla_new(NULL, NULL, NULL, NULL, "cnet");
+	event = cla_new(NULL, NULL, NULL, NULL, "event");
+	sw = cla_new(NULL, NULL, NULL, NULL, "switch");
+	filter = cla_new(NULL, NULL, NULL, NULL, "filter");
+	router = cla_new(NULL, NULL, NULL, NULL, "router");
+	evcap = cla_new(NULL, NULL, NULL, NULL, "evcap");
+	hwtime = cla_new(NULL, NULL, NULL, NULL, "hwtime");
+	oq = cla_new(NULL, NULL, NULL, NULL, "oq");
+	sram = cla_new(NULL, NULL, NULL, NULL, "sram");
+	selftest = cla_new(NULL, NULL, NULL, NULL, "selftest");
+	shape = cla_new(NULL, NULL, NULL, NULL, "shape");
+	link = cla_new(NULL, NULL, NULL, NULL, "link");
+	batch = cla_new(NULL, NULL, NULL, NULL, "batch");
+	server = cla_new(NULL, NULL, NULL, NULL, "server");
+
+	cnet_write = cla_new(nfu_cnet_write, NULL, NULL,
+	    "Write CNET bitstream", "write <file>");
+	cnet_info = cla_new(nfu_cnet_info, NULL, NULL,
+	    "Obtain information about CNET bitstream", "info");
+	cla_add_subcmd(cnet, cnet_write);
+	cla_add_subcmd(cnet, cnet_info);
+
+	reg_read = cla_new(nfu_reg_read, NULL, NULL,
+	    "Reads NetFPGA register", "read <reg>");
+	reg_write = cla_new(nfu_reg_write, NULL, NULL,
+	    "Writes NetFPGA register", "write <reg> <value>");
+	reg_list = cla_new(nfu_reg_list, NULL, NULL,
+	    "Lists all NetFPGA registers", "list");
+	cla_add_subcmd(reg, reg_read);
+	cla_add_subcmd(reg, reg_write);
+	reg_snapshot = cla_new(nfu_reg_snapshot, NULL, NULL,
+	    "Saves all NetFPGA registers",
+	    "snapshot [-c] [-r <lo>-<hi>] ... <file>");
+	reg_diff = cla_new(nfu_reg_diff, NULL, NULL,
+	    "Shows registers which changed", "diff <old> [<new>]");
+	cla_add_subcmd(reg, reg_list);
+	cla_add_subcmd(reg, reg_snapshot);
+	reg_watch = cla_new(nfu_reg_watch, NULL, NULL,
+	    "Prints register changes and fired triggers",
+	    "watch [-p <us>] [-d <seconds>] [-t <trigger>] ... "
+	    "[-s <prefix>] <reg> ...");
+	cla_add_subcmd(reg, reg_diff);
+	cla_add_subcmd(reg, reg_watch);
+
+	cpci_write = cla_new(nfu_cpci_write, NULL, NULL,
+	    "Write CPCI bitstream", "write <file>");
+	cpci_info = cla_new(nfu_cpci_info, NULL, NULL,
+	    "Obtain information about CPCI bitstream", "info");
+	cla_add_subcmd(cpci, cpci_write);
+	cla_add_subcmd(cpci, cpci_info);
+
+	event_wait = cla_new(nfu_event_wait, NULL, NULL,
+	    "Waits for interrupts (INT_* bits)", "wait [-p] <mask> [<timeout>]");
+	cla_add_subcmd(event, event_wait);
+
+	sw_lut = cla_new(nfu_switch_lut, NULL, NULL,
+	    "Dumps switch MAC table, -w shows changes",
+	    "lut [-w <interval> [<count>]]");
+	cla_add_subcmd(sw, sw_lut);
+
+	filter_list = cla_new(nfu_filter_list, NULL, NULL,
+	    "Lists router's destination IP filter", "list");
+	filter_load = cla_new(nfu_filter_load, NULL, NULL,
+	    "Replaces filtered addresses with ones from a file",
+	    "load <file>");
+	filter_add = cla_new(nfu_filter_add, NULL, NULL,
+	    "Adds address to the filter", "add <ip>");
+	filter_del = cla_new(nfu_filter_del, NULL, NULL,
+	    "Removes address from the filter", "del <ip>");
+	cla_add_subcmd(filter, filter_list);
+	cla_add_subcmd(filter, filter_load);
+	cla_add_subcmd(filter, filter_add);
+	cla_add_subcmd(filter, filter_del);
+
+	router_model = cla_new(nfu_router_model, NULL, NULL,
+	    "Predicts router's counters for a pcap file",
+	    "model [-c] [-p <port>] <pcap>");
+	cla_add_subcmd(router, router_model);
+
+	evcap_start = cla_new(nfu_evcap_start, NULL, NULL,
+	    "Starts event capture to a UDP receiver",
+	    "start [-r <res>] [-q <queues>] [-e <events>] [-p <port>] "
+	    "<ip> <udp port>");
+	evcap_stop = cla_new(nfu_evcap_stop, NULL, NULL,
+	    "Stops event capture", "stop");
+	evcap_stats = cla_new(nfu_evcap_stats, NULL, NULL,
+	    "Prints event capture counters", "stats");
+	cla_add_subcmd(evcap, evcap_start);
+	cla_add_subcmd(evcap, evcap_stop);
+	cla_add_subcmd(evcap, evcap_stats);
+
+	hwtime_sync = cla_new(nfu_hwtime_sync, NULL, NULL,
+	    "Maps stamp counter to host time", "sync [<interval> [<count>]]");
+	cla_add_subcmd(hwtime, hwtime_sync);
+
+	oq_watch = cla_new(nfu_oq_watch, NULL, NULL,
+	    "Samples output queues and prints microbursts",
+	    "watch [-p <period us>] [-t <pkts>] <seconds>");
+	oq_stats = cla_new(nfu_oq_stats, NULL, NULL,
+	    "Samples output queues and prints occupancy and drops",
+	    "stats [-p <period us>] [-w <window ms>] <seconds>");
+	oq_plan = cla_new(nfu_oq_plan, NULL, NULL,
+	    "Plans output queue SRAM split, -a applies it",
+	    "plan [-a] [-f <profile>] [-p <period us>] [-w <window ms>] "
+	    "<seconds>");
+	cla_add_subcmd(oq, oq_watch);
+	cla_add_subcmd(oq, oq_stats);
+	cla_add_subcmd(oq, oq_plan);
+
+	sram_dump = cla_new(nfu_sram_dump, NULL, NULL,
+	    "Dumps SRAM bank to a file", "dump <bank> <file>");
+	sram_load = cla_new(nfu_sram_load, NULL, NULL,
+	    "Loads SRAM bank from a file", "load <bank> <file>");
+	cla_add_subcmd(sram, sram_dump);
+	cla_add_subcmd(sram, sram_load);
+
+	selftest_run = cla_new(nfu_selftest_run, NULL, NULL,
+	    "Runs self-test engines on this and other cards",
+	    "run [-e <engine,...>] [-s <seed>] <seconds> [<iface> ...]");
+	cla_add_subcmd(selftest, selftest_run);
+
+	shape_rate = cla_new(nfu_shape_rate, NULL, NULL,
+	    "Sets rate limiter by measuring the port",
+	    "rate [-p <port>] [-m <ms>] [-t <tolerance %>] <Mb/s>");
+	shape_delay = cla_new(nfu_shape_delay, NULL, NULL,
+	    "Sets delay module by measuring the port",
+	    "delay [-p <port>] [-m <ms>] [-t <tolerance %>] <us>");
+	shape_off = cla_new(nfu_shape_off, NULL, NULL,
+	    "Turns rate limiter and delay module off", "off");
+	cla_add_subcmd(shape, shape_rate);
+	cla_add_subcmd(shape, shape_delay);
+	cla_add_subcmd(shape, shape_off);
+
+	link_show = cla_new(nfu_link_show, NULL, NULL,
+	    "Prints ports' link state", "show");
+	link_watch = cla_new(nfu_link_watch, NULL, NULL,
+	    "Prints link changes as they happen", "watch [<seconds>]");
+	cla_add_subcmd(link, link_show);
+	cla_add_subcmd(link, link_watch);
+
+	batch_run = cla_new(nfu_batch_run, NULL, NULL,
+	    "Runs commands, one per line, from a file or standard input",
+	    "run [-k] [-t] [<file>]");
+	cla_add_subcmd(batch, batch_run);
+
+	server_start = cla_new(nfu_server, NULL, NULL,
+	    "Serves the card to \"-m net\" clients over TCP",
+	    "start [-l <addr>] [-p <port>]");
+	cla_add_subcmd(server, server_start);
 
 	cla_add_cmd(reg, cpci);
 	cla_add_cmd(cpci, cnet);
+	cla_add_cmd(cnet, event);
+	cla_add_cmd(event, sw);
+	cla_add_cmd(sw, filter);
+	cla_add_cmd(filter, router);
+	cla_add_cmd(router, evcap);
+	cla_add_cmd(evcap, hwtime);
+	cla_add_cmd(hwtime, oq);
+	cla_add_cmd(oq, sram);
+	cla_add_cmd(sram, selftest);
+	cla_add_cmd(selftest, shape);
+	cla_add_cmd(shape, link);
+	cla_add_cmd(link, batch);
+	cla_add_cmd(batch, server);
 
 	cla_add_subcmd(nf, reg);
 	cla_set_func_arg(nf, softc);
@@ -323,7 +2666,7 @@ main(int argc, char **argv)
 	if (strcmp(argv[0], "./nfutil") == 0)
 		its_nfutil = 1;
 
-	while ((o = getopt(argc, argv, "i:m:qvh")) != -1)
+	while ((o = getopt(argc, argv, "+i:m:qvh")) != -1)
 		switch (o) {
 		case 'i':
 			arg_iface = optarg;
@@ -351,9 +2694,11 @@ main(int argc, char **argv)
 	nf_init(&nf);
 	nf.nf_iface = arg_iface;
 	nf.nf_verbose = flag_verbose;
+	nf.nf_quiet = flag_quiet;
 	nf.nf_module = arg_module;
 
 	cmdtree = nfu_cmdlist_build(&nf);
+	nfu_cmdtree = cmdtree;
 	if (flag_help) {
 		cla_print(cmdtree);
 		exit(0);
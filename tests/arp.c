@@ -0,0 +1,192 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * ARP table manager: the hash from next hop to slot must find every
+ * entry after any mix of inserts and deletes, including clusters that
+ * wrap around the end of the hash, and eviction must pick the least
+ * used entry which isn't static.
+ */
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netfpga.h"
+
+#define	POOL_NUM	48
+
+#define	CHECK(c)	do {						\
+	if (!(c))							\
+		errx(EXIT_FAILURE, "line %d: %s", __LINE__, #c);	\
+} while (0)
+
+static struct netfpga nf;
+static struct nf_arp na;
+static uint32_t pool[POOL_NUM];
+static int present[POOL_NUM];
+static uint8_t macs[POOL_NUM][6];
+
+static u_int
+hash(uint32_t ip)
+{
+
+	return ((ip * 2654435761U) >> (32 - NF_ARP_HASH_BITS));
+}
+
+/*
+ * Next hops which all hash to bucket ``h''.
+ */
+static int
+collide(u_int h, uint32_t *ips, int num, uint32_t ip)
+{
+	int i;
+
+	for (i = 0; i < num; ip++)
+		if (hash(ip) == h)
+			ips[i++] = ip;
+	return (num);
+}
+
+static void
+verify(void)
+{
+	int i, s, n;
+
+	n = 0;
+	for (i = 0; i < POOL_NUM; i++) {
+		s = nf_arp_lookup(&na, pool[i]);
+		if (!present[i]) {
+			CHECK(s == -1);
+			continue;
+		}
+		n++;
+		CHECK(s >= 0 && s < NF_ARP_SIZE);
+		CHECK(na.na_ent[s].nae_ip == pool[i]);
+		CHECK(na.na_ent[s].nae_flags & NF_ARP_VALID);
+		CHECK(memcmp(na.na_ent[s].nae_mac, macs[i], 6) == 0);
+	}
+	CHECK(na.na_num == n);
+}
+
+static void
+test_churn(void)
+{
+	int i, k, n;
+
+	/* Two clusters meeting at the end of the hash, the rest random */
+	n = collide(NF_ARP_HASH_SIZE - 1, pool, 8, 0x0a000001);
+	n += collide(0, pool + n, 6, 0x0a000001);
+	n += collide(1, pool + n, 4, 0x0a000001);
+	for (; n < POOL_NUM; n++)
+		pool[n] = 0xc0a80000 | random() % 0xffff;
+	for (i = 0; i < POOL_NUM; i++) {
+		macs[i][0] = 0x00;
+		macs[i][1] = 0x4e;
+		macs[i][5] = i;
+	}
+
+	n = 0;
+	for (k = 0; k < 100000; k++) {
+		i = random() % POOL_NUM;
+		if (present[i] && random() % 2 == 0) {
+			CHECK(nf_arp_del(&na, pool[i]) == 0);
+			present[i] = 0;
+			n--;
+		} else if (present[i] || n < NF_ARP_SIZE) {
+			macs[i][4] = k;
+			CHECK(nf_arp_set(&na, pool[i], macs[i], 0) >= 0);
+			if (!present[i])
+				n++;
+			present[i] = 1;
+		}
+		verify();
+		if (k % 1000 == 0) {
+			CHECK(nf_arp_commit(&na) >= 0);
+			CHECK(na.na_dirty == 0);
+		}
+	}
+	CHECK(na.na_evictions == 0);
+	nf_arp_flush(&na);
+	memset(present, 0, sizeof(present));
+	verify();
+}
+
+static void
+test_evict(void)
+{
+	uint8_t mac[6] = { 0x00, 0x4e, 0x46, 0x32, 0x43, 0x00 };
+	uint32_t ip;
+	int s, i;
+
+	for (i = 0; i < NF_ARP_SIZE; i++)
+		CHECK(nf_arp_set(&na, 0x0a000100 + i, mac,
+		    i == 0 ? NF_ARP_STATIC : 0) >= 0);
+	for (i = 0; i < NF_ARP_SIZE; i++)
+		if (i != 7)
+			nf_arp_touch(&na, 0x0a000100 + i);
+	/* 0 is the least used, but static; 7 goes */
+	s = nf_arp_lookup(&na, 0x0a000107);
+	CHECK(nf_arp_set(&na, 0x0a000200, mac, 0) == s);
+	CHECK(nf_arp_lookup(&na, 0x0a000107) == -1);
+	CHECK(nf_arp_lookup(&na, 0x0a000100) >= 0);
+	CHECK(na.na_evictions == 1 && na.na_num == NF_ARP_SIZE);
+	for (i = 1; i < NF_ARP_SIZE; i++) {
+		ip = i == 7 ? 0x0a000200 : 0x0a000100 + i;
+		CHECK(nf_arp_lookup(&na, ip) >= 0);
+	}
+	/* Several changes to a slot cost one write */
+	CHECK(nf_arp_commit(&na) == NF_ARP_SIZE);
+	mac[5] = 1;
+	CHECK(nf_arp_set(&na, 0x0a000200, mac, 0) == s);
+	mac[5] = 2;
+	CHECK(nf_arp_set(&na, 0x0a000200, mac, 0) == s);
+	CHECK(nf_arp_commit(&na) == 1);
+	CHECK(nf_arp_commit(&na) == 0);
+}
+
+int
+main(void)
+{
+
+	srandom(1);
+	nf_init(&nf);
+	nf.nf_module = "sim";
+	nf.nf_iface = "design=router";
+	if (nf_start(&nf) != 0 || nf_arp_init(&nf, &na) != 0)
+		errx(EXIT_FAILURE, "%s", nf_strerror(&nf));
+	nf_arp_flush(&na);
+	test_churn();
+	test_evict();
+	return (EXIT_SUCCESS);
+}
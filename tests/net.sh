@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# Share a simulated card through "nfutil server" and nfbrokerd, and take
+# snapshots of it. Needs src/nfutil and src/nfbrokerd built.
+#
+set -e
+
+NFUTIL=${NFUTIL:-../src/nfutil/nfutil}
+NFBROKERD=${NFBROKERD:-../src/nfbrokerd/nfbrokerd}
+T=`mktemp -d`
+PIDS=
+trap 'kill $PIDS 2>/dev/null; rm -rf $T' EXIT
+
+# Tries the command for up to 5 seconds while a server starts
+retry() {
+	i=0
+	until "$@" > /dev/null 2>&1; do
+		i=`expr $i + 1`
+		[ $i -lt 50 ] || { echo "gave up on: $*"; exit 1; }
+		sleep 0.1
+	done
+}
+
+# Snapshot and diff, in one context so that the card is the same
+cat > $T/batch <<EOF
+reg snapshot -r 0x400000-0x40000c $T/a
+reg write 0x400004 9
+reg diff $T/a
+EOF
+v=`$NFUTIL -q -m sim batch run $T/batch`
+set -- $v
+[ "$1 $3 $4" = "0x400004 -> 0x9" ] || { echo "diff: $v"; exit 1; }
+# RD_DATA_WORD and RD_CTRL_WORD of CPU queue 0 would pop a packet
+v=`$NFUTIL -m sim reg snapshot -r 0x700000-0x70001c $T/b`
+case "$v" in
+"6 registers read"*) ;;
+*) echo "snapshot: $v"; exit 1 ;;
+esac
+
+# Net server
+PORT=`expr 17440 + $$ % 1000`
+$NFUTIL -q -m sim server start -p $PORT &
+PIDS="$PIDS $!"
+retry $NFUTIL -m net -i 127.0.0.1:$PORT reg read 0x400000
+$NFUTIL -m net -i 127.0.0.1:$PORT reg write 0x400000 0x1234
+v=`$NFUTIL -m net -i 127.0.0.1:$PORT reg read 0x400000`
+[ "$v" = "Register 0x400000 = 0x1234" ] || { echo "net: $v"; exit 1; }
+
+# Broker with a hot register sampled every second: a read after our
+# write mustn't get the sample from before it
+$NFBROKERD -m sim -s $T/sock -t 1000 -H 0x400000 > /dev/null 2>&1 &
+PIDS="$PIDS $!"
+retry $NFUTIL -m broker -i $T/sock reg read 0x400000
+printf 'reg write 0x400000 0x5\nreg list\nreg read 0x400000\n' > $T/batch
+v=`$NFUTIL -q -m broker -i $T/sock batch run $T/batch | tail -1`
+[ "$v" = "0x5" ] || { echo "broker: $v"; exit 1; }
+exit 0
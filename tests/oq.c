@@ -0,0 +1,112 @@
+/*-
+ * Copyright (c) 2009 HIIT <http://www.hiit.fi/>
+ * All rights reserved.
+ *
+ * Author: Wojciech A. Koszek <wkoszek@FreeBSD.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * Output queue planner: a fixed demand vector must always get the same
+ * plan, which covers the SRAM with one window per queue, gives busy
+ * queues more than idle ones and expects fewer drops than equal
+ * windows. The plan is then applied to a simulated card.
+ */
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netfpga.h"
+
+#define	CHECK(c)	do {						\
+	if (!(c))							\
+		errx(EXIT_FAILURE, "line %d: %s", __LINE__, #c);	\
+} while (0)
+
+#define	WORDS		(8 * 0x10000)	/* What the sim has */
+#define	QUANTUM		(WORDS / 256)
+#define	MIN_WORDS	(2 * NF_OQ_PKT_MAX / NF_OQ_WORD_BYTES + 1)
+
+/* Queue occupancy is spread evenly up to this many bytes */
+static const uint32_t demand[NF_OQ_QUEUES] = {
+	3000000, 1000000, 256000, 0, 0, 0, 0, 64000
+};
+static const double rate[NF_OQ_QUEUES] = {
+	10000, 5000, 1000, 0, 0, 0, 0, 100
+};
+
+/* Window sizes, in words, the planner came up with */
+static const uint32_t expect[NF_OQ_QUEUES] = {
+	364923, 125307, 31099, 379, 379, 379, 379, 1443
+};
+
+int
+main(void)
+{
+	struct nf_oq_profile pr;
+	struct nf_oq_plan plan;
+	struct netfpga nf;
+	uint32_t lo[NF_OQ_QUEUES], hi[NF_OQ_QUEUES], th[NF_OQ_QUEUES];
+	double equal;
+	int q, i;
+
+	memset(&pr, 0, sizeof(pr));
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		nf_hist_init(&pr.nop_occ[q]);
+		for (i = 0; i < 1000; i++)
+			nf_hist_add(&pr.nop_occ[q],
+			    (uint64_t)demand[q] * i / 1000);
+		pr.nop_rate[q] = rate[q];
+	}
+
+	CHECK(nf_oq_plan(&pr, 0, WORDS, QUANTUM, MIN_WORDS, &plan) == 0);
+	equal = 0;
+	for (q = 0; q < NF_OQ_QUEUES; q++) {
+		CHECK(plan.nqp_lo[q] == (q == 0 ? 0 : plan.nqp_hi[q - 1] + 1));
+		CHECK(plan.nqp_hi[q] - plan.nqp_lo[q] + 1 >= MIN_WORDS);
+		CHECK(plan.nqp_thresh[q] == NF_OQ_FULL_THRESH);
+		equal += nf_oq_expected_drops(&pr, q,
+		    (uint64_t)(WORDS / NF_OQ_QUEUES - 1) * NF_OQ_WORD_BYTES);
+	}
+	CHECK(plan.nqp_hi[NF_OQ_QUEUES - 1] == WORDS - 1);
+	CHECK(plan.nqp_drops_total < equal);
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		CHECK(plan.nqp_hi[q] - plan.nqp_lo[q] + 1 == expect[q]);
+
+	nf_init(&nf);
+	nf.nf_module = "sim";
+	nf.nf_iface = "oq=1";
+	if (nf_start(&nf) != 0 || nf_oq_plan_apply(&nf, &plan) != 0 ||
+	    nf_oq_layout(&nf, lo, hi, th) != 0)
+		errx(EXIT_FAILURE, "%s", nf_strerror(&nf));
+	for (q = 0; q < NF_OQ_QUEUES; q++)
+		CHECK(lo[q] == plan.nqp_lo[q] && hi[q] == plan.nqp_hi[q] &&
+		    th[q] == plan.nqp_thresh[q]);
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Run the "linux" module against a fake sysfs tree: a directory with
+# vendor and device attributes and a plain file standing in for BAR0.
+#
+set -e
+
+NFUTIL=${NFUTIL:-../src/nfutil/nfutil}
+T=`mktemp -d`
+trap 'rm -rf $T' EXIT
+
+D=$T/sys/0000:05:00.0
+mkdir -p $D $T/dev
+echo 0xfeed > $D/vendor
+echo 0x0001 > $D/device
+dd if=/dev/zero of=$D/resource0 bs=1024 count=8192 2>/dev/null
+
+export NETFPGA_SYSFS=$T/sys NETFPGA_DEVDIR=$T/dev
+$NFUTIL -m linux reg write 0x400000 0x1234
+v=`$NFUTIL -m linux reg read 0x400000`
+[ "$v" = "Register 0x400000 = 0x1234" ] || { echo "read back: $v"; exit 1; }
+v=`od -An -tx4 -j 4194304 -N 4 $D/resource0 | tr -d ' '`
+[ "$v" = "00001234" ] || { echo "resource0 has: $v"; exit 1; }
+
+# Not a NetFPGA
+mkdir $T/sys/0000:06:00.0
+echo 0x8086 > $T/sys/0000:06:00.0/vendor
+echo 0x0001 > $T/sys/0000:06:00.0/device
+if $NFUTIL -m linux -i 0000:06:00.0 reg read 0x400000 2>/dev/null; then
+	echo "opened a card which isn't a NetFPGA"
+	exit 1
+fi
+exit 0